@@ -0,0 +1,648 @@
+/*
+- Representacin de un rbol-B+ (todas las keys en las hojas, enlazadas entre s)
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __BPLUSTREE_H
+#define __BPLUSTREE_H
+
+#include <cstddef>
+#include <iterator>
+#include "BTree.h"
+
+/** Mnimo de claves por nodo en un rbol-B+: con 2, al partir un nodo interno una de las mitades se queda sin keys */
+const int BPLUS_MIN_SIZE = 3;
+
+/**
+  Nodo de un rbol-B+. Es un Node con un puntero a la siguiente hoja en la cabecera (NULL en los nodos internos
+  y en la ltima hoja). Las keys y los hijos van tras la cabecera en el mismo bloque, igual que en Node.
+
+  En los nodos internos las keys solo separan a los hijos: el hijo i tiene las keys k con _elems[i - 1] <= k < _elems[i].
+  Por eso los nodos internos se parten, se unen y se prestan keys igual que en un rbol-B (con las funciones de Node),
+  pero las hojas no: al partir una hoja su primera key se copia en el padre, y al unir dos hojas la key que las
+  separaba desaparece.
+  */
+template <class T>
+class BPlusNode : public Node<T> {
+
+public:
+
+    /** Crea un nodo vaco en un bloque alineado
+
+    @param max_elems nmero mximo de keys que puede almacenar el nodo
+    @param is_leaf indica si el nodo es o no hoja
+
+    @return puntero al nodo creado
+    */
+    static BPlusNode* create(int max_elems, bool is_leaf = true) {
+        void* mem = ::operator new(bytes(max_elems, is_leaf), align_val_t(NODE_ALIGN));
+        return construct(mem, max_elems, is_leaf);
+    }
+
+    /** Libera un nodo creado con create (no libera sus hijos)
+
+    @param n nodo a liberar
+    */
+    static void destroy(BPlusNode* n) {
+        destruct(n);
+        ::operator delete(n, align_val_t(NODE_ALIGN));
+    }
+
+    /** Tamao en bytes del bloque que ocupa un nodo (cabecera con el puntero a la siguiente hoja incluida) */
+    static size_t bytes(int max_elems, bool is_leaf) {
+        return Node<T>::bytes(max_elems, is_leaf, sizeof(BPlusNode));
+    }
+
+    /** Construye un nodo dentro de un bloque de memoria ya reservado de al menos bytes(max_elems, is_leaf) bytes */
+    static BPlusNode* construct(void* mem, int max_elems, bool is_leaf) {
+        return new (mem) BPlusNode(max_elems, is_leaf);
+    }
+
+    /** Destruye un nodo construido con construct sin liberar su bloque */
+    static void destruct(BPlusNode* n) {
+        n->~BPlusNode();
+    }
+
+    /** Hijo i del nodo (todos los nodos del rbol son BPlusNode) */
+    BPlusNode* child(int i) const {
+        return static_cast<BPlusNode*>(this->_child[i]);
+    }
+
+    /**
+    Funcin que parte el hijo i (que est lleno). Si es interno se parte como en un rbol-B; si es hoja, la mitad
+    derecha pasa a una hoja nueva que se enlaza tras l y su primera key se copia en este nodo para separarlas.
+
+    @param i posicin que ocupa el hijo que queremos partir
+    @param alloc poltica de reserva con la que se crea el nuevo nodo
+    */
+    template <class A>
+    void splitChild(int i, A& alloc) {
+        BPlusNode* y = child(i);
+        if (!y->_is_leaf) {
+            NodeAlloc<A> node_alloc(alloc);
+            Node<T>::splitChild(i, node_alloc);
+            return;
+        }
+
+        BPlusNode* z = static_cast<BPlusNode*>(alloc.allocate(true));
+        int t = (this->_max_elems + 1) / 2; // y se queda con t keys
+        z->_n_elems = y->_n_elems - t;
+        for (int j = 0; j < z->_n_elems; j++) z->_elems[j] = y->_elems[j + t];
+        y->_n_elems = t;
+        z->_next = y->_next; // z va justo detrs de y en la lista de hojas
+        y->_next = z;
+
+        for (int j = this->_n_elems; j > i; j--) this->_child[j + 1] = this->_child[j]; // Movemos nuestros hijos
+        this->_child[i + 1] = z;
+        for (int j = this->_n_elems - 1; j >= i; j--) this->_elems[j + 1] = this->_elems[j]; // y nuestras keys
+        this->_elems[i] = z->_elems[0]; // La primera key de z separa y de z
+        this->_n_elems += 1;
+    }
+
+    /**
+    Funcin para rellenar el hijo en la posicin i dado que tiene menos de t keys, cogiendo una key de un hermano o
+    unindolo con l (en el mismo orden que Node::fill).
+
+    @param i posicin del hijo que queremos rellenar
+    @param alloc poltica de reserva con la que se libera el nodo si se hace merge
+
+    @return posicin del hijo que tiene ahora las keys del hijo i (i - 1 si se ha unido con el anterior)
+    */
+    template <class A>
+    int fillChild(int i, A& alloc) {
+        if (!child(i)->_is_leaf) {
+            int n = this->_n_elems;
+            NodeAlloc<A> node_alloc(alloc);
+            Node<T>::fill(i, node_alloc);
+            return (i == n && this->_n_elems < n) ? i - 1 : i; // Solo se une con el anterior si es el ltimo hijo
+        }
+
+        int t = (this->_max_elems + 1) / 2;
+        if (i != 0 && child(i - 1)->_n_elems >= t) borrowLeafFromPrev(i);
+        else if (i != this->_n_elems && child(i + 1)->_n_elems >= t) borrowLeafFromNext(i);
+        else if (i != this->_n_elems) mergeLeaves(i, alloc);
+        else {
+            mergeLeaves(i - 1, alloc);
+            return i - 1;
+        }
+        return i;
+    }
+
+    BPlusNode* _next; // siguiente hoja (NULL en los nodos internos y en la ltima hoja)
+
+private:
+
+    /** Adapta la poltica de reserva del rbol (que libera BPlusNode) a las funciones de Node (que liberan Node) */
+    template <class A>
+    struct NodeAlloc {
+        NodeAlloc(A& alloc) : _alloc(alloc) {}
+        BPlusNode* allocate(bool is_leaf) { return _alloc.allocate(is_leaf); }
+        void deallocate(Node<T>* n) { _alloc.deallocate(static_cast<BPlusNode*>(n)); }
+        A& _alloc;
+    };
+
+    BPlusNode(int max_elems, bool is_leaf) : Node<T>(max_elems, is_leaf, sizeof(BPlusNode)), _next(NULL) {}
+
+    /** Pasa la ltima key de la hoja i - 1 al principio de la hoja i */
+    void borrowLeafFromPrev(int i) {
+        BPlusNode* c = child(i);
+        BPlusNode* s = child(i - 1);
+        for (int j = c->_n_elems; j > 0; j--) c->_elems[j] = c->_elems[j - 1];
+        c->_elems[0] = s->_elems[s->_n_elems - 1];
+        c->_n_elems += 1;
+        s->_n_elems -= 1;
+        this->_elems[i - 1] = c->_elems[0]; // La nueva primera key de c es el separador
+    }
+
+    /** Pasa la primera key de la hoja i + 1 al final de la hoja i */
+    void borrowLeafFromNext(int i) {
+        BPlusNode* c = child(i);
+        BPlusNode* s = child(i + 1);
+        c->_elems[c->_n_elems] = s->_elems[0];
+        for (int j = 1; j < s->_n_elems; j++) s->_elems[j - 1] = s->_elems[j];
+        c->_n_elems += 1;
+        s->_n_elems -= 1;
+        this->_elems[i] = s->_elems[0]; // La nueva primera key de s es el separador
+    }
+
+    /** Une las hojas i e i + 1 en la i, el separador desaparece y la hoja i + 1 se libera */
+    template <class A>
+    void mergeLeaves(int i, A& alloc) {
+        BPlusNode* c = child(i);
+        BPlusNode* s = child(i + 1);
+        for (int j = 0; j < s->_n_elems; j++) c->_elems[c->_n_elems + j] = s->_elems[j];
+        c->_n_elems += s->_n_elems;
+        c->_next = s->_next;
+
+        for (int j = i + 1; j < this->_n_elems; j++) this->_elems[j - 1] = this->_elems[j];
+        for (int j = i + 2; j <= this->_n_elems; j++) this->_child[j - 1] = this->_child[j];
+        this->_n_elems--;
+
+        alloc.deallocate(s);
+    }
+};
+
+/**
+
+Clase que representa a un rbol-B+ de keys sin repetir.
+
+Todas las keys estn en las hojas y las hojas estn enlazadas en orden, as que se pueden recorrer con iteradores
+(lower_bound, upper_bound, range) sin recursin ni volver a bajar desde la raz. Las keys de los nodos internos
+solo sirven para guiar la bajada.
+
+Igual que en BTree, la memoria de los nodos la gestiona la poltica de reserva Alloc (ver NodePool.h).
+
+@author lvaro Corrochano Lpez
+
+*/
+template <class T, class Alloc = NodePool<BPlusNode<T> > >
+class BPlusTree {
+
+public:
+
+    /** Iterador (de solo lectura) sobre las keys en orden creciente, avanza por la lista de hojas */
+    class const_iterator {
+
+    public:
+
+        typedef forward_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        const_iterator() : _leaf(NULL), _pos(0) {}
+
+        const T& operator*() const {
+            return _leaf->_elems[_pos];
+        }
+
+        const T* operator->() const {
+            return &_leaf->_elems[_pos];
+        }
+
+        const_iterator& operator++() {
+            _pos++;
+            skip();
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return _leaf == other._leaf && _pos == other._pos;
+        }
+
+        bool operator!=(const const_iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+
+        friend class BPlusTree;
+
+        const_iterator(const BPlusNode<T>* leaf, int pos) : _leaf(leaf), _pos(pos) {
+            skip();
+        }
+
+        /** Si la posicin se sale de la hoja pasa a la siguiente (saltando las vacas); al final queda _leaf == NULL */
+        void skip() {
+            while (_leaf != NULL && _pos >= _leaf->_n_elems) {
+                _leaf = _leaf->_next;
+                _pos = 0;
+            }
+        }
+
+        const BPlusNode<T>* _leaf; // hoja actual
+        int _pos;                  // posicin dentro de la hoja
+    };
+
+    /**
+      Keys del intervalo [lo, hi) para recorrerlas con un for de rango. Solo se baja una vez desde la raz
+      (hasta lo): el final no se busca, el recorrido se para en la primera key que no es menor que hi.
+      */
+    class Range {
+
+    public:
+
+        /** Iterador del intervalo: un const_iterator que se considera terminado al llegar a hi */
+        class iterator {
+
+        public:
+
+            typedef forward_iterator_tag iterator_category;
+            typedef T value_type;
+            typedef ptrdiff_t difference_type;
+            typedef const T* pointer;
+            typedef const T& reference;
+
+            iterator(const_iterator it, const_iterator end, const T& hi) : _it(it), _end(end), _hi(hi) {}
+
+            const T& operator*() const {
+                return *_it;
+            }
+
+            iterator& operator++() {
+                ++_it;
+                return *this;
+            }
+
+            bool operator==(const iterator& other) const {
+                bool done = isDone(), other_done = other.isDone();
+                return done == other_done && (done || _it == other._it);
+            }
+
+            bool operator!=(const iterator& other) const {
+                return !(*this == other);
+            }
+
+        private:
+
+            bool isDone() const {
+                return _it == _end || !(*_it < _hi);
+            }
+
+            const_iterator _it;  // posicin actual
+            const_iterator _end; // final del rbol
+            T _hi;               // cota superior (no incluida)
+        };
+
+        Range(const_iterator first, const T& hi) : _first(first), _hi(hi) {}
+
+        iterator begin() const {
+            return iterator(_first, const_iterator(), _hi);
+        }
+
+        iterator end() const {
+            return iterator(const_iterator(), const_iterator(), _hi);
+        }
+
+    private:
+
+        const_iterator _first; // primera key >= lo
+        T _hi;                 // cota superior (no incluida)
+    };
+
+    /** Constructor vaco, tamao de las keys con tamao por defecto (= 3)
+        Complejidad: O(1)
+    */
+    BPlusTree() : _root(NULL), _size(DEFAULT_SIZE), _count(0), _alloc(DEFAULT_SIZE) {
+        _root = _alloc.allocate(true);
+    }
+
+    /**
+    Constructor vaco especificando el tamao
+
+    Error: Si el tamao especificado es menor que 3, lanza una excepcin E_BTree_Lower
+    Error: Si el tamao especificado es mayor que 1000, lanza una excepcin E_BTree_Bigger
+
+    @param size nmero mximo de keys que puede almacenar el nodo
+    */
+    BPlusTree(int size) : _root(NULL), _size(size), _count(0), _alloc(size) {
+        if (size < BPLUS_MIN_SIZE) throw E_BTree_Lower();
+        if (size > MAX_SIZE) throw E_BTree_Bigger();
+
+        _root = _alloc.allocate(true);
+    }
+
+    /** El rbol es dueo de sus nodos, as que no se puede copiar (solo mover) */
+    BPlusTree(const BPlusTree&) = delete;
+    BPlusTree& operator=(const BPlusTree&) = delete;
+
+    /** Constructor de movimiento, el rbol movido se queda sin nodos y solo se puede destruir */
+    BPlusTree(BPlusTree&& other) : _root(other._root), _size(other._size), _count(other._count), _alloc(std::move(other._alloc)) {
+        other._root = NULL;
+    }
+
+    /** Asignacin de movimiento, los nodos que tuviera este rbol se liberan */
+    BPlusTree& operator=(BPlusTree&& other) {
+        if (this != &other) {
+            releaseNodes();
+            _root = other._root;
+            _size = other._size;
+            _count = other._count;
+            _alloc = std::move(other._alloc);
+            other._root = NULL;
+        }
+        return *this;
+    }
+
+    /** Destructor, libera todos los nodos del rbol */
+    ~BPlusTree() {
+        releaseNodes();
+    }
+
+    /** Elimina todas las keys del rbol y libera sus nodos */
+    void clear() {
+        releaseNodes();
+        _root = _alloc.allocate(true);
+        _count = 0;
+    }
+
+    /** Devuelve el nmero mximo de keys que puede almacenar un nodo del rbol
+
+    @return nmero mximo de keys que puede almacenar un nodo del rbol
+    */
+    int n_keys() const {
+        return _size;
+    }
+
+    /** Devuelve el nmero de keys guardadas en el rbol
+
+    @return nmero de keys del rbol
+    */
+    size_t size() const {
+        return _count;
+    }
+
+    /** Indica si el rbol est o no vaco
+
+    @return true si el rbol est vaco y false si no lo est
+    */
+    bool isEmpty() const {
+        return _count == 0;
+    }
+
+    /** Iterador a la key ms pequea */
+    const_iterator begin() const {
+        const BPlusNode<T>* x = _root;
+        while (!x->_is_leaf) x = x->child(0);
+        return const_iterator(x, 0);
+    }
+
+    /** Iterador al final (despus de la key ms grande) */
+    const_iterator end() const {
+        return const_iterator();
+    }
+
+    /**
+    Devuelve un iterador a la primera key mayor o igual que k.
+    Complejidad: O(log n)
+
+    @param k key buscada
+
+    @return iterador a la primera key >= k (end() si no hay ninguna)
+    */
+    const_iterator lower_bound(const T& k) const {
+        const BPlusNode<T>* x = findLeaf(k);
+        return const_iterator(x, keyLowerBound(x->_elems, x->_n_elems, k));
+    }
+
+    /**
+    Devuelve un iterador a la primera key estrictamente mayor que k.
+    Complejidad: O(log n)
+
+    @param k key buscada
+
+    @return iterador a la primera key > k (end() si no hay ninguna)
+    */
+    const_iterator upper_bound(const T& k) const {
+        const BPlusNode<T>* x = findLeaf(k);
+        return const_iterator(x, keyUpperBound(x->_elems, x->_n_elems, k));
+    }
+
+    /**
+    Busca una key en el rbol.
+
+    @param k key buscada
+
+    @return iterador a la key o end() si no est
+    */
+    const_iterator find(const T& k) const {
+        const BPlusNode<T>* x = findLeaf(k);
+        int i = keyLowerBound(x->_elems, x->_n_elems, k);
+        if (i < x->_n_elems && x->_elems[i] == k) return const_iterator(x, i);
+        return end();
+    }
+
+    /**
+    Devuelve las keys del intervalo [lo, hi) en orden, para recorrerlas con for (const T& k : tree.range(lo, hi)).
+    Complejidad: O(log n + nmero de keys recorridas)
+
+    @param lo cota inferior (incluida)
+    @param hi cota superior (no incluida)
+
+    @return el intervalo
+    */
+    Range range(const T& lo, const T& hi) const {
+        return Range(lower_bound(lo), hi);
+    }
+
+    /**
+    Funcin para insertar una key en el rbol. Como en BTree, los hijos llenos se parten antes de bajar a ellos.
+
+    @param k key a insertar
+
+    @return true si se ha insertado y false si ya estaba
+    */
+    bool insert(T k) {
+        if (_root->_n_elems == _size) { // Si la raz est llena la partimos y el rbol crece
+            BPlusNode<T>* s = _alloc.allocate(false);
+            s->_child[0] = _root;
+            s->splitChild(0, _alloc);
+            _root = s;
+        }
+
+        BPlusNode<T>* x = _root;
+        while (!x->_is_leaf) {
+            int i = keyUpperBound(x->_elems, x->_n_elems, k); // Hijo que tendr a k
+            if (x->child(i)->_n_elems == _size) { // Si est lleno le hacemos split
+                x->splitChild(i, _alloc);
+                if (!(k < x->_elems[i])) i++; // y comprobamos en cul de las dos partes ir k
+            }
+            x = x->child(i);
+        }
+
+        int i = keyUpperBound(x->_elems, x->_n_elems, k);
+        if (i > 0 && x->_elems[i - 1] == k) return false; // Ya estaba (los splits de la bajada no cambian las keys)
+        for (int j = x->_n_elems; j > i; j--) x->_elems[j] = x->_elems[j - 1]; // desplazamos las keys mayores que k
+        x->_elems[i] = k;
+        x->_n_elems += 1;
+        _count++;
+        return true;
+    }
+
+    /**
+    Funcin para eliminar una key del rbol. Como en Node::remove, cada hijo con menos de t keys se rellena antes
+    de bajar a l, as que al quitar la key de la hoja ningn nodo se queda por debajo del mnimo.
+
+    @param k key a eliminar
+
+    @return true si la key estaba en el rbol (y se ha eliminado)
+    */
+    bool remove(T k) {
+        int t = (_size + 1) / 2; // Mitad del mximo de hijos
+        BPlusNode<T>* x = _root;
+        while (!x->_is_leaf) {
+            int i = keyUpperBound(x->_elems, x->_n_elems, k); // Hijo que tiene a k
+            if (x->child(i)->_n_elems < t) i = x->fillChild(i, _alloc);
+
+            if (x == _root && x->_n_elems == 0) { // La raz se ha quedado sin keys al hacer merge, su nico hijo pasa a ser la raz
+                _root = x->child(0);
+                _alloc.deallocate(x);
+                x = _root;
+            }
+            else x = x->child(i);
+        }
+
+        int i = keyLowerBound(x->_elems, x->_n_elems, k);
+        if (i == x->_n_elems || !(x->_elems[i] == k)) return false; // No estaba (los fill de la bajada no cambian las keys)
+        x->removeFromLeaf(i);
+        _count--;
+        return true;
+    }
+
+    /**
+    Funcin que aplica f a cada key del rbol, en orden creciente. Recorre la lista de hojas, sin recursin.
+
+    @param f funcin que recibe cada key (const T&)
+    */
+    template <class F>
+    void for_each(F f) const {
+        const BPlusNode<T>* x = _root;
+        while (!x->_is_leaf) x = x->child(0);
+        for (; x != NULL; x = x->_next) {
+            for (int i = 0; i < x->_n_elems; i++) f(x->_elems[i]);
+        }
+    }
+
+    /**
+    Funcin para recorrer el rbol, va sacando las keys guardadas en orden (siempre creciente).
+
+    @param out flujo en el que se sacan (por defecto la salida estndar)
+    */
+    void traverse(ostream& out = cout) const {
+        for_each([&out](const T& k) { out << " " << k; });
+    }
+
+    /**
+    Comprueba las propiedades del rbol-B+: keys ordenadas (tambin respecto a los separadores de los padres), todas
+    las hojas a la misma profundidad, cada nodo salvo la raz con al menos t - 1 keys, la lista de hojas enlazando
+    todas las hojas de izquierda a derecha y el nmero de keys igual a size().
+
+    @return true si el rbol es un rbol-B+ vlido
+    */
+    bool check() const {
+        int leaf_depth = -1;
+        const BPlusNode<T>* prev = NULL;
+        size_t count = 0;
+        if (!check(_root, true, 0, leaf_depth, NULL, NULL, prev, count)) return false;
+        return prev->_next == NULL && count == _count;
+    }
+
+private:
+
+    /**
+    @param is_root indica si x es la raz del rbol
+    @param depth profundidad de x
+    @param leaf_depth profundidad de las hojas (-1 hasta encontrar la primera)
+    @param lo si no es NULL, todas las keys del subrbol deben ser mayores o iguales que *lo
+    @param hi si no es NULL, todas las keys del subrbol deben ser menores que *hi
+    @param prev ltima hoja visitada (NULL hasta encontrar la primera), su siguiente en la lista tiene que ser la prxima
+    @param count keys de las hojas visitadas
+
+    @return true si el subrbol es vlido
+    */
+    bool check(const BPlusNode<T>* x, bool is_root, int depth, int& leaf_depth, const T* lo, const T* hi,
+        const BPlusNode<T>*& prev, size_t& count) const {
+        int t = (_size + 1) / 2;
+        if (x->_n_elems > _size || (!is_root && x->_n_elems < t - 1)) return false;
+        if (!x->_is_leaf && x->_n_elems == 0) return false;
+
+        for (int i = 0; i < x->_n_elems; i++) {
+            if (i > 0 && !(x->_elems[i - 1] < x->_elems[i])) return false;
+            if ((lo != NULL && x->_elems[i] < *lo) || (hi != NULL && !(x->_elems[i] < *hi))) return false;
+        }
+
+        if (x->_is_leaf) {
+            if (leaf_depth == -1) leaf_depth = depth;
+            if (prev != NULL && prev->_next != x) return false;
+            prev = x;
+            count += x->_n_elems;
+            return leaf_depth == depth;
+        }
+        for (int i = 0; i <= x->_n_elems; i++) {
+            const T* clo = i == 0 ? lo : &x->_elems[i - 1];
+            const T* chi = i == x->_n_elems ? hi : &x->_elems[i];
+            if (!check(x->child(i), false, depth + 1, leaf_depth, clo, chi, prev, count)) return false;
+        }
+        return true;
+    }
+
+    /** Hoja en la que est (o estara) k */
+    const BPlusNode<T>* findLeaf(const T& k) const {
+        const BPlusNode<T>* x = _root;
+        while (!x->_is_leaf) x = x->child(keyUpperBound(x->_elems, x->_n_elems, k));
+        return x;
+    }
+
+    /**
+    Funcin que libera todos los nodos del rbol (el rbol se queda sin raz).
+    Si la poltica de reserva puede liberarlo todo de golpe y las keys no tienen destructor, no se recorre el rbol.
+    */
+    void releaseNodes() {
+        if (_root == NULL) return;
+        if (!(Alloc::releases_all && is_trivially_destructible<T>::value)) freeSubtree(_root);
+        _alloc.release();
+        _root = NULL;
+    }
+
+    /** Libera uno a uno los nodos del subrbol con raz x */
+    void freeSubtree(BPlusNode<T>* x) {
+        if (!x->_is_leaf) {
+            for (int i = 0; i <= x->_n_elems; i++) freeSubtree(x->child(i));
+        }
+        _alloc.deallocate(x);
+    }
+
+    BPlusNode<T>* _root; // Puntero que apunta al nodo raz
+    int _size;           // Nmero mximo de keys por nodo
+    size_t _count;       // Nmero de keys del rbol
+    Alloc _alloc;        // Poltica de reserva de los nodos
+};
+
+#endif
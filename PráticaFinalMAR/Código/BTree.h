@@ -7,11 +7,24 @@
 #define __BTREE_H
 
 #include <cstddef>
+#include <cstdint>
+#include <new>
+#include <memory>
+#include <type_traits>
+#include <utility>
 #include <iostream>
 #include <fstream>
 #include <stdlib.h>
 #include <time.h>
 #include <string>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include "NodeSearch.h"
+#include "NodePool.h"
+#include "ParallelSort.h"
+#include "TreeStats.h"
+#include "WorkPool.h"
 using namespace std;
 
 /** Mnimo de claves que puede almacenar un nodo en un rbol-B */
@@ -23,6 +36,24 @@ const int MAX_SIZE = 1000;
 /** Tamao por defecto de un rbol si este no se especifica */
 const int DEFAULT_SIZE = 3;
 
+/** Nmero de keys de un nodo cuyos bits de lpida caben en la cabecera */
+const int DEAD_INLINE = 32;
+
+/** Fraccin de keys borradas (lpidas) de un nodo a partir de la cual el rbol pide una compactacin */
+const double DEFAULT_DEAD_RATIO = 0.5;
+
+/** Nodos de un nivel que rellena cada tarea al construir el rbol en paralelo */
+const size_t BUILD_CHUNK = 1024;
+
+/** Bsquedas que search_many lleva a la vez: mientras llega de memoria el nodo de una, se avanza en las dems */
+const int SEARCH_GROUP = 16;
+
+/** Lneas de cach de un nodo (cabecera y primeras keys) que se piden por adelantado en search_many */
+const size_t PREFETCH_LINES = 4;
+
+/** Profundidad mxima de un rbol cuyos nodos (salvo la raz) tienen al menos 2 hijos: con 64 niveles caben 2^64 keys */
+const int MAX_DEPTH = 64;
+
 /** Excepcin, B-rbol vaco  */
 class E_BTree_Empty{};
 
@@ -32,67 +63,452 @@ class E_BTree_Lower{};
 /** Excepcin, B-rbol con ms de 1000 claves por nodo */
 class E_BTree_Bigger{};
 
+/** Excepcin, keys desordenadas donde se esperaban ordenadas */
+class E_BTree_Unsorted{};
+
+/** Excepcin, no se ha podido abrir o leer un fichero */
+class E_BTree_File{};
+
+/** Excepcin, el fichero no tiene el formato esperado (est daado o guarda otro tipo de key) */
+class E_BTree_Format{};
+
+/** Excepcin, posicin mayor o igual que el nmero de keys del rbol */
+class E_BTree_Range{};
+
+/**
+  Pila para recorrer un camino del rbol sin recursin. Los primeros MAX_DEPTH elementos se guardan en un array
+  dentro de la propia pila, sin reservar memoria; solo un rbol degenerado (de tamao 2, con nodos internos de un
+  solo hijo) puede ser ms profundo, y entonces el resto va a un vector.
+  */
+template <class E>
+class PathStack {
+
+public:
+
+    PathStack() : _n(0), _more() {}
+
+    bool empty() const {
+        return _n == 0;
+    }
+
+    E& top() {
+        return _n <= MAX_DEPTH ? _fixed[_n - 1] : _more[_n - 1 - MAX_DEPTH];
+    }
+
+    void push(const E& e) {
+        if (_n < MAX_DEPTH) _fixed[_n] = e;
+        else _more.push_back(e);
+        _n++;
+    }
+
+    void pop() {
+        _n--;
+        if (_n >= MAX_DEPTH) _more.pop_back();
+    }
+
+private:
+
+    E _fixed[MAX_DEPTH]; // primeros elementos
+    int _n;              // nmero de elementos
+    vector<E> _more;     // elementos por encima de MAX_DEPTH
+};
+
+/** Paso de un recorrido sin recursin: un nodo y el siguiente hijo suyo que hay que visitar */
+template <class N>
+struct NodeStep {
+
+    NodeStep() : _node(NULL), _next(0) {}
+
+    NodeStep(N* node, int next) : _node(node), _next(next) {}
+
+    N* _node;  // nodo
+    int _next; // siguiente hijo a visitar
+};
+
+/**
+Recorre en orden creciente, sin recursin, las keys del subrbol con raz x: en las hojas todas sus keys y en los
+nodos internos la key i justo despus de todo el hijo i. Sirve para Node y para los nodos que heredan de l
+(los hijos se convierten a N), y es el recorrido de for_each y traverse de los rboles en memoria.
+
+@param x raz del subrbol
+@param visit funcin que recibe el nodo y la posicin de cada key (N*, int)
+*/
+template <class N, class F>
+void inOrder(N* x, F&& visit) {
+    PathStack<NodeStep<N> > path;
+    path.push(NodeStep<N>(x, 0));
+
+    while (!path.empty()) {
+        NodeStep<N>& s = path.top();
+        if (s._node->_is_leaf) { // Si es hoja, paso todas sus keys
+            for (int i = 0; i < s._node->_n_elems; i++) visit(s._node, i);
+            path.pop();
+        }
+        else if (s._next <= s._node->_n_elems) { // Si no es hoja, bajo al siguiente hijo
+            path.push(NodeStep<N>(static_cast<N*>(s._node->_child[s._next]), 0));
+            continue;
+        }
+        else path.pop(); // Ya he recorrido todos sus hijos
+
+        if (!path.empty()) { // He terminado con un hijo: paso la key que lo sigue en el padre
+            NodeStep<N>& p = path.top();
+            if (p._next < p._node->_n_elems) visit(p._node, p._next);
+            p._next++;
+        }
+    }
+}
+
+/** Nmero de keys (sin contar las borradas) del subrbol de un nodo, para los nodos que lo llevan (ver CountedBTree) */
+struct SubtreeCount {
+
+    SubtreeCount() : _count(0) {}
+
+    size_t _count; // keys del subrbol con el nodo como raz
+};
+
+/** Base vaca de los nodos que no llevan la cuenta de su subrbol: no ocupa nada en la cabecera */
+struct NoSubtreeCount {};
+
 /**
   Clase para representar a un nodo del rbol, guarda la siguiente informacin:
   - Nmero mximo de keys que puede almacenar el nodo.
   - Nmero de keys (valores) actualmente almacenados en el nodo en orden creciente.
   - Booleano que indica si el nodo es una hoja.
   - Punteros a sus hijos.
+  - Si V no es void, un valor de tipo V por cada key (BTreeMap).
+  - Si ORDER no es 0, el nmero mximo de keys queda fijado al compilar (ver FixedBTree).
+  - Si COUNTED es true, el nmero de keys de su subrbol (en la base SubtreeCount, ver CountedBTree).
+  - Cuntas de sus keys estn borradas (lpidas, ver BTree::remove_lazy) y un bit por key que lo indica.
+
+  Cada nodo ocupa un nico bloque de memoria alineado a NODE_ALIGN: primero la cabecera (estos atributos),
+  justo despus las keys, luego los valores (si los hay, en su propio array para que las keys sigan juntas),
+  el array de hijos y, al final, los bits de las lpidas a partir de la key DEAD_INLINE (los de las primeras
+  van en la cabecera, en el hueco que deja el alineamiento, as que los nodos pequeos no crecen). Los nodos hoja
+  no reservan el array de hijos. Los bits de las posiciones a partir de _n_elems siempre estn a 0.
+  Por eso los nodos no se crean con new/delete sino con create/destroy, o con construct/destruct sobre
+  un bloque ya reservado (as lo hacen las polticas de reserva de NodePool.h).
+  Con ORDER fijo, t y las posiciones de los valores, los hijos y las lpidas dentro del bloque son constantes,
+  as que el compilador las calcula de antemano y los bucles de split, merge y prstamo tienen lmites conocidos.
   */
-template <class T>
-class Node {
+template <class T, class V = void, int ORDER = 0, bool COUNTED = false>
+class Node : public conditional<COUNTED, SubtreeCount, NoSubtreeCount>::type {
 
 public:
 
-    /** Constructor que construye un nodo con el tamao mximo determinado de keys como mximo
+    /** Indica si el nodo lleva la cuenta de las keys de su subrbol */
+    static const bool counted = COUNTED;
+
+    /** Nmero mximo de keys fijado al compilar (0 si se elige al crear el rbol) */
+    static const int order = ORDER;
+
+    /** Nmero mximo de keys del nodo: ORDER si est fijado (y entonces es una constante), si no _max_elems */
+    int maxElems() const {
+        return ORDER > 0 ? ORDER : _max_elems;
+    }
+
+    /** Nmero mximo de keys de un nodo nuevo: ORDER si est fijado, si no el pedido */
+    static int fixedOr(int max_elems) {
+        return ORDER > 0 ? ORDER : max_elems;
+    }
+
+    /** Indica si el nodo guarda un valor por cada key */
+    static const bool has_values = !is_void<V>::value;
+
+    /** Tipo de los valores (char si no hay valores, para que el cdigo que los mueve compile aunque no se use) */
+    typedef typename conditional<has_values, V, char>::type value_type;
+
+    /** Crea un nodo con el tamao mximo determinado de keys como mximo.
+    Cabecera, keys e hijos se reservan en un solo bloque alineado.
 
     @param max_elems nmero mximo de keys que puede almacenar el nodo
+    @param is_leaf indica si el nodo es o no hoja (por defecto lo es)
+
+    @return puntero al nodo creado
     */
-    Node(int max_elems) : _elems(), _child(), _n_elems(0), _max_elems(max_elems), _is_leaf(true) {
-        _elems = new T[max_elems];
-        _child = new Node *[max_elems + 1];
+    static Node* create(int max_elems, bool is_leaf = true) {
+        void* mem = ::operator new(bytes(max_elems, is_leaf), align_val_t(NODE_ALIGN));
+        return construct(mem, max_elems, is_leaf);
     }
 
-    /** Constructor que construye un nodo con el tamao mximo determinado de keys como mximo
+    /** Libera un nodo creado con create (no libera sus hijos)
+
+    @param n nodo a liberar
+    */
+    static void destroy(Node* n) {
+        destruct(n);
+        ::operator delete(n, align_val_t(NODE_ALIGN));
+    }
+
+    /** Tamao en bytes del bloque que ocupa un nodo, redondeado a mltiplo de NODE_ALIGN
 
+    @param max_elems nmero mximo de keys que puede almacenar el nodo
+    @param is_leaf indica si el nodo es hoja (las hojas no tienen array de hijos)
+    @param header tamao de la cabecera (mayor que sizeof(Node) en los nodos que heredan de Node y aaden atributos)
+
+    @return tamao del bloque en bytes
+    */
+    static size_t bytes(int max_elems, bool is_leaf, size_t header = sizeof(Node)) {
+        max_elems = fixedOr(max_elems);
+        size_t size = childOffset(max_elems, header);
+        if (!is_leaf) size += (max_elems + 1) * sizeof(Node*);
+        size = (size + alignof(uint64_t) - 1) / alignof(uint64_t) * alignof(uint64_t) + deadWords(max_elems) * sizeof(uint64_t);
+        return (size + NODE_ALIGN - 1) / NODE_ALIGN * NODE_ALIGN;
+    }
+
+    /** Construye un nodo dentro de un bloque de memoria ya reservado de al menos bytes(max_elems, is_leaf) bytes
+
+    @param mem bloque de memoria alineado a NODE_ALIGN
     @param max_elems nmero mximo de keys que puede almacenar el nodo
     @param is_leaf indica si el nodo es o no hoja
+
+    @return puntero al nodo construido
     */
-    Node(int max_elems, bool is_leaf) : _elems(), _child(), _n_elems(0), _max_elems(max_elems), _is_leaf(is_leaf) {
-        _elems = new T[max_elems];
-        _child = new Node *[max_elems + 1];
+    static Node* construct(void* mem, int max_elems, bool is_leaf) {
+        return new (mem) Node(fixedOr(max_elems), is_leaf);
+    }
+
+    /** Destruye un nodo construido con construct sin liberar su bloque
+
+    @param n nodo a destruir
+    */
+    static void destruct(Node* n) {
+        n->~Node();
     }
 
     /**
-    Funcin que elimina la key k del subrbol con este nodo como raz
+    Funcin usada cuando se quiere aadir k a un hijo que est lleno, este se parte en dos y tanto la particin como el hijo quedan colgando 
+    de este nodo (el padre), manteniendo el orden dentro de los rboles.
 
-    @param k key a eliminar
+    @param i posicin que ocupa el hijo que queremos partir
+    @param alloc poltica de reserva con la que se crea el nuevo nodo
+    */
+    template <class A>
+    void splitChild(int i, A& alloc) {
+        nodeEvent(alloc, STAT_SPLIT);
+        Node* y = _child[i]; // y es el hijo i
+        int y_elems = y->_n_elems;
+        Node* z = alloc.allocate(y->_is_leaf); // Creacin de un nuevo nodo donde van a guardar la mitad de las keys de y
+        int t = (maxElems() + 1) / 2; // Mitad del total de hijos que tiene y (se supone que est lleno)
+        z->_n_elems = y->_n_elems - t; // z tiene la mitad de keys de y (una ms que y si el mximo es par)
+
+        for (int j = 0; j < z->_n_elems; j++) { // Metemos la mitad de los elementos de y en z (los ms grandes)
+            moveElem(z, j, y, j + t);
+        }
+
+        if (!y->_is_leaf) { // Si y no es hoja
+            for (int j = 0; j <= z->_n_elems; j++) { // Pasamos la mitad de sus hijos a z
+                z->_child[j] = y->_child[j + t];
+            }
+        }
+        y->_n_elems = t - 1; // y pasa a tener la mitad de elemntos
+
+        for (int j = _n_elems; j > i; j--) { // Movemos nuestros hijos
+            _child[j + 1] = _child[j];
+        }
+        _child[i + 1] = z; // z es nuestro hijo
+
+        for (int j = _n_elems - 1; j >= i; j--) { // movemos nuestras keys
+            moveElem(this, j + 1, this, j);
+        }
+
+        moveElem(this, i, y, t - 1); // Aadimos la key de en medio de y para que separe y de z
+
+        bool dead = y->_n_dead + _n_dead > 0;
+        if (dead) { // Las lpidas se mueven con sus keys
+            for (int j = 0; j < z->_n_elems; j++) z->setDead(j, y->isDead(j + t));
+            shiftDeadRight(i);
+            setDead(i, y->isDead(t - 1));
+            for (int j = t - 1; j < y_elems; j++) y->setDead(j, false);
+            z->_n_dead = z->countDead();
+            y->_n_dead = y->countDead();
+        }
+        _n_elems += 1; // Aumentamos nuestro nmero de elementos
+        if (dead) _n_dead = countDead();
+        y->recount(); // Las keys de este nodo no cambian, las de y se reparten entre y, z y este nodo
+        z->recount();
+    }
+
+    /** Indica si la key en la posicin i est borrada (es una lpida)
+
+    @param i posicin de la key
+    */
+    bool isDead(int i) const {
+        if (i < DEAD_INLINE) return (_dead_bits >> i) & 1;
+        i -= DEAD_INLINE;
+        return (deadBits()[i >> 6] >> (i & 63)) & 1;
+    }
+
+    /** Marca o desmarca como borrada la key en la posicin i (no cambia _n_dead)
+
+    @param i posicin de la key
+    @param dead true para marcarla como borrada
+    */
+    void setDead(int i, bool dead) {
+        if (i < DEAD_INLINE) {
+            if (dead) _dead_bits |= (uint32_t)1 << i;
+            else _dead_bits &= ~((uint32_t)1 << i);
+            return;
+        }
+        i -= DEAD_INLINE;
+        uint64_t bit = (uint64_t)1 << (i & 63);
+        if (dead) deadBits()[i >> 6] |= bit;
+        else deadBits()[i >> 6] &= ~bit;
+    }
+
+    /** Desplaza una posicin a la derecha los bits de lpida de las keys desde i (antes de insertar una key en i) */
+    void shiftDeadRight(int i) {
+        for (int j = _n_elems; j > i; j--) setDead(j, isDead(j - 1));
+        setDead(i, false);
+    }
+
+    /** Desplaza una posicin a la izquierda los bits de lpida de las keys desde i + 1 (antes de quitar la key en i) */
+    void shiftDeadLeft(int i) {
+        for (int j = i; j < _n_elems - 1; j++) setDead(j, isDead(j + 1));
+        setDead(_n_elems - 1, false);
+    }
+
+    /** Cuenta las keys borradas del nodo
+
+    @return nmero de lpidas
+    */
+    int countDead() const {
+        int n = 0;
+        for (int j = 0; j < _n_elems; j++) n += isDead(j);
+        return n;
+    }
+
+    /** Desmarca todas las keys borradas del nodo */
+    void clearDead() {
+        fill_n(deadBits(), deadWords(maxElems()), (uint64_t)0);
+        _dead_bits = 0;
+        _n_dead = 0;
+    }
+
+    /** Pide a la cach, sin esperar a que lleguen, la cabecera y las primeras keys del nodo (como mucho
+    PREFETCH_LINES lneas). Solo usa la direccin del nodo, as que se puede llamar antes de leer nada de l.
+
+    @param max_elems nmero mximo de keys del nodo
     */
-    void remove(T k) {
-        int i = 0; 
-        while (i < _n_elems && _elems[i] < k) i++; // Busco la posicin de la primera key mayor o igual que k
+    void prefetch(int max_elems) const {
+        size_t end = elemsOffset(sizeof(Node)) + fixedOr(max_elems) * sizeof(T);
+        if (end > PREFETCH_LINES * NODE_ALIGN) end = PREFETCH_LINES * NODE_ALIGN;
+        const char* p = reinterpret_cast<const char*>(this);
+        for (size_t off = 0; off < end; off += NODE_ALIGN) BTREE_PREFETCH(p + off);
+    }
 
-        int t = (_max_elems + 1) / 2; // Mitad del mximo de hijos
+    /** Nmero de keys (sin las borradas) del subrbol con este nodo como raz (solo si counted) */
+    size_t subtreeCount() const {
+        if constexpr (COUNTED) return this->_count;
+        else return 0;
+    }
+
+    /** Suma d a la cuenta del subrbol (no hace nada si el nodo no lleva la cuenta) */
+    void addCount(long d) {
+        if constexpr (COUNTED) this->_count += d;
+    }
 
-        if (i < _n_elems && _elems[i] == k) { // Si la clave a borrar est en este nodo
-            if (_is_leaf) removeFromLeaf(i); // Si soy nodo hoja, llamo a eliminar en hoja
-            else removeFromNonLeaf(i); // Si no soy hoja, llamo a eliminar en no hoja
+    /** Recalcula la cuenta del subrbol con sus keys sin borrar y las cuentas de sus hijos, que deben estar al da */
+    void recount() {
+        if constexpr (COUNTED) {
+            size_t c = _n_elems - _n_dead;
+            if (!_is_leaf) for (int j = 0; j <= _n_elems; j++) c += _child[j]->_count;
+            this->_count = c;
         }
-        else { // Si no est en este nodo
+    }
 
-            if (_is_leaf) { // Si el nodo es hoja, la key no est en el rbol
-                cout << "The key  " << k << " is not in the tree so we can't remove it.\n";
-                return;
+    /** Suma d a la cuenta de los nodos del camino desde este hasta el primero que tiene k (o hasta una hoja si no est)
+
+    @param k key que marca el camino
+    @param d cantidad que se suma
+    */
+    void addCountOnPath(const T& k, long d) {
+        if constexpr (COUNTED) {
+            Node* x = this;
+            while (true) {
+                x->_count += d;
+                int i = keyLowerBound(x->_elems, x->_n_elems, k);
+                if ((i < x->_n_elems && x->_elems[i] == k) || x->_is_leaf) return;
+                x = x->_child[i];
             }
+        }
+    }
 
-            bool is_in_last = ((i == _n_elems) ? true : false); // bool para indicar si k est en el subrbol con el ltimo hijo del nodo como raz
+    /** Array de valores del nodo, justo tras las keys (solo si has_values)
+
+    @return puntero al primer valor
+    */
+    value_type* values() const {
+        uintptr_t end = reinterpret_cast<uintptr_t>(_elems + maxElems());
+        return reinterpret_cast<value_type*>((end + alignof(value_type) - 1) / alignof(value_type) * alignof(value_type));
+    }
 
-            if (_child[i]->_n_elems < t) { // Si el rbol donde se supone que est el ltimo hijo tiene menos de t keys
-                fill(i);
+    /**
+    Funcin que pone en la posicin i de dst la key (y el valor, si hay) de la posicin j de src.
+    Los valores se mueven en vez de copiarse, as que partir o unir nodos no copia valores grandes.
+
+    @param dst nodo destino
+    @param i posicin en dst
+    @param src nodo origen (puede ser el mismo)
+    @param j posicin en src
+    */
+    static void moveElem(Node* dst, int i, Node* src, int j) {
+        dst->_elems[i] = src->_elems[j];
+        if constexpr (has_values) dst->values()[i] = std::move(src->values()[j]);
+    }
+
+    /**
+    Funcin que elimina la key k del subrbol con este nodo como raz (solo para nodos sin valores, BTreeMap tiene su propio erase).
+    Es un bucle que baja de nodo en nodo: en cada uno se elimina k o se rellena el hijo por el que se sigue.
+    Una key borrada con remove_lazy cuenta como que no est. Las lpidas de las dems se mueven con sus keys.
+
+    @param k key a eliminar
+    @param alloc poltica de reserva con la que se liberan los nodos que desaparecen al hacer merge
+
+    @return true si k estaba (y se ha eliminado)
+    */
+    template <class A>
+    bool remove(T k, A& alloc) {
+        static_assert(!has_values, "Node::remove no mueve los valores, se usa BTreeMap::erase");
+        int t = (maxElems() + 1) / 2; // Mitad del mximo de hijos
+        Node* x = this;
+        bool replaced = false; // Si k ya es el predecesor o sucesor que ha sustituido a la key pedida
+        long d = -1; // Lo que cambia la cuenta de cada nodo por el que se baja (0 si lo que se baja a quitar es una lpida)
+
+        while (true) {
+            x->addCount(d); // Cada nodo por el que se baja pierde una key de su subrbol (si k no est se deshace)
+            int i = keyLowerBound(x->_elems, x->_n_elems, k); // Busco la posicin de la primera key mayor o igual que k
+
+            if (i < x->_n_elems && x->_elems[i] == k) { // Si la clave a borrar est en este nodo
+                if (!replaced && x->_n_dead > 0 && x->isDead(i)) { // Est borrada con remove_lazy, como si no estuviera
+                    addCountOnPath(k, 1);
+                    cout << "The key  " << k << " is not in the tree so we can't remove it.\n";
+                    return false;
+                }
+                if (x->_is_leaf) { // Si es nodo hoja, eliminamos en hoja y hemos terminado
+                    x->removeFromLeaf(i);
+                    return true;
+                }
+                Node* c = x->removeFromNonLeaf(i, k, alloc, &replaced); // Si no es hoja, seguimos en el hijo que nos diga (con la key que nos diga)
+                if (replaced && x->_n_dead > 0 && x->isDead(i)) d = 0; // El sustituto era una lpida, que no contaba
+                x = c;
             }
+            else { // Si no est en este nodo
+
+                if (x->_is_leaf) { // Si el nodo es hoja, la key no est en el rbol
+                    addCountOnPath(k, 1);
+                    cout << "The key  " << k << " is not in the tree so we can't remove it.\n";
+                    return false;
+                }
+
+                bool is_in_last = ((i == x->_n_elems) ? true : false); // bool para indicar si k est en el subrbol con el ltimo hijo del nodo como raz
 
-            if (is_in_last && i > _n_elems) _child[i - 1]->remove(k); // Si el ltimo hijo ha hecho merge lo ha hecho con el anterior, as que debemos eliminar ah
-            else _child[i]->remove(k);
+                if (x->_child[i]->_n_elems < t) { // Si el rbol donde se supone que est el ltimo hijo tiene menos de t keys
+                    x->fill(i, alloc);
+                }
+
+                if (is_in_last && i > x->_n_elems) x = x->_child[i - 1]; // Si el ltimo hijo ha hecho merge lo ha hecho con el anterior, as que debemos eliminar ah
+                else x = x->_child[i];
+            }
         }
     }
 
@@ -104,49 +520,67 @@ public:
     void removeFromLeaf(int i) {
 
         for (int j = i + 1; j < _n_elems; j++) { // movemos las keys posteriores a la posicin i
-            _elems[j - 1] = _elems[j];
+            moveElem(this, j - 1, this, j);
         }
 
+        if (_n_dead > 0) { // las lpidas se mueven con sus keys
+            if (isDead(i)) _n_dead--;
+            shiftDeadLeft(i);
+        }
         _n_elems--; // Reducimos el contador de keys
     }
 
     /**
-    Funcin que elimina la key en la posicin i del nodo (que no es hoja).
+    Funcin que elimina la key en la posicin i del nodo (que no es hoja). No baja por el rbol: devuelve el hijo
+    en el que hay que seguir eliminando y la key que hay que eliminar all. La key en i no puede estar borrada con
+    remove_lazy; si el predecesor o sucesor que la sustituye lo est, su lpida sube con l.
 
     @param i posicin donde est la key a eliminar
+    @param k key a eliminar; a la salida, la key que hay que eliminar en el hijo devuelto
+    @param alloc poltica de reserva con la que se liberan los nodos
+    @param replaced si no es NULL, a la salida indica si k se ha sustituido por su predecesor o sucesor (que queda en i)
+
+    @return hijo en el que sigue la eliminacin
     */
-    void removeFromNonLeaf(int i) {
-        T k = _elems[i];
-        int t = (_max_elems + 1) / 2; // // Mitad del mximo de hijos
+    template <class A>
+    Node* removeFromNonLeaf(int i, T& k, A& alloc, bool* replaced = NULL) {
+        int t = (maxElems() + 1) / 2; // // Mitad del mximo de hijos
+        bool dead = false;
+        if (replaced != NULL) *replaced = true;
 
         if (_child[i]->_n_elems >= t) { // si el hijo que precede a k tiene por lo menos t elementos
-            T pred = getPred(i); // buscamos el predecesor de k en ese rbol
-            _elems[i] = pred; // intercambiamos k con el predecesor
-            _child[i]->remove(pred); // eliminamos k en el hijo
+            k = getPred(i, &dead); // buscamos el predecesor de k en ese rbol
+            _elems[i] = k; // intercambiamos k con el predecesor
+            if (dead) { setDead(i, true); _n_dead++; }
+            return _child[i]; // eliminamos el predecesor en el hijo
         }
 
-        else if (_child[i + 1]->_n_elems >= t) { // si el predecesor no los tiene, comprobamos que el sucesor tenga al menos t keys
-            T suc = getSucc(i); // buscamos al sucesor de k en ese rbol
-            _elems[i] = suc; // intercambiamos k con el sucesor
-            _child[i + 1]->remove(suc); // eliminamos k en el hijo
+        if (_child[i + 1]->_n_elems >= t) { // si el predecesor no los tiene, comprobamos que el sucesor tenga al menos t keys
+            k = getSucc(i, &dead); // buscamos al sucesor de k en ese rbol
+            _elems[i] = k; // intercambiamos k con el sucesor
+            if (dead) { setDead(i, true); _n_dead++; }
+            return _child[i + 1]; // eliminamos el sucesor en el hijo
         }
 
-        else { // si ninguno de los dos tiene al menos t keys
-            merge(i); // hacemos una unin del hijo que precede a k y del que lo sucede 
-            _child[i]->remove(k); // eliminamos k del hijo i (que contiene la unin del hijo predecesor  y del sucesor de k, adems de k)
-        }
+        if (replaced != NULL) *replaced = false;
+
+        // si ninguno de los dos tiene al menos t keys
+        merge(i, alloc); // hacemos una unin del hijo que precede a k y del que lo sucede
+        return _child[i]; // eliminamos k del hijo i (que contiene la unin del hijo predecesor  y del sucesor de k, adems de k)
     }
 
     /**
     Funcin para encontrar al elemento sucesor del elemento en la posicin i
 
     @param i posicin donde est el hijo sucesor
+    @param dead si no es NULL, a la salida indica si el sucesor est borrado con remove_lazy
 
     @return el sucesor de la key en la posicin i
     */
-    int getSucc(int i) {
+    T getSucc(int i, bool* dead = NULL) {
         Node* c = _child[i + 1];
         while (!c->_is_leaf) c = c->_child[0]; // Mientras no sea hoja, cogemos el que est ms a la izquierda
+        if (dead != NULL) *dead = c->_n_dead > 0 && c->isDead(0);
         return c->_elems[0]; // Devuelvo la primera key de la hoja ms a la izquierda
     }
 
@@ -154,12 +588,14 @@ public:
     Funcin para encontrar al elemento predecesor del elemento en la posicin i
 
     @param i posicin donde est el hijo predecesor
+    @param dead si no es NULL, a la salida indica si el predecesor est borrado con remove_lazy
 
     @return el predecesor de la key en la posicin i
 */
-    T getPred(int i) {
+    T getPred(int i, bool* dead = NULL) {
         Node* c = _child[i];
         while (!c->_is_leaf) c = c->_child[c->_n_elems]; // Mientras que c no sea hoja, cogemos el que est ms a la derecha
+        if (dead != NULL) *dead = c->_n_dead > 0 && c->isDead(c->_n_elems - 1);
         return c->_elems[c->_n_elems - 1]; // Devuelvo la tima key de la hoja ms a la derecha
     }
 
@@ -173,20 +609,33 @@ public:
         Node* child = _child[i];
         Node* sibling = _child[i + 1]; // Hijo siguiente al hijo al que vamos a dar la keyS
 
-        child->_elems[(child->_n_elems)] = _elems[i]; // Insertamos la key en i del padre como ltima key del hijo
+        moveElem(child, child->_n_elems, this, i); // Insertamos la key en i del padre como ltima key del hijo
 
         if (!(child->_is_leaf)) child->_child[(child->_n_elems) + 1] = sibling->_child[0]; // Si el nodo no es hoja, el primer hijo de su hermano es su ltimo hijo
 
-        _elems[i] = sibling->_elems[0]; // La primer key del hermano es la key en la posicin i del padre
+        moveElem(this, i, sibling, 0); // La primer key del hermano es la key en la posicin i del padre
 
-        for (int j = 1; j < sibling->_n_elems; j++) sibling->_elems[j - 1] = sibling->_elems[j];  // Movemos todas las keys del hermano
+        for (int j = 1; j < sibling->_n_elems; j++) moveElem(sibling, j - 1, sibling, j);  // Movemos todas las keys del hermano
 
         if (!sibling->_is_leaf) { // Si el hermano no es hoja
             for (int j = 1; j <= sibling->_n_elems; j++) sibling->_child[j - 1] = sibling->_child[j]; // Movemos sus hijos
         }
 
+        bool dead = child->_n_dead + sibling->_n_dead + _n_dead > 0;
+        if (dead) { // Las lpidas se mueven con sus keys
+            child->setDead(child->_n_elems, isDead(i));
+            setDead(i, sibling->isDead(0));
+            sibling->shiftDeadLeft(0);
+        }
         child->_n_elems += 1; // Aumentamos el nmero de keys del hijo
         sibling->_n_elems -= 1; // Disminuimos el nmero de keys del hermano
+        if (dead) {
+            child->_n_dead = child->countDead();
+            sibling->_n_dead = sibling->countDead();
+            _n_dead = countDead();
+        }
+        child->recount();
+        sibling->recount();
     }
 
     /**
@@ -200,57 +649,82 @@ public:
         Node* sibling = _child[i - 1]; // hermano anterior al hijo que queremos que consiga una key
 
         for (int j = child->_n_elems - 1; j >= 0; j--) { // movemos todas las keys  del hijo en la posicin i
-            child->_elems[j + 1] = child->_elems[j];
+            moveElem(child, j + 1, child, j);
         }
 
         if (!child->_is_leaf) { // Si este hijo no es hoja, movemos todos sus hijos
             for (int j = child->_n_elems; j >= 0; j--) child->_child[j + 1] = child->_child[j];
         }
 
-        child->_elems[0] = _elems[i - 1]; // La primer key del hijo pasa a ser la key en la posicin i - 1 del padre
+        moveElem(child, 0, this, i - 1); // La primer key del hijo pasa a ser la key en la posicin i - 1 del padre
 
         if (!child->_is_leaf) child->_child[0] = sibling->_child[sibling->_n_elems]; // Si el hijo no es hoja, su primer hijo pasa a ser el ltimo de su hermano
 
-        _elems[i - 1] = sibling->_elems[sibling->_n_elems - 1]; // Movemos la key del hermano al padre
+        moveElem(this, i - 1, sibling, sibling->_n_elems - 1); // Movemos la key del hermano al padre
 
+        bool dead = child->_n_dead + sibling->_n_dead + _n_dead > 0;
+        if (dead) { // Las lpidas se mueven con sus keys
+            child->shiftDeadRight(0);
+            child->setDead(0, isDead(i - 1));
+            setDead(i - 1, sibling->isDead(sibling->_n_elems - 1));
+            sibling->setDead(sibling->_n_elems - 1, false);
+        }
         child->_n_elems += 1; // aumentamos el nmero de keys del hijo
         sibling->_n_elems -= 1; // disminuimos el nmero de keys del hermano
+        if (dead) {
+            child->_n_dead = child->countDead();
+            sibling->_n_dead = sibling->countDead();
+            _n_dead = countDead();
+        }
+        child->recount();
+        sibling->recount();
     }
  
     /**
     Funcin para rellenar el hijo en la posicin i dado que tiene menos de t keys.
 
     @param i posicin del hijo que queremos rellenar
+    @param alloc poltica de reserva con la que se libera el nodo si se hace merge
     */
-    void fill(int i) {      
+    template <class A>
+    void fill(int i, A& alloc) {      
 
-        int t = (_max_elems + 1) / 2; // Mitad del mximo de hijo
+        int t = (maxElems() + 1) / 2; // Mitad del mximo de hijo
 
-        if (i != 0 && _child[i - 1]->_n_elems >= t) borrowFromPrev(i); // si tiene hermano predecesor, si este tiene al menos t keys, coge una key de ese hijo
+        if (i != 0 && _child[i - 1]->_n_elems >= t) { // si tiene hermano predecesor, si este tiene al menos t keys, coge una key de ese hijo
+            nodeEvent(alloc, STAT_BORROW_PREV);
+            borrowFromPrev(i);
+        }
 
-        else if (i != _n_elems && _child[i + 1]->_n_elems  >= t) borrowFromNext(i); // si tiene hermano sucesor, si este tiene al menos t keys, coge una key de ese hijo
+        else if (i != _n_elems && _child[i + 1]->_n_elems  >= t) { // si tiene hermano sucesor, si este tiene al menos t keys, coge una key de ese hijo
+            nodeEvent(alloc, STAT_BORROW_NEXT);
+            borrowFromNext(i);
+        }
 
         else { // si ninguno tiene al menos t keys
-            if (i != _n_elems) merge(i); // si no es el ltimo hijo, hace merge con su sucesor
-            else merge(i - 1); // si es el ltimo hace merge con su predecesor
+            if (i != _n_elems) merge(i, alloc); // si no es el ltimo hijo, hace merge con su sucesor
+            else merge(i - 1, alloc); // si es el ltimo hace merge con su predecesor
         }
     }
 
     /**
     Funcin para unir dos hijos (el i y el i+1) en el hijo i.
-    El hijo i + 1 es liberado.
+    El hijo i + 1 se devuelve a la poltica de reserva para reutilizarlo.
     
     @param i posicin del hijo que va a acoger la unin (y el primero que se va a unir, con el i+1)
+    @param alloc poltica de reserva con la que se libera el hijo i + 1
     */
-    void merge(int i) {
-        int t = (_max_elems + 1) / 2; // Mitad del mximo de hijo
+    template <class A>
+    void merge(int i, A& alloc) {
+        nodeEvent(alloc, STAT_MERGE);
+        int t = (maxElems() + 1) / 2; // Mitad del mximo de hijo
         Node* child = _child[i];
         Node* sibling = _child[i + 1];
 
-        child->_elems[t - 1] = _elems[i]; // Ponemos la key i del padre en la posicin t-1 del hijo
+        moveElem(child, t - 1, this, i); // Ponemos la key i del padre en la posicin t-1 del hijo
  
         for (int j = 0; j < sibling->_n_elems; j++) { // Copiamos las keys del hermano en el hijo
-            child->_elems[j + t] = sibling->_elems[j];
+            moveElem(child, j + t, sibling, j);
         }
 
         if (!child->_is_leaf) { // Copiamos los hijos del hermano en el hijo
@@ -260,45 +734,119 @@ public:
         }
 
         for (int j = i + 1; j < _n_elems; j++) { // Movemos las keys del padre posteriores a i
-            _elems[j - 1] = _elems[j];
+            moveElem(this, j - 1, this, j);
         }
 
         for (int j = i + 2; j <= _n_elems; j++) { // Movemos los hijos posteriores a la posicin i+1 en el padre
             _child[j - 1] = _child[j];
         }
 
+        bool dead = child->_n_dead + sibling->_n_dead + _n_dead > 0;
+        if (dead) { // Las lpidas se mueven con sus keys
+            child->setDead(t - 1, isDead(i));
+            for (int j = 0; j < sibling->_n_elems; j++) child->setDead(j + t, sibling->isDead(j));
+            shiftDeadLeft(i);
+        }
         child->_n_elems += sibling->_n_elems + 1; // Actualizamos el nmero de keys en el hijo
         _n_elems--; // Actualizamos el nmero de keys en el padre
+        if (dead) {
+            child->_n_dead = child->countDead();
+            _n_dead = countDead();
+        }
+        child->recount();
 
-        delete(sibling); // Liberamos al hermano
+        alloc.deallocate(sibling); // Liberamos al hermano
     }
 
     /**  Atributos  */
-    T* _elems;       // valores del nodo
-    Node** _child;  // punteros a sus hijos
+    T* _elems;       // valores del nodo (dentro del mismo bloque, justo tras la cabecera)
+    Node** _child;  // punteros a sus hijos (dentro del mismo bloque, NULL en las hojas)
     int _n_elems;   // nmero de keys que tiene el nodo actualmente
     int _max_elems; // nmero mximo de keys que puede tener el nodo
     bool _is_leaf;  // booleano que indica si el nodo es hoja o no
+    uint16_t _n_dead;    // nmero de keys borradas (lpidas) del nodo
+    uint32_t _dead_bits; // bits de lpida de las primeras DEAD_INLINE keys
+
+protected:
+
+    /** Constructor que construye un nodo con el tamao mximo determinado de keys como mximo.
+    Solo se usa desde construct (o desde los nodos que heredan de Node), el bloque ya tiene sitio para las keys y los hijos.
+
+    @param max_elems nmero mximo de keys que puede almacenar el nodo
+    @param is_leaf indica si el nodo es o no hoja
+    @param header tamao de la cabecera, las keys empiezan justo despus
+    */
+    Node(int max_elems, bool is_leaf, size_t header = sizeof(Node)) : _elems(), _child(), _n_elems(0), _max_elems(max_elems), _is_leaf(is_leaf), _n_dead(0), _dead_bits(0) {
+        char* base = reinterpret_cast<char*>(this);
+        _elems = reinterpret_cast<T*>(base + elemsOffset(header));
+        uninitialized_default_construct_n(_elems, max_elems);
+        if constexpr (has_values) uninitialized_default_construct_n(values(), max_elems);
+        if (!is_leaf) _child = reinterpret_cast<Node**>(base + childOffset(max_elems, header));
+        fill_n(deadBits(), deadWords(max_elems), (uint64_t)0);
+    }
+
+    /** Destructor, destruye las keys (el bloque lo libera quien lo reserv) */
+    ~Node() {
+        if constexpr (has_values) destroy_n(values(), maxElems());
+        destroy_n(_elems, maxElems());
+    }
+
+    /** Nmero de palabras de 64 bits que hacen falta al final del bloque para los bits de lpida de max_elems keys */
+    static size_t deadWords(int max_elems) {
+        return max_elems > DEAD_INLINE ? (max_elems - DEAD_INLINE + 63) / 64 : 0;
+    }
+
+    /** Bits de lpida del nodo, al final del bloque (tras los hijos o, en las hojas, tras las keys y los valores) */
+    uint64_t* deadBits() const {
+        uintptr_t end;
+        if (!_is_leaf) end = reinterpret_cast<uintptr_t>(_child + maxElems() + 1);
+        else if (has_values) end = reinterpret_cast<uintptr_t>(values() + maxElems());
+        else end = reinterpret_cast<uintptr_t>(_elems + maxElems());
+        return reinterpret_cast<uint64_t*>((end + alignof(uint64_t) - 1) / alignof(uint64_t) * alignof(uint64_t));
+    }
+
+    /** Desplazamiento de las keys dentro del bloque: tras la cabecera, alineado para T */
+    static size_t elemsOffset(size_t header) {
+        return (header + alignof(T) - 1) / alignof(T) * alignof(T);
+    }
+
+    /** Desplazamiento del array de hijos dentro del bloque: tras las keys y los valores, alineado para punteros */
+    static size_t childOffset(int max_elems, size_t header) {
+        size_t end = elemsOffset(header) + max_elems * sizeof(T);
+        if (has_values) end = (end + alignof(value_type) - 1) / alignof(value_type) * alignof(value_type) + max_elems * sizeof(value_type);
+        return (end + alignof(Node*) - 1) / alignof(Node*) * alignof(Node*);
+    }
 };
 
 /**
 
 Clase que representa a un rbol-B
 
+La memoria de los nodos la gestiona la poltica de reserva Alloc (ver NodePool.h). Por defecto es un
+NodePool, que saca los nodos de slabs y reutiliza los que se liberan al hacer merge.
+
+La poltica Stats (ver TreeStats.h) decide si se cuentan los splits, merges, prstamos, nodos y bsquedas. Por
+defecto es NoStats y no se cuenta nada; con TreeStats se pueden consultar con stats() y sacar en JSON con stats_json.
+
+Si los nodos tienen el orden fijado al compilar (Node<T, void, ORDER>, ver FixedBTree), el rbol usa esa constante en
+vez del tamao pedido en el constructor.
+
 @author lvaro Corrochano Lpez
 
 */
-template <class T>
+template <class T, class Alloc = NodePool<Node<T> >, class Stats = NoStats>
 class BTree {
 
 public:
 
-    /** Constructor vaco, tamao de las keys con tamao por defecto (= 3) 
+    /** Tipo de los nodos (Node<T>, o Node<T, void, ORDER> si el orden se fija al compilar) */
+    typedef typename Alloc::node_type node_type;
+
+    /** Constructor vaco, tamao de las keys con tamao por defecto (= 3, o el orden de los nodos si est fijado)
         Complejidad: O(1)
     */
-    BTree() {
-        _root = new Node<T>(DEFAULT_SIZE);
-        _size = DEFAULT_SIZE;
+    BTree() : _root(NULL), _size(node_type::fixedOr(DEFAULT_SIZE)), _alloc(_size), _keys(0), _dead(0), _dead_ratio(DEFAULT_DEAD_RATIO), _to_compact() {
+        _root = _alloc.allocate(true);
     };
 
     /**
@@ -306,26 +854,55 @@ public:
 
     Error: Si el tamao especificado es menor que 2, lanza una excepcin E_BTree_Lower
     Error: Si el tamao especificado es mayor que 1000, lanza una excepcin E_BTree_Bigger
+    Error: Si el orden de los nodos est fijado y el tamao es otro, lanza una excepcin E_BTree_Format
  
     @param size nmero mximo de keys que puede almacenar el nodo
     */
-    BTree(int size) {
+    BTree(int size) : _root(NULL), _size(size), _alloc(size), _keys(0), _dead(0), _dead_ratio(DEFAULT_DEAD_RATIO), _to_compact() {
         if (size < MIN_SIZE) throw E_BTree_Lower();
         if (size > MAX_SIZE) throw E_BTree_Bigger();
+        if (node_type::fixedOr(size) != size) throw E_BTree_Format();
 
-        _root = new Node<T>(size);
-        _size = size;
+        _root = _alloc.allocate(true);
     };
 
-    /**
-    Constructor que crea un rbol dado un puntero a un nodo y el nmero mximo de keys que tendr cada nodo.
+    /** El rbol es dueo de sus nodos, as que no se puede copiar (solo mover) */
+    BTree(const BTree&) = delete;
+    BTree& operator=(const BTree&) = delete;
 
-    @param n nodo que ser la raz del rbol
-    @param s nmero mximo de keys que tendr cada nodo
+    /** Constructor de movimiento, el rbol movido se queda sin nodos y solo se puede destruir */
+    BTree(BTree&& other) : _root(other._root), _size(other._size), _alloc(std::move(other._alloc)),
+                           _keys(other._keys), _dead(other._dead), _dead_ratio(other._dead_ratio), _to_compact(std::move(other._to_compact)) {
+        other._root = NULL;
+    }
+
+    /** Asignacin de movimiento, los nodos que tuviera este rbol se liberan */
+    BTree& operator=(BTree&& other) {
+        if (this != &other) {
+            releaseNodes();
+            _root = other._root;
+            _size = other._size;
+            _alloc = std::move(other._alloc);
+            _keys = other._keys;
+            _dead = other._dead;
+            _dead_ratio = other._dead_ratio;
+            _to_compact = std::move(other._to_compact);
+            other._root = NULL;
+        }
+        return *this;
+    }
+
+    /** Destructor, libera todos los nodos del rbol */
+    ~BTree() {
+        releaseNodes();
+    }
+
+    /** Elimina todas las keys del rbol y libera sus nodos.
+    Con NodePool y keys sin destructor (como int) no recorre el rbol: cuesta O(nmero de slabs).
     */
-    BTree(Node<T>* n, int s) {
-        _root = n;
-        _size = s;
+    void clear() {
+        releaseNodes();
+        _root = _alloc.allocate(true);
     }
 
     /** Devuelve el nmero de keys alojadas en el nodo raz del rbol
@@ -358,31 +935,130 @@ public:
         return _size;
     }
 
-    /** Indica si el rbol est o no vaco
+    /** Devuelve el nmero de keys del rbol (sin las borradas con remove_lazy)
+
+    @return nmero de keys
+    */
+    size_t size() const {
+        return _keys - _dead;
+    }
+
+    /** Indica si el rbol est o no vaco (un rbol con todas sus keys borradas con remove_lazy est vaco)
 
     @return true si el rbol est vaco y false si no lo est
     */
     bool isEmpty() const {
-        return _root->_n_elems == 0;
+        return _keys == _dead;
     }
 
    /**
    Funcin para recorrer un rbol, va sacando las keys guardadas en orden (siempre creciente).
+   Para sacar muchas keys es mucho ms rpido exportKeys (KeyExport.h), que no usa operator<< con cada una.
+
+   @param out flujo en el que se sacan (por defecto la salida estndar)
    */
-    void traverse()
+    void traverse(ostream& out = cout)
     {
-        int i;
-        for (i = 0; i < _root->_n_elems; i++) {
-            if (!_root->_is_leaf) { // Si no es hoja, recorro los hijos
-                BTree(_root->_child[i], _size).traverse();
+        auto print = [&out](const T& k) { out << " " << k; };
+        forEach(_root, print);
+    }
+
+    /**
+    Funcin que aplica f a cada key del rbol, en orden creciente.
+
+    @param f funcin que recibe cada key (const T&)
+    */
+    template <class F>
+    void for_each(F f) const {
+        forEach(_root, f);
+    }
+
+    /**
+    Funcin que aplica f a cada key del rbol repartiendo el recorrido entre varios hilos, sin ningn orden.
+    Se bajan los niveles de arriba hasta tener TASKS_PER_THREAD subrboles por hilo (o llegar a las hojas); cada
+    subrbol es una tarea de un WorkPool, que recorre el subrbol en orden con una copia de f, y las keys de los
+    nodos de arriba las recorre al final el hilo que llama.
+    f se llama desde varios hilos a la vez (por ejemplo, para sumar tiene que usar un atmico o una suma por hilo).
+
+    @param policy poltica de ejecucin (par o par(hilos))
+    @param f funcin que recibe cada key (const T&)
+    */
+    template <class F>
+    void for_each(const ParallelPolicy& policy, F f) const {
+        unsigned threads = policy.threads();
+        vector<node_type*> tasks(1, _root), next;
+        vector<const T*> upper; // Keys de los nodos que se han bajado
+        bool inner = !_root->_is_leaf;
+        while (inner && tasks.size() < threads * TASKS_PER_THREAD) {
+            next.clear();
+            inner = false;
+            for (size_t j = 0; j < tasks.size(); j++) {
+                node_type* x = tasks[j];
+                if (x->_is_leaf) { // Las hojas se quedan como tarea
+                    next.push_back(x);
+                    continue;
+                }
+                for (int i = 0; i < x->_n_elems; i++) if (x->_n_dead == 0 || !x->isDead(i)) upper.push_back(&x->_elems[i]);
+                for (int i = 0; i <= x->_n_elems; i++) {
+                    next.push_back(x->_child[i]);
+                    inner = inner || !x->_child[i]->_is_leaf;
+                }
             }
-            cout << " " << _root->_elems[i];
+            tasks.swap(next);
         }
 
-        if (!_root->_is_leaf) { // Si no es hoja, recorro su ltimo hijo (no se hace en el bucle).
-            BTree(_root->_child[i], _size).traverse();
+        WorkPool::shared(threads).run(tasks.size(), [&tasks, &f](size_t i) {
+            F g = f;
+            forEach(tasks[i], g);
+        });
+        for (size_t j = 0; j < upper.size(); j++) f(*upper[j]);
+    }
+
+    /**
+    Funcin que aplica f a cada key del intervalo [lo, hi), en orden creciente. Baja hasta lo guardando el camino
+    (en cada nodo, el hijo por el que se baja) y desde ah sigue como for_each hasta la primera key mayor o igual que hi.
+    Complejidad: O(m log n + r), con m el mximo de keys por nodo y r las keys del intervalo
+
+    @param lo cota inferior (incluida)
+    @param hi cota superior (excluida)
+    @param f funcin que recibe cada key (const T&)
+    */
+    template <class F>
+    void for_each_range(const T& lo, const T& hi, F f) const {
+        if (!(lo < hi)) return;
+        PathStack<Step> path;
+        node_type* x = _root;
+        while (true) { // Bajo hasta la primera key >= lo
+            int i = keyLowerBound(x->_elems, x->_n_elems, lo);
+            path.push(Step(x, i));
+            if (x->_is_leaf) break;
+            x = x->_child[i];
         }
 
+        while (!path.empty()) {
+            Step& s = path.top();
+            if (s._node->_is_leaf) { // En la hoja, desde _next hasta la primera key >= hi
+                for (int i = s._next; i < s._node->_n_elems; i++) {
+                    if (!(s._node->_elems[i] < hi)) return;
+                    if (s._node->_n_dead == 0 || !s._node->isDead(i)) f(s._node->_elems[i]);
+                }
+                path.pop();
+            }
+            else if (s._next <= s._node->_n_elems) {
+                path.push(Step(s._node->_child[s._next], 0));
+                continue;
+            }
+            else path.pop();
+
+            if (!path.empty()) { // He terminado con un hijo: la key que lo sigue en el padre
+                Step& p = path.top();
+                if (p._next < p._node->_n_elems) {
+                    if (!(p._node->_elems[p._next] < hi)) return;
+                    if (p._node->_n_dead == 0 || !p._node->isDead(p._next)) f(p._node->_elems[p._next]);
+                }
+                p._next++;
+            }
+        }
     }
 
 
@@ -394,27 +1070,134 @@ public:
     
       @return retorna el nodo donde se encuentra la clave a NULL en caso de no encontrarla.
     */
-    Node<T>* search(int k) {
-        int i = 0;
-
+    node_type* search(T k) {
         if(isEmpty()) throw E_BTree_Empty(); // Si el rbol est vaco, error
-       
-        while (i < _root->_n_elems && k > _root->_elems[i]) { // Iteramos para encontrar el primer ndice i cuya clava cumpla key <= k 
-             i++;
-        }
 
-        if (i < _root->_n_elems && k == _root->_elems[i]) { // Si he encontrado el elemento
-            return _root;    
+        return search(_root, k);
+    }
+
+    /**
+    Funcin que cuenta las keys del rbol menores que k (sin las borradas), bajando una sola vez: en cada nodo se suman
+    las keys menores que k y las cuentas de los hijos que quedan a su izquierda. Solo con nodos que llevan la cuenta
+    de su subrbol (CountedBTree).
+    Complejidad: O(m log n), con m el mximo de keys por nodo
+
+    @param k key
+
+    @return nmero de keys menores que k
+    */
+    size_t rank(const T& k) const {
+        static_assert(node_type::counted, "rank necesita nodos con la cuenta del subrbol (CountedBTree)");
+        size_t r = 0;
+        const node_type* x = _root;
+        while (true) {
+            int i = keyLowerBound(x->_elems, x->_n_elems, k); // Las keys 0..i-1 son menores que k
+            r += i;
+            if (x->_n_dead > 0) for (int j = 0; j < i; j++) r -= x->isDead(j);
+            if (x->_is_leaf) return r;
+            for (int j = 0; j < i; j++) r += x->_child[j]->subtreeCount();
+            x = x->_child[i]; // Con keys repetidas puede haber keys menores que k en el hijo i aunque k est en este nodo
         }
+    }
 
-        else if (_root->_is_leaf) { // Si el nodo es hoja     
-            return NULL;
+    /**
+    Funcin que devuelve la key en la posicin i del rbol en orden creciente (sin contar las borradas), es decir, la
+    key que tiene i keys menores por delante. Solo con nodos que llevan la cuenta de su subrbol (CountedBTree).
+    Complejidad: O(m log n), con m el mximo de keys por nodo
+
+    Error: Si i es mayor o igual que el nmero de keys, lanza una excepcin E_BTree_Range
+
+    @param i posicin, empezando en 0
+
+    @return la key en la posicin i
+    */
+    const T& select(size_t i) const {
+        static_assert(node_type::counted, "select necesita nodos con la cuenta del subrbol (CountedBTree)");
+        if (i >= _root->subtreeCount()) throw E_BTree_Range();
+        const node_type* x = _root;
+        while (true) {
+            int j = 0;
+            for (; j <= x->_n_elems; j++) {
+                if (!x->_is_leaf) { // Primero las keys del hijo j
+                    size_t c = x->_child[j]->subtreeCount();
+                    if (i < c) break;
+                    i -= c;
+                }
+                if (j < x->_n_elems && !(x->_n_dead > 0 && x->isDead(j))) { // y despus la key j
+                    if (i == 0) return x->_elems[j];
+                    i--;
+                }
+            }
+            x = x->_child[j]; // Solo se sale del bucle sin devolver nada cuando la key est en el hijo j
         }
+    }
+
+    /**
+    Funcin que cuenta las keys del intervalo [lo, hi) sin recorrerlas. Solo con nodos que llevan la cuenta de su
+    subrbol (CountedBTree).
+    Complejidad: O(m log n), con m el mximo de keys por nodo
+
+    @param lo cota inferior (incluida)
+    @param hi cota superior (excluida)
+
+    @return nmero de keys k con lo <= k < hi
+    */
+    size_t count(const T& lo, const T& hi) const {
+        if (!(lo < hi)) return 0;
+        return rank(hi) - rank(lo);
+    }
+
+    /** Devuelve las estadsticas contadas desde que se cre el rbol (o desde reset_stats)
+
+    @return estadsticas del rbol
+    */
+    const Stats& stats() const {
+        return _alloc.stats();
+    }
+
+    /** Pone a 0 las estadsticas */
+    void reset_stats() {
+        _alloc.stats().reset();
+    }
+
+    /**
+    Funcin que recorre el rbol y calcula su forma: altura, nmero de nodos y de keys y llenado medio de los nodos.
+    Complejidad: O(nmero de nodos)
 
-        else { //  En otro caso, miro el hijo del index conseguido anteriormente
-            return BTree(_root->_child[i], _size).search(k);
+    @return forma del rbol
+    */
+    TreeShape shape() const {
+        TreeShape s;
+        PathStack<Step> path;
+        path.push(Step(_root, 1)); // En los pasos de este recorrido _next es el nivel del nodo
+
+        while (!path.empty()) {
+            Step x = path.top();
+            path.pop();
+            s._nodes++;
+            s._keys += x._node->_n_elems;
+            s._dead += x._node->_n_dead;
+            s._capacity += _size;
+            if (x._next > s._height) s._height = x._next;
+            if (x._node->_is_leaf) s._leaves++;
+            else for (int i = 0; i <= x._node->_n_elems; i++) path.push(Step(x._node->_child[i], x._next + 1));
         }
+        return s;
+    }
+
+    /**
+    Funcin que escribe en JSON el orden del rbol, su forma y, si la poltica Stats cuenta algo, sus estadsticas.
 
+    @param out flujo de salida
+    */
+    void stats_json(ostream& out) const {
+        out << "{\"order\": " << _size << ", \"shape\": ";
+        shape().json(out);
+        if (Stats::enabled) {
+            out << ", \"stats\": ";
+            stats().json(out);
+        }
+        out << "}\n";
     }
 
     /**
@@ -425,84 +1208,822 @@ public:
         @param k elemento a insertar en el rbol.
     */
     void insert(T k) {
+        if (_dead > 0 && revive(k)) return; // Si k estaba borrada con remove_lazy, basta con quitarle la lpida
+
+        if (_root->_n_elems == maxElems()) { // Si el nodo est lleno
+            splitRoot(); // Parto la raz y crece el rbol
+        }
+        insert_nonfull(_root, k); // La raz ya no est llena, insercin no completo
+        _keys++;
+    }
+
+
+    /**
+    Funcin para eliminar el elemento k del rbol.
+    Una key borrada con remove_lazy cuenta como que no est; las lpidas de las dems se mueven con sus keys al
+    reequilibrar, as que se pueden mezclar los dos borrados.
+
+    Error: Si el rbol est vaco, lanza una excepcin E_BTree_Empty
+
+    @param k elemento a eliminar
+    */
+    void remove (T k) {
+        if (isEmpty()) throw E_BTree_Empty(); // Si el rbol est vaco, error
+
+        if (_root->remove(k, _alloc)) _keys--; // Llamamos a la funcin remove de la raz
+
+        if (_root->_n_elems == 0 && !_root->_is_leaf) { // si la raz se ha quedado sin keys y no es hoja
+            node_type* old_root = _root;
+            _root = _root->_child[0]; // su primer hijo es la nueva raz
+            _alloc.deallocate(old_root); // liberamos la raz antigua
+            _alloc.stats().count(STAT_ROOT_COLLAPSE);
+        }
+    }
+
+    /**
+    Funcin para eliminar el elemento k del rbol sin reequilibrarlo: la key se marca como borrada (una lpida) en su
+    nodo, search, traverse y for_each se la saltan y se quita de verdad al compactar (ver compact y compact_step).
+    No reserva ni libera nodos ni mueve keys. Si se vuelve a insertar k antes de compactar, solo se le quita la lpida.
+    Supone keys sin repetir: si k est repetida se marca la primera que se encuentra al bajar.
+    Complejidad: O(log n)
+
+    Error: Si el rbol est vaco, lanza una excepcin E_BTree_Empty
+
+    @param k elemento a eliminar
+
+    @return true si k estaba en el rbol (y no estaba ya borrada)
+    */
+    bool remove_lazy(T k) {
+        if (isEmpty()) throw E_BTree_Empty(); // Si el rbol est vaco, error
 
-        if (_root->_n_elems == _root->_max_elems) { // Si el nodo est lleno
-            Node<T>* r = _root; // Me guardo la raz actual
+        node_type* x = _root;
+        while (true) {
+            int i = keyLowerBound(x->_elems, x->_n_elems, k);
+            if (i < x->_n_elems && k == x->_elems[i]) {
+                if (x->isDead(i)) return false; // Ya estaba borrada
+                x->setDead(i, true);
+                x->_n_dead++;
+                _dead++;
+                _alloc.stats().count(STAT_TOMBSTONE);
+                if (x->_n_dead >= _dead_ratio * x->_n_elems && x->_n_dead - 1 < _dead_ratio * x->_n_elems) {
+                    _to_compact.push_back(k); // Este nodo acaba de llegar a demasiadas lpidas, se apunta con una de sus keys
+                }
+                _root->addCountOnPath(k, -1);
+                return true;
+            }
+            if (x->_is_leaf) return false; // No est
+            x = x->_child[i];
+        }
+    }
 
-            Node<T>* s = new Node<T>(_size, false); // Creo un nuevo nodo
-            s->_n_elems = 0; // Le asigno que tiene 0 keys
-            s->_child[0] = r; // La antigua raz es su hijo
+    /**
+    Funcin que compacta el rbol: quita de verdad las keys borradas con remove_lazy, reequilibrando los nodos igual
+    que remove_batch. Recorre todos los nodos; para quitar solo las de los nodos con demasiadas lpidas est compact_step.
+    El rbol no se puede usar desde varios hilos, as que si se llama en segundo plano hay que excluir las dems operaciones.
+    Complejidad: O(nmero de nodos + d log n), con d el nmero de lpidas
 
-            splitChild(0, s); // Parto la raz y aado 1 de sus elementos a la nueva raz
-            BTree(s, _size).insert_nonfull(k); // Aado el elemento en s
-            _root = s; // s es el nuevo nodo raz
+    @return nmero de keys quitadas
+    */
+    size_t compact() {
+        _to_compact.clear();
+        if (_dead == 0) return 0;
+
+        vector<T> dead; // Primero se recogen las keys borradas y se les quitan las lpidas
+        dead.reserve(_dead);
+        PathStack<node_type*> path;
+        path.push(_root);
+        while (!path.empty()) {
+            node_type* x = path.top();
+            path.pop();
+            if (x->_n_dead > 0) {
+                for (int i = 0; i < x->_n_elems; i++) if (x->isDead(i)) dead.push_back(x->_elems[i]);
+                x->clearDead();
+            }
+            if (!x->_is_leaf) for (int i = 0; i <= x->_n_elems; i++) path.push(x->_child[i]);
         }
-        else { // Si no lo est, insercin no completo
-            insert_nonfull(k);
+        _dead = 0;
+        _alloc.stats().count(STAT_COMPACTION);
+        if constexpr (node_type::counted) recountAll(); // Las keys que tenan lpida vuelven a contar hasta que se eliminan
+
+        remove_batch(dead.begin(), dead.end()); // y despus se eliminan como cualquier otra key
+        return dead.size();
+    }
+
+    /**
+    Funcin que compacta como mucho max_nodes de los nodos que han llegado a la fraccin de lpidas (ver set_dead_ratio):
+    quita de verdad sus keys borradas con remove_lazy, igual que compact pero sin recorrer el resto del rbol. As la
+    compactacin se puede repartir en pasos cortos entre las dems operaciones, mientras needs_compaction() lo pida.
+    Cada nodo se apunta con una de sus keys y se vuelve a comprobar al compactarlo, porque al reequilibrar las keys
+    (y sus lpidas) cambian de nodo.
+    Complejidad: O(max_nodes m log n)
+
+    @param max_nodes nmero mximo de nodos que se compactan
+
+    @return nmero de keys quitadas
+    */
+    size_t compact_step(size_t max_nodes = 1) {
+        vector<T> dead;
+        for (size_t done = 0; done < max_nodes && !_to_compact.empty(); ) {
+            T k = _to_compact.back();
+            _to_compact.pop_back();
+            int i;
+            node_type* x = locate(k, i);
+            if (x == NULL || x->_n_dead == 0 || x->_n_dead < _dead_ratio * x->_n_elems) continue; // Ya no hace falta
+            size_t first = dead.size();
+            for (int j = 0; j < x->_n_elems; j++) if (x->isDead(j)) dead.push_back(x->_elems[j]);
+            for (size_t j = first; j < dead.size(); j++) revive(dead[j]); // Vuelven a contar hasta que se eliminan
+            done++;
         }
+        if (dead.empty()) return 0;
+        _alloc.stats().count(STAT_COMPACTION);
+        remove_batch(dead.begin(), dead.end());
+        return dead.size();
+    }
+
+    /** Indica si algn nodo ha llegado a la fraccin de lpidas que pide una compactacin (ver set_dead_ratio)
+
+    @return true si conviene llamar a compact_step (o a compact)
+    */
+    bool needs_compaction() const {
+        return !_to_compact.empty();
+    }
+
+    /** Devuelve el nmero de keys borradas con remove_lazy que an no se han quitado
+
+    @return nmero de lpidas
+    */
+    size_t n_dead() const {
+        return _dead;
+    }
+
+    /** Cambia la fraccin de keys borradas de un nodo a partir de la cual needs_compaction() es true
+
+    @param ratio fraccin entre 0 y 1 (por defecto DEFAULT_DEAD_RATIO)
+    */
+    void set_dead_ratio(double ratio) {
+        _dead_ratio = ratio;
+    }
+
+    /**
+    Funcin para insertar todas las keys del rango [first, last).
+    Se ordenan y se insertan en orden recordando el camino de la ltima insercin: cada key empieza a bajar desde el
+    nodo ms profundo de ese camino que la puede contener y no est lleno, en vez de desde la raz. As las keys que
+    van a la misma hoja se insertan juntas y solo se baja desde arriba cuando la key sale del rango del camino.
 
+    @param first iterador al principio de las keys
+    @param last iterador al final de las keys
+    */
+    template <class It>
+    void insert_batch(It first, It last) {
+        vector<T> keys(first, last);
+        sort(keys.begin(), keys.end());
+
+        vector<Level> path; // Camino de la ltima insercin
+        for (size_t j = 0; j < keys.size(); j++) {
+            const T& k = keys[j];
+            if (_dead > 0 && revive(k)) continue; // Estaba borrada con remove_lazy
+            if (_root->_n_elems == maxElems()) { // Si la raz est llena la partimos y el camino deja de valer
+                splitRoot();
+                path.clear();
+            }
+            while (!path.empty() && (path.back()._node->_n_elems == maxElems() || !path.back().holds(k, true))) {
+                path.pop_back(); // Subimos hasta un nodo no lleno cuyo rango contenga a k
+            }
+            if (path.empty()) path.push_back(Level(_root));
+            insertFrom(path, k);
+            _keys++;
+        }
     }
 
+    /**
+    Funcin para eliminar todas las keys del rango [first, last) (una vez cada una).
+    Igual que insert_batch, se ordenan y cada key empieza a bajar desde el nodo ms profundo del camino anterior
+    que la contiene y tiene keys de sobra para no necesitar fill. Las keys borradas con remove_lazy cuentan como que no estn.
+
+    Error: Si el rbol est vaco, lanza una excepcin E_BTree_Empty
+
+    @param first iterador al principio de las keys
+    @param last iterador al final de las keys
+    */
+    template <class It>
+    void remove_batch(It first, It last) {
+        if (isEmpty()) throw E_BTree_Empty(); // Si el rbol est vaco, error
+
+        vector<T> keys(first, last);
+        sort(keys.begin(), keys.end());
+
+        int t = (maxElems() + 1) / 2; // Mitad del mximo de hijos
+        vector<Level> path; // Camino del ltimo borrado
+        for (size_t j = 0; j < keys.size(); j++) {
+            const T& k = keys[j];
+            while (path.size() > 1 && (path.back()._node->_n_elems < t || !path.back().holds(k, false))) {
+                path.pop_back(); // Subimos hasta un nodo con keys de sobra cuyo rango contenga a k (o hasta la raz)
+            }
+            if (path.empty()) path.push_back(Level(_root));
+
+            if (removeFrom(path, k)) _keys--;
+            else cout << "The key  " << k << " is not in the tree so we can't remove it.\n";
+
+            if (_root->_n_elems == 0 && !_root->_is_leaf) { // si la raz se ha quedado sin keys y no es hoja
+                node_type* old_root = _root;
+                _root = _root->_child[0]; // su primer hijo es la nueva raz
+                _alloc.deallocate(old_root);
+                _alloc.stats().count(STAT_ROOT_COLLAPSE);
+                path.clear();
+            }
+        }
+    }
 
     /**
-    Funcin para eliminar el elemento k del rbol
+    Funcin que busca todas las keys del rango [first, last).
+    Se buscan en orden recordando el camino de la bsqueda anterior, as que las keys que estn en la misma zona del
+    rbol comparten la bajada.
 
     Error: Si el rbol est vaco, lanza una excepcin E_BTree_Empty
 
-    @param k elemento a eliminar
+    @param first iterador al principio de las keys
+    @param last iterador al final de las keys
+
+    @return para cada key (en el mismo orden en que se han pasado) el nodo donde se encuentra o NULL si no est
     */
-    void remove (int k) {
+    template <class It>
+    vector<node_type*> search_batch(It first, It last) {
         if (isEmpty()) throw E_BTree_Empty(); // Si el rbol est vaco, error
 
-        _root->remove(k); // Llamamos a la funcin remove de la raz
+        vector<T> keys(first, last);
+        vector<size_t> order(keys.size()); // Posiciones de las keys ordenadas por key
+        for (size_t j = 0; j < order.size(); j++) order[j] = j;
+        sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] < keys[b]; });
+
+        vector<node_type*> found(keys.size(), (node_type*)NULL);
+        vector<Level> path(1, Level(_root)); // Camino de la ltima bsqueda
+        Stats& stats = _alloc.stats();
+        stats.count(STAT_SEARCH, keys.size());
+        for (size_t j = 0; j < order.size(); j++) {
+            const T& k = keys[order[j]];
+            while (path.size() > 1 && !path.back().holds(k, false)) path.pop_back();
+
+            node_type* x = path.back()._node;
+            while (true) {
+                stats.count(STAT_SEARCH_NODES);
+                stats.count(STAT_SEARCH_KEYS, x->_n_elems);
+                int i = keyLowerBound(x->_elems, x->_n_elems, k);
+                if (i < x->_n_elems && k == x->_elems[i]) { // Encontrada (si no est borrada)
+                    if (x->_n_dead == 0 || !x->isDead(i)) found[order[j]] = x;
+                    break;
+                }
+                if (x->_is_leaf) break; // No est
+
+                path.push_back(path.back().child(i));
+                x = path.back()._node;
+            }
+        }
+        return found;
+    }
+
+    /**
+    Funcin que busca todas las keys del rango [first, last) llevando SEARCH_GROUP bsquedas a la vez.
+    En cada vuelta cada bsqueda del grupo mira su nodo actual y pide a la cach el hijo por el que sigue, sin
+    esperarlo; cuando vuelve a tocarle, el hijo ya suele haber llegado. As los fallos de cach de las distintas
+    bsquedas se solapan en vez de ir uno detrs de otro. Cuando una bsqueda acaba, su hueco lo ocupa la siguiente key.
+    A diferencia de search_batch no ordena las keys, as que conviene cuando estn dispersas y el rbol no cabe en cach.
+
+    Error: Si el rbol est vaco, lanza una excepcin E_BTree_Empty
+
+    @param first iterador al principio de las keys
+    @param last iterador al final de las keys
 
-        if (_root->_n_elems == 0) { // si la raz se ha quedado sin keys
-            Node<T>* old_root = _root;
-            if (!_root->_is_leaf) _root = _root->_child[0]; // si no es hoja, su primer hijo es la nueva raz
-            else _root = new Node<T>(_size);
+    @return para cada key (en el mismo orden en que se han pasado) el nodo donde se encuentra o NULL si no est
+    */
+    template <class It>
+    vector<node_type*> search_many(It first, It last) {
+        if (isEmpty()) throw E_BTree_Empty(); // Si el rbol est vaco, error
+
+        vector<T> keys(first, last);
+        vector<node_type*> found(keys.size(), (node_type*)NULL);
+        Stats& stats = _alloc.stats();
+        stats.count(STAT_SEARCH, keys.size());
+
+        node_type* node[SEARCH_GROUP]; // Nodo que le toca mirar a cada bsqueda del grupo
+        size_t pos[SEARCH_GROUP];      // Posicin de su key
+        int active = 0;
+        size_t next = 0; // Siguiente key que entra en el grupo
+        while (active < SEARCH_GROUP && next < keys.size()) {
+            node[active] = _root;
+            pos[active++] = next++;
+        }
+        while (active > 0) {
+            for (int j = 0; j < active; j++) {
+                node_type* x = node[j];
+                const T& k = keys[pos[j]];
+                stats.count(STAT_SEARCH_NODES);
+                stats.count(STAT_SEARCH_KEYS, x->_n_elems);
+                int i = keyLowerBound(x->_elems, x->_n_elems, k);
+                bool hit = i < x->_n_elems && k == x->_elems[i];
+                if (!hit && !x->_is_leaf) { // Sigue por el hijo: se pide ya y se mira en la prxima vuelta
+                    node[j] = x->_child[i];
+                    node[j]->prefetch(maxElems());
+                    continue;
+                }
+                if (hit && (x->_n_dead == 0 || !x->isDead(i))) found[pos[j]] = x;
 
-            delete old_root; // liberamos la raz antigua
+                if (next < keys.size()) { // Acabada: su hueco lo ocupa la siguiente key, que empieza por la raz
+                    node[j] = _root;
+                    pos[j] = next++;
+                }
+                else { // No quedan keys: el grupo se encoge y la ltima bsqueda pasa a este hueco
+                    active--;
+                    node[j] = node[active];
+                    pos[j] = pos[active];
+                    j--;
+                }
+            }
         }
+        return found;
+    }
+
+    /**
+    Funcin que sustituye el contenido del rbol por las keys (ya ordenadas) del rango [first, last).
+    El rbol se construye de abajo a arriba: primero se llenan las hojas de izquierda a derecha y despus
+    cada nivel interno con las keys que separan los nodos del nivel de debajo, sin ningn split.
+    Complejidad: O(n)
+
+    Error: Si las keys no estn ordenadas de forma creciente, lanza una excepcin E_BTree_Unsorted (y el rbol no cambia)
+
+    @param first iterador al principio de las keys
+    @param last iterador al final de las keys
+    @param fill fraccin de cada nodo que se llena (se ajusta para que ningn nodo quede por debajo del mnimo).
+                Dejar hueco (por ejemplo 0.7) evita que las inserciones posteriores partan nodos enseguida.
+    */
+    template <class It>
+    void bulk_load(It first, It last, double fill = 1.0) {
+        bulk_load(first, last, fill, typename iterator_traits<It>::iterator_category());
+    }
+
+    /**
+    Igual que bulk_load, pero repartiendo el trabajo entre varios hilos: el orden de las keys se comprueba por trozos
+    y cada nivel se construye por tramos de BUILD_CHUNK nodos (los nodos se reservan antes, en un solo hilo, porque la
+    poltica de reserva no se puede usar desde varios hilos). Como el reparto de las keys entre los nodos de un nivel
+    se calcula sin recorrerlo, cada tramo es un conjunto de subrboles independientes y el rbol que sale es el mismo
+    que con bulk_load.
+
+    Error: Si las keys no estn ordenadas de forma creciente, lanza una excepcin E_BTree_Unsorted (y el rbol no cambia)
+
+    @param policy poltica de ejecucin (par o par(hilos))
+    @param first iterador de acceso aleatorio al principio de las keys
+    @param last iterador al final de las keys
+    @param fill fraccin de cada nodo que se llena
+    */
+    template <class It>
+    void bulk_load(const ParallelPolicy& policy, It first, It last, double fill = 1.0) {
+        size_t n = (size_t)(last - first);
+        unsigned threads = policy.threads();
+        size_t chunks = threads * TASKS_PER_THREAD;
+        vector<char> sorted(chunks, 1);
+        WorkPool::shared(threads).run(chunks, [&](size_t c) { // Cada trozo incluye la primera key del siguiente
+            size_t lo = n * c / chunks, hi = n * (c + 1) / chunks;
+            if (hi < n) hi++;
+            sorted[c] = is_sorted(first + lo, first + hi);
+        });
+        if (find(sorted.begin(), sorted.end(), 0) != sorted.end()) throw E_BTree_Unsorted();
+        build(first, n, fill, threads);
+    }
+
+    /**
+    Funcin que sustituye el contenido del rbol por las keys del rango [first, last), que pueden estar desordenadas.
+    Se copian, se ordenan en paralelo y se construye el rbol como bulk_load(par(threads), ...).
+
+    @param first iterador al principio de las keys
+    @param last iterador al final de las keys
+    @param fill fraccin de cada nodo que se llena
+    @param threads nmero de hilos para ordenar y construir (0 para usar tantos como ncleos)
+    */
+    template <class It>
+    void bulk_load_unsorted(It first, It last, double fill = 1.0, unsigned threads = 0) {
+        vector<T> keys(first, last);
+        parallelSort(keys, threads);
+        build(keys.begin(), keys.size(), fill, par(threads).threads());
+    }
+
+    /**
+    Funcin que sustituye el contenido del rbol por las keys de un fichero de texto (separadas por espacios o saltos de lnea).
+    Como el rbol va a estar entero en memoria, las keys tambin caben y se ordenan en memoria en vez de con una ordenacin externa.
+
+    Error: Si no se puede abrir el fichero, lanza una excepcin E_BTree_File
+    Error: Si sorted es true y las keys no estn ordenadas, lanza una excepcin E_BTree_Unsorted
+
+    @param path ruta del fichero
+    @param fill fraccin de cada nodo que se llena
+    @param sorted indica si las keys del fichero ya estn ordenadas (si no, se ordenan en paralelo)
+    @param threads nmero de hilos para ordenar y construir (0 para usar tantos como ncleos)
+    */
+    void bulk_load_file(const string& path, double fill = 1.0, bool sorted = true, unsigned threads = 0) {
+        ifstream fe(path.c_str());
+        if (!fe.is_open()) throw E_BTree_File();
+
+        vector<T> keys;
+        T k;
+        while (fe >> k) keys.push_back(k);
+
+        if (sorted) bulk_load(par(threads), keys.begin(), keys.end(), fill);
+        else bulk_load_unsorted(keys.begin(), keys.end(), fill, threads);
     }
 
 private:
 
+    template <class U>
+    friend class BTreeSnapshot; // Recorre los nodos para guardarlos (Snapshot.h)
+
+    /** Mximo de keys de cada nodo: con el orden fijado al compilar es una constante y las comparaciones con los
+    nodos llenos y los clculos de t no leen _size */
+    int maxElems() const {
+        return node_type::fixedOr(_size);
+    }
+
+    /**
+    Nivel de un camino desde la raz: el nodo y las keys de su padre que acotan las keys que puede tener.
+    La raz (y los nodos ms a la izquierda o a la derecha de cada nivel) no tienen alguna de las cotas.
+    */
+    struct Level {
+
+        Level(node_type* node) : _node(node), _has_lo(false), _has_hi(false), _lo(), _hi() {}
+
+        /** Indica si k est dentro de las cotas del nodo
+
+        @param k key a comprobar
+        @param inclusive si es true, k puede ser igual a las cotas
+
+        @return true si k est dentro de las cotas
+        */
+        bool holds(const T& k, bool inclusive) const {
+            if (inclusive) return (!_has_lo || !(k < _lo)) && (!_has_hi || !(_hi < k));
+            return (!_has_lo || _lo < k) && (!_has_hi || k < _hi);
+        }
+
+        /** Devuelve el nivel del hijo i del nodo, con sus cotas
+
+        @param i posicin del hijo
+
+        @return el nivel del hijo
+        */
+        Level child(int i) const {
+            Level l(_node->_child[i]);
+            l._has_lo = i > 0 || _has_lo;
+            l._lo = i > 0 ? _node->_elems[i - 1] : _lo;
+            l._has_hi = i < _node->_n_elems || _has_hi;
+            l._hi = i < _node->_n_elems ? _node->_elems[i] : _hi;
+            return l;
+        }
+
+        node_type* _node; // nodo
+        bool _has_lo;   // indica si hay cota inferior
+        bool _has_hi;   // indica si hay cota superior
+        T _lo;          // cota inferior
+        T _hi;          // cota superior
+    };
+
     /**
-    Funcin usada cuando se quiere aadir k a un nodo que est lleno, este se parte en dos y tanto la particin como el nodo quedan colgando 
-    del padre (que es el parmetro x), manteniendo el orden dentro de los rboles.
+    Funcin que parte la raz (que est llena): se crea una nueva raz con la antigua como nico hijo y se le hace split.
+    */
+    void splitRoot() {
+        node_type* r = _root; // Me guardo la raz actual
 
-    @param i posicin que ocupa el nodo que queremos partir dentro de los hijos del padre
-    @param x nodo padre del que queremos partir
+        node_type* s = _alloc.allocate(false); // Creo un nuevo nodo
+        s->_n_elems = 0; // Le asigno que tiene 0 keys
+        s->_child[0] = r; // La antigua raz es su hijo
+
+        s->splitChild(0, _alloc); // Parto la raz y aado 1 de sus elementos a la nueva raz
+        s->recount();
+        _root = s; // s es el nuevo nodo raz
+        _alloc.stats().count(STAT_ROOT_SPLIT);
+    }
+
+    /**
+    Funcin que inserta k bajando desde el ltimo nodo del camino (que no est lleno), igual que insert_nonfull pero sin
+    recursin y aadiendo al camino los nodos por los que pasa.
+
+    @param path camino desde la raz, su ltimo nodo no est lleno y su rango contiene a k
+    @param k elemento a insertar
     */
-    void splitChild(int i, Node<T>* x) {
-        Node<T>* y = x->_child[i]; // y es el hijo i de x
-        Node<T>* z = new Node<T>(y->_max_elems, y->_is_leaf); // Creacin de un nuevo nodo donde van a guardar la mitad de las keys de y
-        int t = (x->_max_elems + 1) / 2; // Mitad del total de hijos que tiene y (se supone que est lleno)
-        z->_n_elems = t - 1; // z tiene la mitad de keys de y
+    void insertFrom(vector<Level>& path, const T& k) {
+        node_type* x = path.back()._node;
+        while (!x->_is_leaf) {
+            int i = keyUpperBound(x->_elems, x->_n_elems, k); // Hijo que tendr a k
+            if (x->_child[i]->_n_elems == maxElems()) { // Si est lleno le hacemos split
+                x->splitChild(i, _alloc);
+                if (x->_elems[i] < k) i++; // y comprobamos en cul de las dos partes ir k
+            }
+            path.push_back(path.back().child(i));
+            x = path.back()._node;
+        }
 
-        for (int j = 0; j < t - 1; j++) { // Metemos la mitad de los elementos de y en z (los ms grandes)
-            z->_elems[j] = y->_elems[j + t];
+        int i = keyUpperBound(x->_elems, x->_n_elems, k); // Posicin de la primera key mayor que k
+        for (int j = x->_n_elems; j > i; j--) { // desplazamos las keys mayores que k
+            x->_elems[j] = x->_elems[j - 1];
+        }
+        if (x->_n_dead > 0) x->shiftDeadRight(i); // las lpidas se desplazan con sus keys
+        x->_elems[i] = k; // insertamos la key
+        x->_n_elems += 1;
+        if constexpr (node_type::counted) {
+            for (size_t j = 0; j < path.size(); j++) path[j]._node->addCount(1); // Todo el camino gana una key
         }
+    }
 
-        if (!y->_is_leaf) { // Si y no es hoja
-            for (int j = 0; j < t; j++) { // Pasamos la mitad de sus hijos a z
-                z->_child[j] = y->_child[j + t];
+    /**
+    Funcin que elimina k bajando desde el ltimo nodo del camino, igual que Node::remove pero sin recursin y aadiendo
+    al camino los nodos por los que pasa. Antes de bajar a un hijo se asegura de que tenga al menos t keys.
+    Una key borrada con remove_lazy cuenta como que no est.
+
+    @param path camino desde la raz, su ltimo nodo es la raz o tiene al menos t keys, y su rango contiene a k
+    @param k elemento a eliminar
+
+    @return true si k estaba en el rbol
+    */
+    bool removeFrom(vector<Level>& path, T k) {
+        int t = (maxElems() + 1) / 2; // Mitad del mximo de hijos
+        node_type* x = path.back()._node;
+        size_t replaced = 0; // Si k se ha sustituido por su predecesor o sucesor, nodos del camino hasta el que lo tiene
+        while (true) {
+            int i = keyLowerBound(x->_elems, x->_n_elems, k); // Posicin de la primera key mayor o igual que k
+            bool found = i < x->_n_elems && x->_elems[i] == k;
+            if (found && replaced == 0 && x->_n_dead > 0 && x->isDead(i)) return false; // Borrada con remove_lazy
+
+            if (x->_is_leaf) { // En una hoja, o est aqu o no est en el rbol
+                if constexpr (node_type::counted) {
+                    size_t n = path.size(); // Todo el camino pierde una key,
+                    if (replaced > 0 && found && x->isDead(i)) n = replaced; // salvo por debajo del sustituto si era una lpida
+                    if (found) for (size_t j = 0; j < n; j++) path[j]._node->addCount(-1);
+                }
+                if (found) x->removeFromLeaf(i);
+                return found;
             }
+
+            if (found) { // Est en este nodo que no es hoja
+                bool dead = false;
+                if (x->_child[i]->_n_elems >= t) { // Lo cambiamos por su predecesor y seguimos para borrar el predecesor
+                    k = x->getPred(i, &dead);
+                    x->_elems[i] = k;
+                    replaced = path.size();
+                }
+                else if (x->_child[i + 1]->_n_elems >= t) { // O por su sucesor
+                    k = x->getSucc(i, &dead);
+                    x->_elems[i] = k;
+                    replaced = path.size();
+                }
+                else { // O unimos los dos hijos y k baja al hijo i
+                    x->merge(i, _alloc);
+                }
+                if (dead) { // La lpida del sustituto sube con l
+                    x->setDead(i, true);
+                    x->_n_dead++;
+                }
+                if (replaced == path.size() && x->_child[i]->_n_elems < t) i++; // Si se ha cambiado por el sucesor, se sigue por l
+            }
+            else { // Est en el hijo i, que rellenamos si tiene menos de t keys
+                bool is_in_last = (i == x->_n_elems);
+                if (x->_child[i]->_n_elems < t) x->fill(i, _alloc);
+                if (is_in_last && i > x->_n_elems) i--; // Si el ltimo hijo ha hecho merge, lo ha hecho con el anterior
+            }
+
+            path.push_back(path.back().child(i));
+            x = path.back()._node;
         }
-        y->_n_elems = t - 1; // y pasa a tener la mitad de elemntos
+    }
+
+    /** bulk_load con iteradores de acceso aleatorio: se comprueba el orden y se construye sin copiar las keys */
+    template <class It>
+    void bulk_load(It first, It last, double fill, random_access_iterator_tag) {
+        if (!is_sorted(first, last)) throw E_BTree_Unsorted();
+        build(first, (size_t)(last - first), fill);
+    }
+
+    /** bulk_load con cualquier otro iterador: hace falta saber cuntas keys hay antes de empezar, as que se copian */
+    template <class It>
+    void bulk_load(It first, It last, double fill, input_iterator_tag) {
+        vector<T> keys(first, last);
+        bulk_load(keys.begin(), keys.end(), fill, random_access_iterator_tag());
+    }
+
+    /**
+    Funcin que sustituye el contenido del rbol por n keys ordenadas, construyndolo nivel a nivel de abajo a arriba.
+
+    @param first iterador de acceso aleatorio a la primera key
+    @param n nmero de keys
+    @param fill fraccin de cada nodo que se llena
+    @param threads nmero de hilos con los que se rellenan los nodos de cada nivel
+    */
+    template <class It>
+    void build(It first, size_t n, double fill, unsigned threads = 1) {
+        int t = (maxElems() + 1) / 2; // Mitad del mximo de hijos
+        int cap = (int)(fill * maxElems() + 0.5); // Keys por nodo que queremos
+        if (cap > maxElems()) cap = maxElems();
+        if (cap < t - 1) cap = t - 1;
+        if (cap < 1) cap = 1;
+
+        releaseNodes();
+
+        vector<node_type*> nodes, children;
+        vector<T> seps, keys;
+        buildLevel(first, n, children, cap, seps, nodes, threads); // Hojas
+        while (nodes.size() > 1) { // Cada nivel interno se hace con los nodos y separadores del de debajo
+            children.swap(nodes);
+            keys.swap(seps);
+            buildLevel(keys.begin(), keys.size(), children, cap, seps, nodes, threads);
+        }
+        _root = nodes[0];
+        _keys = n;
+    }
+
+    /**
+    Funcin que construye un nivel del rbol. El nivel tiene n keys repartidas lo ms igualado posible entre los nodos,
+    y entre cada dos nodos consecutivos queda una key que los separa (y que va al nivel de arriba).
+
+    Como el nodo j empieza en la key j * per + min(j, extra) + j (sus keys, ms los separadores de los anteriores) y
+    su primer hijo tiene ese mismo ndice, cada nodo se puede rellenar sin recorrer los anteriores: los nodos se
+    reservan primero en un solo hilo y se rellenan por tramos de BUILD_CHUNK en paralelo.
+
+    @param keys iterador de acceso aleatorio a la primera de las n keys del nivel (en orden)
+    @param n nmero de keys del nivel, contando los separadores
+    @param children nodos del nivel de debajo (n + 1) o vaco si el nivel es de hojas
+    @param cap nmero de keys que queremos en cada nodo
+    @param seps (salida) separadores entre los nodos del nivel
+    @param nodes (salida) nodos del nivel
+    @param threads nmero de hilos
+    */
+    template <class It>
+    void buildLevel(It keys, size_t n, const vector<node_type*>& children, int cap, vector<T>& seps, vector<node_type*>& nodes, unsigned threads) {
+        bool leaf = children.empty();
+        size_t p = levelNodes(n, cap); // Nmero de nodos del nivel
+        size_t per = (n - (p - 1)) / p, extra = (n - (p - 1)) % p; // Keys por nodo (los primeros 'extra' tienen una ms)
+
+        nodes.resize(p);
+        for (size_t j = 0; j < p; j++) nodes[j] = _alloc.allocate(leaf);
+        seps.resize(p - 1);
+
+        size_t chunks = (p + BUILD_CHUNK - 1) / BUILD_CHUNK;
+        WorkPool::shared(threads).run(chunks, [&](size_t c) {
+            size_t last = min(p, (c + 1) * BUILD_CHUNK);
+            for (size_t j = c * BUILD_CHUNK; j < last; j++) {
+                node_type* x = nodes[j];
+                size_t start = j * per + min(j, extra) + j; // ndice de su primera key y de su primer hijo
+                int m = (int)(per + (j < extra ? 1 : 0));
+                It k = keys + start;
+                for (int i = 0; i < m; i++, ++k) x->_elems[i] = *k;
+                if (!leaf) {
+                    for (int i = 0; i <= m; i++) x->_child[i] = children[start + i];
+                }
+                x->_n_elems = m;
+                x->recount(); // El nivel de debajo ya est completo
+                if (j + 1 < p) seps[j] = *k; // La key siguiente separa este nodo del siguiente
+            }
+        });
+    }
+
+    /**
+    Funcin que calcula cuntos nodos tiene un nivel con n keys (incluidos los separadores) si queremos cap keys por nodo,
+    sin que ninguno quede con menos del mnimo de t - 1 keys.
+
+    @param n nmero de keys del nivel
+    @param cap nmero de keys que queremos en cada nodo
+
+    @return nmero de nodos del nivel
+    */
+    size_t levelNodes(size_t n, int cap) const {
+        size_t min = (maxElems() + 1) / 2 - 1; // Mnimo de keys de un nodo que no es la raz
+        size_t p = (n + cap + 1) / (cap + 1); // p nodos con cap keys y p - 1 separadores
+        while (p > 1 && (n - (p - 1)) / p < min) p--;
+        return p;
+    }
+
+    typedef NodeStep<node_type> Step;
+
+    /**
+    Funcin que recorre el subrbol con raz x, aplicando f a sus keys en orden creciente (con inOrder), saltndose
+    las borradas con remove_lazy.
+
+    @param x raz del subrbol a recorrer
+    @param f funcin que recibe cada key
+    */
+    template <class F>
+    static void forEach(node_type* x, F& f) {
+        inOrder(x, [&f](const node_type* y, int i) {
+            if (y->_n_dead == 0 || !y->isDead(i)) f(y->_elems[i]);
+        });
+    }
+
+    /**
+    Funcin que busca k en el subrbol con raz x, contando en las estadsticas los nodos que visita y sus keys.
+
+    @param x raz del subrbol donde buscar
+    @param k elemento a buscar
+
+    @return el nodo donde se encuentra la clave o NULL en caso de no encontrarla.
+    */
+    node_type* search(node_type* x, T k) {
+        Stats& stats = _alloc.stats();
+        stats.count(STAT_SEARCH);
+        while (true) {
+            stats.count(STAT_SEARCH_NODES);
+            stats.count(STAT_SEARCH_KEYS, x->_n_elems);
+            int i = keyLowerBound(x->_elems, x->_n_elems, k); // Buscamos el primer ndice i cuya clave cumpla k <= key
+
+            if (i < x->_n_elems && k == x->_elems[i]) { // Si he encontrado el elemento
+                return (x->_n_dead > 0 && x->isDead(i)) ? NULL : x; // Una lpida cuenta como no encontrado
+            }
+
+            if (x->_is_leaf) { // Si el nodo es hoja
+                return NULL;
+            }
+
+            x = x->_child[i]; //  En otro caso, miro el hijo del index conseguido anteriormente
+        }
+    }
+
+    /**
+    Funcin que libera todos los nodos del rbol (el rbol se queda sin raz).
+    Si la poltica de reserva puede liberarlo todo de golpe y las keys no tienen destructor, no se recorre el rbol.
+    */
+    void releaseNodes() {
+        if (_root == NULL) return;
+        if (!(Alloc::releases_all && is_trivially_destructible<T>::value)) freeSubtree(_root);
+        _alloc.release();
+        _root = NULL;
+        _keys = 0;
+        _dead = 0;
+        _to_compact.clear();
+    }
+
+    /**
+    Funcin que libera uno a uno los nodos del subrbol con raz x.
 
-        for (int j = x->_n_elems + 1; j > i; j--) { // Movemos los hijos de x
-            x->_child[j + 1] = x->_child[j];
+    @param x raz del subrbol a liberar
+    */
+    void freeSubtree(node_type* x) {
+        PathStack<Step> path;
+        path.push(Step(x, 0));
+
+        while (!path.empty()) {
+            Step& s = path.top();
+            if (!s._node->_is_leaf && s._next <= s._node->_n_elems) { // Primero se liberan los hijos
+                node_type* c = s._node->_child[s._next++];
+                path.push(Step(c, 0));
+            }
+            else { // y despus el nodo
+                node_type* n = s._node;
+                path.pop();
+                _alloc.deallocate(n);
+            }
         }
-        x->_child[i + 1] = z; // z es hijo de x
+    }
 
-        for (int j = x->_n_elems - 1; j >= i; j--) { // movemos las keys de x
-            x->_elems[j + 1] = x->_elems[j];
+    /** Funcin que recalcula la cuenta del subrbol de todos los nodos, de las hojas hacia arriba */
+    void recountAll() {
+        PathStack<Step> path;
+        path.push(Step(_root, 0));
+        while (!path.empty()) {
+            Step& s = path.top();
+            if (!s._node->_is_leaf && s._next <= s._node->_n_elems) path.push(Step(s._node->_child[s._next++], 0));
+            else {
+                s._node->recount();
+                path.pop();
+            }
         }
+    }
+
+    /**
+    Funcin que busca k y, si est borrada con remove_lazy, le quita la lpida.
+
+    @param k elemento a buscar
+
+    @return true si k estaba borrada (y ya no lo est)
+    */
+    bool revive(const T& k) {
+        int i;
+        node_type* x = locate(k, i);
+        if (x == NULL || !x->isDead(i)) return false;
+        x->setDead(i, false);
+        x->_n_dead--;
+        _dead--;
+        _root->addCountOnPath(k, 1);
+        return true;
+    }
+
+    /**
+    Funcin que busca k sin tener en cuenta las lpidas ni contar en las estadsticas.
 
-        x->_elems[i] = y->_elems[t - 1]; // Aadimos la key de en medio de y en x para que separe y de z
-        x->_n_elems += 1; // Aumentamos el nmero de elementos de x
+    @param k elemento a buscar
+    @param i (salida) posicin de k en el nodo devuelto
 
+    @return el nodo donde est k (aunque est borrada con remove_lazy) o NULL si no est
+    */
+    node_type* locate(const T& k, int& i) const {
+        node_type* x = _root;
+        while (true) {
+            i = keyLowerBound(x->_elems, x->_n_elems, k);
+            if (i < x->_n_elems && k == x->_elems[i]) return x;
+            if (x->_is_leaf) return NULL;
+            x = x->_child[i];
+        }
     }
 
     /**
@@ -512,36 +2033,54 @@ private:
     @param x nodo donde se desea realizar la insercin
     @param k elemento a insertar en el nodo
     */
-    void insert_nonfull(T k) {
-        int i = _root->_n_elems - 1; // Elementos que tiene el nodo actualmente
-        if (_root->_is_leaf) { // Si el nodo es hoja
-            while (i >= 0 && k < _root->_elems[i]) { // buscamos la nueva localizacin de key a ser insertada y desplazamos las mayores
-                _root->_elems[i + 1] = _root->_elems[i];
-                i--;
-            }
-            _root->_elems[i + 1] = k; // insertamos la key
-            _root->_n_elems += 1; // Aumentamos el nmero de keys que tiene el nodo
-        }
-        else { // Si el nodo no es una hoja
-            while (i >= 0 && k < _root->_elems[i]) { // Buscamos al hijo que tendr a k
-                i--;
-            }
-            i += 1;
-
-            if (_root->_child[i]->_n_elems == _size) { // Comprobamos si est lleno
-                splitChild(i, _root); // como est lleno, le hacemos split
-                
-                if (_root->_elems[i] < k) { // Al hacer el split, la key del medio del hijo sube y este se parte en dos,
+    void insert_nonfull(node_type* x, T k) {
+        while (!x->_is_leaf) { // Mientras el nodo no sea una hoja, bajamos al hijo que tendr a k
+            x->addCount(1); // Su subrbol gana una key
+            int i = keyUpperBound(x->_elems, x->_n_elems, k); // Posicin de la primera key mayor que k
+            if (x->_child[i]->_n_elems == maxElems()) { // Comprobamos si est lleno
+                x->splitChild(i, _alloc); // como est lleno, le hacemos split
+
+                if (x->_elems[i] < k) { // Al hacer el split, la key del medio del hijo sube y este se parte en dos,
                     i++;                //por lo que comprobamos en cual de las dos partes ir k
                 }
             }
-            BTree(_root->_child[i], _size).insert_nonfull(k);
+            x = x->_child[i];
         }
+
+        int i = keyUpperBound(x->_elems, x->_n_elems, k); // Posicin de la primera key mayor que k
+        for (int j = x->_n_elems; j > i; j--) { // desplazamos las keys mayores que k
+            x->_elems[j] = x->_elems[j - 1];
+        }
+        if (x->_n_dead > 0) x->shiftDeadRight(i); // las lpidas se desplazan con sus keys
+        x->_elems[i] = k; // insertamos la key
+        x->_n_elems += 1; // Aumentamos el nmero de keys que tiene el nodo
+        x->addCount(1);
     }
 
     /** Atributos */
-    Node<T> *_root; // Puntero que apunta al nodo raz
+    node_type *_root; // Puntero que apunta al nodo raz
     int _size; // Mximo de keys en cada nodo
+    StatsAllocator<Alloc, Stats> _alloc; // Poltica de reserva de los nodos (que cuenta en Stats)
+    size_t _keys; // Nmero de keys del rbol, contando las borradas con remove_lazy
+    size_t _dead; // Nmero de keys borradas con remove_lazy (lpidas) que an no se han quitado
+    double _dead_ratio; // Fraccin de lpidas de un nodo a partir de la cual se pide compactar
+    vector<T> _to_compact; // Una key de cada nodo que ha llegado a esa fraccin (ver compact_step)
 };
 
+/**
+  rbol-B con el mximo de keys por nodo fijado al compilar, por ejemplo FixedBTree<int, 63>. Guarda lo mismo que
+  BTree<T> y tiene las mismas operaciones, pero los lmites de los bucles de los nodos y las posiciones dentro de su
+  bloque son constantes. El constructor sin parmetros ya usa ORDER; BTree(size) solo acepta size == ORDER.
+  */
+template <class T, int ORDER, class Stats = NoStats>
+using FixedBTree = BTree<T, NodePool<Node<T, void, ORDER> >, Stats>;
+
+/**
+  rbol-B en el que cada nodo lleva la cuenta de las keys de su subrbol, as que rank, select y count cuestan
+  O(m log n) en vez de recorrer el rbol. Cada insercin o borrado actualiza las cuentas del camino y los split,
+  merge y prstamos recalculan las de los nodos que tocan. Los dems rboles no llevan la cuenta y no pagan nada.
+  */
+template <class T, class Stats = NoStats>
+using CountedBTree = BTree<T, NodePool<Node<T, void, 0, true> >, Stats>;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,358 @@
+/*
+- Representacin de un mapa (key -> valor) sobre un rbol-B
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __BTREEMAP_H
+#define __BTREEMAP_H
+
+#include <cstddef>
+#include <utility>
+#include "BTree.h"
+
+/**
+
+Clase que representa a un mapa ordenado de keys sin repetir a valores, guardado en un rbol-B.
+
+Cada nodo es un Node<K, V>: las keys en un array y los valores en otro justo detrs, as que las bsquedas
+solo recorren keys. Al partir, unir o prestar keys entre nodos (las mismas funciones de Node que usa BTree)
+los valores se mueven junto con sus keys, nunca se copian.
+
+Igual que en BTree, la memoria de los nodos la gestiona la poltica de reserva Alloc (ver NodePool.h).
+Al crear un nodo se construyen por defecto todos sus huecos de valores (ver Node::construct), no solo los usados,
+as que V tiene que tener constructor por defecto y asignacin de movimiento: insertar asigna el valor a un hueco
+que ya tiene un valor construido, y eliminar deja en el hueco un V() para liberar lo que tuviera el valor.
+
+@author lvaro Corrochano Lpez
+
+*/
+template <class K, class V, class Alloc = NodePool<Node<K, V> > >
+class BTreeMap {
+
+public:
+
+    typedef Node<K, V> node_type;
+
+    /** Constructor vaco, tamao de las keys con tamao por defecto (= 3)
+        Complejidad: O(1)
+    */
+    BTreeMap() : _root(NULL), _size(DEFAULT_SIZE), _count(0), _alloc(DEFAULT_SIZE) {
+        _root = _alloc.allocate(true);
+    }
+
+    /**
+    Constructor vaco especificando el tamao
+
+    Error: Si el tamao especificado es menor que 2, lanza una excepcin E_BTree_Lower
+    Error: Si el tamao especificado es mayor que 1000, lanza una excepcin E_BTree_Bigger
+
+    @param size nmero mximo de keys que puede almacenar el nodo
+    */
+    BTreeMap(int size) : _root(NULL), _size(size), _count(0), _alloc(size) {
+        if (size < MIN_SIZE) throw E_BTree_Lower();
+        if (size > MAX_SIZE) throw E_BTree_Bigger();
+
+        _root = _alloc.allocate(true);
+    }
+
+    /** El mapa es dueo de sus nodos, as que no se puede copiar (solo mover) */
+    BTreeMap(const BTreeMap&) = delete;
+    BTreeMap& operator=(const BTreeMap&) = delete;
+
+    /** Constructor de movimiento, el mapa movido se queda sin nodos y solo se puede destruir */
+    BTreeMap(BTreeMap&& other) : _root(other._root), _size(other._size), _count(other._count), _alloc(std::move(other._alloc)) {
+        other._root = NULL;
+    }
+
+    /** Asignacin de movimiento, los nodos que tuviera este mapa se liberan */
+    BTreeMap& operator=(BTreeMap&& other) {
+        if (this != &other) {
+            releaseNodes();
+            _root = other._root;
+            _size = other._size;
+            _count = other._count;
+            _alloc = std::move(other._alloc);
+            other._root = NULL;
+        }
+        return *this;
+    }
+
+    /** Destructor, libera todos los nodos (y los valores) */
+    ~BTreeMap() {
+        releaseNodes();
+    }
+
+    /** Elimina todas las keys y valores y libera los nodos */
+    void clear() {
+        releaseNodes();
+        _root = _alloc.allocate(true);
+        _count = 0;
+    }
+
+    /** Devuelve el nmero mximo de keys que puede almacenar un nodo del rbol
+
+    @return nmero mximo de keys que puede almacenar un nodo del rbol
+    */
+    int n_keys() const {
+        return _size;
+    }
+
+    /** Devuelve el nmero de keys guardadas en el mapa
+
+    @return nmero de keys del mapa
+    */
+    size_t size() const {
+        return _count;
+    }
+
+    /** Indica si el mapa est o no vaco
+
+    @return true si el mapa est vaco y false si no lo est
+    */
+    bool isEmpty() const {
+        return _count == 0;
+    }
+
+    /**
+    Busca el valor asociado a una key.
+    Complejidad: O(log n)
+
+    @param k key buscada
+
+    @return puntero al valor (se puede modificar) o NULL si la key no est
+    */
+    V* find(const K& k) const {
+        node_type* x = _root;
+        while (true) {
+            int i = keyLowerBound(x->_elems, x->_n_elems, k); // Primer ndice i cuya key cumpla k <= key
+            if (i < x->_n_elems && x->_elems[i] == k) return &x->values()[i];
+            if (x->_is_leaf) return NULL;
+            x = x->_child[i];
+        }
+    }
+
+    /**
+    Inserta la key con el valor V(args...) si la key no est; si ya est no hace nada (y args no se usan, as que un
+    valor pasado con std::move no se pierde).
+    A diferencia de std::map::try_emplace el valor no se construye en el sitio: se construye un temporal que se
+    asigna por movimiento al hueco del nodo, que ya tiene un valor construido por defecto.
+
+    @param k key
+    @param args argumentos para construir el valor
+
+    @return puntero al valor de la key y true si se ha insertado (false si ya estaba)
+    */
+    template <class... Args>
+    pair<V*, bool> try_emplace(const K& k, Args&&... args) {
+        pair<V*, bool> r = insertSlot(k);
+        if (r.second) *r.first = V(std::forward<Args>(args)...);
+        return r;
+    }
+
+    /**
+    Inserta la key con el valor v, o sustituye su valor si ya estaba. El valor se mueve si se pasa como rvalue.
+
+    @param k key
+    @param v valor
+
+    @return puntero al valor de la key y true si se ha insertado (false si se ha sustituido)
+    */
+    template <class M>
+    pair<V*, bool> insert_or_assign(const K& k, M&& v) {
+        pair<V*, bool> r = insertSlot(k);
+        *r.first = std::forward<M>(v);
+        return r;
+    }
+
+    /**
+    Devuelve el valor de la key, insertndola con un valor por defecto si no estaba.
+
+    @param k key
+
+    @return el valor de la key
+    */
+    V& operator[](const K& k) {
+        pair<V*, bool> r = insertSlot(k);
+        if (r.second) *r.first = V(); // El hueco puede tener un valor ya movido
+        return *r.first;
+    }
+
+    /**
+    Funcin para eliminar una key (y su valor) del mapa.
+    Como en Node::remove, cada hijo con menos de t keys se rellena antes de bajar a l, pero la bajada es un bucle
+    y, cuando la key est en un nodo interno, su sustituta (predecesora o sucesora) sube con su valor.
+
+    @param k key a eliminar
+
+    @return true si la key estaba en el mapa (y se ha eliminado)
+    */
+    bool erase(const K& k) {
+        int t = (_size + 1) / 2; // Mitad del mximo de hijos
+        node_type* x = _root;
+
+        while (true) {
+            int i = keyLowerBound(x->_elems, x->_n_elems, k);
+
+            if (i < x->_n_elems && x->_elems[i] == k) { // Si la key est en este nodo
+                if (x->_is_leaf) {
+                    x->values()[i] = V(); // Liberamos el valor ya (si es el ltimo no se sobrescribe al desplazar)
+                    x->removeFromLeaf(i);
+                    _count--;
+                    return true;
+                }
+                if (x->_child[i]->_n_elems >= t) { // Subimos el predecesor
+                    replaceWithExtreme(x, i, x->_child[i], true);
+                    _count--;
+                    return true;
+                }
+                if (x->_child[i + 1]->_n_elems >= t) { // Subimos el sucesor
+                    replaceWithExtreme(x, i, x->_child[i + 1], false);
+                    _count--;
+                    return true;
+                }
+                x->merge(i, _alloc); // k baja al hijo i junto con todas las keys del hijo i + 1
+            }
+            else {
+                if (x->_is_leaf) return false; // La key no est
+
+                bool is_in_last = (i == x->_n_elems);
+                if (x->_child[i]->_n_elems < t) x->fill(i, _alloc);
+                if (is_in_last && i > x->_n_elems) i--; // El ltimo hijo se ha unido con el anterior
+            }
+
+            if (x == _root && x->_n_elems == 0) { // La raz se ha quedado sin keys, su nico hijo pasa a ser la raz
+                _root = x->_child[0];
+                _alloc.deallocate(x);
+                x = _root;
+            }
+            else x = x->_child[i];
+        }
+    }
+
+    /**
+    Funcin que aplica f a cada key del mapa, en orden creciente (igual que for_each de los rboles, as que sirve
+    para exportKeys).
+
+    @param f funcin que recibe cada key (const K&)
+    */
+    template <class F>
+    void for_each(F f) const {
+        forEach([&f](const K& k, V&) { f(k); });
+    }
+
+    /**
+    Funcin para recorrer el mapa, va sacando las parejas key:valor en orden creciente de key.
+
+    @param out flujo en el que se sacan (por defecto la salida estndar)
+    */
+    void traverse(ostream& out = cout) const {
+        forEach([&out](const K& k, V& v) { out << " " << k << ":" << v; });
+    }
+
+private:
+
+    /**
+    Funcin que busca la key y, si no est, la inserta (con el valor por defecto) partiendo los nodos llenos de la
+    bajada como BTree::insert.
+
+    @param k key
+
+    @return puntero al valor de la key y true si se ha insertado
+    */
+    pair<V*, bool> insertSlot(const K& k) {
+        if (_root->_n_elems == _size) { // Si la raz est llena la partimos y el rbol crece
+            node_type* s = _alloc.allocate(false);
+            s->_child[0] = _root;
+            s->splitChild(0, _alloc);
+            _root = s;
+        }
+
+        node_type* x = _root;
+        while (true) {
+            int i = keyLowerBound(x->_elems, x->_n_elems, k);
+            if (i < x->_n_elems && x->_elems[i] == k) return pair<V*, bool>(&x->values()[i], false);
+
+            if (x->_is_leaf) {
+                for (int j = x->_n_elems; j > i; j--) node_type::moveElem(x, j, x, j - 1); // desplazamos las keys mayores que k
+                x->_elems[i] = k;
+                x->_n_elems += 1;
+                _count++;
+                return pair<V*, bool>(&x->values()[i], true);
+            }
+
+            if (x->_child[i]->_n_elems == _size) { // Si el hijo est lleno le hacemos split
+                x->splitChild(i, _alloc);
+                if (x->_elems[i] == k) return pair<V*, bool>(&x->values()[i], false); // La key que ha subido era k
+                if (x->_elems[i] < k) i++;
+            }
+            x = x->_child[i];
+        }
+    }
+
+    /**
+    Funcin que sustituye la key i de x por la mayor (o la menor) key del subrbol con raz c, con su valor, y la
+    elimina de ah. Baja rellenando los hijos con menos de t keys igual que erase.
+
+    @param x nodo con la key que se sustituye
+    @param i posicin de la key en x
+    @param c hijo (con al menos t keys) del que se saca la key
+    @param max true para sacar el predecesor (la mayor key de c), false para el sucesor (la menor)
+    */
+    void replaceWithExtreme(node_type* x, int i, node_type* c, bool max) {
+        int t = (_size + 1) / 2;
+        node_type* y = c;
+        while (!y->_is_leaf) {
+            int j = max ? y->_n_elems : 0;
+            if (y->_child[j]->_n_elems < t) y->fill(j, _alloc);
+            if (max && j > y->_n_elems) j--; // El ltimo hijo se ha unido con el anterior
+            y = y->_child[j];
+        }
+
+        int j = max ? y->_n_elems - 1 : 0;
+        node_type::moveElem(x, i, y, j);
+        y->removeFromLeaf(j);
+    }
+
+    /** Aplica f(key, valor) a cada pareja del mapa en orden creciente de key (con inOrder, igual que BTree) */
+    template <class F>
+    void forEach(F f) const {
+        inOrder(_root, [&f](node_type* x, int i) { f(x->_elems[i], x->values()[i]); });
+    }
+
+    /**
+    Funcin que libera todos los nodos del mapa (el mapa se queda sin raz).
+    Si la poltica de reserva puede liberarlo todo de golpe y ni las keys ni los valores tienen destructor, no se recorre el rbol.
+    */
+    void releaseNodes() {
+        if (_root == NULL) return;
+        if (!(Alloc::releases_all && is_trivially_destructible<K>::value && is_trivially_destructible<V>::value)) freeSubtree(_root);
+        _alloc.release();
+        _root = NULL;
+    }
+
+    /** Libera uno a uno los nodos del subrbol con raz x */
+    void freeSubtree(node_type* x) {
+        PathStack<NodeStep<node_type> > path;
+        path.push(NodeStep<node_type>(x, 0));
+
+        while (!path.empty()) {
+            NodeStep<node_type>& s = path.top();
+            if (!s._node->_is_leaf && s._next <= s._node->_n_elems) { // Primero los hijos y despus el nodo
+                node_type* c = s._node->_child[s._next++];
+                path.push(NodeStep<node_type>(c, 0));
+            }
+            else {
+                node_type* n = s._node;
+                path.pop();
+                _alloc.deallocate(n);
+            }
+        }
+    }
+
+    node_type* _root; // Puntero que apunta al nodo raz
+    int _size;        // Nmero mximo de keys por nodo
+    size_t _count;    // Nmero de keys del mapa
+    Alloc _alloc;     // Poltica de reserva de los nodos
+};
+
+#endif
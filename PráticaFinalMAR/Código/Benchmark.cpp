@@ -0,0 +1,800 @@
+/*
+lvaro Corrochano Lpez
+
+Mide el tiempo de las operaciones del rbol y genera ficheros .dat como los de Data (insert.dat, search.dat y
+delete.dat): lneas "operaciones segundos" con el tiempo acumulado, para pintarlas con gnuplot.
+
+Cada medida se repite varias veces tras una ejecucin de calentamiento que no cuenta, con un reloj montono
+(steady_clock) de resolucin de nanosegundos, y tambin se mide cada operacin por separado para dar la mediana
+(p50) y el percentil 99 (p99) de su duracin y las operaciones por segundo.
+
+Las keys de las operaciones siguen una distribucin:
+  sec:  0, 1, 2, ..., n - 1 en orden
+  unif: uniforme en [0, n)
+  zipf: Zipf (s = 0.99) en [0, n), unas pocas keys se repiten muchsimo (las ms frecuentes no son las ms pequeas)
+Las bsquedas y eliminaciones se hacen sobre un rbol con las keys 0..n-1 insertadas en orden aleatorio.
+
+Uso:
+  Benchmark <i|s|d|l|f> [n = 50000] [orden = 3] [paso = 1] [dist = unif] [reps = 5]
+    Una curva: el tiempo acumulado (mediana de las repeticiones) cada paso operaciones, por la salida estndar.
+    Con l las eliminaciones son con lpidas (remove_lazy), sin reequilibrar el rbol.
+    Con f las bsquedas son en el ndice congelado del rbol (freeze, FrozenBTree.h).
+    En la salida de error, p50, p99 y operaciones por segundo.
+  Benchmark data [carpeta = .] [reps = 5]
+    Regenera en la carpeta los .dat de Data: insert, search y delete con 50000, 10000 (2) y 30000 (3) keys, orden 3.
+  Benchmark barrido [fichero = barrido.dat] [reps = 3] [n ...]
+    Barre el orden (de 2 a MAX_SIZE), el nmero de keys (por defecto 10000 y 100000) y las tres distribuciones
+    para las tres operaciones, y escribe una lnea por combinacin: operacin, distribucin, orden, n, p50 (ns),
+    p99 (ns) y operaciones por segundo. Sirve para comparar dos versiones del rbol y detectar si algo va ms lento.
+  Benchmark comprimido [n = 1000000] [reps = 5]
+    Compara BTree (orden 64) con CompressedBTree sobre n IDs ordenados (enteros de 64 bits con huecos pequeos y
+    strings "user:" seguidos del ID con ceros delante): bytes por key, keys por GB y tiempo medio de bsqueda.
+  Benchmark exportar [n = 10000000] [carpeta]
+    Saca las n keys de un BTree (orden 64) con traverse (operator<< por key) y con exportKeys en texto y en binario
+    (KeyExport.h): segundos, nanosegundos por key y MB/s de cada forma. Sin carpeta se escriben en /dev/null; con
+    ella, en claves_traverse.txt, claves.txt y claves.bin (cada forma en su fichero, porque sobrescribir uno que
+    an se est pasando a disco hace esperar a la siguiente).
+  Benchmark instantanea [n = 10000000] [fichero = instantanea.snap]
+    Guarda un BTree (orden 64) con n keys en una instantnea (Snapshot.h) y compara abrirla y buscar en ella
+    directamente con reconstruir el rbol a partir de ella: segundos de cada paso y tiempo medio de bsqueda.
+  Benchmark orden [n = 1000000] [reps = 3]
+    Compara BTree(orden) con FixedBTree<orden> (orden fijado al compilar) insertando, buscando y borrando n keys.
+  Benchmark lotes [n = 20000000] [reps = 3]
+    Compara buscar un milln de keys dispersas de una en una, con search_batch y con search_many.
+  Benchmark posiciones [n = 1000000] [reps = 3]
+    Compara BTree con CountedBTree (insertar y borrar) y rank y select con contar recorriendo el rbol.
+  Benchmark congelado [reps = 5]
+    Compara buscar en el rbol y en su ndice congelado (freeze) con las cargas de search.dat, search2.dat y
+    search3.dat (orden 3) y con 10 millones de keys (rdenes 3 y 64): nanosegundos por bsqueda y bytes por key.
+
+*/
+
+#include "BTree.h"
+#include "CompressedBTree.h"
+#include "FrozenBTree.h"
+#include "KeyExport.h"
+#include "Snapshot.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+/** Distribucin de las keys de las operaciones */
+enum Dist { SEQUENTIAL, UNIFORM, ZIPF };
+
+/** Exponente de la distribucin de Zipf */
+const double ZIPF_S = 0.99;
+
+/** rdenes del barrido (de MIN_SIZE a MAX_SIZE). Con orden 2 el rbol degenera: al partir, un nodo interno se queda
+    sin keys, as que con keys en orden la altura crece linealmente y la raz puede quedarse vaca (isEmpty da true) */
+const int SWEEP_ORDERS[] = { MIN_SIZE, 3, 4, 8, 16, 32, 64, 128, 256, 512, MAX_SIZE };
+
+/** Orden del BTree con el que se compara CompressedBTree */
+const int COMPRESSED_ORDER = 64;
+
+/** Nombre de cada distribucin */
+const char* DIST_NAMES[] = { "sec", "unif", "zipf" };
+
+
+/** Resultado de medir una serie de operaciones */
+struct Result {
+	vector<double> _latency;    // duracin de cada operacin de todas las repeticiones (ns)
+	vector<double> _cumulative; // tiempo acumulado cada paso operaciones (s, mediana de las repeticiones)
+	double _seconds;            // duracin de toda la serie (s, mediana de las repeticiones)
+};
+
+/**
+Segundos desde a.
+
+@param a instante de inicio
+
+@return segundos transcurridos
+*/
+double since(Clock::time_point a) {
+	return chrono::duration<double>(Clock::now() - a).count();
+}
+
+/**
+Mediana de un vector (lo desordena).
+
+@param v valores
+
+@return la mediana
+*/
+double median(vector<double>& v) {
+	nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+	return v[v.size() / 2];
+}
+
+/**
+Percentil p de un vector (lo desordena).
+
+@param v valores
+@param p percentil entre 0 y 1
+
+@return el valor del percentil
+*/
+double percentile(vector<double>& v, double p) {
+	size_t i = min(v.size() - 1, (size_t)(p * v.size()));
+	nth_element(v.begin(), v.begin() + i, v.end());
+	return v[i];
+}
+
+/**
+Keys de n operaciones segn la distribucin.
+
+@param d distribucin
+@param n nmero de operaciones (las keys estn en [0, n))
+@param rng generador de nmeros aleatorios
+
+@return las keys
+*/
+vector<int> makeKeys(Dist d, int n, mt19937& rng) {
+	vector<int> keys(n);
+	if (d == SEQUENTIAL) {
+		for (int i = 0; i < n; i++) keys[i] = i;
+	}
+	else if (d == UNIFORM) {
+		for (int i = 0; i < n; i++) keys[i] = (int)(rng() % (unsigned)n);
+	}
+	else { // Zipf: la key de rango r sale con probabilidad proporcional a 1 / r^s
+		vector<double> cdf(n);
+		double sum = 0;
+		for (int r = 0; r < n; r++) cdf[r] = sum += 1.0 / pow(r + 1.0, ZIPF_S);
+
+		vector<int> scramble(n); // Key de cada rango, para que las frecuentes no sean las ms pequeas
+		for (int i = 0; i < n; i++) scramble[i] = i;
+		shuffle(scramble.begin(), scramble.end(), rng);
+
+		uniform_real_distribution<double> u(0, sum);
+		for (int i = 0; i < n; i++) keys[i] = scramble[lower_bound(cdf.begin(), cdf.end(), u(rng)) - cdf.begin()];
+	}
+	return keys;
+}
+
+/**
+Mide una serie de n operaciones sobre un rbol de ese orden, con una ejecucin de calentamiento y reps repeticiones.
+
+@param action 'i', 's', 'd', 'l' o 'f'
+@param d distribucin de las keys
+@param n nmero de operaciones
+@param order orden del rbol (mximo de keys por nodo)
+@param reps repeticiones que cuentan
+@param step cada cuntas operaciones se guarda el tiempo acumulado
+
+@return las medidas
+*/
+Result measure(char action, Dist d, int n, int order, int reps, int step) {
+	Result res;
+	vector<vector<double> > cumulative(reps);
+	vector<double> seconds;
+
+	streambuf* out = cout.rdbuf();
+	cout.rdbuf(NULL); // remove avisa por cout de las keys que no estn
+
+	for (int rep = -1; rep < reps; rep++) { // La repeticin -1 es el calentamiento
+		mt19937 rng(rep + 2);
+		vector<int> keys = makeKeys(d, n, rng);
+
+		BTree<int> tree(order);
+		if (action != 'i') { // Las bsquedas y eliminaciones se hacen con las n keys ya insertadas
+			vector<int> fill(n);
+			for (int i = 0; i < n; i++) fill[i] = i;
+			shuffle(fill.begin(), fill.end(), rng);
+			for (int i = 0; i < n; i++) tree.insert(fill[i]);
+		}
+		FrozenBTree<int> frozen;
+		if (action == 'f') frozen = freeze(tree);
+
+		vector<double> cum;
+		volatile int found = 0; // Para que el compilador no quite las bsquedas
+		Clock::time_point start = Clock::now();
+		Clock::time_point prev = start;
+		for (int i = 0; i < n; i++) {
+			switch (action) {
+			case 'i':
+				tree.insert(keys[i]);
+				break;
+			case 's':
+				found = found + (tree.search(keys[i]) != NULL);
+				break;
+			case 'd':
+				if (!tree.isEmpty()) tree.remove(keys[i]);
+				break;
+			case 'l':
+				tree.remove_lazy(keys[i]);
+				break;
+			case 'f':
+				found = found + frozen.search(keys[i]);
+				break;
+			}
+			Clock::time_point now = Clock::now();
+			if (rep >= 0) {
+				res._latency.push_back(chrono::duration<double, nano>(now - prev).count());
+				if ((i + 1) % step == 0) cum.push_back(chrono::duration<double>(now - start).count());
+			}
+			prev = now;
+		}
+		if (rep >= 0) {
+			seconds.push_back(since(start));
+			cumulative[rep] = cum;
+		}
+	}
+	cout.rdbuf(out);
+
+	res._seconds = median(seconds);
+	for (size_t j = 0; j < cumulative[0].size(); j++) { // Mediana de cada punto de la curva
+		vector<double> v(reps);
+		for (int rep = 0; rep < reps; rep++) v[rep] = cumulative[rep][j];
+		res._cumulative.push_back(median(v));
+	}
+	return res;
+}
+
+/**
+Escribe una curva en formato .dat: "operaciones segundos" cada paso operaciones.
+
+@param f fichero
+@param res medidas
+@param step paso de la curva
+*/
+void writeCurve(FILE* f, const Result& res, int step) {
+	for (size_t j = 0; j < res._cumulative.size(); j++) fprintf(f, "%zu %.9f\n", (j + 1) * step, res._cumulative[j]);
+}
+
+/**
+Lee una distribucin de su nombre.
+
+@param s nombre ("sec", "unif" o "zipf")
+@param d a la salida, la distribucin
+
+@return false si el nombre no existe
+*/
+bool parseDist(const string& s, Dist& d) {
+	for (int i = 0; i < 3; i++) {
+		if (s == DIST_NAMES[i]) {
+			d = (Dist)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+Regenera los .dat de Data en una carpeta.
+
+@param dir carpeta
+@param reps repeticiones de cada medida
+
+@return 0 si todo ha ido bien
+*/
+int data(const string& dir, int reps) {
+	const char* names[] = { "insert", "search", "delete" };
+	const char actions[] = { 'i', 's', 'd' };
+	const int sizes[] = { 50000, 10000, 30000 };
+	const char* suffixes[] = { "", "2", "3" };
+
+	for (int a = 0; a < 3; a++) {
+		for (int s = 0; s < 3; s++) {
+			string path = dir + "/" + names[a] + suffixes[s] + ".dat";
+			FILE* f = fopen(path.c_str(), "w");
+			if (f == NULL) {
+				cerr << "No se puede crear " << path << '\n';
+				return 1;
+			}
+			Result res = measure(actions[a], UNIFORM, sizes[s], DEFAULT_SIZE, reps, 1);
+			writeCurve(f, res, 1);
+			fclose(f);
+			cerr << path << ": " << res._seconds << " s\n";
+		}
+	}
+	return 0;
+}
+
+/**
+Barre rdenes, nmeros de keys y distribuciones para las tres operaciones.
+
+@param path fichero de resultados
+@param reps repeticiones de cada medida
+@param sizes nmeros de keys
+
+@return 0 si todo ha ido bien
+*/
+int sweep(const string& path, int reps, const vector<int>& sizes) {
+	FILE* f = fopen(path.c_str(), "w");
+	if (f == NULL) {
+		cerr << "No se puede crear " << path << '\n';
+		return 1;
+	}
+
+	Clock::time_point a = Clock::now(); // Coste de leer el reloj, incluido en cada duracin
+	const int CLOCK_READS = 100000;
+	for (int i = 0; i < CLOCK_READS - 1; i++) Clock::now();
+	fprintf(f, "# reloj: %.1f ns por lectura, %d repeticiones\n", since(a) * 1e9 / CLOCK_READS, reps);
+	fprintf(f, "# operacion distribucion orden n p50(ns) p99(ns) op/s\n");
+
+	const char actions[] = { 'i', 's', 'd' };
+	for (size_t o = 0; o < sizeof(SWEEP_ORDERS) / sizeof(SWEEP_ORDERS[0]); o++) {
+		for (size_t s = 0; s < sizes.size(); s++) {
+			for (int d = 0; d < 3; d++) {
+				for (int ac = 0; ac < 3; ac++) {
+					Result res = measure(actions[ac], (Dist)d, sizes[s], SWEEP_ORDERS[o], reps, sizes[s]);
+					double p50 = percentile(res._latency, 0.5);
+					double p99 = percentile(res._latency, 0.99);
+					fprintf(f, "%c %s %d %d %.1f %.1f %.0f\n", actions[ac], DIST_NAMES[d], SWEEP_ORDERS[o], sizes[s], p50, p99, sizes[s] / res._seconds);
+					fflush(f);
+				}
+			}
+		}
+		cerr << "orden " << SWEEP_ORDERS[o] << " terminado\n";
+	}
+	fclose(f);
+	return 0;
+}
+
+/**
+Memoria que ocupan los nodos de un BTree (la de NodePool, sin contar lo que reserven las propias keys).
+
+@param tree rbol
+@param order orden del rbol
+
+@return bytes
+*/
+template <class T>
+size_t treeBytes(const BTree<T>& tree, int order = COMPRESSED_ORDER) {
+	TreeShape s = tree.shape();
+	return s._leaves * Node<T>::bytes(order, true) + (s._nodes - s._leaves) * Node<T>::bytes(order, false);
+}
+
+/**
+Memoria que reservan aparte las keys de tipo string que no caben en el propio string (ms de 15 caracteres).
+
+@param keys keys
+
+@return bytes aproximados
+*/
+size_t heapBytes(const vector<string>& keys) {
+	size_t b = 0;
+	for (size_t i = 0; i < keys.size(); i++) if (keys[i].size() > 15) b += (keys[i].size() + 16) / 16 * 16;
+	return b;
+}
+
+/** Indica si k est en un BTree */
+template <class T, class Alloc, class Stats>
+bool searchHit(BTree<T, Alloc, Stats>& tree, const T& k) {
+	return tree.search(k) != NULL;
+}
+
+/** Indica si k est en un CompressedBTree */
+template <class T>
+bool searchHit(CompressedBTree<T>& tree, const T& k) {
+	return tree.search(k);
+}
+
+/** Indica si k est en un ndice congelado */
+template <class T>
+bool searchHit(FrozenBTree<T>& frozen, const T& k) {
+	return frozen.search(k);
+}
+
+/** Indica si k est en una instantnea */
+template <class T>
+bool searchHit(BTreeSnapshot<T>& snap, const T& k) {
+	return snap.search(k);
+}
+
+/**
+Mide el tiempo medio de buscar las keys probe en un rbol (mediana de reps repeticiones).
+
+@param tree rbol (BTree o CompressedBTree)
+@param probe keys a buscar
+@param reps repeticiones
+
+@return nanosegundos por bsqueda
+*/
+template <class Tree, class T>
+double searchTime(Tree& tree, const vector<T>& probe, int reps) {
+	vector<double> ns;
+	volatile int found = 0;
+	for (int rep = -1; rep < reps; rep++) { // La repeticin -1 es el calentamiento
+		Clock::time_point start = Clock::now();
+		for (size_t i = 0; i < probe.size(); i++) found = found + searchHit(tree, probe[i]);
+		if (rep >= 0) ns.push_back(since(start) * 1e9 / probe.size());
+	}
+	return median(ns);
+}
+
+/**
+Compara un BTree con un CompressedBTree con las mismas keys y saca una lnea por rbol.
+
+@param name nombre del tipo de key
+@param keys keys ordenadas y sin repetir
+@param extra bytes que reservan aparte las keys del BTree
+@param reps repeticiones
+*/
+template <class T>
+void compareCompressed(const char* name, const vector<T>& keys, size_t extra, int reps) {
+	mt19937 rng(1);
+	vector<T> probe(keys);
+	shuffle(probe.begin(), probe.end(), rng);
+
+	BTree<T> tree(COMPRESSED_ORDER);
+	tree.bulk_load(keys.begin(), keys.end());
+	double bytes = (double)(treeBytes(tree) + extra) / keys.size();
+	printf("%-8s BTree           %8.2f bytes/key %12.0f keys/GB %8.1f ns/busqueda\n", name, bytes, 1e9 / bytes, searchTime(tree, probe, reps));
+
+	CompressedBTree<T> comp;
+	comp.bulk_load(keys.begin(), keys.end());
+	bytes = (double)comp.bytes() / keys.size();
+	printf("%-8s CompressedBTree %8.2f bytes/key %12.0f keys/GB %8.1f ns/busqueda\n", name, bytes, 1e9 / bytes, searchTime(comp, probe, reps));
+}
+
+/**
+Compara BTree y CompressedBTree con n IDs ordenados, enteros y strings.
+
+@param n nmero de IDs
+@param reps repeticiones
+
+@return 0
+*/
+int compressed(int n, int reps) {
+	mt19937 rng(7);
+	vector<int64_t> ids(n);
+	int64_t id = 1000000000;
+	for (int i = 0; i < n; i++) ids[i] = id += 1 + rng() % 4; // IDs crecientes con huecos pequeos
+	compareCompressed("int64", ids, 0, reps);
+
+	vector<string> names(n);
+	char buf[32];
+	for (int i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "user:%012lld", (long long)ids[i]);
+		names[i] = buf;
+	}
+	compareCompressed("string", names, heapBytes(names), reps);
+	return 0;
+}
+
+/**
+Saca la lnea de una forma de exportar las keys.
+
+@param name forma de exportar
+@param n nmero de keys
+@param seconds segundos que ha tardado
+@param bytes bytes escritos
+*/
+void exportLine(const char* name, size_t n, double seconds, double bytes) {
+	printf("%-16s %8.3f s %8.1f ns/key %8.1f MB/s\n", name, seconds, seconds * 1e9 / n, bytes / seconds / 1e6);
+}
+
+/**
+Compara traverse con exportKeys sacando las keys de un BTree a ficheros.
+
+@param n nmero de keys
+@param dir carpeta en la que se escriben (vaca para escribirlas en /dev/null)
+
+@return 0, o 1 si no se puede escribir algn fichero
+*/
+int exportBench(int n, const string& dir) {
+	vector<int64_t> keys(n);
+	double bytes = 0; // Bytes en texto: las dos formas sacan cada key con un carcter ms (espacio o salto de lnea)
+	for (int i = 0; i < n; i++) {
+		keys[i] = (int64_t)i * 7919;
+		bytes += to_string(keys[i]).size() + 1;
+	}
+	BTree<int64_t> tree(COMPRESSED_ORDER);
+	tree.bulk_load(keys.begin(), keys.end());
+
+	string path = dir.empty() ? "/dev/null" : dir + "/claves_traverse.txt";
+	try {
+		ofstream fs(path.c_str());
+		if (!fs.is_open()) throw E_BTree_File();
+		Clock::time_point start = Clock::now();
+		tree.traverse(fs);
+		fs.close();
+		exportLine("traverse", n, since(start), bytes);
+
+		if (!dir.empty()) path = dir + "/claves.txt";
+		start = Clock::now();
+		exportKeys<int64_t>(tree, path);
+		exportLine("exportKeys texto", n, since(start), bytes);
+
+		if (!dir.empty()) path = dir + "/claves.bin";
+		start = Clock::now();
+		exportKeys<int64_t>(tree, path, KEYS_BINARY);
+		exportLine("exportKeys bin", n, since(start), (double)n * sizeof(int64_t));
+	}
+	catch (E_BTree_File&) {
+		cerr << "No se puede escribir " << path << "\n";
+		return 1;
+	}
+	return 0;
+}
+
+/**
+Compara abrir una instantnea y buscar en ella con reconstruir el rbol a partir de ella.
+
+@param n nmero de keys
+@param path fichero de la instantnea
+
+@return 0, o 1 si no se puede escribir o leer la instantnea
+*/
+int snapshotBench(int n, const string& path) {
+	vector<int64_t> keys(n);
+	for (int i = 0; i < n; i++) keys[i] = (int64_t)i * 7919;
+	mt19937 rng(1);
+	vector<int64_t> probe(1000000);
+	for (size_t i = 0; i < probe.size(); i++) probe[i] = keys[rng() % n];
+
+	try {
+		BTree<int64_t> tree(COMPRESSED_ORDER);
+		tree.bulk_load(keys.begin(), keys.end());
+		Clock::time_point start = Clock::now();
+		uint64_t bytes = BTreeSnapshot<int64_t>::save(tree, path);
+		printf("guardar        %8.3f s  (%.1f MB)\n", since(start), bytes / 1e6);
+		printf("BTree          %8.1f ns/busqueda\n", searchTime(tree, probe, 3));
+
+		start = Clock::now();
+		BTreeSnapshot<int64_t> snap(path);
+		printf("abrir          %8.3f ms\n", since(start) * 1e3);
+		printf("instantanea    %8.1f ns/busqueda\n", searchTime(snap, probe, 3));
+
+		start = Clock::now();
+		bool ok = snap.verify();
+		printf("comprobar      %8.3f s  (%s)\n", since(start), ok ? "bien" : "MAL");
+
+		start = Clock::now();
+		BTree<int64_t> rebuilt(COMPRESSED_ORDER);
+		snap.load(rebuilt);
+		printf("reconstruir    %8.3f s\n", since(start));
+	}
+	catch (E_BTree_File&) {
+		cerr << "No se puede escribir o leer " << path << "\n";
+		return 1;
+	}
+	return 0;
+}
+
+/**
+Mide insertar, buscar y borrar n keys aleatorias en un rbol y saca una lnea.
+
+@param name nombre del rbol
+@param tree rbol vaco
+@param keys keys en orden aleatorio
+@param reps repeticiones de las bsquedas
+*/
+template <class Tree>
+void orderLine(const char* name, Tree& tree, const vector<int>& keys, int reps) {
+	Clock::time_point start = Clock::now();
+	for (size_t i = 0; i < keys.size(); i++) tree.insert(keys[i]);
+	double insert = since(start) * 1e9 / keys.size();
+	double search = searchTime(tree, keys, reps);
+	start = Clock::now();
+	for (size_t i = 0; i < keys.size(); i++) tree.remove(keys[i]);
+	double remove = since(start) * 1e9 / keys.size();
+	printf("%-16s %8.1f ns/insercion %8.1f ns/busqueda %8.1f ns/borrado\n", name, insert, search, remove);
+}
+
+/**
+Compara, para algunos rdenes, el BTree con el orden elegido al crearlo y el FixedBTree con el mismo orden fijado al compilar.
+
+@param n nmero de keys
+@param reps repeticiones de las bsquedas
+
+@return 0
+*/
+int orderBench(int n, int reps) {
+	vector<int> keys(n);
+	for (int i = 0; i < n; i++) keys[i] = i;
+	mt19937 rng(3);
+	shuffle(keys.begin(), keys.end(), rng);
+
+	BTree<int> t3(3), t15(15), t63(63);
+	FixedBTree<int, 3> f3;
+	FixedBTree<int, 15> f15;
+	FixedBTree<int, 63> f63;
+	orderLine("BTree(3)", t3, keys, reps);
+	orderLine("FixedBTree<3>", f3, keys, reps);
+	orderLine("BTree(15)", t15, keys, reps);
+	orderLine("FixedBTree<15>", f15, keys, reps);
+	orderLine("BTree(63)", t63, keys, reps);
+	orderLine("FixedBTree<63>", f63, keys, reps);
+	return 0;
+}
+/**
+Compara buscar un lote de keys dispersas de una en una, con search_batch y con search_many, en un rbol de n keys
+para varios rdenes (con n grande el rbol no cabe en la cach y cada nivel es un fallo).
+
+@param n nmero de keys del rbol
+@param reps repeticiones
+
+@return 0
+*/
+int manyBench(int n, int reps) {
+	vector<int> keys(n);
+	for (int i = 0; i < n; i++) keys[i] = 2 * i;
+	mt19937 rng(9);
+	vector<int> probe(1000000);
+	for (size_t i = 0; i < probe.size(); i++) probe[i] = rng() % (2 * n); // La mitad no estn
+
+	int orders[] = { 7, 15, 63 };
+	for (int order : orders) {
+		BTree<int> tree(order);
+		tree.bulk_load(keys.begin(), keys.end());
+		vector<double> one, batch, many;
+		for (int rep = -1; rep < reps; rep++) { // La repeticin -1 es el calentamiento
+			Clock::time_point start = Clock::now();
+			size_t hits = 0;
+			for (size_t i = 0; i < probe.size(); i++) hits += tree.search(probe[i]) != NULL;
+			double t1 = since(start);
+			start = Clock::now();
+			vector<Node<int>*> b = tree.search_batch(probe.begin(), probe.end());
+			double t2 = since(start);
+			start = Clock::now();
+			vector<Node<int>*> m = tree.search_many(probe.begin(), probe.end());
+			double t3 = since(start);
+			if (b != m || hits != (size_t)(m.size() - count(m.begin(), m.end(), (Node<int>*)NULL))) {
+				cerr << "search_many no coincide con search\n";
+				return 1;
+			}
+			if (rep < 0) continue;
+			one.push_back(t1 * 1e9 / probe.size());
+			batch.push_back(t2 * 1e9 / probe.size());
+			many.push_back(t3 * 1e9 / probe.size());
+		}
+		printf("orden %3d  search %8.1f ns/key  search_batch %8.1f ns/key  search_many %8.1f ns/key\n", order, median(one), median(batch), median(many));
+	}
+	return 0;
+}
+/**
+Mide lo que cuesta llevar la cuenta de los subrboles (insertar y borrar en un BTree y en un CountedBTree) y compara
+rank con contar recorriendo el rbol con for_each.
+
+@param n nmero de keys
+@param reps repeticiones de las bsquedas
+
+@return 0
+*/
+int rankBench(int n, int reps) {
+	vector<int> keys(n);
+	for (int i = 0; i < n; i++) keys[i] = i;
+	mt19937 rng(5);
+	shuffle(keys.begin(), keys.end(), rng);
+
+	BTree<int> plain(15);
+	CountedBTree<int> counted(15);
+	orderLine("BTree(15)", plain, keys, reps);
+	orderLine("CountedBTree(15)", counted, keys, reps);
+
+	counted.insert_batch(keys.begin(), keys.end());
+	vector<int> probe(100000);
+	for (size_t i = 0; i < probe.size(); i++) probe[i] = rng() % n;
+	Clock::time_point start = Clock::now();
+	size_t sum = 0;
+	for (size_t i = 0; i < probe.size(); i++) sum += counted.rank(probe[i]);
+	double rank = since(start) * 1e9 / probe.size();
+	start = Clock::now();
+	for (size_t i = 0; i < probe.size(); i++) sum += counted.select(probe[i]);
+	double select = since(start) * 1e9 / probe.size();
+	start = Clock::now();
+	size_t below = 0;
+	int k = probe[0];
+	counted.for_each([&below, k](int x) { below += x < k; });
+	double walk = since(start) * 1e9;
+	if (below != counted.rank(k)) {
+		cerr << "rank no coincide con for_each\n";
+		return 1;
+	}
+	printf("rank %8.1f ns  select %8.1f ns  contar con for_each %12.0f ns  (%zu)\n", rank, select, walk, sum % 10);
+	return 0;
+}
+/**
+Compara buscar en un BTree y en su ndice congelado con keys uniformes en [0, n) sobre las keys 0..n-1 insertadas en
+orden aleatorio (como measure con 's') y saca una lnea.
+
+@param name nombre de la carga
+@param n nmero de keys
+@param order orden del rbol
+@param reps repeticiones
+*/
+void frozenLine(const char* name, int n, int order, int reps) {
+	mt19937 rng(2);
+	vector<int> probe = makeKeys(UNIFORM, n, rng);
+	vector<int> fill(n);
+	for (int i = 0; i < n; i++) fill[i] = i;
+	shuffle(fill.begin(), fill.end(), rng);
+	BTree<int> tree(order);
+	for (int i = 0; i < n; i++) tree.insert(fill[i]);
+	FrozenBTree<int> frozen = freeze(tree);
+
+	double t = searchTime(tree, probe, reps), f = searchTime(frozen, probe, reps);
+	printf("%-12s orden %3d  BTree %7.1f ns %6.1f bytes/key  FrozenBTree %7.1f ns %6.1f bytes/key  (x%.1f)\n", name, order,
+		t, (double)treeBytes(tree, order) / n, f, (double)frozen.bytes() / n, t / f);
+}
+
+/**
+Compara buscar en el rbol y en su ndice congelado con las cargas de los search*.dat y con un rbol grande.
+
+@param reps repeticiones
+
+@return 0
+*/
+int frozenBench(int reps) {
+	frozenLine("search.dat", 50000, DEFAULT_SIZE, reps);
+	frozenLine("search2.dat", 10000, DEFAULT_SIZE, reps);
+	frozenLine("search3.dat", 30000, DEFAULT_SIZE, reps);
+	frozenLine("10M", 10000000, DEFAULT_SIZE, reps);
+	frozenLine("10M", 10000000, COMPRESSED_ORDER, reps);
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		cerr << "Uso: " << argv[0] << " <i|s|d|l|f> [n] [orden] [paso] [dist] [reps]\n";
+		cerr << "     " << argv[0] << " data [carpeta] [reps]\n";
+		cerr << "     " << argv[0] << " barrido [fichero] [reps] [n ...]\n";
+		cerr << "     " << argv[0] << " comprimido [n] [reps]\n";
+		cerr << "     " << argv[0] << " exportar [n] [carpeta]\n";
+		cerr << "     " << argv[0] << " instantanea [n] [fichero]\n";
+		cerr << "     " << argv[0] << " orden [n] [reps]\n";
+		cerr << "     " << argv[0] << " lotes [n] [reps]\n";
+		cerr << "     " << argv[0] << " posiciones [n] [reps]\n";
+		cerr << "     " << argv[0] << " congelado [reps]\n";
+		return 1;
+	}
+	string mode = argv[1];
+
+	if (mode == "data") return data(argc > 2 ? argv[2] : ".", argc > 3 ? atoi(argv[3]) : 5);
+
+	if (mode == "instantanea") return snapshotBench(argc > 2 ? atoi(argv[2]) : 10000000, argc > 3 ? argv[3] : "instantanea.snap");
+
+	if (mode == "congelado") return frozenBench(argc > 2 ? atoi(argv[2]) : 5);
+
+	if (mode == "posiciones") return rankBench(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? atoi(argv[3]) : 3);
+
+	if (mode == "lotes") return manyBench(argc > 2 ? atoi(argv[2]) : 20000000, argc > 3 ? atoi(argv[3]) : 3);
+
+	if (mode == "orden") return orderBench(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? atoi(argv[3]) : 3);
+
+	if (mode == "exportar") return exportBench(argc > 2 ? atoi(argv[2]) : 10000000, argc > 3 ? argv[3] : "");
+
+	if (mode == "comprimido") return compressed(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? atoi(argv[3]) : 5);
+
+	if (mode == "barrido") {
+		vector<int> sizes;
+		for (int i = 4; i < argc; i++) sizes.push_back(atoi(argv[i]));
+		if (sizes.empty()) {
+			sizes.push_back(10000);
+			sizes.push_back(100000);
+		}
+		return sweep(argc > 2 ? argv[2] : "barrido.dat", argc > 3 ? atoi(argv[3]) : 3, sizes);
+	}
+
+	char action = argv[1][0];
+	int n = argc > 2 ? atoi(argv[2]) : 50000;
+	int order = argc > 3 ? atoi(argv[3]) : DEFAULT_SIZE;
+	int step = argc > 4 ? atoi(argv[4]) : 1;
+	Dist d = UNIFORM;
+	int reps = argc > 6 ? atoi(argv[6]) : 5;
+	if (n <= 0 || step <= 0 || reps <= 0 || order < MIN_SIZE || order > MAX_SIZE || (argc > 5 && !parseDist(argv[5], d))
+		|| (action != 'i' && action != 's' && action != 'd' && action != 'l' && action != 'f') || argv[1][1] != '\0') {
+		cerr << "Parametros incorrectos\n";
+		return 1;
+	}
+
+	Result res = measure(action, d, n, order, reps, step);
+	writeCurve(stdout, res, step);
+	fprintf(stderr, "%d operaciones en %g s: p50 %.1f ns, p99 %.1f ns, %.0f op/s\n", n, res._seconds,
+		percentile(res._latency, 0.5), percentile(res._latency, 0.99), n / res._seconds);
+
+	return 0;
+}
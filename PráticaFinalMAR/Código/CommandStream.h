@@ -0,0 +1,315 @@
+/*
+- Lectura y escritura de casos de prueba (secuencias de operaciones sobre el rbol) en texto y en binario
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __COMMANDSTREAM_H
+#define __COMMANDSTREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "BTree.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define BTREE_MMAP 1
+#endif
+
+/** Identificador de un fichero de operaciones en binario ("BTCS") */
+const uint32_t COMMAND_MAGIC = 0x53435442;
+
+/** Versin del formato binario */
+const uint32_t COMMAND_VERSION = 1;
+
+/** Bytes que se leen o escriben de golpe */
+const size_t COMMAND_BLOCK = 1 << 20;
+
+/** Mximo de bytes de una operacin en binario: el tipo y la key en varint (hasta 10 bytes) */
+const size_t MAX_COMMAND_BYTES = 11;
+
+/** Indica si c es un tipo de operacin vlido ('i', 'd' o 's') */
+inline bool isCommand(char c) {
+    return c == 'i' || c == 'd' || c == 's';
+}
+
+/**
+  Lector de un caso de prueba en texto (como prueba.txt): cada operacin es un carcter ('i', 'd' o 's') y una key.
+  Devuelve las operaciones seguidas del mismo tipo en lotes.
+  */
+template <class T>
+class TextCommandReader {
+
+public:
+
+    /** Abre el fichero
+
+    Error: Si no se puede abrir, lanza una excepcin E_BTree_File
+
+    @param path ruta del fichero
+    */
+    explicit TextCommandReader(const string& path) : _fe(path.c_str()), _has_next(false), _next_op(0), _next_key() {
+        if (!_fe.is_open()) throw E_BTree_File();
+    }
+
+    /**
+    Lee el siguiente lote: las operaciones seguidas del mismo tipo (como mucho max).
+
+    @param op a la salida, el tipo de las operaciones del lote
+    @param batch a la salida, las keys del lote
+    @param max mximo de operaciones del lote
+
+    @return false si ya no quedan operaciones
+    */
+    bool next(char& op, vector<T>& batch, size_t max) {
+        batch.clear();
+        if (!_has_next) _has_next = read();
+        if (!_has_next) return false;
+
+        op = _next_op;
+        while (_has_next && _next_op == op && batch.size() < max) {
+            batch.push_back(_next_key);
+            _has_next = read();
+        }
+        return true;
+    }
+
+private:
+
+    /** Lee una operacin en _next_op y _next_key (false al llegar al final) */
+    bool read() {
+        return (bool)(_fe >> _next_op >> _next_key); // As no se repite la ltima operacin al llegar al final
+    }
+
+    ifstream _fe;   // fichero
+    bool _has_next; // si hay una operacin leda que an no est en ningn lote
+    char _next_op;  // tipo de esa operacin
+    T _next_key;    // key de esa operacin
+};
+
+/**
+  Escritor de un caso de prueba en binario. El fichero empieza con COMMAND_MAGIC y COMMAND_VERSION (4 bytes cada uno)
+  y cada operacin es un byte con su tipo ('i', 'd' o 's') seguido de la key en varint (7 bits por byte, el bit alto
+  indica que sigue otro byte) tras pasarla a zigzag (0, -1, 1, -2... -> 0, 1, 2, 3...), as las keys pequeas,
+  positivas o negativas, ocupan uno o dos bytes.
+  */
+template <class T>
+class CommandWriter {
+
+    static_assert(is_integral<T>::value, "Las keys en binario son enteros en varint");
+
+public:
+
+    /** Crea el fichero y escribe la cabecera
+
+    Error: Si no se puede crear, lanza una excepcin E_BTree_File
+
+    @param path ruta del fichero
+    */
+    explicit CommandWriter(const string& path) : _f(NULL), _buf() {
+        _f = fopen(path.c_str(), "wb");
+        if (_f == NULL) throw E_BTree_File();
+        _buf.reserve(COMMAND_BLOCK + MAX_COMMAND_BYTES);
+        uint32_t header[2] = { COMMAND_MAGIC, COMMAND_VERSION };
+        _buf.insert(_buf.end(), reinterpret_cast<char*>(header), reinterpret_cast<char*>(header + 2));
+    }
+
+    CommandWriter(const CommandWriter&) = delete;
+    CommandWriter& operator=(const CommandWriter&) = delete;
+
+    /** Destructor, escribe lo que quede y cierra el fichero */
+    ~CommandWriter() {
+        if (_f == NULL) return;
+        fwrite(_buf.data(), 1, _buf.size(), _f);
+        fclose(_f);
+    }
+
+    /** Aade una operacin
+
+    @param op tipo de la operacin ('i', 'd' o 's')
+    @param k key
+    */
+    void write(char op, T k) {
+        _buf.push_back(op);
+        int64_t x = (int64_t)k;
+        uint64_t z = ((uint64_t)x << 1) ^ (uint64_t)(x >> 63); // zigzag
+        while (z >= 0x80) {
+            _buf.push_back((char)(z | 0x80));
+            z >>= 7;
+        }
+        _buf.push_back((char)z);
+        if (_buf.size() >= COMMAND_BLOCK) flush();
+    }
+
+    /**
+    Escribe en el fichero lo que haya en el buffer y cierra el fichero.
+
+    Error: Si no se puede escribir, lanza una excepcin E_BTree_File
+    */
+    void close() {
+        flush();
+        fclose(_f);
+        _f = NULL;
+    }
+
+private:
+
+    /** Escribe el buffer en el fichero */
+    void flush() {
+        if (fwrite(_buf.data(), 1, _buf.size(), _f) != _buf.size()) throw E_BTree_File();
+        _buf.clear();
+    }
+
+    FILE* _f;          // fichero
+    vector<char> _buf; // operaciones que an no se han escrito
+};
+
+/**
+  Lector de un caso de prueba en binario (ver CommandWriter). En POSIX el fichero se proyecta en memoria con mmap;
+  si no se puede, se lee en bloques de COMMAND_BLOCK bytes. En los dos casos las operaciones se decodifican
+  directamente de la memoria, sin pasar por iostream, y se devuelven en lotes del mismo tipo.
+  */
+template <class T>
+class CommandReader {
+
+    static_assert(is_integral<T>::value, "Las keys en binario son enteros en varint");
+
+public:
+
+    /** Abre el fichero y comprueba la cabecera
+
+    Error: Si no se puede abrir, lanza una excepcin E_BTree_File
+    Error: Si no es un fichero de operaciones en binario, lanza una excepcin E_BTree_Format
+
+    @param path ruta del fichero
+    */
+    explicit CommandReader(const string& path) : _f(NULL), _block(), _map(NULL), _map_bytes(0), _p(NULL), _end(NULL), _eof(false) {
+        _f = fopen(path.c_str(), "rb");
+        if (_f == NULL) throw E_BTree_File();
+
+        uint32_t header[2];
+        if (fread(header, sizeof(header), 1, _f) != 1 || header[0] != COMMAND_MAGIC || header[1] != COMMAND_VERSION) {
+            fclose(_f);
+            throw E_BTree_Format();
+        }
+
+#ifdef BTREE_MMAP
+        fseek(_f, 0, SEEK_END);
+        size_t n = (size_t)ftell(_f);
+        void* p = n > sizeof(header) ? mmap(NULL, n, PROT_READ, MAP_PRIVATE, fileno(_f), 0) : MAP_FAILED;
+        if (p != MAP_FAILED) {
+            madvise(p, n, MADV_SEQUENTIAL); // Se lee de principio a fin una sola vez
+            _map = static_cast<const unsigned char*>(p);
+            _map_bytes = n;
+            _p = _map + sizeof(header);
+            _end = _map + n;
+            _eof = true; // Todo el fichero est ya en la ventana
+            return;
+        }
+        fseek(_f, sizeof(header), SEEK_SET);
+#endif
+        _block.resize(COMMAND_BLOCK);
+        _p = _end = _block.data();
+    }
+
+    CommandReader(const CommandReader&) = delete;
+    CommandReader& operator=(const CommandReader&) = delete;
+
+    /** Destructor, deshace la proyeccin y cierra el fichero */
+    ~CommandReader() {
+#ifdef BTREE_MMAP
+        if (_map != NULL) munmap(const_cast<unsigned char*>(_map), _map_bytes);
+#endif
+        fclose(_f);
+    }
+
+    /**
+    Lee el siguiente lote: las operaciones seguidas del mismo tipo (como mucho max).
+
+    Error: Si el fichero est cortado o tiene una operacin que no existe, lanza una excepcin E_BTree_Format
+
+    @param op a la salida, el tipo de las operaciones del lote
+    @param batch a la salida, las keys del lote
+    @param max mximo de operaciones del lote
+
+    @return false si ya no quedan operaciones
+    */
+    bool next(char& op, vector<T>& batch, size_t max) {
+        batch.clear();
+        while (batch.size() < max) {
+            if ((size_t)(_end - _p) < MAX_COMMAND_BYTES && !_eof) refill(); // Que quepa una operacin entera
+            if (_p == _end) break;
+
+            char c = (char)*_p;
+            if (!isCommand(c)) throw E_BTree_Format();
+            if (!batch.empty() && c != op) break; // Empieza otro lote
+
+            const unsigned char* q = _p + 1;
+            uint64_t z = 0;
+            int shift = 0;
+            while (true) {
+                if (q == _end || shift > 63) throw E_BTree_Format();
+                unsigned char b = *q++;
+                z |= (uint64_t)(b & 0x7f) << shift;
+                if (b < 0x80) break;
+                shift += 7;
+            }
+            op = c;
+            batch.push_back((T)(int64_t)((z >> 1) ^ (~(z & 1) + 1))); // deshace el zigzag
+            _p = q;
+        }
+        return !batch.empty();
+    }
+
+private:
+
+    /** Mueve al principio del bloque los bytes que quedan sin leer y lo completa con los siguientes del fichero */
+    void refill() {
+        size_t left = _end - _p;
+        memmove(_block.data(), _p, left);
+        size_t got = fread(_block.data() + left, 1, _block.size() - left, _f);
+        if (got == 0) _eof = true;
+        _p = _block.data();
+        _end = _p + left + got;
+    }
+
+    FILE* _f;                        // fichero
+    vector<unsigned char> _block;    // bloque ledo (si no se ha proyectado)
+    const unsigned char* _map;       // proyeccin del fichero (NULL si no se ha proyectado)
+    size_t _map_bytes;               // bytes proyectados
+    const unsigned char* _p;         // siguiente byte por leer
+    const unsigned char* _end;       // final de los bytes disponibles
+    bool _eof;                       // si ya no hay ms bytes que los disponibles
+};
+
+/**
+Convierte un caso de prueba en texto a binario.
+
+Error: Si no se puede abrir o crear algn fichero, lanza una excepcin E_BTree_File
+
+@param text ruta del fichero de texto
+@param binary ruta del fichero binario que se crea
+
+@return nmero de operaciones convertidas
+*/
+template <class T>
+size_t convertCommands(const string& text, const string& binary) {
+    TextCommandReader<T> in(text);
+    CommandWriter<T> out(binary);
+    char op;
+    vector<T> batch;
+    size_t n = 0;
+    while (in.next(op, batch, COMMAND_BLOCK)) {
+        for (size_t j = 0; j < batch.size(); j++) out.write(op, batch[j]);
+        n += batch.size();
+    }
+    out.close();
+    return n;
+}
+
+#endif
@@ -0,0 +1,921 @@
+/*
+- Representacin de un rbol-B+ con las hojas comprimidas (keys enteras o strings)
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __COMPRESSEDBTREE_H
+#define __COMPRESSEDBTREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "BTree.h"
+
+/** Nmero de keys por hoja por defecto */
+const int DEFAULT_LEAF_KEYS = 256;
+
+/** Nmero mximo de hijos de un nodo del ndice de un CompressedBTree (los que no son la raz tienen al menos la mitad) */
+const int INDEX_FANOUT = 64;
+
+/** Cabecera comn de una hoja comprimida: nmero de keys y tamao del bloque en bytes */
+struct LeafHeader {
+    uint32_t _n;     // nmero de keys
+    uint32_t _bytes; // tamao del bloque reservado (puede sobrar sitio tras las keys)
+};
+
+/**
+  Formato de las hojas comprimidas para un tipo de key. Cada hoja es un nico bloque de bytes que empieza con una
+  LeafHeader; el resto depende del tipo. El caso general no existe: solo se comprimen enteros y strings.
+
+  Cualquier formato debe ofrecer:
+  - bytes(keys, n): tamao del bloque que hace falta para n keys ordenadas (sin repetir).
+  - encode(leaf, keys, n): escribe las n keys en el bloque leaf, que tiene al menos bytes(keys, n) bytes.
+  - find(leaf, k, found): posicin de la primera key >= k y si es k. Solo aqu se descomprime, y solo lo necesario.
+  - decode(leaf, out): aade a out las keys de la hoja en orden.
+  */
+template <class T, class Enable = void>
+struct KeyCodec;
+
+/** Crea el bloque vaco de una hoja con bytes de tamao */
+inline unsigned char* newLeaf(size_t bytes) {
+    unsigned char* leaf = new unsigned char[bytes];
+    LeafHeader h = { 0, (uint32_t)bytes };
+    memcpy(leaf, &h, sizeof(h));
+    return leaf;
+}
+
+/** Cambia el nmero de keys de la cabecera de una hoja */
+inline void setLeafCount(unsigned char* leaf, int n) {
+    uint32_t c = (uint32_t)n;
+    memcpy(leaf, &c, sizeof(c));
+}
+
+/** Cabecera de una hoja */
+inline const LeafHeader& leafHeader(const unsigned char* leaf) {
+    return *reinterpret_cast<const LeafHeader*>(leaf);
+}
+
+/**
+  Enteros: frame of reference. La hoja guarda su menor key (la base) y, por cada key, la diferencia con la base en
+  1, 2, 4 u 8 bytes, los justos para la mayor diferencia de la hoja. Con IDs casi consecutivos cada key ocupa un byte.
+  Como las diferencias estn ordenadas y tienen todas el mismo tamao, se busca directamente sobre ellas.
+
+  Bloque: LeafHeader (8 bytes), bytes por diferencia (1 byte, y hasta el 16 sin usar), base (sizeof(T)) y diferencias
+  (alineadas a su tamao, que nunca es mayor que el de la base).
+  */
+template <class T>
+struct KeyCodec<T, typename enable_if<is_integral<T>::value>::type> {
+
+    static const size_t BASE = 16; // posicin de la base
+
+    static size_t bytes(const T* keys, int n) {
+        return BASE + sizeof(T) + (size_t)n * width(keys, n);
+    }
+
+    static void encode(unsigned char* leaf, const T* keys, int n) {
+        T base = n > 0 ? keys[0] : T();
+        int w = width(keys, n);
+
+        setLeafCount(leaf, n);
+        leaf[sizeof(LeafHeader)] = (unsigned char)w;
+        memcpy(leaf + BASE, &base, sizeof(T));
+        unsigned char* d = leaf + BASE + sizeof(T);
+        switch (w) {
+        case 1: putDeltas<uint8_t>(d, keys, n, base); break;
+        case 2: putDeltas<uint16_t>(d, keys, n, base); break;
+        case 4: putDeltas<uint32_t>(d, keys, n, base); break;
+        default: putDeltas<uint64_t>(d, keys, n, base); break;
+        }
+    }
+
+    static int find(const unsigned char* leaf, const T& k, bool& found) {
+        int n = (int)leafHeader(leaf)._n;
+        T base;
+        memcpy(&base, leaf + BASE, sizeof(T));
+        found = false;
+        if (n == 0 || k < base) return 0;
+
+        uint64_t target = (uint64_t)k - (uint64_t)base;
+        const unsigned char* d = leaf + BASE + sizeof(T);
+        switch (leaf[sizeof(LeafHeader)]) {
+        case 1: return findDelta<uint8_t>(d, n, target, found);
+        case 2: return findDelta<uint16_t>(d, n, target, found);
+        case 4: return findDelta<uint32_t>(d, n, target, found);
+        default: return findDelta<uint64_t>(d, n, target, found);
+        }
+    }
+
+    static void decode(const unsigned char* leaf, vector<T>& out) {
+        int n = (int)leafHeader(leaf)._n;
+        T base;
+        memcpy(&base, leaf + BASE, sizeof(T));
+        const unsigned char* d = leaf + BASE + sizeof(T);
+        switch (leaf[sizeof(LeafHeader)]) {
+        case 1: getDeltas<uint8_t>(d, n, base, out); break;
+        case 2: getDeltas<uint16_t>(d, n, base, out); break;
+        case 4: getDeltas<uint32_t>(d, n, base, out); break;
+        default: getDeltas<uint64_t>(d, n, base, out); break;
+        }
+    }
+
+private:
+
+    /** Bytes por diferencia: los justos para la mayor diferencia de las keys */
+    static int width(const T* keys, int n) {
+        uint64_t range = n > 0 ? (uint64_t)keys[n - 1] - (uint64_t)keys[0] : 0;
+        return range <= 0xff ? 1 : range <= 0xffff ? 2 : range <= 0xffffffffu ? 4 : 8;
+    }
+
+    template <class U>
+    static void putDeltas(unsigned char* d, const T* keys, int n, T base) {
+        U* u = reinterpret_cast<U*>(d);
+        for (int i = 0; i < n; i++) u[i] = (U)((uint64_t)keys[i] - (uint64_t)base);
+    }
+
+    template <class U>
+    static void getDeltas(const unsigned char* d, int n, T base, vector<T>& out) {
+        const U* u = reinterpret_cast<const U*>(d);
+        for (int i = 0; i < n; i++) out.push_back((T)((uint64_t)base + u[i]));
+    }
+
+    template <class U>
+    static int findDelta(const unsigned char* d, int n, uint64_t target, bool& found) {
+        if (target > (uint64_t)(U)~(U)0) return n; // Mayor que cualquier diferencia de la hoja
+        const U* u = reinterpret_cast<const U*>(d);
+        int i = keyLowerBound(u, n, (U)target);
+        found = i < n && u[i] == (U)target;
+        return i;
+    }
+};
+
+/**
+  Strings: truncado de prefijos. La hoja guarda una sola vez el prefijo comn de todas sus keys y, seguidos en un
+  mismo bloque, los sufijos, con la posicin donde empieza cada uno (en 2 bytes si caben y si no en 4). Las keys
+  no reservan memoria cada una como en un nodo de std::string. Al buscar, k se compara con el prefijo una vez y
+  despus solo con los sufijos.
+
+  Bloque: LeafHeader (8 bytes), longitud del prefijo (4 bytes), bytes por posicin (1 byte, y hasta el 16 sin usar),
+  prefijo, n + 1 posiciones (la ltima es el final) y sufijos.
+  */
+template <>
+struct KeyCodec<string> {
+
+    static const size_t PREFIX = 16; // posicin del prefijo
+
+    static size_t bytes(const string* keys, int n) {
+        size_t plen, total;
+        int w = sizes(keys, n, plen, total);
+        return PREFIX + plen + (size_t)(n + 1) * w + total;
+    }
+
+    static void encode(unsigned char* leaf, const string* keys, int n) {
+        size_t plen, total;
+        int w = sizes(keys, n, plen, total);
+
+        setLeafCount(leaf, n);
+        uint32_t p = (uint32_t)plen;
+        memcpy(leaf + sizeof(LeafHeader), &p, sizeof(p));
+        leaf[sizeof(LeafHeader) + sizeof(p)] = (unsigned char)w;
+        if (n > 0) memcpy(leaf + PREFIX, keys[0].data(), plen);
+
+        unsigned char* offs = leaf + PREFIX + plen;
+        unsigned char* data = offs + (size_t)(n + 1) * w;
+        uint32_t pos = 0;
+        for (int i = 0; i <= n; i++) {
+            putOffset(offs, i, w, pos);
+            if (i == n) break;
+            size_t len = keys[i].size() - plen;
+            memcpy(data + pos, keys[i].data() + plen, len);
+            pos += (uint32_t)len;
+        }
+    }
+
+    static int find(const unsigned char* leaf, const string& k, bool& found) {
+        int n = (int)leafHeader(leaf)._n;
+        found = false;
+        if (n == 0) return 0;
+
+        Layout l(leaf);
+        size_t m = k.size() < l._plen ? k.size() : l._plen;
+        int c = memcmp(k.data(), l._prefix, m);
+        if (c < 0 || (c == 0 && k.size() < l._plen)) return 0; // Menor que todas las keys de la hoja
+        if (c > 0) return n;                                    // Mayor que todas
+
+        const char* s = k.data() + l._plen; // Ya solo hay que comparar el resto de k con los sufijos
+        size_t len = k.size() - l._plen;
+        int lo = 0, hi = n;
+        while (lo < hi) { // Primer sufijo >= resto de k
+            int mid = (lo + hi) / 2;
+            if (compare(l, mid, s, len) < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        found = lo < n && compare(l, lo, s, len) == 0;
+        return lo;
+    }
+
+    static void decode(const unsigned char* leaf, vector<string>& out) {
+        int n = (int)leafHeader(leaf)._n;
+        Layout l(leaf);
+        for (int i = 0; i < n; i++) {
+            uint32_t a = l.offset(i), b = l.offset(i + 1);
+            string k;
+            k.reserve(l._plen + (b - a));
+            k.append(l._prefix, l._plen);
+            k.append(reinterpret_cast<const char*>(l._data) + a, b - a);
+            out.push_back(k);
+        }
+    }
+
+private:
+
+    /**
+    Calcula las medidas de una hoja con n keys.
+
+    @param plen (salida) longitud del prefijo comn
+    @param total (salida) bytes de todos los sufijos
+
+    @return bytes por posicin
+    */
+    static int sizes(const string* keys, int n, size_t& plen, size_t& total) {
+        plen = 0;
+        if (n > 0) { // El prefijo comn de la primera y la ltima key lo es de todas (estn ordenadas)
+            const string& a = keys[0];
+            const string& b = keys[n - 1];
+            while (plen < a.size() && plen < b.size() && a[plen] == b[plen]) plen++;
+        }
+        total = 0;
+        for (int i = 0; i < n; i++) total += keys[i].size() - plen;
+        return total <= 0xffff ? 2 : 4;
+    }
+
+    /** Partes de una hoja ya localizadas dentro del bloque */
+    struct Layout {
+
+        Layout(const unsigned char* leaf) {
+            uint32_t p;
+            memcpy(&p, leaf + sizeof(LeafHeader), sizeof(p));
+            _plen = p;
+            _w = leaf[sizeof(LeafHeader) + sizeof(p)];
+            _prefix = reinterpret_cast<const char*>(leaf + PREFIX);
+            _offs = leaf + PREFIX + _plen;
+            _data = _offs + (size_t)(leafHeader(leaf)._n + 1) * _w;
+        }
+
+        /** Posicin del sufijo i dentro de los sufijos */
+        uint32_t offset(int i) const {
+            if (_w == 2) {
+                uint16_t o;
+                memcpy(&o, _offs + 2 * i, 2);
+                return o;
+            }
+            uint32_t o;
+            memcpy(&o, _offs + 4 * i, 4);
+            return o;
+        }
+
+        size_t _plen;               // longitud del prefijo comn
+        int _w;                     // bytes por posicin
+        const char* _prefix;        // prefijo comn
+        const unsigned char* _offs; // posiciones de los sufijos
+        const unsigned char* _data; // sufijos
+    };
+
+    static void putOffset(unsigned char* offs, int i, int w, uint32_t pos) {
+        if (w == 2) {
+            uint16_t o = (uint16_t)pos;
+            memcpy(offs + 2 * i, &o, 2);
+        }
+        else memcpy(offs + 4 * i, &pos, 4);
+    }
+
+    /** Compara el sufijo i de la hoja con s (de len bytes), como memcmp */
+    static int compare(const Layout& l, int i, const char* s, size_t len) {
+        uint32_t a = l.offset(i), b = l.offset(i + 1);
+        size_t slen = b - a;
+        int c = memcmp(l._data + a, s, slen < len ? slen : len);
+        if (c != 0) return c;
+        return slen < len ? -1 : (slen > len ? 1 : 0);
+    }
+};
+
+/**
+
+Clase que representa a un rbol-B+ de keys sin repetir cuyas hojas estn comprimidas con Codec (ver KeyCodec): para
+enteros casi consecutivos (IDs ordenados) o strings con prefijos comunes ocupa varias veces menos memoria por key
+que un BTree.
+
+El ndice sobre las hojas es un rbol-B+ de nodos con hasta INDEX_FANOUT hijos: cada nodo guarda la cota inferior de
+cada hijo (una key menor o igual que todas las suyas y mayor que todas las del hijo anterior), que se busca igual que
+las keys de un nodo de BTree. Con DEFAULT_LEAF_KEYS keys por hoja, el ndice de un milln de keys tiene unas 4000
+entradas en dos niveles, as que cabe en cach. Partir o unir una hoja solo cambia el nodo del ndice que la apunta
+(y, si este se llena o se queda con menos de la mitad de hijos, uno por nivel hacia arriba): O(log n).
+
+Las hojas solo se descomprimen en la bsqueda dentro de la hoja (y solo la parte necesaria). Para insertar o
+eliminar se descomprime la hoja entera, se cambia y se vuelve a comprimir en el mismo bloque si cabe, as que esas
+operaciones cuestan O(keys por hoja): el rbol est pensado para muchas ms bsquedas que modificaciones.
+Las hojas que se llenan se parten en dos; las que se quedan con menos de un cuarto de keys se unen con una hermana
+si caben las dos en una.
+
+@author lvaro Corrochano Lpez
+
+*/
+template <class T, class Codec = KeyCodec<T> >
+class CompressedBTree {
+
+public:
+
+    /**
+    Constructor vaco especificando las keys por hoja
+
+    Error: Si el tamao especificado es menor que 2, lanza una excepcin E_BTree_Lower
+    Error: Si el tamao especificado es mayor que 1000, lanza una excepcin E_BTree_Bigger
+
+    @param leaf_keys nmero mximo de keys de una hoja
+    */
+    explicit CompressedBTree(int leaf_keys = DEFAULT_LEAF_KEYS) : _leaf_keys(leaf_keys), _count(0), _bytes(0), _n_leaves(0),
+        _n_index(0), _root(NULL), _path(), _buf() {
+        if (leaf_keys < MIN_SIZE) throw E_BTree_Lower();
+        if (leaf_keys > MAX_SIZE) throw E_BTree_Bigger();
+    }
+
+    /** El rbol es dueo de sus hojas, as que no se puede copiar (solo mover) */
+    CompressedBTree(const CompressedBTree&) = delete;
+    CompressedBTree& operator=(const CompressedBTree&) = delete;
+
+    /** Constructor de movimiento, el rbol movido se queda vaco */
+    CompressedBTree(CompressedBTree&& other) : _leaf_keys(other._leaf_keys), _count(other._count), _bytes(other._bytes),
+        _n_leaves(other._n_leaves), _n_index(other._n_index), _root(other._root), _path(), _buf() {
+        other._root = NULL;
+        other._count = other._bytes = other._n_leaves = other._n_index = 0;
+    }
+
+    /** Asignacin de movimiento, las hojas que tuviera este rbol se liberan */
+    CompressedBTree& operator=(CompressedBTree&& other) {
+        if (this != &other) {
+            clear();
+            _leaf_keys = other._leaf_keys;
+            _count = other._count;
+            _bytes = other._bytes;
+            _n_leaves = other._n_leaves;
+            _n_index = other._n_index;
+            _root = other._root;
+            other._root = NULL;
+            other._count = other._bytes = other._n_leaves = other._n_index = 0;
+        }
+        return *this;
+    }
+
+    /** Destructor, libera las hojas */
+    ~CompressedBTree() {
+        clear();
+    }
+
+    /** Elimina todas las keys y libera las hojas y el ndice */
+    void clear() {
+        if (_root != NULL) {
+            PathStack<Step> path;
+            path.push(Step(_root, 0));
+            while (!path.empty()) {
+                Step& s = path.top();
+                IndexNode* x = s._node;
+                if (!x->_leaves && s._next < (int)x->_child.size()) { // Primero se liberan los hijos
+                    IndexNode* c = x->inner(s._next++);
+                    path.push(Step(c, 0));
+                }
+                else { // y despus el nodo (con sus hojas)
+                    path.pop();
+                    if (x->_leaves) for (size_t j = 0; j < x->_child.size(); j++) delete[] x->leaf((int)j);
+                    delete x;
+                }
+            }
+        }
+        _root = NULL;
+        _count = 0;
+        _bytes = 0;
+        _n_leaves = 0;
+        _n_index = 0;
+    }
+
+    /** Devuelve el nmero mximo de keys de una hoja
+
+    @return nmero mximo de keys de una hoja
+    */
+    int n_keys() const {
+        return _leaf_keys;
+    }
+
+    /** Devuelve el nmero de keys guardadas en el rbol
+
+    @return nmero de keys del rbol
+    */
+    size_t size() const {
+        return _count;
+    }
+
+    /** Indica si el rbol est o no vaco
+
+    @return true si el rbol est vaco y false si no lo est
+    */
+    bool isEmpty() const {
+        return _count == 0;
+    }
+
+    /** Devuelve el nmero de hojas
+
+    @return nmero de hojas
+    */
+    size_t n_leaves() const {
+        return _n_leaves;
+    }
+
+    /** Devuelve la memoria que ocupa el rbol: las hojas y el ndice (sin contar la memoria propia de las keys del
+    ndice, como el texto de un string largo)
+
+    @return bytes ocupados
+    */
+    size_t bytes() const {
+        return _bytes + _n_index * (sizeof(IndexNode) + (INDEX_FANOUT + 1) * (sizeof(T) + sizeof(void*)));
+    }
+
+    /**
+    Busca una key en el rbol.
+    Complejidad: O(log n)
+
+    @param k key buscada
+
+    @return true si k est en el rbol
+    */
+    bool search(const T& k) const {
+        if (_root == NULL) return false;
+        const IndexNode* x = _root;
+        int i = childOf(x, k);
+        while (!x->_leaves) {
+            x = x->inner(i);
+            i = childOf(x, k);
+        }
+        bool found;
+        Codec::find(x->leaf(i), k, found);
+        return found;
+    }
+
+    /**
+    Funcin para insertar una key en el rbol. Si la hoja se pasa de keys se parte en dos.
+    Complejidad: O(log n + keys por hoja)
+
+    @param k key a insertar
+
+    @return true si se ha insertado y false si ya estaba
+    */
+    bool insert(const T& k) {
+        if (_root == NULL) { // Primera key
+            _root = newIndex(true);
+            addChild(_root, 0, k, NULL);
+            encode(_root, 0, &k, 1, true);
+            _n_leaves = 1;
+            _count = 1;
+            return true;
+        }
+
+        descend(k);
+        IndexNode* x = _path.back()._node;
+        int j = _path.back()._next;
+        bool found;
+        int i = Codec::find(x->leaf(j), k, found);
+        if (found) return false;
+
+        decode(x->leaf(j));
+        _buf.insert(_buf.begin() + i, k);
+        for (size_t l = 0; l < _path.size(); l++) { // Solo el primer hijo recibe keys menores que su cota inferior
+            Step& s = _path[l];
+            if (s._next == 0 && k < s._node->_fences[0]) s._node->_fences[0] = k;
+        }
+
+        if ((int)_buf.size() > _leaf_keys) { // Partimos la hoja: la mitad derecha va a una hoja nueva detrs
+            size_t h = _buf.size() / 2;
+            addChild(x, j + 1, _buf[h], NULL);
+            encode(x, j + 1, _buf.data() + h, _buf.size() - h, true);
+            encode(x, j, _buf.data(), h, true);
+            _n_leaves++;
+            splitIndex(_path.size() - 1);
+        }
+        else encode(x, j, _buf.data(), _buf.size(), true);
+        _count++;
+        return true;
+    }
+
+    /**
+    Funcin para eliminar una key del rbol. La hoja que se queda vaca desaparece y la que se queda con menos de un
+    cuarto de keys se une con la siguiente (o con la anterior si es la ltima de su nodo del ndice) si caben en una.
+    Complejidad: O(log n + keys por hoja)
+
+    @param k key a eliminar
+
+    @return true si la key estaba en el rbol
+    */
+    bool remove(const T& k) {
+        if (_root == NULL) return false;
+
+        descend(k);
+        IndexNode* x = _path.back()._node;
+        int j = _path.back()._next;
+        bool found;
+        int i = Codec::find(x->leaf(j), k, found);
+        if (!found) return false;
+
+        decode(x->leaf(j));
+        _buf.erase(_buf.begin() + i);
+        _count--;
+
+        if (_buf.empty()) { // La hoja desaparece (su cota inferior ya no hace falta)
+            if (_count == 0) {
+                clear();
+                return true;
+            }
+            freeLeaf(x, j);
+            fixIndex(_path.size() - 1);
+            return true;
+        }
+
+        int siblings = (int)x->_child.size();
+        if ((int)_buf.size() < _leaf_keys / 4 && siblings > 1) { // Unimos con una hermana si caben
+            int a = j + 1 < siblings ? j : j - 1; // Se unen las hojas a y a + 1
+            size_t n = _buf.size() + leafHeader(x->leaf(a == j ? j + 1 : a))._n;
+            if ((int)n <= _leaf_keys) {
+                if (a == j) Codec::decode(x->leaf(j + 1), _buf); // La siguiente va detrs
+                else {
+                    vector<T> rest;
+                    rest.swap(_buf);
+                    Codec::decode(x->leaf(a), _buf); // La anterior va delante
+                    _buf.insert(_buf.end(), rest.begin(), rest.end());
+                }
+                freeLeaf(x, a + 1);
+                encode(x, a, _buf.data(), _buf.size(), true);
+                fixIndex(_path.size() - 1);
+                return true;
+            }
+        }
+        encode(x, j, _buf.data(), _buf.size(), true);
+        return true;
+    }
+
+    /**
+    Funcin que sustituye el contenido del rbol por las keys (ordenadas y sin repetir) del rango [first, last).
+    Las hojas se llenan de izquierda a derecha sin ningn split y el ndice se construye nivel a nivel.
+    Complejidad: O(n)
+
+    Error: Si las keys no estn ordenadas de forma estrictamente creciente, lanza una excepcin E_BTree_Unsorted (y el rbol no cambia)
+
+    @param first iterador al principio de las keys
+    @param last iterador al final de las keys
+    @param fill fraccin de cada hoja que se llena (dejar hueco evita partir hojas en las inserciones posteriores)
+    */
+    template <class It>
+    void bulk_load(It first, It last, double fill = 1.0) {
+        vector<T> keys(first, last);
+        for (size_t j = 1; j < keys.size(); j++) if (!(keys[j - 1] < keys[j])) throw E_BTree_Unsorted();
+
+        clear();
+        if (keys.empty()) return;
+        size_t per = (size_t)(fill * _leaf_keys + 0.5);
+        if (per < 1) per = 1;
+        if (per > (size_t)_leaf_keys) per = _leaf_keys;
+
+        vector<T> fences; // Cotas y nodos del nivel que se est construyendo
+        vector<void*> nodes;
+        for (size_t j = 0; j < keys.size(); j += per) {
+            size_t m = keys.size() - j < per ? keys.size() - j : per;
+            size_t need = Codec::bytes(keys.data() + j, (int)m);
+            unsigned char* leaf = newLeaf(need);
+            Codec::encode(leaf, keys.data() + j, (int)m);
+            _bytes += need;
+            fences.push_back(keys[j]);
+            nodes.push_back(leaf);
+        }
+        _n_leaves = nodes.size();
+        _count = keys.size();
+
+        bool leaves = true;
+        do { // Cada nivel agrupa los nodos del de debajo, repartidos lo ms igualado posible
+            size_t p = (nodes.size() + INDEX_FANOUT - 1) / INDEX_FANOUT;
+            vector<T> up_fences;
+            vector<void*> up;
+            for (size_t q = 0, j = 0; q < p; q++) {
+                size_t end = nodes.size() * (q + 1) / p;
+                IndexNode* x = newIndex(leaves);
+                for (; j < end; j++) addChild(x, (int)x->_child.size(), fences[j], nodes[j]);
+                up_fences.push_back(x->_fences[0]);
+                up.push_back(x);
+            }
+            fences.swap(up_fences);
+            nodes.swap(up);
+            leaves = false;
+        } while (nodes.size() > 1);
+        _root = static_cast<IndexNode*>(nodes[0]);
+    }
+
+    /**
+    Funcin que aplica f a cada key del rbol, en orden creciente (descomprimiendo las hojas de una en una).
+
+    @param f funcin que recibe cada key (const T&)
+    */
+    template <class F>
+    void for_each(F f) const {
+        if (_root == NULL) return;
+        vector<T> keys;
+        PathStack<Step> path;
+        path.push(Step(_root, 0));
+        while (!path.empty()) {
+            Step& s = path.top();
+            IndexNode* x = s._node;
+            if (s._next == (int)x->_child.size()) {
+                path.pop();
+                continue;
+            }
+            int i = s._next++;
+            if (!x->_leaves) {
+                path.push(Step(x->inner(i), 0));
+                continue;
+            }
+            keys.clear();
+            Codec::decode(x->leaf(i), keys);
+            for (size_t j = 0; j < keys.size(); j++) f(keys[j]);
+        }
+    }
+
+    /**
+    Funcin para recorrer el rbol, va sacando las keys guardadas en orden (siempre creciente).
+
+    @param out flujo en el que se sacan (por defecto la salida estndar)
+    */
+    void traverse(ostream& out = cout) const {
+        for_each([&out](const T& k) { out << " " << k; });
+    }
+
+    /**
+    Comprueba las propiedades del rbol: cotas del ndice crecientes y cada una menor o igual que todas las keys de
+    su hijo (y mayor que las del hijo anterior), todas las hojas a la misma profundidad, cada nodo del ndice salvo
+    la raz con entre INDEX_FANOUT / 2 e INDEX_FANOUT hijos, cada hoja con entre 1 y n_keys() keys ordenadas en un
+    bloque de tamao suficiente, y los contadores (keys, hojas, nodos del ndice y bytes) iguales a lo que hay.
+
+    @return true si el rbol es vlido
+    */
+    bool check() const {
+        if (_root == NULL) return _count == 0 && _n_leaves == 0 && _n_index == 0 && _bytes == 0;
+        int leaf_depth = -1;
+        size_t count = 0, leaves = 0, index = 0, bytes = 0;
+        if (!check(_root, true, 0, leaf_depth, NULL, NULL, count, leaves, index, bytes)) return false;
+        return count == _count && leaves == _n_leaves && index == _n_index && bytes == _bytes;
+    }
+
+private:
+
+    /** Nodo del ndice: la cota inferior de cada hijo y el hijo, que es una hoja comprimida si el nodo es del ltimo
+    nivel y otro nodo del ndice si no */
+    struct IndexNode {
+
+        explicit IndexNode(bool leaves) : _leaves(leaves), _fences(), _child() {
+            _fences.reserve(INDEX_FANOUT + 1);
+            _child.reserve(INDEX_FANOUT + 1);
+        }
+
+        IndexNode* inner(int i) const {
+            return static_cast<IndexNode*>(_child[i]);
+        }
+
+        unsigned char* leaf(int i) const {
+            return static_cast<unsigned char*>(_child[i]);
+        }
+
+        bool _leaves;          // si los hijos son hojas comprimidas
+        vector<T> _fences;     // cota inferior de cada hijo
+        vector<void*> _child;  // hijos, en orden
+    };
+
+    /** Paso del camino desde la raz: un nodo del ndice y el hijo por el que se ha bajado */
+    typedef NodeStep<IndexNode> Step;
+
+    /** Hijo de x en el que est (o ira) k: el ltimo cuya cota inferior es <= k, o el primero si k es menor que todas */
+    static int childOf(const IndexNode* x, const T& k) {
+        int i = keyUpperBound(x->_fences.data(), (int)x->_fences.size(), k);
+        return i > 0 ? i - 1 : 0;
+    }
+
+    /** Baja desde la raz hasta la hoja de k, apuntando en _path cada nodo del ndice y el hijo por el que se sigue */
+    void descend(const T& k) {
+        _path.clear();
+        IndexNode* x = _root;
+        while (true) {
+            int i = childOf(x, k);
+            _path.push_back(Step(x, i));
+            if (x->_leaves) return;
+            x = x->inner(i);
+        }
+    }
+
+    /** Crea un nodo del ndice vaco */
+    IndexNode* newIndex(bool leaves) {
+        _n_index++;
+        return new IndexNode(leaves);
+    }
+
+    /** Libera un nodo del ndice (no sus hijos) */
+    void deleteIndex(IndexNode* x) {
+        _n_index--;
+        delete x;
+    }
+
+    /** Aade a x un hijo c con cota inferior fence en la posicin i */
+    static void addChild(IndexNode* x, int i, const T& fence, void* c) {
+        x->_fences.insert(x->_fences.begin() + i, fence);
+        x->_child.insert(x->_child.begin() + i, c);
+    }
+
+    /** Quita el hijo i de x (no lo libera) */
+    static void removeChild(IndexNode* x, int i) {
+        x->_fences.erase(x->_fences.begin() + i);
+        x->_child.erase(x->_child.begin() + i);
+    }
+
+    /** Libera la hoja i de x y la quita del ndice */
+    void freeLeaf(IndexNode* x, int i) {
+        _bytes -= leafHeader(x->leaf(i))._bytes;
+        delete[] x->leaf(i);
+        removeChild(x, i);
+        _n_leaves--;
+    }
+
+    /**
+    Funcin que parte el nodo del ndice del nivel l del camino si tiene ms de INDEX_FANOUT hijos: la mitad derecha
+    pasa a un nodo nuevo que se aade al padre, y se sigue subiendo mientras el padre tambin se pase.
+    Si se parte la raz, el ndice crece un nivel.
+
+    @param l nivel del camino (_path) en el que puede haber un nodo con demasiados hijos
+    */
+    void splitIndex(size_t l) {
+        while ((int)_path[l]._node->_child.size() > INDEX_FANOUT) {
+            IndexNode* x = _path[l]._node;
+            IndexNode* y = newIndex(x->_leaves);
+            size_t h = x->_child.size() / 2;
+            y->_fences.assign(x->_fences.begin() + h, x->_fences.end());
+            y->_child.assign(x->_child.begin() + h, x->_child.end());
+            x->_fences.erase(x->_fences.begin() + h, x->_fences.end());
+            x->_child.erase(x->_child.begin() + h, x->_child.end());
+
+            if (l == 0) { // La raz se ha partido: nueva raz con los dos
+                IndexNode* r = newIndex(false);
+                addChild(r, 0, x->_fences[0], x);
+                addChild(r, 1, y->_fences[0], y);
+                _root = r;
+                return;
+            }
+            l--;
+            addChild(_path[l]._node, _path[l]._next + 1, y->_fences[0], y);
+        }
+    }
+
+    /**
+    Funcin que rellena el nodo del ndice del nivel l del camino si se ha quedado con menos de INDEX_FANOUT / 2 hijos:
+    coge un hijo de un hermano o, si caben los dos en uno, se une con l y se sigue por el padre, que pierde un hijo.
+    Si la raz se queda con un solo hijo que no es una hoja, ese hijo pasa a ser la raz.
+
+    @param l nivel del camino (_path) del nodo que ha perdido un hijo
+    */
+    void fixIndex(size_t l) {
+        while (l > 0) {
+            IndexNode* x = _path[l]._node;
+            if ((int)x->_child.size() >= INDEX_FANOUT / 2) return;
+
+            IndexNode* p = _path[l - 1]._node;
+            int i = _path[l - 1]._next;
+            int a = i + 1 < (int)p->_child.size() ? i : i - 1; // Se juntan los hijos a y a + 1 de p
+            IndexNode* left = p->inner(a);
+            IndexNode* right = p->inner(a + 1);
+
+            if ((int)(left->_child.size() + right->_child.size()) <= INDEX_FANOUT) { // Caben en uno: se unen en left
+                left->_fences.insert(left->_fences.end(), right->_fences.begin(), right->_fences.end());
+                left->_child.insert(left->_child.end(), right->_child.begin(), right->_child.end());
+                removeChild(p, a + 1);
+                deleteIndex(right);
+                l--;
+                continue;
+            }
+
+            if (x == right) { // Cogemos el ltimo hijo del hermano anterior
+                addChild(right, 0, left->_fences.back(), left->_child.back());
+                left->_fences.pop_back();
+                left->_child.pop_back();
+            }
+            else { // O el primero del siguiente
+                addChild(left, (int)left->_child.size(), right->_fences[0], right->_child[0]);
+                removeChild(right, 0);
+            }
+            p->_fences[a + 1] = right->_fences[0];
+            return;
+        }
+
+        if (!_root->_leaves && _root->_child.size() == 1) { // La raz se queda con un solo nodo del ndice
+            IndexNode* old = _root;
+            _root = old->inner(0);
+            deleteIndex(old);
+        }
+    }
+
+    /**
+    Comprueba recursivamente el subrbol del ndice con raz x.
+
+    @param x nodo del ndice
+    @param is_root indica si x es la raz
+    @param depth profundidad de x
+    @param leaf_depth profundidad de los nodos que apuntan a hojas (-1 hasta encontrar el primero)
+    @param lo si no es NULL, todas las cotas y keys del subrbol deben ser mayores o iguales que *lo
+    @param hi si no es NULL, todas las cotas y keys del subrbol deben ser menores que *hi
+    @param count keys de las hojas visitadas
+    @param leaves hojas visitadas
+    @param index nodos del ndice visitados
+    @param bytes bytes de las hojas visitadas
+
+    @return true si el subrbol es vlido
+    */
+    bool check(const IndexNode* x, bool is_root, int depth, int& leaf_depth, const T* lo, const T* hi,
+        size_t& count, size_t& leaves, size_t& index, size_t& bytes) const {
+        int n = (int)x->_child.size();
+        if (n != (int)x->_fences.size() || n > INDEX_FANOUT || n < (is_root ? (x->_leaves ? 1 : 2) : INDEX_FANOUT / 2)) return false;
+        for (int i = 0; i < n; i++) {
+            if (i > 0 && !(x->_fences[i - 1] < x->_fences[i])) return false;
+            if ((lo != NULL && x->_fences[i] < *lo) || (hi != NULL && !(x->_fences[i] < *hi))) return false;
+        }
+        index++;
+
+        if (x->_leaves) {
+            if (leaf_depth == -1) leaf_depth = depth;
+            if (leaf_depth != depth) return false;
+            vector<T> keys;
+            for (int i = 0; i < n; i++) {
+                keys.clear();
+                Codec::decode(x->leaf(i), keys);
+                const LeafHeader& h = leafHeader(x->leaf(i));
+                int m = (int)keys.size();
+                if (m == 0 || m > _leaf_keys || h._n != (uint32_t)m || h._bytes < Codec::bytes(keys.data(), m)) return false;
+                for (int j = 1; j < m; j++) if (!(keys[j - 1] < keys[j])) return false;
+                const T* chi = i + 1 < n ? &x->_fences[i + 1] : hi;
+                if (keys[0] < x->_fences[i] || (chi != NULL && !(keys[m - 1] < *chi))) return false;
+                count += m;
+                bytes += h._bytes;
+            }
+            leaves += n;
+            return true;
+        }
+        for (int i = 0; i < n; i++) {
+            const T* chi = i + 1 < n ? &x->_fences[i + 1] : hi;
+            if (!check(x->inner(i), false, depth + 1, leaf_depth, &x->_fences[i], chi, count, leaves, index, bytes)) return false;
+        }
+        return true;
+    }
+
+    /** Descomprime una hoja en _buf */
+    void decode(const unsigned char* leaf) {
+        _buf.clear();
+        Codec::decode(leaf, _buf);
+    }
+
+    /**
+    Funcin que comprime n keys en la hoja j de x. Si ya hay una hoja y caben, se escriben en su mismo bloque; si no
+    caben (o sobrara ms de la mitad del bloque) se reserva otro y se libera el que hubiera.
+
+    @param x nodo del ndice que apunta a la hoja
+    @param j posicin de la hoja en x
+    @param keys keys ordenadas
+    @param n nmero de keys
+    @param slack si se deja sitio para que las prximas keys quepan sin reservar otra vez
+    */
+    void encode(IndexNode* x, int j, const T* keys, size_t n, bool slack) {
+        size_t need = Codec::bytes(keys, (int)n);
+        unsigned char* leaf = x->leaf(j);
+        size_t cap = leaf != NULL ? leafHeader(leaf)._bytes : 0;
+        if (leaf == NULL || need > cap || need < cap / 2) {
+            size_t bytes = slack ? need + need / 4 : need;
+            if (leaf != NULL) {
+                _bytes -= cap;
+                delete[] leaf;
+            }
+            leaf = newLeaf(bytes);
+            _bytes += bytes;
+            x->_child[j] = leaf;
+        }
+        Codec::encode(leaf, keys, (int)n);
+    }
+
+    int _leaf_keys;                // nmero mximo de keys de una hoja
+    size_t _count;                 // nmero de keys del rbol
+    size_t _bytes;                 // bytes de todas las hojas
+    size_t _n_leaves;              // nmero de hojas
+    size_t _n_index;               // nmero de nodos del ndice
+    IndexNode* _root;              // raz del ndice (NULL si el rbol est vaco)
+    vector<Step> _path;            // camino de la ltima bajada para insertar o eliminar
+    vector<T> _buf;                // hoja descomprimida para insertar o eliminar
+};
+
+#endif
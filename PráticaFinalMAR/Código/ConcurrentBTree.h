@@ -0,0 +1,745 @@
+/*
+- rbol-B concurrente con bloqueo optimista por versiones (optimistic lock coupling)
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __CONCURRENTBTREE_H
+#define __CONCURRENTBTREE_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "BTree.h"
+#include "Epoch.h"
+
+/**
+  Cerrojo con versin de un nodo. La versin va en un solo entero de 64 bits:
+  - bit 0: el nodo est obsoleto (se ha quitado del rbol y est retirado).
+  - bit 1: hay un escritor dentro del nodo.
+  - resto: contador que aumenta cada vez que un escritor sale.
+
+  Los lectores no escriben en el cerrojo: apuntan la versin, leen el nodo y comprueban que la versin
+  no ha cambiado (si ha cambiado vuelven a empezar). Los escritores lo cogen en exclusiva.
+  */
+class VersionLock {
+
+public:
+
+    VersionLock() : _version(0) {}
+
+    /** Devuelve la versin actual para leer el nodo de forma optimista
+
+    @param restart se pone a true si el nodo est bloqueado u obsoleto y hay que volver a empezar
+
+    @return versin del nodo
+    */
+    uint64_t readLock(bool& restart) const {
+        uint64_t v = _version.load(std::memory_order_acquire);
+        if (v & 3) restart = true;
+        return v;
+    }
+
+    /** Comprueba que el nodo no ha cambiado desde que se ley la versin v
+
+    @param v versin devuelta por readLock
+
+    @return true si lo ledo desde entonces es vlido
+    */
+    bool check(uint64_t v) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return _version.load(std::memory_order_relaxed) == v;
+    }
+
+    /** Bloquea el nodo en exclusiva, esperando si lo tiene otro escritor */
+    void writeLock() {
+        for (int spins = 0; ; spins++) {
+            uint64_t v = _version.load(std::memory_order_relaxed);
+            if (!(v & 2) && _version.compare_exchange_weak(v, v + 2, std::memory_order_acquire)) break;
+            if (spins > 64) std::this_thread::yield();
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    /** Desbloquea el nodo y aumenta la versin */
+    void writeUnlock() {
+        _version.fetch_add(2, std::memory_order_release);
+    }
+
+    /** Desbloquea el nodo dejando la versin que tena antes de writeLock. Solo si el escritor no lo ha cambiado:
+    as los lectores que lo estaban leyendo no tienen que volver a empezar. */
+    void writeUnlockUnchanged() {
+        _version.fetch_sub(2, std::memory_order_release);
+    }
+
+    /** Desbloquea el nodo marcndolo como obsoleto (ya no est en el rbol) */
+    void writeUnlockObsolete() {
+        _version.fetch_add(3, std::memory_order_release);
+    }
+
+private:
+
+    std::atomic<uint64_t> _version; // versin, bit de bloqueo y bit de obsoleto
+};
+
+/**
+  Nodo de un ConcurrentBTree: un Node con un cerrojo con versin en la cabecera.
+  Las keys y los hijos van tras la cabecera en el mismo bloque, igual que en Node.
+
+  Los lectores leen el nmero de keys, las keys y los hijos sin cerrojo mientras un escritor puede estar cambindolos,
+  as que esos campos se leen y se escriben siempre con operaciones atmicas (relajadas; los hijos con acquire y
+  release, para que quien llega a un nodo recin creado vea cmo se construy). Por eso el nodo tiene sus propias
+  versiones de las operaciones de Node que los cambian (splitChild, borrowFromPrev, borrowFromNext, merge y
+  removeFromLeaf), que ocultan las de Node. Los escritores leen con normalidad los nodos que tienen bloqueados.
+  */
+template <class T>
+class OLCNode : public Node<T> {
+
+public:
+
+    /** Crea un nodo vaco en un bloque alineado
+
+    @param max_elems nmero mximo de keys que puede almacenar el nodo
+    @param is_leaf indica si el nodo es o no hoja
+
+    @return puntero al nodo creado
+    */
+    static OLCNode* create(int max_elems, bool is_leaf) {
+        void* mem = ::operator new(Node<T>::bytes(max_elems, is_leaf, sizeof(OLCNode)), align_val_t(NODE_ALIGN));
+        return new (mem) OLCNode(max_elems, is_leaf);
+    }
+
+    /** Libera un nodo creado con create (no libera sus hijos)
+
+    @param n nodo a liberar
+    */
+    static void destroy(OLCNode* n) {
+        n->~OLCNode();
+        ::operator delete(n, align_val_t(NODE_ALIGN));
+    }
+
+    /** Igual que destroy, con la forma que espera EpochManager::retire */
+    static void destroyRetired(void* n) {
+        destroy(static_cast<OLCNode*>(n));
+    }
+
+    /** Hijo i del nodo (todos los nodos del rbol son OLCNode) */
+    OLCNode* child(int i) const {
+        return static_cast<OLCNode*>(__atomic_load_n(&this->_child[i], __ATOMIC_ACQUIRE));
+    }
+
+    /** Nmero de keys ledo sin cerrojo: puede estar cambiando, as que se acota al mximo */
+    int optimisticCount() const {
+        int n = __atomic_load_n(&this->_n_elems, __ATOMIC_RELAXED);
+        if (n < 0) return 0;
+        return n > this->_max_elems ? this->_max_elems : n;
+    }
+
+    /** Key i leda sin cerrojo */
+    T key(int i) const {
+        T k;
+        __atomic_load(&this->_elems[i], &k, __ATOMIC_RELAXED);
+        return k;
+    }
+
+    /** Posicin de la primera de las n primeras keys que es mayor o igual que k, leyendo las keys sin cerrojo
+    (si el nodo cambia mientras tanto el resultado no vale, pero la bsqueda termina igual) */
+    int lowerBound(int n, const T& k) const {
+        int lo = 0, hi = n;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (key(mid) < k) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    /** Cambia el nmero de keys */
+    void setCount(int n) {
+        __atomic_store_n(&this->_n_elems, n, __ATOMIC_RELAXED);
+    }
+
+    /** Cambia la key i */
+    void setKey(int i, T k) {
+        __atomic_store(&this->_elems[i], &k, __ATOMIC_RELAXED);
+    }
+
+    /** Cambia el hijo i (con release: lo escrito antes en c se ve al llegar a c por aqu) */
+    void setChild(int i, OLCNode* c) {
+        __atomic_store_n(&this->_child[i], static_cast<Node<T>*>(c), __ATOMIC_RELEASE);
+    }
+
+    /**
+    Parte el hijo i (lleno) en dos, como Node::splitChild: la mitad mayor de sus keys pasa a un nodo nuevo que queda
+    como hijo i + 1, y la key de en medio sube a este nodo.
+
+    @param i posicin del hijo que se parte
+    @param alloc poltica de reserva con la que se crea el nodo nuevo
+    */
+    template <class A>
+    void splitChild(int i, A& alloc) {
+        OLCNode* y = child(i);
+        OLCNode* z = alloc.allocate(y->_is_leaf);
+        int t = (this->_max_elems + 1) / 2;
+        int z_elems = y->_n_elems - t;
+        for (int j = 0; j < z_elems; j++) z->setKey(j, y->_elems[j + t]);
+        if (!y->_is_leaf) for (int j = 0; j <= z_elems; j++) z->setChild(j, y->child(j + t));
+        z->setCount(z_elems);
+        y->setCount(t - 1);
+
+        for (int j = this->_n_elems; j > i; j--) setChild(j + 1, child(j));
+        setChild(i + 1, z);
+        for (int j = this->_n_elems - 1; j >= i; j--) setKey(j + 1, this->_elems[j]);
+        setKey(i, y->_elems[t - 1]);
+        setCount(this->_n_elems + 1);
+    }
+
+    /** Pasa la key i al hijo i (al final) y la primera del hijo i + 1 a la posicin i, como Node::borrowFromNext */
+    void borrowFromNext(int i) {
+        OLCNode* c = child(i);
+        OLCNode* s = child(i + 1);
+        int c_elems = c->_n_elems, s_elems = s->_n_elems;
+        c->setKey(c_elems, this->_elems[i]);
+        if (!c->_is_leaf) c->setChild(c_elems + 1, s->child(0));
+        setKey(i, s->_elems[0]);
+        for (int j = 1; j < s_elems; j++) s->setKey(j - 1, s->_elems[j]);
+        if (!s->_is_leaf) for (int j = 1; j <= s_elems; j++) s->setChild(j - 1, s->child(j));
+        c->setCount(c_elems + 1);
+        s->setCount(s_elems - 1);
+    }
+
+    /** Pasa la key i - 1 al hijo i (al principio) y la ltima del hijo i - 1 a la posicin i - 1, como Node::borrowFromPrev */
+    void borrowFromPrev(int i) {
+        OLCNode* c = child(i);
+        OLCNode* s = child(i - 1);
+        int c_elems = c->_n_elems, s_elems = s->_n_elems;
+        for (int j = c_elems - 1; j >= 0; j--) c->setKey(j + 1, c->_elems[j]);
+        if (!c->_is_leaf) for (int j = c_elems; j >= 0; j--) c->setChild(j + 1, c->child(j));
+        c->setKey(0, this->_elems[i - 1]);
+        if (!c->_is_leaf) c->setChild(0, s->child(s_elems));
+        setKey(i - 1, s->_elems[s_elems - 1]);
+        c->setCount(c_elems + 1);
+        s->setCount(s_elems - 1);
+    }
+
+    /**
+    Une el hijo i + 1 y la key i con el hijo i, como Node::merge. El hijo i + 1 se devuelve a la poltica de reserva.
+
+    @param i posicin del hijo que acoge la unin
+    @param alloc poltica de reserva con la que se libera el hijo i + 1
+    */
+    template <class A>
+    void merge(int i, A& alloc) {
+        OLCNode* c = child(i);
+        OLCNode* s = child(i + 1);
+        int t = (this->_max_elems + 1) / 2;
+        int n = this->_n_elems, s_elems = s->_n_elems;
+        c->setKey(t - 1, this->_elems[i]);
+        for (int j = 0; j < s_elems; j++) c->setKey(j + t, s->_elems[j]);
+        if (!c->_is_leaf) for (int j = 0; j <= s_elems; j++) c->setChild(j + t, s->child(j));
+        for (int j = i + 1; j < n; j++) setKey(j - 1, this->_elems[j]);
+        for (int j = i + 2; j <= n; j++) setChild(j - 1, child(j));
+        c->setCount(c->_n_elems + s_elems + 1);
+        setCount(n - 1);
+        alloc.deallocate(s);
+    }
+
+    /** Quita la key i del nodo (que es hoja) */
+    void removeFromLeaf(int i) {
+        int n = this->_n_elems;
+        for (int j = i + 1; j < n; j++) setKey(j - 1, this->_elems[j]);
+        setCount(n - 1);
+    }
+
+    /** Mete k en la posicin i del nodo (que es hoja), desplazando las keys desde i */
+    void insertInLeaf(int i, const T& k) {
+        for (int j = this->_n_elems; j > i; j--) setKey(j, this->_elems[j - 1]);
+        setKey(i, k);
+        setCount(this->_n_elems + 1);
+    }
+
+    VersionLock _lock; // cerrojo con versin del nodo
+
+private:
+
+    OLCNode(int max_elems, bool is_leaf) : Node<T>(max_elems, is_leaf, sizeof(OLCNode)), _lock() {}
+};
+
+/**
+
+Clase que representa a un rbol-B que se puede usar desde varios hilos a la vez.
+
+- search es optimista: no bloquea nada, lee cada nodo y valida su versin antes de pasar al hijo
+  (si un escritor lo ha cambiado mientras tanto, vuelve a empezar desde la raz).
+- insert y remove bajan bloqueando nodo a nodo (lock coupling): como se parten los hijos llenos antes de bajar
+  (insert) y se rellenan los que tienen menos de t keys (remove), ningn cambio sube hacia arriba y se puede soltar
+  el padre en cuanto se tiene el hijo. Solo se bloquean a la vez varios hijos de un mismo nodo estando bloqueado
+  el padre, as que no puede haber interbloqueos. Los nodos por los que solo se pasa se sueltan sin cambiar su
+  versin, as que los lectores solo vuelven a empezar si de verdad se ha cambiado algo de lo que han ledo (un nodo
+  que se ha partido o rellenado al bajar a l cuenta como cambiado aunque luego solo se pase por l).
+- El puntero a la raz solo se bloquea para cambiarlo (al partir la raz o al quedarse vaca); los escritores
+  empiezan bloqueando la raz y comprobando que sigue sindolo.
+- Los nodos que desaparecen al hacer merge no se liberan hasta que ningn lector puede estar leyndolos (ver Epoch.h).
+
+Las keys se leen mientras otro hilo las puede estar escribiendo (la lectura se descarta si la versin cambia). Para que
+eso no sea una carrera de datos se leen y se escriben con operaciones atmicas (ver OLCNode), por eso tienen que ser
+trivialmente copiables y de un tamao que se pueda leer de forma atmica sin cerrojo (1, 2, 4 u 8 bytes).
+Los nodos se reservan de uno en uno (NodePool no es seguro entre hilos).
+
+traverse, size y check solo se deben llamar cuando no hay otros hilos usando el rbol.
+
+@author lvaro Corrochano Lpez
+
+*/
+template <class T>
+class ConcurrentBTree {
+
+    static_assert(is_trivially_copyable<T>::value, "ConcurrentBTree necesita keys trivialmente copiables");
+    static_assert(__atomic_always_lock_free(sizeof(T), 0), "ConcurrentBTree necesita keys que se puedan leer de forma atmica");
+
+public:
+
+    /** Constructor vaco, tamao de las keys con tamao por defecto (= 3) */
+    ConcurrentBTree() : _rootLock(), _root(NULL), _size(DEFAULT_SIZE), _epoch(), _alloc(DEFAULT_SIZE, _epoch) {
+        _root.store(_alloc.allocate(true));
+    }
+
+    /**
+    Constructor vaco especificando el tamao
+
+    Error: Si el tamao especificado es menor que 2, lanza una excepcin E_BTree_Lower
+    Error: Si el tamao especificado es mayor que 1000, lanza una excepcin E_BTree_Bigger
+
+    @param size nmero mximo de keys que puede almacenar el nodo
+    */
+    ConcurrentBTree(int size) : _rootLock(), _root(NULL), _size(size), _epoch(), _alloc(size, _epoch) {
+        if (size < MIN_SIZE) throw E_BTree_Lower();
+        if (size > MAX_SIZE) throw E_BTree_Bigger();
+
+        _root.store(_alloc.allocate(true));
+    }
+
+    ConcurrentBTree(const ConcurrentBTree&) = delete;
+    ConcurrentBTree& operator=(const ConcurrentBTree&) = delete;
+
+    /** Destructor, libera todos los nodos (los retirados los libera el gestor de pocas) */
+    ~ConcurrentBTree() {
+        freeSubtree(_root.load());
+    }
+
+    /** Devuelve el nmero mximo de keys que puede almacenar un nodo del rbol
+
+    @return nmero mximo de keys que puede almacenar un nodo del rbol
+    */
+    int n_keys() const {
+        return _size;
+    }
+
+    /** Busca el elemento pasado por parmetro en el rbol sin bloquear ningn nodo.
+
+      @param k elemento a buscar en el rbol.
+
+      @return true si la clave est en el rbol
+    */
+    bool search(T k) {
+        EpochGuard guard(_epoch); // Ningn nodo que leamos se libera hasta que salgamos
+        while (true) {
+            bool restart = false;
+            bool found = searchOptimistic(k, restart);
+            if (!restart) return found;
+        }
+    }
+
+    /**
+        Funcin para insertar un elemento en el rbol.
+        Parte la raz si est llena y baja bloqueando nodo a nodo, partiendo los hijos llenos antes de entrar en ellos.
+
+        @param k elemento a insertar en el rbol.
+    */
+    void insert(T k) {
+        EpochGuard guard(_epoch); // La raz que se bloquea puede dejar de serlo y retirarse mientras tanto
+        OLCNode<T>* x = lockRoot();
+        bool dirty = false; // Si se ha cambiado x desde que se bloque (al partirlo como hijo)
+
+        if (x->_n_elems == _size) { // Si la raz est llena la partimos y el rbol crece
+            OLCNode<T>* s = _alloc.allocate(false);
+            s->_lock.writeLock();
+            s->setChild(0, x);
+            s->splitChild(0, _alloc);
+            setRoot(s);
+            x->_lock.writeUnlock();
+            x = s;
+            dirty = true;
+        }
+
+        while (!x->_is_leaf) { // x est bloqueado y no est lleno
+            int i = keyUpperBound(x->_elems, x->_n_elems, k); // Posicin de la primera key mayor que k
+            OLCNode<T>* c = x->child(i);
+            c->_lock.writeLock();
+            bool c_dirty = c->_n_elems == _size;
+
+            if (c_dirty) { // Si el hijo est lleno lo partimos antes de bajar
+                x->splitChild(i, _alloc);
+                if (x->_elems[i] < k) { // k va a la mitad nueva
+                    OLCNode<T>* z = x->child(i + 1);
+                    z->_lock.writeLock();
+                    c->_lock.writeUnlock();
+                    c = z;
+                }
+                x->_lock.writeUnlock(); // Ya tenemos el hijo, soltamos el padre
+            }
+            else if (dirty) x->_lock.writeUnlock();
+            else x->_lock.writeUnlockUnchanged(); // Solo hemos pasado por el padre
+            x = c;
+            dirty = c_dirty;
+        }
+
+        x->insertInLeaf(keyUpperBound(x->_elems, x->_n_elems, k), k);
+        x->_lock.writeUnlock();
+    }
+
+    /**
+    Funcin para eliminar una key del rbol.
+    Baja bloqueando nodo a nodo y rellena (fill) cada hijo con menos de t keys antes de entrar en l, igual que Node::remove.
+
+    @param k key a eliminar
+
+    @return true si la key estaba en el rbol (y se ha eliminado)
+    */
+    bool remove(T k) {
+        int t = (_size + 1) / 2; // Mitad del mximo de hijos
+        EpochGuard guard(_epoch); // La raz que se bloquea puede dejar de serlo y retirarse mientras tanto
+        OLCNode<T>* x = lockRoot();
+        bool is_root = true; // Si x es la raz (que puede quedarse vaca)
+        bool dirty = false;  // Si se ha cambiado x desde que se bloque (al rellenarlo como hijo)
+
+        while (true) {
+            int i = keyLowerBound(x->_elems, x->_n_elems, k); // Posicin de la primera key mayor o igual que k
+            OLCNode<T>* next;
+            bool changed = true; // Si se ha cambiado x (y next) en esta vuelta
+
+            if (i < x->_n_elems && x->_elems[i] == k) { // Si la key est en este nodo
+                if (x->_is_leaf) {
+                    x->removeFromLeaf(i);
+                    x->_lock.writeUnlock();
+                    return true;
+                }
+
+                OLCNode<T>* c = x->child(i);
+                c->_lock.writeLock();
+                if (c->_n_elems >= t) { // Sustituimos k por su predecesor
+                    replaceWithExtreme(x, i, c, true);
+                    x->_lock.writeUnlock();
+                    return true;
+                }
+
+                OLCNode<T>* d = x->child(i + 1);
+                d->_lock.writeLock();
+                if (d->_n_elems >= t) { // Sustituimos k por su sucesor
+                    c->_lock.writeUnlockUnchanged();
+                    replaceWithExtreme(x, i, d, false);
+                    x->_lock.writeUnlock();
+                    return true;
+                }
+
+                x->merge(i, _alloc); // k baja al hijo i junto con todas las keys de d
+                next = c;
+            }
+            else {
+                if (x->_is_leaf) { // La key no est en el rbol
+                    if (dirty) x->_lock.writeUnlock();
+                    else x->_lock.writeUnlockUnchanged();
+                    return false;
+                }
+                x->child(i)->_lock.writeLock();
+                next = fillChild(x, i, changed);
+            }
+
+            if (is_root && x->_n_elems == 0) { // La raz se ha quedado sin keys al hacer merge, su nico hijo pasa a ser la raz
+                setRoot(next);
+                _alloc.deallocate(x);
+            }
+            else if (changed || dirty) x->_lock.writeUnlock();
+            else x->_lock.writeUnlockUnchanged();
+            is_root = false;
+            x = next;
+            dirty = changed;
+        }
+    }
+
+    /**
+    Funcin que aplica f a cada key del rbol, en orden creciente.
+    Solo se debe llamar cuando ningn otro hilo est usando el rbol.
+
+    @param f funcin que recibe cada key (const T&)
+    */
+    template <class F>
+    void for_each(F f) const {
+        inOrder(static_cast<const OLCNode<T>*>(_root.load()), [&f](const OLCNode<T>* x, int i) { f(x->_elems[i]); });
+    }
+
+    /**
+    Funcin para recorrer el rbol, va sacando las keys guardadas en orden (siempre creciente).
+    Solo se debe llamar cuando ningn otro hilo est usando el rbol.
+
+    @param out flujo en el que se sacan (por defecto la salida estndar)
+    */
+    void traverse(ostream& out = cout) const {
+        for_each([&out](const T& k) { out << " " << k; });
+    }
+
+    /**
+    Nmero de keys del rbol. Solo se debe llamar cuando ningn otro hilo est usando el rbol.
+
+    @return nmero de keys guardadas en el rbol
+    */
+    size_t size() const {
+        return count(_root.load());
+    }
+
+    /**
+    Comprueba las propiedades de un rbol-B: keys ordenadas (tambin respecto a los padres), todas las hojas
+    a la misma profundidad, cada nodo salvo la raz con al menos t - 1 keys y ningn nodo bloqueado ni obsoleto.
+    Solo se debe llamar cuando ningn otro hilo est usando el rbol.
+
+    @return true si el rbol es un rbol-B vlido
+    */
+    bool check() const {
+        int leaf_depth = -1;
+        return check(_root.load(), true, 0, leaf_depth, NULL, NULL);
+    }
+
+private:
+
+    /**
+      Poltica de reserva de los nodos: los crea en el heap y, al liberarlos (merge o raz vaca), en vez de
+      destruirlos los marca como obsoletos y se los da al gestor de pocas. El nodo tiene que estar bloqueado.
+      */
+    class RetireAllocator {
+
+    public:
+
+        RetireAllocator(int max_elems, EpochManager& epoch) : _max_elems(max_elems), _epoch(epoch) {}
+
+        OLCNode<T>* allocate(bool is_leaf) {
+            return OLCNode<T>::create(_max_elems, is_leaf);
+        }
+
+        void deallocate(Node<T>* n) {
+            OLCNode<T>* o = static_cast<OLCNode<T>*>(n);
+            o->_lock.writeUnlockObsolete();
+            _epoch.retire(o, &OLCNode<T>::destroyRetired);
+        }
+
+    private:
+
+        int _max_elems;        // nmero mximo de keys de cada nodo
+        EpochManager& _epoch;  // gestor de pocas del rbol
+    };
+
+    /**
+    Una pasada de search desde la raz. Si algn nodo cambia mientras se lee, pone restart a true.
+
+    @param k elemento a buscar
+    @param restart se pone a true si hay que volver a empezar
+
+    @return true si la clave est en el rbol (solo vale si restart sigue a false)
+    */
+    bool searchOptimistic(const T& k, bool& restart) {
+        uint64_t vr = _rootLock.readLock(restart);
+        if (restart) return false;
+        OLCNode<T>* x = _root.load(std::memory_order_acquire);
+        uint64_t v = x->_lock.readLock(restart);
+        if (restart || !_rootLock.check(vr)) {
+            restart = true;
+            return false;
+        }
+
+        while (true) {
+            int n = x->optimisticCount();
+            int i = x->lowerBound(n, k); // Buscamos el primer ndice i cuya clave cumpla k <= key
+            if (i < n && k == x->key(i)) {
+                if (!x->_lock.check(v)) restart = true;
+                return true;
+            }
+            if (x->_is_leaf) {
+                if (!x->_lock.check(v)) restart = true;
+                return false;
+            }
+            OLCNode<T>* c = x->child(i);
+            if (!x->_lock.check(v)) { // El puntero al hijo puede no valer
+                restart = true;
+                return false;
+            }
+            uint64_t cv = c->_lock.readLock(restart);
+            if (restart || !x->_lock.check(v)) {
+                restart = true;
+                return false;
+            }
+            x = c;
+            v = cv;
+        }
+    }
+
+    /**
+    Funcin que se asegura de que el hijo i de x (x y el hijo bloqueados) tenga al menos t keys antes de bajar a l,
+    cogiendo una key de un hermano o haciendo merge con l, como Node::fill. Bloquea los hermanos que necesita y
+    los suelta al terminar.
+
+    @param x nodo padre (bloqueado)
+    @param i posicin del hijo
+    @param changed (salida) true si se ha cambiado x (y el hijo), false si el hijo ya tena t keys
+
+    @return el nodo (bloqueado) al que hay que bajar: el hijo i o, si se ha unido con el anterior, el hijo i - 1
+    */
+    OLCNode<T>* fillChild(OLCNode<T>* x, int i, bool& changed) {
+        int t = (_size + 1) / 2;
+        OLCNode<T>* c = x->child(i);
+        changed = c->_n_elems < t;
+        if (!changed) return c;
+
+        OLCNode<T>* prev = NULL;
+        if (i != 0) { // si tiene hermano predecesor y tiene al menos t keys, cogemos una key suya
+            prev = x->child(i - 1);
+            prev->_lock.writeLock();
+            if (prev->_n_elems >= t) {
+                x->borrowFromPrev(i);
+                prev->_lock.writeUnlock();
+                return c;
+            }
+        }
+
+        if (i != x->_n_elems) { // si tiene hermano sucesor, cogemos una key suya o hacemos merge con l
+            OLCNode<T>* next = x->child(i + 1);
+            next->_lock.writeLock();
+            if (prev != NULL) prev->_lock.writeUnlockUnchanged();
+            if (next->_n_elems >= t) {
+                x->borrowFromNext(i);
+                next->_lock.writeUnlock();
+            }
+            else x->merge(i, _alloc); // next queda obsoleto y desbloqueado
+            return c;
+        }
+
+        x->merge(i - 1, _alloc); // si es el ltimo hijo hace merge con su predecesor, c queda obsoleto
+        return prev;
+    }
+
+    /**
+    Funcin que sustituye la key i de x por la mayor (o la menor) key del subrbol con raz c y la elimina de ah.
+    Baja rellenando los hijos como remove pero sin soltar ningn nodo del camino hasta terminar: la key cambia de nivel,
+    y as ningn lector puede verla a la vez en los dos sitios ni en ninguno. Por lo mismo, todos los nodos del camino
+    se sueltan cambiando su versin aunque no se hayan tocado: un lector que pas por x antes del cambio no puede
+    seguir bajando hasta la hoja sin volver a empezar.
+
+    @param x nodo (bloqueado) con la key que se sustituye
+    @param i posicin de la key en x
+    @param c hijo (bloqueado y con al menos t keys) del que se saca la key
+    @param max true para sacar el predecesor (la mayor key de c), false para el sucesor (la menor)
+    */
+    void replaceWithExtreme(OLCNode<T>* x, int i, OLCNode<T>* c, bool max) {
+        vector<OLCNode<T>*> path(1, c); // Nodos bloqueados por debajo de x
+        OLCNode<T>* y = c;
+        while (!y->_is_leaf) {
+            int j = max ? y->_n_elems : 0;
+            y->child(j)->_lock.writeLock();
+            bool changed;
+            y = fillChild(y, j, changed);
+            path.push_back(y);
+        }
+
+        int j = max ? y->_n_elems - 1 : 0;
+        x->setKey(i, y->_elems[j]);
+        y->removeFromLeaf(j);
+        for (size_t l = 0; l < path.size(); l++) path[l]->_lock.writeUnlock();
+    }
+
+    /**
+    Funcin que bloquea la raz. Entre leer el puntero y bloquear el nodo otro escritor puede haber cambiado la raz,
+    as que despus se comprueba que sigue sindolo (mientras est bloqueada ya no puede dejar de serlo).
+    Hay que estar dentro de una poca: la raz antigua puede estar retirada.
+
+    @return la raz, bloqueada
+    */
+    OLCNode<T>* lockRoot() {
+        while (true) {
+            OLCNode<T>* x = _root.load(std::memory_order_acquire);
+            x->_lock.writeLock();
+            if (_root.load(std::memory_order_acquire) == x) return x;
+            x->_lock.writeUnlockUnchanged();
+        }
+    }
+
+    /** Cambia la raz (la antigua tiene que estar bloqueada) bloqueando el puntero para que los lectores lo noten
+
+    @param x nueva raz
+    */
+    void setRoot(OLCNode<T>* x) {
+        _rootLock.writeLock();
+        _root.store(x, std::memory_order_release);
+        _rootLock.writeUnlock();
+    }
+
+    /** Libera uno a uno los nodos del subrbol con raz x */
+    void freeSubtree(OLCNode<T>* x) {
+        if (!x->_is_leaf) {
+            for (int i = 0; i <= x->_n_elems; i++) freeSubtree(x->child(i));
+        }
+        OLCNode<T>::destroy(x);
+    }
+
+    /** Nmero de keys del subrbol con raz x */
+    static size_t count(const OLCNode<T>* x) {
+        size_t n = x->_n_elems;
+        if (!x->_is_leaf) {
+            for (int i = 0; i <= x->_n_elems; i++) n += count(x->child(i));
+        }
+        return n;
+    }
+
+    /**
+    Comprueba recursivamente el subrbol con raz x.
+
+    @param x raz del subrbol
+    @param is_root indica si x es la raz del rbol
+    @param depth profundidad de x
+    @param leaf_depth profundidad de las hojas (-1 hasta encontrar la primera)
+    @param lo si no es NULL, todas las keys del subrbol deben ser mayores o iguales que *lo
+    @param hi si no es NULL, todas las keys del subrbol deben ser menores o iguales que *hi
+
+    @return true si el subrbol es vlido
+    */
+    bool check(const OLCNode<T>* x, bool is_root, int depth, int& leaf_depth, const T* lo, const T* hi) const {
+        bool restart = false;
+        x->_lock.readLock(restart);
+        if (restart) return false; // Bloqueado u obsoleto
+        int t = (_size + 1) / 2;
+        if (x->_n_elems > _size || (!is_root && x->_n_elems < t - 1)) return false;
+        if (!x->_is_leaf && x->_n_elems == 0) return false;
+
+        for (int i = 0; i < x->_n_elems; i++) {
+            if (i > 0 && x->_elems[i] < x->_elems[i - 1]) return false;
+            if ((lo != NULL && x->_elems[i] < *lo) || (hi != NULL && *hi < x->_elems[i])) return false;
+        }
+
+        if (x->_is_leaf) {
+            if (leaf_depth == -1) leaf_depth = depth;
+            return leaf_depth == depth;
+        }
+        for (int i = 0; i <= x->_n_elems; i++) {
+            const T* clo = i == 0 ? lo : &x->_elems[i - 1];
+            const T* chi = i == x->_n_elems ? hi : &x->_elems[i];
+            if (!check(x->child(i), false, depth + 1, leaf_depth, clo, chi)) return false;
+        }
+        return true;
+    }
+
+    VersionLock _rootLock;            // cerrojo del puntero a la raz (solo se coge al partir la raz o al quedarse vaca)
+    atomic<OLCNode<T>*> _root;        // nodo raz
+    int _size;                        // nmero mximo de keys por nodo
+    EpochManager _epoch;              // gestor de pocas para liberar los nodos retirados
+    RetireAllocator _alloc;           // poltica de reserva de los nodos
+};
+
+#endif
@@ -0,0 +1,480 @@
+/*
+- rbol-B con copia en escritura (copy-on-write): los lectores ven versiones fijas del rbol sin bloquear nada
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __COWBTREE_H
+#define __COWBTREE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+#include "BTree.h"
+#include "Epoch.h"
+
+/**
+
+Clase que representa a un rbol-B con copia en escritura (MVCC): los nodos publicados no se modifican nunca.
+
+- Un escritor copia cada nodo que va a cambiar (el camino desde la raz hasta la hoja, y los hermanos con los que
+  presta o hace merge) y cambia las copias con las mismas funciones de Node que BTree (splitChild, fill, merge...).
+  Al terminar publica de una vez, con un puntero atmico, una versin nueva con la raz copiada; los nodos que no
+  se han tocado se comparten entre las dos versiones.
+- Un lector coge la versin actual con view y la recorre sin bloquear nada: ve el rbol tal y como estaba al
+  cogerla aunque los escritores sigan cambindolo, y los escritores no le esperan nunca.
+- Los nodos sustituidos se retiran al publicar y se liberan cuando ya no puede haber ningn lector en una versin
+  que los tenga (ver Epoch.h). Un lector que tarda mucho (por ejemplo, una exportacin) retrasa esa liberacin.
+
+Los escritores se ponen en fila con un mutex. Las operaciones en lote (insert_batch, remove_batch) copian cada nodo
+una sola vez para todo el lote y publican una nica versin, as que cuestan mucho menos que de una en una.
+No hay borrado con lpidas (remove_lazy): en un nodo copiado borrar de verdad cuesta lo mismo.
+
+@author lvaro Corrochano Lpez
+
+*/
+template <class T>
+class CowBTree {
+
+    /** Versin publicada del rbol: su raz y su nmero de keys */
+    struct Version {
+        Version(Node<T>* root, size_t size, uint64_t number) : _root(root), _size(size), _number(number) {}
+
+        Node<T>* _root;   // raz
+        size_t _size;     // nmero de keys
+        uint64_t _number; // nmero de la versin (1 la del rbol vaco, y una ms con cada escritura)
+    };
+
+public:
+
+    /**
+      Versin del rbol que est leyendo un hilo. Mientras existe, ningn nodo de la versin se libera.
+      No se puede copiar; se crea con CowBTree::view y debe destruirse antes que el rbol.
+      */
+    class View {
+
+    public:
+
+        /**
+        Busca una key en la versin.
+
+        @param k elemento a buscar
+
+        @return true si la clave est
+        */
+        bool search(const T& k) const {
+            const Node<T>* x = _version->_root;
+            while (true) {
+                int i = keyLowerBound(x->_elems, x->_n_elems, k); // Primer ndice i cuya clave cumpla k <= key
+                if (i < x->_n_elems && k == x->_elems[i]) return true;
+                if (x->_is_leaf) return false;
+                x = x->_child[i];
+            }
+        }
+
+        /**
+        Funcin que aplica f a cada key de la versin, en orden creciente.
+
+        @param f funcin que recibe cada key (const T&)
+        */
+        template <class F>
+        void for_each(F f) const {
+            inOrder(static_cast<const Node<T>*>(_version->_root), [&f](const Node<T>* x, int i) { f(x->_elems[i]); });
+        }
+
+        /**
+        Funcin para recorrer la versin, va sacando las keys guardadas en orden (siempre creciente).
+
+        @param out flujo en el que se sacan (por defecto la salida estndar)
+        */
+        void traverse(ostream& out = cout) const {
+            for_each([&out](const T& k) { out << " " << k; });
+        }
+
+        /** Nmero de keys de la versin */
+        size_t size() const {
+            return _version->_size;
+        }
+
+        /** Nmero de la versin (crece con cada escritura) */
+        uint64_t number() const {
+            return _version->_number;
+        }
+
+        View(const View&) = delete;
+        View& operator=(const View&) = delete;
+
+    private:
+
+        friend class CowBTree;
+
+        /** Entra en la poca y solo despus coge la versin, as no se puede liberar mientras se lee */
+        explicit View(const CowBTree& tree) : _guard(tree._epoch), _version(tree._current.load(std::memory_order_acquire)) {}
+
+        EpochGuard _guard;       // mantiene al hilo dentro de la poca
+        const Version* _version; // versin que se lee
+    };
+
+    /** Constructor vaco, tamao de las keys con tamao por defecto (= 3) */
+    CowBTree() : _size(DEFAULT_SIZE), _epoch(), _fresh(), _alloc(DEFAULT_SIZE, _fresh), _current(NULL), _write(), _replaced() {
+        _current.store(new Version(Node<T>::create(_size, true), 0, 1));
+    }
+
+    /**
+    Constructor vaco especificando el tamao
+
+    Error: Si el tamao especificado es menor que 2, lanza una excepcin E_BTree_Lower
+    Error: Si el tamao especificado es mayor que 1000, lanza una excepcin E_BTree_Bigger
+
+    @param size nmero mximo de keys que puede almacenar el nodo
+    */
+    CowBTree(int size) : _size(size), _epoch(), _fresh(), _alloc(size, _fresh), _current(NULL), _write(), _replaced() {
+        if (size < MIN_SIZE) throw E_BTree_Lower();
+        if (size > MAX_SIZE) throw E_BTree_Bigger();
+
+        _current.store(new Version(Node<T>::create(_size, true), 0, 1));
+    }
+
+    CowBTree(const CowBTree&) = delete;
+    CowBTree& operator=(const CowBTree&) = delete;
+
+    /** Destructor, libera los nodos de la versin actual (los retirados los libera el gestor de pocas) */
+    ~CowBTree() {
+        Version* v = _current.load();
+        freeSubtree(v->_root);
+        delete v;
+    }
+
+    /** Devuelve el nmero mximo de keys que puede almacenar un nodo del rbol
+
+    @return nmero mximo de keys que puede almacenar un nodo del rbol
+    */
+    int n_keys() const {
+        return _size;
+    }
+
+    /** Nmero de keys de la versin actual */
+    size_t size() const {
+        View v(*this);
+        return v.size();
+    }
+
+    /**
+    Coge la versin actual del rbol para leerla sin bloquear a los escritores.
+
+    @return la versin, que no cambia aunque se siga escribiendo en el rbol
+    */
+    View view() const {
+        return View(*this);
+    }
+
+    /** Busca el elemento pasado por parmetro en la versin actual del rbol, sin bloquear nada.
+
+      @param k elemento a buscar en el rbol.
+
+      @return true si la clave est en el rbol
+    */
+    bool search(const T& k) const {
+        View v(*this);
+        return v.search(k);
+    }
+
+    /**
+    Funcin que aplica f a cada key de la versin actual, en orden creciente (aunque se escriba a la vez).
+
+    @param f funcin que recibe cada key (const T&)
+    */
+    template <class F>
+    void for_each(F f) const {
+        View v(*this);
+        v.for_each(f);
+    }
+
+    /**
+    Funcin para recorrer la versin actual del rbol, va sacando las keys guardadas en orden (siempre creciente).
+
+    @param out flujo en el que se sacan (por defecto la salida estndar)
+    */
+    void traverse(ostream& out = cout) const {
+        View v(*this);
+        v.traverse(out);
+    }
+
+    /**
+    Funcin para insertar un elemento en el rbol y publicar la versin nueva.
+
+    @param k elemento a insertar en el rbol.
+    */
+    void insert(T k) {
+        std::lock_guard<std::mutex> lock(_write);
+        Node<T>* root = begin();
+        root = insertCopy(root, k);
+        publish(root, 1, 0);
+    }
+
+    /**
+    Funcin para eliminar una key del rbol y publicar la versin nueva (si estaba).
+
+    @param k key a eliminar
+
+    @return true si la key estaba en el rbol (y se ha eliminado)
+    */
+    bool remove(T k) {
+        std::lock_guard<std::mutex> lock(_write);
+        if (!contains(_current.load()->_root, k)) return false; // Si no est, no se copia nada
+        Node<T>* root = begin();
+        root = removeCopy(root, k);
+        publish(root, 0, 1);
+        return true;
+    }
+
+    /**
+    Funcin para insertar varias keys publicando una sola versin: cada nodo se copia como mucho una vez.
+
+    @param first iterador al principio de las keys
+    @param last iterador al final de las keys
+    */
+    template <class It>
+    void insert_batch(It first, It last) {
+        std::lock_guard<std::mutex> lock(_write);
+        Node<T>* root = begin();
+        size_t n = 0;
+        for (; first != last; ++first, n++) root = insertCopy(root, *first);
+        publish(root, n, 0);
+    }
+
+    /**
+    Funcin para eliminar varias keys publicando una sola versin: cada nodo se copia como mucho una vez.
+
+    @param first iterador al principio de las keys
+    @param last iterador al final de las keys
+
+    @return nmero de keys que estaban en el rbol (y se han eliminado)
+    */
+    template <class It>
+    size_t remove_batch(It first, It last) {
+        std::lock_guard<std::mutex> lock(_write);
+        Node<T>* root = begin();
+        size_t n = 0;
+        for (; first != last; ++first) {
+            if (!contains(root, *first)) continue;
+            root = removeCopy(root, *first);
+            n++;
+        }
+        publish(root, 0, n);
+        return n;
+    }
+
+private:
+
+    /**
+      Poltica de reserva de los nodos de una escritura: los crea en el heap y apunta en fresh los que todava no se
+      han publicado (se pueden cambiar sin copiarlos). Los nicos que se liberan con ella son hermanos copiados que
+      desaparecen al hacer merge o races copiadas que se quedan vacas, que no ha visto ningn lector.
+      */
+    class CowAllocator {
+
+    public:
+
+        CowAllocator(int max_elems, unordered_set<const Node<T>*>& fresh) : _heap(max_elems), _fresh(fresh) {}
+
+        Node<T>* allocate(bool is_leaf) {
+            Node<T>* n = _heap.allocate(is_leaf);
+            _fresh.insert(n);
+            return n;
+        }
+
+        void deallocate(Node<T>* n) {
+            _fresh.erase(n);
+            _heap.deallocate(n);
+        }
+
+    private:
+
+        HeapNodeAllocator<Node<T> > _heap;       // reserva de los nodos
+        unordered_set<const Node<T>*>& _fresh;   // nodos sin publicar
+    };
+
+    /** Libera un nodo retirado, con la forma que espera EpochManager::retire */
+    static void destroyRetired(void* n) {
+        Node<T>::destroy(static_cast<Node<T>*>(n));
+    }
+
+    /** Libera una versin retirada */
+    static void deleteVersion(void* v) {
+        delete static_cast<Version*>(v);
+    }
+
+    /** Empieza una escritura: devuelve una copia de la raz actual (con _write cogido) */
+    Node<T>* begin() {
+        _fresh.clear(); // Por si una escritura anterior se qued a medias con una excepcin
+        _replaced.clear();
+        return own(_current.load()->_root);
+    }
+
+    /**
+    Devuelve un nodo que se puede cambiar con el contenido de x: x si an no se ha publicado y, si no, una copia suya
+    (y x se apunta para retirarlo al publicar).
+
+    @param x nodo
+
+    @return x o su copia
+    */
+    Node<T>* own(Node<T>* x) {
+        if (_fresh.count(x) > 0) return x;
+        Node<T>* c = _alloc.allocate(x->_is_leaf);
+        for (int i = 0; i < x->_n_elems; i++) c->_elems[i] = x->_elems[i];
+        if (!x->_is_leaf) {
+            for (int i = 0; i <= x->_n_elems; i++) c->_child[i] = x->_child[i];
+        }
+        c->_n_elems = x->_n_elems;
+        _replaced.push_back(x);
+        return c;
+    }
+
+    /** Sustituye el hijo i de x (que ya se puede cambiar) por un nodo que se puede cambiar y lo devuelve */
+    Node<T>* ownChild(Node<T>* x, int i) {
+        return x->_child[i] = own(x->_child[i]);
+    }
+
+    /**
+    Publica la nueva raz como versin actual y retira los nodos sustituidos y la versin anterior.
+
+    @param root raz de la nueva versin
+    @param added keys aadidas
+    @param removed keys eliminadas
+    */
+    void publish(Node<T>* root, size_t added, size_t removed) {
+        Version* old = _current.load();
+        _current.store(new Version(root, old->_size + added - removed, old->_number + 1), std::memory_order_release);
+        _fresh.clear();
+
+        _epoch.retire(old, &deleteVersion);
+        for (size_t j = 0; j < _replaced.size(); j++) _epoch.retire(_replaced[j], &destroyRetired);
+        _replaced.clear();
+    }
+
+    /** Indica si k est en el subrbol con raz x (sin contar en ninguna estadstica) */
+    static bool contains(const Node<T>* x, const T& k) {
+        while (true) {
+            int i = keyLowerBound(x->_elems, x->_n_elems, k);
+            if (i < x->_n_elems && k == x->_elems[i]) return true;
+            if (x->_is_leaf) return false;
+            x = x->_child[i];
+        }
+    }
+
+    /**
+    Inserta k bajando desde la raz (que ya se puede cambiar) y copiando cada nodo por el que pasa, como
+    BTree::insert_nonfull.
+
+    @param root raz
+    @param k key
+
+    @return la raz, que es otra si se ha partido
+    */
+    Node<T>* insertCopy(Node<T>* root, const T& k) {
+        if (root->_n_elems == _size) { // Si la raz est llena la partimos y el rbol crece
+            Node<T>* s = _alloc.allocate(false);
+            s->_child[0] = root;
+            s->splitChild(0, _alloc);
+            root = s;
+        }
+
+        Node<T>* x = root;
+        while (!x->_is_leaf) { // x ya se puede cambiar y no est lleno
+            int i = keyUpperBound(x->_elems, x->_n_elems, k); // Posicin de la primera key mayor que k
+            Node<T>* c = ownChild(x, i);
+            if (c->_n_elems == _size) { // Si el hijo est lleno lo partimos antes de bajar (la otra mitad es nueva)
+                x->splitChild(i, _alloc);
+                if (x->_elems[i] < k) i++;
+            }
+            x = x->_child[i];
+        }
+
+        int i = keyUpperBound(x->_elems, x->_n_elems, k);
+        for (int j = x->_n_elems; j > i; j--) x->_elems[j] = x->_elems[j - 1]; // desplazamos las keys mayores que k
+        x->_elems[i] = k;
+        x->_n_elems += 1;
+        return root;
+    }
+
+    /**
+    Elimina k (que est en el rbol) bajando desde la raz como Node::remove, copiando antes cada nodo que cambia:
+    el hijo al que se baja y, si hay que rellenarlo o hacer merge, sus hermanos.
+
+    @param root raz
+    @param k key
+
+    @return la raz, que es otra si se ha quedado sin keys
+    */
+    Node<T>* removeCopy(Node<T>* root, T k) {
+        int t = (_size + 1) / 2; // Mitad del mximo de hijos
+        Node<T>* x = root;
+
+        while (true) {
+            int i = keyLowerBound(x->_elems, x->_n_elems, k); // Primera key mayor o igual que k
+
+            if (i < x->_n_elems && x->_elems[i] == k) { // Si la clave est en este nodo
+                if (x->_is_leaf) {
+                    x->removeFromLeaf(i);
+                    break;
+                }
+                ownChild(x, i); // Puede cambiar cualquiera de los dos hijos de la key
+                ownChild(x, i + 1);
+                x = x->removeFromNonLeaf(i, k, _alloc); // Seguimos en el hijo que nos diga, con la key que nos diga
+            }
+            else {
+                if (x->_is_leaf) break; // No debera pasar: remove y remove_batch comprueban antes que est
+
+                bool is_in_last = (i == x->_n_elems);
+                if (ownChild(x, i)->_n_elems < t) { // Si hay que rellenarlo, tambin pueden cambiar sus hermanos
+                    if (i != 0) ownChild(x, i - 1);
+                    if (i != x->_n_elems) ownChild(x, i + 1);
+                    x->fill(i, _alloc);
+                }
+
+                if (is_in_last && i > x->_n_elems) x = x->_child[i - 1]; // Si el ltimo hijo ha hecho merge, lo ha hecho con el anterior
+                else x = x->_child[i];
+            }
+        }
+
+        if (root->_n_elems == 0 && !root->_is_leaf) { // La raz se ha quedado sin keys, su nico hijo pasa a ser la raz
+            Node<T>* child = root->_child[0];
+            _alloc.deallocate(root);
+            root = child;
+        }
+        return root;
+    }
+
+    /** Libera uno a uno los nodos del subrbol con raz x, sin recursin (como BTree::freeSubtree) */
+    static void freeSubtree(Node<T>* x) {
+        PathStack<NodeStep<Node<T> > > path;
+        path.push(NodeStep<Node<T> >(x, 0));
+
+        while (!path.empty()) {
+            NodeStep<Node<T> >& s = path.top();
+            if (!s._node->_is_leaf && s._next <= s._node->_n_elems) { // Primero se liberan los hijos
+                Node<T>* c = s._node->_child[s._next++];
+                path.push(NodeStep<Node<T> >(c, 0));
+            }
+            else { // y despus el nodo
+                Node<T>* n = s._node;
+                path.pop();
+                Node<T>::destroy(n);
+            }
+        }
+    }
+
+    int _size;                               // nmero mximo de keys por nodo
+    mutable EpochManager _epoch;             // gestor de pocas para liberar los nodos y versiones retirados
+    unordered_set<const Node<T>*> _fresh;    // nodos de la escritura en curso que an no se han publicado
+    CowAllocator _alloc;                     // poltica de reserva de los nodos
+    atomic<Version*> _current;               // versin actual
+    std::mutex _write;                       // pone en fila a los escritores
+    vector<Node<T>*> _replaced;              // nodos sustituidos por copias en la escritura en curso
+};
+
+#endif
@@ -0,0 +1,979 @@
+/*
+- Representacin de un rbol-B guardado en disco (pginas de tamao fijo, buffer pool y lecturas con mmap)
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __DISKBTREE_H
+#define __DISKBTREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "BTree.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define BTREE_MMAP 1
+#endif
+
+#ifdef _WIN32
+#define BTREE_FSEEK _fseeki64
+#define BTREE_FTELL _ftelli64
+#else
+#define BTREE_FSEEK fseeko
+#define BTREE_FTELL ftello
+#endif
+
+/** Tamao en bytes de cada pgina del fichero: cada nodo ocupa exactamente una */
+const size_t DISK_PAGE_SIZE = 4096;
+
+/** Pginas del buffer pool si no se especifica (4 MB) */
+const size_t DEFAULT_POOL_PAGES = 1024;
+
+/** Mnimo de pginas del buffer pool: una operacin tiene como mucho 5 pginas fijadas a la vez */
+const size_t MIN_POOL_PAGES = 16;
+
+/** Mnimo de claves por nodo en el disco: con 2, al partir un nodo una de las mitades se queda sin keys */
+const int DISK_MIN_SIZE = 3;
+
+/** Identificador de la cabecera del fichero ("BTRE") */
+const uint32_t DISK_MAGIC = 0x42545245;
+
+/** Versin del formato del fichero */
+const uint32_t DISK_VERSION = 1;
+
+/** Nmero de una pgina dentro del fichero (la pgina 0 es la cabecera, as que 0 sirve de "ninguna") */
+typedef uint64_t page_id;
+
+/** Pgina que no existe */
+const page_id NO_PAGE = 0;
+
+/** Excepcin, se ha intentado modificar un rbol abierto en modo solo lectura */
+class E_BTree_ReadOnly{};
+
+/** Excepcin, todas las pginas del buffer pool estn fijadas y no se puede traer otra */
+class E_BTree_Pool{};
+
+/** Modo en el que se abre un DiskBTree */
+enum DiskMode { DISK_READ_WRITE, DISK_READ_ONLY };
+
+/**
+  Fichero de pginas de DISK_PAGE_SIZE bytes. Se lee y se escribe pgina a pgina sin buffer propio (de eso se
+  encarga el buffer pool). En sistemas POSIX se puede proyectar entero en memoria (mmap) para solo leer.
+  */
+class PageFile {
+
+public:
+
+    /** Abre el fichero, o lo crea si no existe y no es de solo lectura
+
+    Error: Si no se puede abrir ni crear, lanza una excepcin E_BTree_File
+
+    @param path ruta del fichero
+    @param read_only true para abrirlo solo para leer
+    */
+    PageFile(const string& path, bool read_only) : _f(NULL), _map(NULL), _map_bytes(0) {
+        _f = fopen(path.c_str(), read_only ? "rb" : "r+b");
+        if (_f == NULL && !read_only) _f = fopen(path.c_str(), "w+b");
+        if (_f == NULL) throw E_BTree_File();
+        setvbuf(_f, NULL, _IONBF, 0); // Las pginas ya las guarda el buffer pool
+    }
+
+    PageFile(const PageFile&) = delete;
+    PageFile& operator=(const PageFile&) = delete;
+
+    /** Destructor, deshace la proyeccin y cierra el fichero (no escribe nada) */
+    ~PageFile() {
+#ifdef BTREE_MMAP
+        if (_map != NULL) munmap(const_cast<char*>(_map), _map_bytes);
+#endif
+        fclose(_f);
+    }
+
+    /** Tamao del fichero en bytes */
+    uint64_t bytes() {
+        if (BTREE_FSEEK(_f, 0, SEEK_END) != 0) throw E_BTree_File();
+        return (uint64_t)BTREE_FTELL(_f);
+    }
+
+    /** Lee una pgina
+
+    Error: Si no se puede leer entera, lanza una excepcin E_BTree_File
+
+    @param id nmero de la pgina
+    @param dst donde se copia (DISK_PAGE_SIZE bytes)
+    */
+    void read(page_id id, char* dst) {
+        if (BTREE_FSEEK(_f, id * DISK_PAGE_SIZE, SEEK_SET) != 0) throw E_BTree_File();
+        if (fread(dst, 1, DISK_PAGE_SIZE, _f) != DISK_PAGE_SIZE) throw E_BTree_File();
+    }
+
+    /** Escribe una pgina
+
+    Error: Si no se puede escribir entera, lanza una excepcin E_BTree_File
+
+    @param id nmero de la pgina
+    @param src contenido de la pgina (DISK_PAGE_SIZE bytes)
+    */
+    void write(page_id id, const char* src) {
+        if (BTREE_FSEEK(_f, id * DISK_PAGE_SIZE, SEEK_SET) != 0) throw E_BTree_File();
+        if (fwrite(src, 1, DISK_PAGE_SIZE, _f) != DISK_PAGE_SIZE) throw E_BTree_File();
+    }
+
+    /** Se asegura de que lo escrito llega al disco */
+    void sync() {
+        fflush(_f);
+#ifdef BTREE_MMAP
+        fsync(fileno(_f));
+#endif
+    }
+
+    /** Proyecta el fichero entero en memoria para leerlo (solo en POSIX)
+
+    @return true si se ha podido proyectar
+    */
+    bool map() {
+#ifdef BTREE_MMAP
+        size_t n = (size_t)bytes();
+        void* p = mmap(NULL, n, PROT_READ, MAP_SHARED, fileno(_f), 0);
+        if (p == MAP_FAILED) return false;
+        madvise(p, n, MADV_RANDOM); // Cada bsqueda toca unas pocas pginas sueltas
+        _map = static_cast<const char*>(p);
+        _map_bytes = n;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /** Pgina dentro de la proyeccin (solo si map ha devuelto true)
+
+    @param id nmero de la pgina
+
+    @return puntero al principio de la pgina
+    */
+    const char* mapped(page_id id) const {
+        return _map + id * DISK_PAGE_SIZE;
+    }
+
+    /** Indica si el fichero est proyectado en memoria */
+    bool isMapped() const {
+        return _map != NULL;
+    }
+
+private:
+
+    FILE* _f;          // fichero
+    const char* _map;  // proyeccin del fichero (NULL si no est proyectado)
+    size_t _map_bytes; // bytes proyectados
+};
+
+/**
+  Buffer pool: guarda en memoria un nmero fijo de pginas del fichero (marcos) y decide cul sale cuando hace falta
+  sitio con el algoritmo CLOCK (una aguja recorre los marcos en crculo y da una segunda oportunidad a los usados
+  desde la ltima vuelta). Las pginas modificadas (sucias) solo se escriben al salir del pool o con flush.
+
+  Mientras se usa una pgina est fijada (pins > 0) y no puede salir. Se fija con fetch o create y se suelta con unpin.
+  */
+class BufferPool {
+
+public:
+
+    /** Constructor, la memoria de los marcos no se reserva hasta que se trae la primera pgina
+
+    @param file fichero de las pginas
+    @param frames nmero de marcos
+    */
+    BufferPool(PageFile& file, size_t frames) : _file(file), _frames(frames), _data(NULL), _table(), _hand(0), _reads(0), _writes(0) {}
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    /** Destructor, libera los marcos sin escribirlos (hay que llamar antes a flush) */
+    ~BufferPool() {
+        if (_data != NULL) ::operator delete(_data, align_val_t(DISK_PAGE_SIZE));
+    }
+
+    /** Trae una pgina al pool (si no estaba) y la fija
+
+    @param id nmero de la pgina
+
+    @return marco con la pgina
+    */
+    size_t fetch(page_id id) {
+        unordered_map<page_id, size_t>::iterator it = _table.find(id);
+        if (it != _table.end()) {
+            Frame& f = _frames[it->second];
+            f._pins++;
+            f._ref = true;
+            return it->second;
+        }
+        size_t v = victim();
+        _file.read(id, data(v));
+        _reads++;
+        install(v, id);
+        return v;
+    }
+
+    /** Fija un marco para una pgina nueva (o reutilizada), llena de ceros y ya sucia, sin leerla del fichero
+
+    @param id nmero de la pgina
+
+    @return marco con la pgina
+    */
+    size_t create(page_id id) {
+        unordered_map<page_id, size_t>::iterator it = _table.find(id);
+        size_t v;
+        if (it != _table.end()) {
+            v = it->second;
+            _frames[v]._pins++;
+        }
+        else {
+            v = victim();
+            install(v, id);
+        }
+        memset(data(v), 0, DISK_PAGE_SIZE);
+        _frames[v]._dirty = true;
+        return v;
+    }
+
+    /** Suelta una pgina fijada
+
+    @param v marco de la pgina
+    */
+    void unpin(size_t v) {
+        _frames[v]._pins--;
+    }
+
+    /** Marca como modificada la pgina de un marco, se escribir al salir del pool */
+    void markDirty(size_t v) {
+        _frames[v]._dirty = true;
+    }
+
+    /** Contenido del marco v */
+    char* data(size_t v) {
+        return _data + v * DISK_PAGE_SIZE;
+    }
+
+    /** Escribe todas las pginas sucias (siguen en el pool) */
+    void flush() {
+        for (size_t v = 0; v < _frames.size(); v++) {
+            if (_frames[v]._id != NO_PAGE && _frames[v]._dirty) {
+                _file.write(_frames[v]._id, data(v));
+                _writes++;
+                _frames[v]._dirty = false;
+            }
+        }
+    }
+
+    /** Nmero de pginas ledas del fichero */
+    uint64_t reads() const {
+        return _reads;
+    }
+
+    /** Nmero de pginas escritas en el fichero */
+    uint64_t writes() const {
+        return _writes;
+    }
+
+private:
+
+    /** Estado de un marco */
+    struct Frame {
+
+        Frame() : _id(NO_PAGE), _pins(0), _dirty(false), _ref(false) {}
+
+        page_id _id; // pgina que tiene (NO_PAGE si est libre)
+        int _pins;   // veces que est fijada
+        bool _dirty; // si se ha modificado desde que se ley o escribi
+        bool _ref;   // bit de referencia de CLOCK
+    };
+
+    /**
+    Elige un marco para una pgina nueva con CLOCK: los marcos con el bit de referencia a 1 lo pierden y se saltan,
+    el primero sin l (y sin fijar) sale del pool, escribindolo antes si est sucio.
+
+    Error: Si todos los marcos estn fijados, lanza una excepcin E_BTree_Pool
+
+    @return marco libre
+    */
+    size_t victim() {
+        if (_data == NULL) _data = static_cast<char*>(::operator new(_frames.size() * DISK_PAGE_SIZE, align_val_t(DISK_PAGE_SIZE)));
+
+        for (size_t step = 0; step < 2 * _frames.size(); step++) { // En dos vueltas todos han perdido el bit de referencia
+            size_t v = _hand;
+            _hand = (_hand + 1) % _frames.size();
+            Frame& f = _frames[v];
+            if (f._pins > 0) continue;
+            if (f._ref) {
+                f._ref = false;
+                continue;
+            }
+            if (f._id != NO_PAGE) {
+                if (f._dirty) {
+                    _file.write(f._id, data(v));
+                    _writes++;
+                }
+                _table.erase(f._id);
+            }
+            return v;
+        }
+        throw E_BTree_Pool();
+    }
+
+    /** Asocia el marco v a la pgina id y lo deja fijado */
+    void install(size_t v, page_id id) {
+        Frame& f = _frames[v];
+        f._id = id;
+        f._pins = 1;
+        f._dirty = false;
+        f._ref = true;
+        _table[id] = v;
+    }
+
+    PageFile& _file;                               // fichero de las pginas
+    vector<Frame> _frames;                    // estado de cada marco
+    char* _data;                                   // contenido de los marcos, uno tras otro
+    unordered_map<page_id, size_t> _table;    // marco de cada pgina del pool
+    size_t _hand;                                  // aguja de CLOCK
+    uint64_t _reads;                               // pginas ledas
+    uint64_t _writes;                              // pginas escritas
+};
+
+/**
+  Nodo de un DiskBTree: una pgina fijada (en el buffer pool o en la proyeccin del fichero) vista como nodo.
+  La pgina tiene una cabecera (nmero de keys y si es hoja), las keys y los nmeros de pgina de los hijos,
+  que en el fichero hacen de punteros.
+
+  Mientras existe, la pgina sigue fijada; al destruirlo (o asignarle otro) se suelta. Solo se puede mover.
+  */
+template <class T>
+class DiskNode {
+
+public:
+
+    /** Cabecera de la pgina */
+    struct Header {
+        int32_t _n_elems; // nmero de keys
+        int32_t _is_leaf; // 1 si es hoja
+    };
+
+    /** Desplazamiento de las keys dentro de la pgina */
+    static size_t elemsOffset() {
+        return (sizeof(Header) + alignof(T) - 1) / alignof(T) * alignof(T);
+    }
+
+    /** Desplazamiento de los hijos dentro de la pgina */
+    static size_t childOffset(int max_elems) {
+        size_t end = elemsOffset() + max_elems * sizeof(T);
+        return (end + alignof(page_id) - 1) / alignof(page_id) * alignof(page_id);
+    }
+
+    /** Nmero mximo de keys que caben en una pgina (con sus max + 1 hijos) */
+    static int maxFit() {
+        int m = (int)((DISK_PAGE_SIZE - elemsOffset() - sizeof(page_id)) / (sizeof(T) + sizeof(page_id)));
+        while (childOffset(m) + (m + 1) * sizeof(page_id) > DISK_PAGE_SIZE) m--;
+        return m;
+    }
+
+    DiskNode() : _pool(NULL), _frame(0), _id(NO_PAGE), _data(NULL), _max_elems(0) {}
+
+    /** Constructor a partir de una pgina ya fijada
+
+    @param pool buffer pool donde est fijada (NULL si es de la proyeccin)
+    @param frame marco de la pgina en el pool
+    @param id nmero de la pgina
+    @param data contenido de la pgina
+    @param max_elems nmero mximo de keys del nodo
+    */
+    DiskNode(BufferPool* pool, size_t frame, page_id id, char* data, int max_elems)
+        : _pool(pool), _frame(frame), _id(id), _data(data), _max_elems(max_elems) {}
+
+    DiskNode(const DiskNode&) = delete;
+    DiskNode& operator=(const DiskNode&) = delete;
+
+    DiskNode(DiskNode&& other) : _pool(other._pool), _frame(other._frame), _id(other._id), _data(other._data), _max_elems(other._max_elems) {
+        other._pool = NULL;
+    }
+
+    DiskNode& operator=(DiskNode&& other) {
+        if (this != &other) {
+            release();
+            _pool = other._pool;
+            _frame = other._frame;
+            _id = other._id;
+            _data = other._data;
+            _max_elems = other._max_elems;
+            other._pool = NULL;
+        }
+        return *this;
+    }
+
+    /** Destructor, suelta la pgina */
+    ~DiskNode() {
+        release();
+    }
+
+    /** Nmero de la pgina */
+    page_id id() const {
+        return _id;
+    }
+
+    /** Nmero de keys del nodo (se puede modificar) */
+    int32_t& n() const {
+        return reinterpret_cast<Header*>(_data)->_n_elems;
+    }
+
+    /** Indica si el nodo es hoja */
+    bool leaf() const {
+        return reinterpret_cast<Header*>(_data)->_is_leaf != 0;
+    }
+
+    /** Keys del nodo */
+    T* elems() const {
+        return reinterpret_cast<T*>(_data + elemsOffset());
+    }
+
+    /** Nmeros de pgina de los hijos del nodo */
+    page_id* child() const {
+        return reinterpret_cast<page_id*>(_data + childOffset(_max_elems));
+    }
+
+    /** Marca la pgina como modificada */
+    void dirty() const {
+        if (_pool != NULL) _pool->markDirty(_frame);
+    }
+
+    /** Contenido de la pgina */
+    char* data() const {
+        return _data;
+    }
+
+private:
+
+    /** Suelta la pgina (si es del pool) */
+    void release() {
+        if (_pool != NULL) _pool->unpin(_frame);
+        _pool = NULL;
+    }
+
+    BufferPool* _pool; // pool donde est fijada la pgina (NULL si no hay que soltarla)
+    size_t _frame;     // marco de la pgina
+    page_id _id;       // nmero de la pgina
+    char* _data;       // contenido de la pgina
+    int _max_elems;    // nmero mximo de keys
+};
+
+/**
+
+Clase que representa a un rbol-B guardado en un fichero, que sigue ah al cerrar el programa.
+
+Cada nodo es una pgina de DISK_PAGE_SIZE bytes y los hijos se apuntan con nmeros de pgina. La pgina 0 es la
+cabecera: tipo de fichero, tamao de las keys, nmero mximo de keys por nodo, pgina de la raz, nmero de
+pginas, lista de pginas libres (las que quedan al hacer merge) y nmero de keys. Abrir el rbol solo lee la
+cabecera; los nodos se traen al buffer pool segn se necesitan.
+
+Las operaciones son las mismas que en BTree (los hijos con el mximo de keys se parten al bajar al insertar y los
+que tienen menos de t se rellenan al bajar al eliminar), pero las keys tienen que poder copiarse byte a byte
+(int, double, structs sin punteros...). El fichero usa el orden de bytes de la mquina que lo escribe.
+
+En modo solo lectura (DISK_READ_ONLY), en POSIX el fichero se proyecta en memoria con mmap y las bsquedas leen
+las pginas directamente de la proyeccin, sin copiarlas al pool; en otros sistemas se leen a travs del pool.
+
+Lo modificado solo est seguro en el fichero tras flush (o al destruir el rbol).
+
+@author lvaro Corrochano Lpez
+
+*/
+template <class T>
+class DiskBTree {
+
+    static_assert(is_trivially_copyable<T>::value, "DiskBTree guarda las keys en el fichero byte a byte");
+
+public:
+
+    /**
+    Constructor, abre el rbol guardado en el fichero o, si el fichero no existe (o est vaco), crea un rbol vaco.
+
+    Error: Si no se puede abrir o crear el fichero, o se abre en solo lectura y no existe, lanza una excepcin E_BTree_File
+    Error: Si el fichero no es un rbol con keys de este tamao, lanza una excepcin E_BTree_Format
+    Error: Si el tamao especificado es menor que 3, lanza una excepcin E_BTree_Lower
+    Error: Si el tamao especificado no cabe en una pgina, lanza una excepcin E_BTree_Bigger
+
+    @param path ruta del fichero
+    @param mode DISK_READ_WRITE o DISK_READ_ONLY
+    @param size nmero mximo de keys por nodo al crear el rbol (0 para las que quepan en una pgina; si el fichero ya existe no se usa)
+    @param pool_pages nmero de pginas del buffer pool (como mnimo MIN_POOL_PAGES)
+    */
+    DiskBTree(const string& path, DiskMode mode = DISK_READ_WRITE, int size = 0, size_t pool_pages = DEFAULT_POOL_PAGES)
+        : _file(path, mode == DISK_READ_ONLY), _pool(_file, pool_pages < MIN_POOL_PAGES ? MIN_POOL_PAGES : pool_pages),
+          _meta(), _size(0), _read_only(mode == DISK_READ_ONLY) {
+        if (_file.bytes() == 0) {
+            if (_read_only) throw E_BTree_File();
+            create(size);
+        }
+        else open();
+    }
+
+    DiskBTree(const DiskBTree&) = delete;
+    DiskBTree& operator=(const DiskBTree&) = delete;
+
+    /** Destructor, escribe en el fichero lo que falte */
+    ~DiskBTree() {
+        if (_read_only) return;
+        try {
+            flush();
+        }
+        catch (...) {} // Un destructor no puede lanzar; quien quiera saber si se ha escrito debe llamar a flush
+    }
+
+    /**
+    Escribe en el fichero las pginas modificadas y la cabecera.
+
+    Error: Si no se puede escribir, lanza una excepcin E_BTree_File
+    */
+    void flush() {
+        if (_read_only) return;
+        _pool.flush();
+        vector<char> page(DISK_PAGE_SIZE, 0);
+        memcpy(&page[0], &_meta, sizeof(_meta));
+        _file.write(0, &page[0]);
+        _file.sync();
+    }
+
+    /** Devuelve el nmero mximo de keys que puede almacenar un nodo del rbol
+
+    @return nmero mximo de keys que puede almacenar un nodo del rbol
+    */
+    int n_keys() const {
+        return _size;
+    }
+
+    /** Devuelve el nmero de keys guardadas en el rbol
+
+    @return nmero de keys del rbol
+    */
+    uint64_t size() const {
+        return _meta._count;
+    }
+
+    /** Indica si el rbol est o no vaco
+
+    @return true si el rbol est vaco y false si no lo est
+    */
+    bool isEmpty() const {
+        return _meta._count == 0;
+    }
+
+    /** Nmero de pginas que se han ledo del fichero (las de la proyeccin no cuentan) */
+    uint64_t reads() const {
+        return _pool.reads();
+    }
+
+    /** Nmero de pginas que se han escrito en el fichero */
+    uint64_t writes() const {
+        return _pool.writes();
+    }
+
+    /** Busca el elemento pasado por parmetro en el rbol.
+
+      @param k elemento a buscar en el rbol.
+
+      @return true si la clave est en el rbol
+    */
+    bool search(T k) {
+        DiskNode<T> x = node(_meta._root);
+        while (true) {
+            int i = keyLowerBound(x.elems(), x.n(), k); // Primer ndice i cuya clave cumpla k <= key
+            if (i < x.n() && x.elems()[i] == k) return true;
+            if (x.leaf()) return false;
+            x = node(x.child()[i]);
+        }
+    }
+
+    /**
+        Funcin para insertar un elemento en el rbol.
+        Parte la raz si est llena y baja partiendo los hijos llenos antes de entrar en ellos, igual que BTree::insert.
+
+        Error: Si el rbol es de solo lectura, lanza una excepcin E_BTree_ReadOnly
+
+        @param k elemento a insertar en el rbol.
+    */
+    void insert(T k) {
+        if (_read_only) throw E_BTree_ReadOnly();
+
+        DiskNode<T> x = node(_meta._root);
+        if (x.n() == _size) { // Si la raz est llena la partimos y el rbol crece
+            DiskNode<T> s = allocNode(false);
+            s.child()[0] = x.id();
+            splitChild(s, 0, x);
+            _meta._root = s.id();
+            x = std::move(s);
+        }
+
+        while (!x.leaf()) { // Bajamos al hijo que tendr a k
+            int i = keyUpperBound(x.elems(), x.n(), k); // Posicin de la primera key mayor que k
+            DiskNode<T> c = node(x.child()[i]);
+            if (c.n() == _size) { // Si est lleno le hacemos split
+                DiskNode<T> z = splitChild(x, i, c);
+                if (x.elems()[i] < k) c = std::move(z); // k va a la mitad de la derecha
+            }
+            x = std::move(c);
+        }
+
+        int i = keyUpperBound(x.elems(), x.n(), k);
+        copy_backward(x.elems() + i, x.elems() + x.n(), x.elems() + x.n() + 1); // desplazamos las keys mayores que k
+        x.elems()[i] = k;
+        x.n() += 1;
+        x.dirty();
+        _meta._count++;
+    }
+
+    /**
+    Funcin para eliminar una key del rbol.
+    Baja rellenando (fill) cada hijo con menos de t keys antes de entrar en l, igual que Node::remove.
+
+    Error: Si el rbol es de solo lectura, lanza una excepcin E_BTree_ReadOnly
+
+    @param k key a eliminar
+
+    @return true si la key estaba en el rbol (y se ha eliminado)
+    */
+    bool remove(T k) {
+        if (_read_only) throw E_BTree_ReadOnly();
+
+        int t = (_size + 1) / 2; // Mitad del mximo de hijos
+        bool removed = false;
+        {
+            DiskNode<T> x = node(_meta._root);
+            while (true) {
+                int i = keyLowerBound(x.elems(), x.n(), k);
+
+                if (i < x.n() && x.elems()[i] == k) { // Si la key est en este nodo
+                    if (x.leaf()) {
+                        removeFromLeaf(x, i);
+                        removed = true;
+                        break;
+                    }
+                    DiskNode<T> c = node(x.child()[i]);
+                    if (c.n() >= t) { // Sustituimos k por su predecesor y lo eliminamos del hijo i
+                        k = getPred(c.id());
+                        x.elems()[i] = k;
+                        x.dirty();
+                        x = std::move(c);
+                        continue;
+                    }
+                    DiskNode<T> d = node(x.child()[i + 1]);
+                    if (d.n() >= t) { // Sustituimos k por su sucesor y lo eliminamos del hijo i + 1
+                        k = getSucc(d.id());
+                        x.elems()[i] = k;
+                        x.dirty();
+                        x = std::move(d);
+                        continue;
+                    }
+                    merge(x, i, c, d); // k baja al hijo i junto con todas las keys del hijo i + 1
+                    x = std::move(c);
+                }
+                else {
+                    if (x.leaf()) break; // La key no est
+
+                    bool is_in_last = (i == x.n());
+                    {
+                        DiskNode<T> c = node(x.child()[i]);
+                        if (c.n() < t) fill(x, i, c);
+                    }
+                    if (is_in_last && i > x.n()) i--; // El ltimo hijo se ha unido con el anterior
+                    x = node(x.child()[i]);
+                }
+            }
+        }
+
+        DiskNode<T> r = node(_meta._root);
+        if (r.n() == 0 && !r.leaf()) { // La raz se ha quedado sin keys, su nico hijo pasa a ser la raz
+            _meta._root = r.child()[0];
+            freePage(r);
+        }
+        if (removed) _meta._count--;
+        return removed;
+    }
+
+    /**
+    Funcin para recorrer el rbol, va sacando las keys guardadas en orden (siempre creciente).
+
+    @param out flujo en el que se sacan (por defecto la salida estndar)
+    */
+    void traverse(ostream& out = cout) {
+        for_each([&out](const T& k) { out << " " << k; });
+    }
+
+    /**
+    Funcin que aplica f a cada key del rbol, en orden creciente.
+
+    @param f funcin que recibe cada key (const T&)
+    */
+    template <class F>
+    void for_each(F f) {
+        PathStack<Step> path;
+        path.push(Step(_meta._root, 0));
+
+        while (!path.empty()) {
+            Step& s = path.top();
+            DiskNode<T> x = node(s._id);
+            if (x.leaf()) { // Si es hoja, saco todas sus keys
+                for (int i = 0; i < x.n(); i++) f(x.elems()[i]);
+                path.pop();
+            }
+            else if (s._next <= x.n()) { // Si no es hoja, bajo al siguiente hijo
+                path.push(Step(x.child()[s._next], 0));
+                continue;
+            }
+            else path.pop(); // Ya he recorrido todos sus hijos
+
+            if (!path.empty()) { // He terminado con un hijo: paso a f la key que lo sigue en el padre
+                Step& p = path.top();
+                DiskNode<T> y = node(p._id);
+                if (p._next < y.n()) f(y.elems()[p._next]);
+                p._next++;
+            }
+        }
+    }
+
+private:
+
+    /** Cabecera del fichero (pgina 0) */
+    struct Meta {
+        uint32_t _magic;     // DISK_MAGIC
+        uint32_t _version;   // DISK_VERSION
+        uint32_t _page_size; // DISK_PAGE_SIZE
+        uint32_t _key_size;  // sizeof(T)
+        uint32_t _max_elems; // nmero mximo de keys por nodo
+        uint32_t _pad;       // (sin usar)
+        page_id _root;       // pgina de la raz
+        page_id _n_pages;    // nmero de pginas del fichero (contando la cabecera)
+        page_id _free;       // primera pgina de la lista de pginas libres (NO_PAGE si no hay)
+        uint64_t _count;     // nmero de keys
+    };
+
+    /** Paso del recorrido: una pgina y el siguiente hijo suyo que hay que visitar */
+    struct Step {
+
+        Step() : _id(NO_PAGE), _next(0) {}
+
+        Step(page_id id, int next) : _id(id), _next(next) {}
+
+        page_id _id; // pgina
+        int _next;   // siguiente hijo a visitar
+    };
+
+    /**
+    Prepara un fichero vaco con la cabecera y una raz hoja vaca, y lo escribe.
+
+    @param size nmero mximo de keys por nodo (0 para las que quepan en una pgina)
+    */
+    void create(int size) {
+        int fit = DiskNode<T>::maxFit();
+        if (size == 0) size = fit;
+        if (size < DISK_MIN_SIZE) throw E_BTree_Lower();
+        if (size > fit) throw E_BTree_Bigger();
+
+        _size = size;
+        _meta._magic = DISK_MAGIC;
+        _meta._version = DISK_VERSION;
+        _meta._page_size = DISK_PAGE_SIZE;
+        _meta._key_size = sizeof(T);
+        _meta._max_elems = size;
+        _meta._n_pages = 1; // La cabecera
+        _meta._free = NO_PAGE;
+        _meta._count = 0;
+        _meta._root = allocNode(true).id();
+        flush();
+    }
+
+    /** Lee la cabecera de un fichero existente y, en solo lectura, lo proyecta en memoria si se puede */
+    void open() {
+        vector<char> page(DISK_PAGE_SIZE);
+        _file.read(0, &page[0]);
+        memcpy(&_meta, &page[0], sizeof(_meta));
+        if (_meta._magic != DISK_MAGIC || _meta._version != DISK_VERSION || _meta._page_size != DISK_PAGE_SIZE || _meta._key_size != sizeof(T)) {
+            throw E_BTree_Format();
+        }
+        _size = (int)_meta._max_elems;
+        if (_size < DISK_MIN_SIZE || _size > DiskNode<T>::maxFit()) throw E_BTree_Format();
+
+        if (_read_only) _file.map(); // Si no se puede, se lee a travs del pool
+    }
+
+    /** Fija una pgina y la devuelve como nodo */
+    DiskNode<T> node(page_id id) {
+        if (_file.isMapped()) return DiskNode<T>(NULL, 0, id, const_cast<char*>(_file.mapped(id)), _size);
+        size_t v = _pool.fetch(id);
+        return DiskNode<T>(&_pool, v, id, _pool.data(v), _size);
+    }
+
+    /** Reserva una pgina (de la lista de libres o al final del fichero) para un nodo vaco
+
+    @param is_leaf indica si el nodo es o no hoja
+
+    @return el nodo creado
+    */
+    DiskNode<T> allocNode(bool is_leaf) {
+        page_id id;
+        if (_meta._free != NO_PAGE) { // Reutilizamos una pgina libre, que guarda la siguiente de la lista
+            id = _meta._free;
+            DiskNode<T> f = node(id);
+            memcpy(&_meta._free, f.data(), sizeof(page_id));
+        }
+        else id = _meta._n_pages++;
+
+        size_t v = _pool.create(id);
+        DiskNode<T> x(&_pool, v, id, _pool.data(v), _size);
+        reinterpret_cast<typename DiskNode<T>::Header*>(x.data())->_is_leaf = is_leaf ? 1 : 0;
+        return x;
+    }
+
+    /** Aade la pgina de un nodo que ya no se usa a la lista de pginas libres */
+    void freePage(DiskNode<T>& x) {
+        memcpy(x.data(), &_meta._free, sizeof(page_id));
+        x.dirty();
+        _meta._free = x.id();
+    }
+
+    /**
+    Parte el hijo i de x, que est lleno, igual que Node::splitChild.
+
+    @param x padre
+    @param i posicin del hijo en x
+    @param y el hijo
+
+    @return el nodo nuevo, con la mitad de las keys de y (las mayores)
+    */
+    DiskNode<T> splitChild(DiskNode<T>& x, int i, DiskNode<T>& y) {
+        DiskNode<T> z = allocNode(y.leaf());
+        int t = (_size + 1) / 2; // Mitad del total de hijos que tiene y
+        z.n() = y.n() - t;
+
+        copy(y.elems() + t, y.elems() + y.n(), z.elems()); // Las keys ms grandes de y pasan a z
+        if (!y.leaf()) copy(y.child() + t, y.child() + y.n() + 1, z.child()); // y sus hijos
+        y.n() = t - 1;
+
+        copy_backward(x.child() + i + 1, x.child() + x.n() + 1, x.child() + x.n() + 2); // Hacemos hueco en el padre
+        x.child()[i + 1] = z.id();
+        copy_backward(x.elems() + i, x.elems() + x.n(), x.elems() + x.n() + 1);
+        x.elems()[i] = y.elems()[t - 1]; // La key de en medio de y separa y de z
+        x.n() += 1;
+
+        x.dirty();
+        y.dirty();
+        return z;
+    }
+
+    /** Elimina la key en la posicin i de la hoja x */
+    void removeFromLeaf(DiskNode<T>& x, int i) {
+        copy(x.elems() + i + 1, x.elems() + x.n(), x.elems() + i);
+        x.n()--;
+        x.dirty();
+    }
+
+    /** Mayor key del subrbol con raz en la pgina id */
+    T getPred(page_id id) {
+        DiskNode<T> c = node(id);
+        while (!c.leaf()) c = node(c.child()[c.n()]); // Mientras no sea hoja, bajamos por la derecha
+        return c.elems()[c.n() - 1];
+    }
+
+    /** Menor key del subrbol con raz en la pgina id */
+    T getSucc(page_id id) {
+        DiskNode<T> c = node(id);
+        while (!c.leaf()) c = node(c.child()[0]); // Mientras no sea hoja, bajamos por la izquierda
+        return c.elems()[0];
+    }
+
+    /**
+    Rellena el hijo i de x (c), que tiene menos de t keys, igual que Node::fill: le presta una key un hermano
+    que tenga al menos t o, si ninguno la tiene, se une con uno de ellos.
+    */
+    void fill(DiskNode<T>& x, int i, DiskNode<T>& c) {
+        int t = (_size + 1) / 2;
+
+        if (i != 0) {
+            DiskNode<T> p = node(x.child()[i - 1]);
+            if (p.n() >= t) {
+                borrowFromPrev(x, i, c, p);
+                return;
+            }
+            if (i == x.n()) { // Es el ltimo hijo, se une con el anterior
+                merge(x, i - 1, p, c);
+                return;
+            }
+        }
+
+        DiskNode<T> s = node(x.child()[i + 1]);
+        if (s.n() >= t) borrowFromNext(x, i, c, s);
+        else merge(x, i, c, s);
+    }
+
+    /** El hijo i de x (c) coge una key de su hermano anterior (s), igual que Node::borrowFromPrev */
+    void borrowFromPrev(DiskNode<T>& x, int i, DiskNode<T>& c, DiskNode<T>& s) {
+        copy_backward(c.elems(), c.elems() + c.n(), c.elems() + c.n() + 1);
+        if (!c.leaf()) copy_backward(c.child(), c.child() + c.n() + 1, c.child() + c.n() + 2);
+
+        c.elems()[0] = x.elems()[i - 1]; // La key del padre baja al hijo
+        if (!c.leaf()) c.child()[0] = s.child()[s.n()]; // y el ltimo hijo del hermano pasa a ser su primer hijo
+        x.elems()[i - 1] = s.elems()[s.n() - 1]; // La ltima key del hermano sube al padre
+
+        c.n() += 1;
+        s.n() -= 1;
+        x.dirty();
+        c.dirty();
+        s.dirty();
+    }
+
+    /** El hijo i de x (c) coge una key de su hermano siguiente (s), igual que Node::borrowFromNext */
+    void borrowFromNext(DiskNode<T>& x, int i, DiskNode<T>& c, DiskNode<T>& s) {
+        c.elems()[c.n()] = x.elems()[i]; // La key del padre baja al hijo
+        if (!c.leaf()) c.child()[c.n() + 1] = s.child()[0]; // y el primer hijo del hermano pasa a ser su ltimo hijo
+        x.elems()[i] = s.elems()[0]; // La primera key del hermano sube al padre
+
+        copy(s.elems() + 1, s.elems() + s.n(), s.elems());
+        if (!s.leaf()) copy(s.child() + 1, s.child() + s.n() + 1, s.child());
+
+        c.n() += 1;
+        s.n() -= 1;
+        x.dirty();
+        c.dirty();
+        s.dirty();
+    }
+
+    /** Une los hijos i (c) e i + 1 (s) de x en c con la key i de x en medio, igual que Node::merge, y libera la pgina de s */
+    void merge(DiskNode<T>& x, int i, DiskNode<T>& c, DiskNode<T>& s) {
+        int n = c.n();
+        c.elems()[n] = x.elems()[i]; // La key del padre baja al hijo
+        copy(s.elems(), s.elems() + s.n(), c.elems() + n + 1); // Y detrs las del hermano
+        if (!c.leaf()) copy(s.child(), s.child() + s.n() + 1, c.child() + n + 1); // con sus hijos
+        c.n() = n + 1 + s.n();
+
+        copy(x.elems() + i + 1, x.elems() + x.n(), x.elems() + i); // Quitamos la key y el hijo i + 1 del padre
+        copy(x.child() + i + 2, x.child() + x.n() + 1, x.child() + i + 1);
+        x.n()--;
+
+        x.dirty();
+        c.dirty();
+        freePage(s);
+    }
+
+    PageFile _file;   // fichero del rbol (tiene que construirse antes que el pool)
+    BufferPool _pool; // pginas en memoria
+    Meta _meta;       // cabecera del fichero
+    int _size;        // nmero mximo de keys por nodo
+    bool _read_only;  // si se ha abierto en solo lectura
+};
+
+#endif
@@ -0,0 +1,201 @@
+/*
+- Liberacin diferida de memoria por pocas (epoch-based reclamation)
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __EPOCH_H
+#define __EPOCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Nmero de ranuras de cada bloque (hilos dentro de una poca a la vez); si se ocupan todas se aade otro bloque */
+const int EPOCH_SLOTS = 256;
+
+/** Cada cuntos objetos retirados se intenta avanzar la poca y liberar */
+const size_t RETIRE_BATCH = 64;
+
+/**
+  Clase para liberar memoria que todava pueden estar leyendo otros hilos sin bloquearlos.
+
+  Cada hilo que va a leer nodos compartidos entra en la poca actual (enter) y sale al terminar (exit).
+  Un nodo que se desengancha de la estructura no se libera enseguida sino que se retira (retire) con la
+  poca del momento; solo se libera cuando todos los hilos que estn dentro lo estn en una poca posterior,
+  porque esos hilos empezaron despus de que el nodo dejase de ser alcanzable.
+  */
+class EpochManager {
+
+public:
+
+    /** Constructor, empieza en la poca 1 (0 indica una ranura libre) */
+    EpochManager() : _global(1), _slots(), _retired(), _since_collect(0) {}
+
+    EpochManager(const EpochManager&) = delete;
+    EpochManager& operator=(const EpochManager&) = delete;
+
+    /** Destructor, libera todo lo que quede retirado (ya no puede haber lectores) y los bloques de ranuras aadidos */
+    ~EpochManager() {
+        for (size_t i = 0; i < _retired.size(); i++) _retired[i]._deleter(_retired[i]._ptr);
+        SlotBlock* b = _slots._next.load();
+        while (b != NULL) {
+            SlotBlock* next = b->_next.load();
+            delete b;
+            b = next;
+        }
+    }
+
+    /** Entra en la poca actual ocupando una ranura libre. Si todas las ranuras estn ocupadas (ms de EPOCH_SLOTS
+    hilos dentro a la vez) se aade otro bloque de ranuras, que ya no se quita hasta destruir el gestor.
+
+    @return la ranura ocupada, que hay que pasar a exit
+    */
+    int enter() {
+        size_t h = std::hash<std::thread::id>()(std::this_thread::get_id());
+        SlotBlock* b = &_slots;
+        for (int base = 0; ; base += EPOCH_SLOTS) {
+            for (int j = 0; j < EPOCH_SLOTS; j++) {
+                int slot = (int)((h + j) % EPOCH_SLOTS);
+                uint64_t expected = 0;
+                if (b->_slots[slot]._state.compare_exchange_strong(expected, _global.load())) {
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    return base + slot;
+                }
+            }
+            SlotBlock* next = b->_next.load(std::memory_order_acquire);
+            if (next == NULL) { // Bloque lleno y es el ltimo: se aade otro (si otro hilo se adelanta, se usa el suyo)
+                SlotBlock* added = new SlotBlock();
+                if (b->_next.compare_exchange_strong(next, added)) next = added;
+                else delete added;
+            }
+            b = next;
+        }
+    }
+
+    /** Sale de la poca liberando la ranura
+
+    @param slot ranura devuelta por enter
+    */
+    void exit(int slot) {
+        SlotBlock* b = &_slots;
+        for (; slot >= EPOCH_SLOTS; slot -= EPOCH_SLOTS) b = b->_next.load(std::memory_order_acquire);
+        b->_slots[slot]._state.store(0, std::memory_order_release);
+    }
+
+    /**
+    Espera a que salgan todos los hilos que estaban dentro al llamar; los que entran despus no se esperan, porque la
+    poca se avanza antes y entran en una posterior.
+    */
+    void synchronize() {
+        uint64_t g = _global.fetch_add(1) + 1;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (SlotBlock* b = &_slots; b != NULL; b = b->_next.load(std::memory_order_acquire)) {
+            for (int i = 0; i < EPOCH_SLOTS; i++) {
+                while (true) {
+                    uint64_t e = b->_slots[i]._state.load();
+                    if (e == 0 || e >= g) break;
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+
+    /** Retira un objeto que ya no es alcanzable: se liberar con deleter cuando ningn hilo pueda estar leyndolo
+
+    @param ptr objeto retirado
+    @param deleter funcin que lo libera
+    */
+    void retire(void* ptr, void (*deleter)(void*)) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::lock_guard<std::mutex> lock(_mutex);
+        Retired r;
+        r._ptr = ptr;
+        r._deleter = deleter;
+        r._epoch = _global.load();
+        _retired.push_back(r);
+        if (++_since_collect >= RETIRE_BATCH) collect();
+    }
+
+private:
+
+    /** Objeto retirado pendiente de liberar */
+    struct Retired {
+        void* _ptr;
+        void (*_deleter)(void*);
+        uint64_t _epoch;
+    };
+
+    /** Ranura de un hilo, cada una en su propia lnea de cach */
+    struct alignas(64) Slot {
+        Slot() : _state(0) {}
+        std::atomic<uint64_t> _state; // 0 si est libre, si no la poca en la que entr el hilo
+    };
+
+    /** Bloque de ranuras; los bloques forman una lista a la que solo se aaden al final */
+    struct SlotBlock {
+        SlotBlock() : _next(NULL) {}
+        Slot _slots[EPOCH_SLOTS];
+        std::atomic<SlotBlock*> _next; // siguiente bloque, NULL si es el ltimo
+    };
+
+    /**
+    Funcin que avanza la poca si todos los hilos dentro estn en la actual y libera los objetos retirados
+    en una poca anterior a la de todos los hilos que siguen dentro. Se llama con _mutex cogido.
+    */
+    void collect() {
+        _since_collect = 0;
+        uint64_t g = _global.load();
+        uint64_t min = g;
+        bool all_current = true;
+        for (SlotBlock* b = &_slots; b != NULL; b = b->_next.load(std::memory_order_acquire)) {
+            for (int i = 0; i < EPOCH_SLOTS; i++) {
+                uint64_t e = b->_slots[i]._state.load();
+                if (e == 0) continue;
+                if (e < min) min = e;
+                if (e != g) all_current = false;
+            }
+        }
+        if (all_current) _global.compare_exchange_strong(g, g + 1);
+
+        size_t kept = 0;
+        for (size_t i = 0; i < _retired.size(); i++) {
+            if (_retired[i]._epoch < min) _retired[i]._deleter(_retired[i]._ptr);
+            else _retired[kept++] = _retired[i];
+        }
+        _retired.resize(kept);
+    }
+
+    std::atomic<uint64_t> _global;  // poca actual
+    SlotBlock _slots;               // primer bloque de ranuras de los hilos
+    std::mutex _mutex;              // protege la lista de retirados
+    std::vector<Retired> _retired;  // objetos pendientes de liberar
+    size_t _since_collect;          // retirados desde el ltimo collect
+};
+
+/**
+  Clase que mantiene al hilo dentro de una poca mientras existe (entra al construirse y sale al destruirse).
+  */
+class EpochGuard {
+
+public:
+
+    explicit EpochGuard(EpochManager& manager) : _manager(manager), _slot(manager.enter()) {}
+
+    ~EpochGuard() {
+        _manager.exit(_slot);
+    }
+
+    EpochGuard(const EpochGuard&) = delete;
+    EpochGuard& operator=(const EpochGuard&) = delete;
+
+private:
+
+    EpochManager& _manager; // gestor de pocas
+    int _slot;              // ranura ocupada
+};
+
+#endif
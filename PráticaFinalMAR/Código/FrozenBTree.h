@@ -0,0 +1,291 @@
+/*
+- ndice de solo lectura sin punteros (rbol-B+ esttico) construido a partir de un rbol-B
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __FROZENBTREE_H
+#define __FROZENBTREE_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+#include "BTree.h"
+
+/** Keys por bloque por defecto: las que caben en una lnea de cach, y al menos 8 */
+template <class T>
+constexpr int frozenBlock() {
+    return NODE_ALIGN / sizeof(T) >= 8 ? (int)(NODE_ALIGN / sizeof(T)) : 8;
+}
+
+/**
+
+Clase que representa un ndice de solo lectura con las keys de un rbol: un rbol-B+ esttico sin punteros.
+
+Todo va en un nico array alineado a NODE_ALIGN, dividido en bloques de B keys. Al final estn las hojas: todas las
+keys en orden, en bloques seguidos (el ltimo se rellena repitiendo la mayor). Encima, cada nivel tiene un bloque por
+cada B + 1 bloques del nivel de debajo, con la mayor key de cada uno de sus B primeros hijos. Los hijos no se guardan:
+el hijo i del bloque j es el bloque j * (B + 1) + i del nivel de debajo, as que no hay cabeceras ni punteros y todo
+el espacio es de keys (las de las hojas ms un 1 / B en los niveles de arriba). Los niveles van de la raz a las hojas.
+
+En cada bloque se cuentan las keys menores que k con un bucle de B comparaciones sin saltos, que el compilador
+convierte en instrucciones SIMD (con enteros de 32 bits ya con SSE2): con B constante y en lnea sale ms rpido que
+llamar a SimdCount. El nmero de keys menores es el hijo por el que se sigue o, en las hojas, la posicin de k.
+
+No se puede modificar: se construye de una vez con freeze (o a partir de keys ordenadas) y se sustituye entero.
+
+@author lvaro Corrochano Lpez
+
+*/
+template <class T, int B = frozenBlock<T>()>
+class FrozenBTree {
+
+public:
+
+    /** ndice vaco */
+    FrozenBTree() : _keys(NULL), _n(0), _blocks(0), _layers() {}
+
+    /**
+    Construye el ndice con las keys (ordenadas, pueden repetirse) del rango [first, last).
+    Complejidad: O(n)
+
+    Error: Si las keys no estn ordenadas de forma creciente, lanza una excepcin E_BTree_Unsorted
+
+    @param first iterador al principio de las keys
+    @param last iterador al final de las keys
+    */
+    template <class It>
+    FrozenBTree(It first, It last) : _keys(NULL), _n(0), _blocks(0), _layers() {
+        vector<T> keys(first, last);
+        if (!is_sorted(keys.begin(), keys.end())) throw E_BTree_Unsorted();
+        build(keys);
+    }
+
+    /** El ndice es dueo de su array, as que no se puede copiar (solo mover) */
+    FrozenBTree(const FrozenBTree&) = delete;
+    FrozenBTree& operator=(const FrozenBTree&) = delete;
+
+    /** Constructor de movimiento, el ndice movido se queda vaco */
+    FrozenBTree(FrozenBTree&& other) : _keys(other._keys), _n(other._n), _blocks(other._blocks), _layers(std::move(other._layers)) {
+        other._keys = NULL;
+        other._n = other._blocks = 0;
+        other._layers.clear();
+    }
+
+    /** Asignacin de movimiento, el array que tuviera este ndice se libera */
+    FrozenBTree& operator=(FrozenBTree&& other) {
+        if (this != &other) {
+            release();
+            _keys = other._keys;
+            _n = other._n;
+            _blocks = other._blocks;
+            _layers.swap(other._layers);
+            other._keys = NULL;
+            other._n = other._blocks = 0;
+            other._layers.clear();
+        }
+        return *this;
+    }
+
+    /** Destructor, libera el array */
+    ~FrozenBTree() {
+        release();
+    }
+
+    /** Devuelve el nmero de keys del ndice
+
+    @return nmero de keys
+    */
+    size_t size() const {
+        return _n;
+    }
+
+    /** Indica si el ndice est o no vaco
+
+    @return true si no tiene keys
+    */
+    bool isEmpty() const {
+        return _n == 0;
+    }
+
+    /** Devuelve el nmero de niveles (0 si est vaco)
+
+    @return niveles, contando el de las hojas
+    */
+    int height() const {
+        return (int)_layers.size();
+    }
+
+    /** Devuelve la memoria que ocupa el ndice (sin contar la memoria propia de las keys, como el texto de un string largo)
+
+    @return bytes ocupados
+    */
+    size_t bytes() const {
+        return _blocks * B * sizeof(T) + _layers.capacity() * sizeof(size_t);
+    }
+
+    /**
+    Busca una key en el ndice.
+    Complejidad: O(B log n / log B)
+
+    @param k key buscada
+
+    @return true si k est en el ndice
+    */
+    bool search(const T& k) const {
+        size_t i = lower_bound(k);
+        return i < _n && leaves()[i] == k;
+    }
+
+    /**
+    Devuelve la posicin (en orden creciente) de la primera key mayor o igual que k, que coincide con el nmero de
+    keys menores que k.
+    Complejidad: O(B log n / log B)
+
+    @param k key buscada
+
+    @return posicin de la primera key >= k (size() si no hay ninguna)
+    */
+    size_t lower_bound(const T& k) const {
+        if (_n == 0 || leaves()[_n - 1] < k) return _n; // As en cada bloque hay alguna key >= k salvo en el ltimo hijo
+        size_t j = 0; // Bloque dentro del nivel
+        for (size_t l = 0; l + 1 < _layers.size(); l++) j = j * (B + 1) + rankInBlock(_keys + (_layers[l] + j) * B, k);
+        return j * B + rankInBlock(leaves() + j * B, k);
+    }
+
+    /**
+    Devuelve la key en la posicin i (en orden creciente).
+
+    @param i posicin (menor que size())
+
+    @return la key
+    */
+    const T& operator[](size_t i) const {
+        return leaves()[i];
+    }
+
+    /**
+    Funcin que aplica f a cada key del ndice, en orden creciente.
+
+    @param f funcin que recibe cada key (const T&)
+    */
+    template <class F>
+    void for_each(F f) const {
+        if (_n == 0) return;
+        const T* keys = leaves();
+        for (size_t i = 0; i < _n; i++) f(keys[i]);
+    }
+
+    /**
+    Funcin para recorrer el ndice, va sacando las keys guardadas en orden (siempre creciente).
+
+    @param out flujo en el que se sacan (por defecto la salida estndar)
+    */
+    void traverse(ostream& out = cout) const {
+        for_each([&out](const T& k) { out << " " << k; });
+    }
+
+private:
+
+    template <class U, class Alloc, class Stats>
+    friend FrozenBTree<U> freeze(const BTree<U, Alloc, Stats>& tree);
+
+    /**
+    Construye el ndice con keys que ya se sabe que estn ordenadas (las de un recorrido de un rbol), sin comprobarlo.
+    Las keys se mueven al array del ndice.
+
+    @param keys keys ordenadas (el vector se queda con keys movidas)
+    */
+    explicit FrozenBTree(vector<T>&& keys) : _keys(NULL), _n(0), _blocks(0), _layers() {
+        build(keys);
+    }
+
+    /**
+    Cuenta las keys del bloque menores que k: B comparaciones sin saltos, que con B constante se vectorizan.
+
+    @param block primera key del bloque
+    @param k key buscada
+
+    @return nmero de keys del bloque menores que k
+    */
+    static int rankInBlock(const T* block, const T& k) {
+        int c = 0;
+        for (int i = 0; i < B; i++) c += block[i] < k;
+        return c;
+    }
+
+    /** Hojas: las keys en orden, tras los niveles de arriba */
+    const T* leaves() const {
+        return _keys + _layers.back() * B;
+    }
+
+    /**
+    Funcin que reparte las keys ordenadas en los niveles: primero calcula cuntos bloques tiene cada nivel y dnde
+    empieza, y despus mueve las keys a las hojas y rellena cada nivel de arriba con la mayor key de cada hijo
+    (leyndola ya de las hojas).
+
+    @param keys keys ordenadas (el vector se queda con keys movidas)
+    */
+    void build(vector<T>& keys) {
+        _n = keys.size();
+        if (_n == 0) return;
+
+        vector<size_t> counts(1, (_n + B - 1) / B); // Bloques de cada nivel, de las hojas hacia arriba
+        while (counts.back() > 1) counts.push_back((counts.back() + B) / (B + 1));
+        _layers.resize(counts.size());
+        _blocks = 0;
+        for (size_t l = counts.size(); l-- > 0;) { // Los niveles se guardan de la raz a las hojas
+            _layers[counts.size() - 1 - l] = _blocks;
+            _blocks += counts[l];
+        }
+
+        _keys = static_cast<T*>(::operator new(_blocks * B * sizeof(T), align_val_t(NODE_ALIGN)));
+        T* out = _keys + _layers.back() * B;
+        uninitialized_move(keys.begin(), keys.end(), out);
+        uninitialized_fill_n(out + _n, counts[0] * B - _n, out[_n - 1]); // El ltimo bloque se rellena con la mayor
+
+        size_t span = B; // Keys de las hojas que hay bajo cada bloque del nivel de debajo
+        for (size_t l = 1; l < counts.size(); l++) {
+            T* layer = _keys + _layers[counts.size() - 1 - l] * B;
+            for (size_t j = 0; j < counts[l]; j++) {
+                for (int i = 0; i < B; i++) { // La mayor key del hijo i es la ltima de las hojas que tiene debajo
+                    size_t end = (j * (B + 1) + i + 1) * span;
+                    ::new (layer + j * B + i) T(out[(end < _n ? end : _n) - 1]);
+                }
+            }
+            span *= B + 1;
+        }
+    }
+
+    /** Destruye las keys y libera el array */
+    void release() {
+        if (_keys == NULL) return;
+        destroy_n(_keys, _blocks * B);
+        ::operator delete(_keys, align_val_t(NODE_ALIGN));
+        _keys = NULL;
+    }
+
+    T* _keys;              // bloques de todos los niveles, de la raz a las hojas
+    size_t _n;             // nmero de keys
+    size_t _blocks;        // nmero de bloques
+    vector<size_t> _layers; // bloque en el que empieza cada nivel, de la raz a las hojas
+};
+
+/**
+Construye un ndice de solo lectura con las keys de un rbol (sin las borradas con remove_lazy). El rbol no cambia.
+Las keys del recorrido ya estn ordenadas, as que no se comprueba y se mueven al ndice sin ms copias.
+Complejidad: O(n)
+
+@param tree rbol
+
+@return ndice con las mismas keys
+*/
+template <class T, class Alloc, class Stats>
+FrozenBTree<T> freeze(const BTree<T, Alloc, Stats>& tree) {
+    vector<T> keys;
+    keys.reserve(tree.size());
+    tree.for_each([&keys](const T& k) { keys.push_back(k); });
+    return FrozenBTree<T>(std::move(keys));
+}
+
+#endif
@@ -0,0 +1,293 @@
+/*
+- Exportacin de las keys de un rbol en bloques grandes, en texto o en binario, a un fichero o descriptor
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __KEYEXPORT_H
+#define __KEYEXPORT_H
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "BTree.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define BTREE_WRITE ::write
+#elif defined(_WIN32)
+#include <io.h>
+#define BTREE_WRITE _write
+#endif
+
+/** Bytes que se acumulan antes de escribirlos de golpe */
+const size_t EXPORT_BLOCK = 1 << 20;
+
+/** Mximo de caracteres de un entero de 64 bits en texto (con el signo) */
+const size_t MAX_DIGITS = 20;
+
+/** Formato en que se exportan las keys */
+enum KeyFormat {
+    KEYS_TEXT,  // texto: cada key seguida del separador
+    KEYS_BINARY // binario: los bytes de cada key, una detrs de otra (solo tipos que se copian byte a byte)
+};
+
+/** Pares de dgitos de 00 a 99, para pasar un entero a texto de dos en dos dgitos */
+const char DIGIT_PAIRS[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/** Indica si las keys de tipo T se pasan a texto a mano: los enteros, salvo los de carcter, que operator<< escribe
+como el carcter y no como un nmero */
+template <class T>
+struct WritesDigits : integral_constant<bool, is_integral<T>::value && !is_same<T, char>::value
+    && !is_same<T, signed char>::value && !is_same<T, unsigned char>::value> {};
+
+/**
+Escribe x en decimal terminando justo antes de end.
+
+@param end final del hueco (debe haber al menos MAX_DIGITS caracteres antes)
+@param x nmero
+
+@return puntero al primer dgito
+*/
+inline char* formatDigits(char* end, unsigned long long x) {
+    while (x >= 100) {
+        unsigned d = (unsigned)(x % 100) * 2;
+        x /= 100;
+        *--end = DIGIT_PAIRS[d + 1];
+        *--end = DIGIT_PAIRS[d];
+    }
+    if (x >= 10) {
+        *--end = DIGIT_PAIRS[x * 2 + 1];
+        *--end = DIGIT_PAIRS[x * 2];
+    }
+    else *--end = (char)('0' + x);
+    return end;
+}
+
+/**
+  Escritor de keys con buffer: las keys se pasan a texto o a binario en un bloque de EXPORT_BLOCK bytes, que se
+  escribe de una vez cuando se llena, as que el coste es el de escribir los bloques y no el de un operator<< por key.
+  Los enteros se pasan a texto a mano (de dos en dos dgitos); las strings se copian tal cual y cualquier otro tipo
+  (tambin char, para que salga el carcter) usa operator<<, as que el texto es el mismo que con operator<<.
+  Puede escribir en un descriptor de fichero (write), en un FILE* o en un ostream; ninguno se cierra al terminar.
+  */
+template <class T>
+class KeyWriter {
+
+public:
+
+    /** Escritor en un descriptor de fichero (1 es la salida estndar)
+
+    Error: Si se pide binario y T no se puede copiar byte a byte, lanza una excepcin E_BTree_Format
+
+    @param fd descriptor abierto para escribir
+    @param format formato de las keys
+    @param sep separador que sigue a cada key en texto
+    */
+    explicit KeyWriter(int fd, KeyFormat format = KEYS_TEXT, char sep = '\n') : _fd(fd), _f(NULL), _out(NULL),
+        _format(format), _sep(sep), _buf(EXPORT_BLOCK), _n(0), _fmt() {
+        check();
+    }
+
+    /** Escritor en un FILE* (ver el constructor con descriptor) */
+    explicit KeyWriter(FILE* f, KeyFormat format = KEYS_TEXT, char sep = '\n') : _fd(-1), _f(f), _out(NULL),
+        _format(format), _sep(sep), _buf(EXPORT_BLOCK), _n(0), _fmt() {
+        check();
+    }
+
+    /** Escritor en un ostream (ver el constructor con descriptor) */
+    explicit KeyWriter(ostream& out, KeyFormat format = KEYS_TEXT, char sep = '\n') : _fd(-1), _f(NULL), _out(&out),
+        _format(format), _sep(sep), _buf(EXPORT_BLOCK), _n(0), _fmt() {
+        check();
+    }
+
+    KeyWriter(const KeyWriter&) = delete;
+    KeyWriter& operator=(const KeyWriter&) = delete;
+
+    /** Destructor, escribe lo que quede (sin avisar si falla; para saberlo hay que llamar antes a flush) */
+    ~KeyWriter() {
+        if (_n > 0) rawWrite(_buf.data(), _n);
+    }
+
+    /** Aade una key
+
+    Error: Si al vaciar el bloque no se puede escribir, lanza una excepcin E_BTree_File
+
+    @param k key
+    */
+    void put(const T& k) {
+        if (_format == KEYS_BINARY) writeBinary(k, typename is_trivially_copyable<T>::type());
+        else {
+            writeText(k, typename WritesDigits<T>::type());
+            if (_n == _buf.size()) flush();
+            _buf[_n++] = _sep;
+        }
+    }
+
+    /** Aade caracteres sueltos (por ejemplo, una cabecera o un separador que no va tras una key)
+
+    @param p caracteres
+    @param n nmero de caracteres
+    */
+    void write(const char* p, size_t n) {
+        if (_buf.size() - _n < n) flush();
+        if (n > _buf.size()) { // No cabe en el bloque: se escribe directamente
+            if (rawWrite(p, n) != n) throw E_BTree_File();
+            return;
+        }
+        memcpy(_buf.data() + _n, p, n);
+        _n += n;
+    }
+
+    /**
+    Escribe lo que haya en el bloque (y vaca el buffer del FILE* o del ostream, si lo hay).
+
+    Error: Si no se puede escribir, lanza una excepcin E_BTree_File
+    */
+    void flush() {
+        size_t n = _n;
+        _n = 0;
+        if (rawWrite(_buf.data(), n) != n) throw E_BTree_File();
+        if (_f != NULL && fflush(_f) != 0) throw E_BTree_File();
+        if (_out != NULL && !_out->flush()) throw E_BTree_File();
+    }
+
+private:
+
+    /** Comprueba que el formato se puede usar con T */
+    void check() const {
+        if (_format == KEYS_BINARY && !is_trivially_copyable<T>::value) throw E_BTree_Format();
+    }
+
+    /** Escribe un entero en texto */
+    void writeText(const T& k, true_type) {
+        if (_buf.size() - _n < MAX_DIGITS + 1) flush();
+        char digits[MAX_DIGITS + 1];
+        char* end = digits + sizeof(digits);
+        char* p;
+        if (is_signed<T>::value && k < 0) {
+            p = formatDigits(end, 0ULL - (unsigned long long)(long long)k);
+            *--p = '-';
+        }
+        else p = formatDigits(end, (unsigned long long)k);
+        memcpy(_buf.data() + _n, p, end - p);
+        _n += end - p;
+    }
+
+    /** Escribe en texto una key que no es un entero */
+    void writeText(const T& k, false_type) {
+        writeOther(k);
+    }
+
+    /** Escribe una string tal cual */
+    void writeOther(const string& k) {
+        write(k.data(), k.size());
+    }
+
+    /** Escribe cualquier otro tipo con operator<< */
+    template <class U>
+    void writeOther(const U& k) {
+        _fmt.str("");
+        _fmt << k;
+        string s = _fmt.str();
+        write(s.data(), s.size());
+    }
+
+    /** Escribe los bytes de la key */
+    void writeBinary(const T& k, true_type) {
+        write(reinterpret_cast<const char*>(&k), sizeof(T));
+    }
+
+    /** No se usa: el constructor no deja elegir binario si T no se copia byte a byte */
+    void writeBinary(const T&, false_type) {}
+
+    /** Escribe n bytes en el destino
+
+    @return bytes escritos (menos de n si ha fallado)
+    */
+    size_t rawWrite(const char* p, size_t n) {
+        if (n == 0) return 0;
+        if (_out != NULL) return _out->write(p, n) ? n : 0;
+        if (_f != NULL) return fwrite(p, 1, n, _f);
+
+        size_t done = 0;
+#ifdef BTREE_WRITE
+        while (done < n) { // write puede escribir menos de lo pedido
+            long w = (long)BTREE_WRITE(_fd, p + done, (unsigned)min(n - done, (size_t)EXPORT_BLOCK));
+            if (w <= 0) break;
+            done += (size_t)w;
+        }
+#endif
+        return done;
+    }
+
+    int _fd;                  // descriptor de fichero (-1 si se escribe en _f o en _out)
+    FILE* _f;                 // FILE* en el que se escribe (o NULL)
+    ostream* _out;            // ostream en el que se escribe (o NULL)
+    KeyFormat _format;        // formato de las keys
+    char _sep;                // separador tras cada key en texto
+    vector<char> _buf;        // bloque que se est llenando
+    size_t _n;                // bytes ocupados del bloque
+    ostringstream _fmt;       // para pasar a texto con operator<< los tipos que no son enteros ni strings
+};
+
+/**
+Escribe todas las keys de un rbol en orden creciente con un KeyWriter y lo vaca al terminar.
+Sirve para cualquier rbol con for_each (todos los de este directorio; de un BTreeMap se exportan las keys).
+
+Error: Si no se puede escribir, lanza una excepcin E_BTree_File
+
+@param tree rbol
+@param out escritor de keys
+
+@return nmero de keys escritas
+*/
+template <class Tree, class T>
+size_t exportKeys(Tree& tree, KeyWriter<T>& out) {
+    size_t n = 0;
+    tree.for_each([&out, &n](const T& k) {
+        out.put(k);
+        n++;
+    });
+    out.flush();
+    return n;
+}
+
+/**
+Escribe todas las keys de un rbol en orden creciente en un fichero nuevo.
+
+Error: Si no se puede crear o escribir el fichero, lanza una excepcin E_BTree_File
+Error: Si se pide binario y las keys no se pueden copiar byte a byte, lanza una excepcin E_BTree_Format
+
+@param tree rbol
+@param path ruta del fichero
+@param format formato de las keys
+@param sep separador que sigue a cada key en texto
+
+@return nmero de keys escritas
+*/
+template <class T, class Tree>
+size_t exportKeys(Tree& tree, const string& path, KeyFormat format = KEYS_TEXT, char sep = '\n') {
+    FILE* f = fopen(path.c_str(), format == KEYS_BINARY ? "wb" : "w");
+    if (f == NULL) throw E_BTree_File();
+    size_t n;
+    try {
+        KeyWriter<T> out(f, format, sep);
+        n = exportKeys(tree, out);
+    }
+    catch (...) {
+        fclose(f);
+        throw;
+    }
+    if (fclose(f) != 0) throw E_BTree_File();
+    return n;
+}
+
+#endif
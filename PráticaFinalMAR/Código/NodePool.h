@@ -0,0 +1,254 @@
+/*
+- Reserva de memoria para los nodos de un rbol-B
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __NODEPOOL_H
+#define __NODEPOOL_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+/** Alineamiento (en bytes) del bloque de cada nodo: una lnea de cach */
+const size_t NODE_ALIGN = 64;
+
+/** Tamao aproximado (en bytes) de cada slab de un NodePool */
+const size_t SLAB_BYTES = 64 * 1024;
+
+/**
+  Poltica de reserva que usa directamente el reservador del sistema: cada nodo es un bloque
+  reservado con create y liberado con destroy. No puede liberar todo de golpe (releases_all = false).
+
+  Cualquier poltica de reserva para BTree debe ofrecer la misma interfaz:
+  - node_type: tipo de los nodos que reserva.
+  - releases_all: true si release libera todos los nodos que se hayan reservado.
+  - Constructor a partir del nmero mximo de keys por nodo.
+  - allocate(is_leaf), deallocate(n) y release().
+  */
+template <class N>
+class HeapNodeAllocator {
+
+public:
+
+    typedef N node_type;
+
+    static const bool releases_all = false;
+
+    /** Constructor
+
+    @param max_elems nmero mximo de keys de los nodos que se van a reservar
+    */
+    explicit HeapNodeAllocator(int max_elems) : _max_elems(max_elems) {}
+
+    /** Reserva y construye un nodo vaco
+
+    @param is_leaf indica si el nodo es o no hoja
+
+    @return el nodo creado
+    */
+    N* allocate(bool is_leaf) {
+        return N::create(_max_elems, is_leaf);
+    }
+
+    /** Destruye y libera un nodo
+
+    @param n nodo a liberar
+    */
+    void deallocate(N* n) {
+        N::destroy(n);
+    }
+
+    /** No hace nada, los nodos se liberan uno a uno */
+    void release() {}
+
+private:
+
+    int _max_elems; // nmero mximo de keys de cada nodo
+};
+
+/**
+  Poltica de reserva por defecto de BTree: los nodos se sacan de slabs (bloques grandes de SLAB_BYTES)
+  y los nodos liberados (por ejemplo al hacer merge) se guardan en una lista libre para reutilizarlos
+  sin pasar por el reservador del sistema.
+
+  Como todos los nodos de un rbol tienen la misma capacidad, hay solo dos tamaos de bloque: el de las
+  hojas (sin array de hijos) y el de los nodos internos. release devuelve todos los slabs en
+  O(nmero de slabs), sin recorrer los nodos.
+  */
+template <class N>
+class NodePool {
+
+public:
+
+    typedef N node_type;
+
+    static const bool releases_all = true;
+
+    /** Constructor, no reserva nada hasta que se pide el primer nodo
+
+    @param max_elems nmero mximo de keys de los nodos que se van a reservar
+    */
+    explicit NodePool(int max_elems) : _max_elems(max_elems), _leaves(), _inners() {
+        if (max_elems > 0) {
+            _leaves.setBlock(N::bytes(max_elems, true));
+            _inners.setBlock(N::bytes(max_elems, false));
+        }
+    }
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    /** Constructor de movimiento, los slabs pasan a ser de este pool */
+    NodePool(NodePool&& other) : _max_elems(other._max_elems), _leaves(), _inners() {
+        swap(other);
+    }
+
+    /** Asignacin de movimiento, los slabs que tuviera este pool se liberan */
+    NodePool& operator=(NodePool&& other) {
+        if (this != &other) {
+            release();
+            _max_elems = other._max_elems;
+            swap(other);
+        }
+        return *this;
+    }
+
+    /** Destructor, libera todos los slabs */
+    ~NodePool() {
+        release();
+    }
+
+    /** Construye un nodo vaco en un bloque libre (de la lista libre o del slab actual)
+
+    @param is_leaf indica si el nodo es o no hoja
+
+    @return el nodo creado
+    */
+    N* allocate(bool is_leaf) {
+        return N::construct((is_leaf ? _leaves : _inners).get(), _max_elems, is_leaf);
+    }
+
+    /** Destruye un nodo y guarda su bloque en la lista libre para reutilizarlo
+
+    @param n nodo a liberar
+    */
+    void deallocate(N* n) {
+        SlabList& list = n->_is_leaf ? _leaves : _inners;
+        N::destruct(n);
+        list.put(n);
+    }
+
+    /** Libera todos los slabs de golpe. No llama a los destructores de los nodos que sigan vivos. */
+    void release() {
+        _leaves.release();
+        _inners.release();
+    }
+
+    /** Nmero de slabs reservados actualmente
+
+    @return nmero de slabs
+    */
+    size_t slabs() const {
+        return _leaves.slabs() + _inners.slabs();
+    }
+
+private:
+
+    /** Bloque libre, el puntero al siguiente se guarda dentro del propio bloque */
+    struct FreeBlock {
+        FreeBlock* _next;
+    };
+
+    /** Slabs y lista libre de un tamao de bloque */
+    class SlabList {
+
+    public:
+
+        SlabList() : _block(0), _per_slab(0), _free(NULL), _bump(NULL), _end(NULL), _slabs() {}
+
+        ~SlabList() {
+            release();
+        }
+
+        /** Fija el tamao de bloque y cuntos bloques caben en cada slab */
+        void setBlock(size_t block) {
+            _block = block;
+            _per_slab = SLAB_BYTES / block;
+            if (_per_slab == 0) _per_slab = 1;
+        }
+
+        /** Devuelve un bloque: primero de la lista libre y si no del slab actual */
+        void* get() {
+            if (_free != NULL) {
+                FreeBlock* b = _free;
+                _free = b->_next;
+                return b;
+            }
+            if (_bump == _end) grow(); // El slab actual est agotado
+            void* b = _bump;
+            _bump += _block;
+            return b;
+        }
+
+        /** Devuelve un bloque a la lista libre */
+        void put(void* p) {
+            FreeBlock* b = static_cast<FreeBlock*>(p);
+            b->_next = _free;
+            _free = b;
+        }
+
+        /** Libera todos los slabs */
+        void release() {
+            for (size_t i = 0; i < _slabs.size(); i++) ::operator delete(_slabs[i], std::align_val_t(NODE_ALIGN));
+            _slabs.clear();
+            _free = NULL;
+            _bump = _end = NULL;
+        }
+
+        size_t slabs() const {
+            return _slabs.size();
+        }
+
+        void swap(SlabList& other) {
+            std::swap(_block, other._block);
+            std::swap(_per_slab, other._per_slab);
+            std::swap(_free, other._free);
+            std::swap(_bump, other._bump);
+            std::swap(_end, other._end);
+            _slabs.swap(other._slabs);
+        }
+
+    private:
+
+        /** Reserva un slab nuevo */
+        void grow() {
+            size_t bytes = _block * _per_slab;
+            char* s = static_cast<char*>(::operator new(bytes, std::align_val_t(NODE_ALIGN)));
+            _slabs.push_back(s);
+            _bump = s;
+            _end = s + bytes;
+        }
+
+        size_t _block;           // tamao de cada bloque
+        size_t _per_slab;        // bloques por slab
+        FreeBlock* _free;        // lista libre
+        char* _bump;             // siguiente bloque sin usar del slab actual
+        char* _end;              // final del slab actual
+        std::vector<char*> _slabs; // slabs reservados
+    };
+
+    /** Intercambia el contenido con otro pool */
+    void swap(NodePool& other) {
+        std::swap(_max_elems, other._max_elems);
+        _leaves.swap(other._leaves);
+        _inners.swap(other._inners);
+    }
+
+    int _max_elems;    // nmero mximo de keys de cada nodo
+    SlabList _leaves;  // bloques para hojas
+    SlabList _inners;  // bloques para nodos internos
+};
+
+#endif
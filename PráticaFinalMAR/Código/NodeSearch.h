@@ -0,0 +1,293 @@
+/*
+- Bsqueda de la posicin de una key dentro de un nodo de un rbol-B
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __NODESEARCH_H
+#define __NODESEARCH_H
+
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <immintrin.h>
+#define BTREE_SSE2 1
+#endif
+
+#if defined(__SSE4_2__) || defined(__AVX2__)
+#define BTREE_SSE42 1
+#endif
+
+#if defined(__AVX2__)
+#define BTREE_AVX2 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BTREE_NOINLINE __declspec(noinline)
+#else
+#define BTREE_NOINLINE __attribute__((noinline))
+#endif
+
+/* Pide a la cach la lnea de p sin esperar a que llegue (para leerla ms tarde) */
+#if defined(__GNUC__) || defined(__clang__)
+#define BTREE_PREFETCH(p) __builtin_prefetch((const void*)(p), 0, 3)
+#elif defined(BTREE_SSE2)
+#define BTREE_PREFETCH(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define BTREE_PREFETCH(p) ((void)(p))
+#endif
+
+/** Hasta este nmero de keys se busca con un bucle lineal con salto: en nodos pequeos el predictor
+    acierta y la CPU puede adelantar la carga del hijo, lo que compensa ms que evitar los saltos */
+const int SCALAR_SEARCH_MAX = 16;
+
+/** Nmero de keys que quedan como mximo tras la bsqueda binaria para recorrerlas con SIMD */
+const int SIMD_WINDOW = 64;
+
+/** Cuenta los bits a 1 de una mscara devuelta por movemask */
+inline int maskCount(unsigned m) {
+#ifdef _MSC_VER
+    return (int)__popcnt(m);
+#else
+    return __builtin_popcount(m);
+#endif
+}
+
+/**
+  Ncleos SIMD para contar cuntas keys de un array son menores (o menores o iguales) que k.
+  El caso general no tiene ncleo (enabled = false) y se usa la bsqueda binaria sin saltos.
+  Se especializa para int, int64, float y double segn las instrucciones disponibles al compilar.
+  */
+template <class T, class Enable = void>
+struct SimdCount {
+    static const bool enabled = false;
+    static int less(const T*, int, T) { return 0; }
+    static int lessEqual(const T*, int, T) { return 0; }
+};
+
+#ifdef BTREE_SSE2
+
+/** Enteros con signo de 32 bits */
+template <class T>
+struct SimdCount<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value && sizeof(T) == 4>::type> {
+    static const bool enabled = true;
+
+    BTREE_NOINLINE static int less(const T* a, int n, T k) {
+        int c = 0, i = 0;
+#ifdef BTREE_AVX2
+        __m256i kv8 = _mm256_set1_epi32((int)k);
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            c += maskCount((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(kv8, v))));
+        }
+#endif
+        __m128i kv = _mm_set1_epi32((int)k);
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            c += maskCount((unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(kv, v))));
+        }
+        for (; i < n; i++) c += a[i] < k;
+        return c;
+    }
+
+    BTREE_NOINLINE static int lessEqual(const T* a, int n, T k) {
+        int c = 0, i = 0;
+#ifdef BTREE_AVX2
+        __m256i kv8 = _mm256_set1_epi32((int)k);
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            c += 8 - maskCount((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, kv8))));
+        }
+#endif
+        __m128i kv = _mm_set1_epi32((int)k);
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            c += 4 - maskCount((unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(v, kv))));
+        }
+        for (; i < n; i++) c += !(k < a[i]);
+        return c;
+    }
+};
+
+#ifdef BTREE_SSE42
+
+/** Enteros con signo de 64 bits (la comparacin de 64 bits necesita SSE4.2) */
+template <class T>
+struct SimdCount<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value && sizeof(T) == 8>::type> {
+    static const bool enabled = true;
+
+    BTREE_NOINLINE static int less(const T* a, int n, T k) {
+        int c = 0, i = 0;
+#ifdef BTREE_AVX2
+        __m256i kv4 = _mm256_set1_epi64x((long long)k);
+        for (; i + 4 <= n; i += 4) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            c += maskCount((unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(kv4, v))));
+        }
+#endif
+        __m128i kv = _mm_set1_epi64x((long long)k);
+        for (; i + 2 <= n; i += 2) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            c += maskCount((unsigned)_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(kv, v))));
+        }
+        for (; i < n; i++) c += a[i] < k;
+        return c;
+    }
+
+    BTREE_NOINLINE static int lessEqual(const T* a, int n, T k) {
+        int c = 0, i = 0;
+#ifdef BTREE_AVX2
+        __m256i kv4 = _mm256_set1_epi64x((long long)k);
+        for (; i + 4 <= n; i += 4) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            c += 4 - maskCount((unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v, kv4))));
+        }
+#endif
+        __m128i kv = _mm_set1_epi64x((long long)k);
+        for (; i + 2 <= n; i += 2) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            c += 2 - maskCount((unsigned)_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(v, kv))));
+        }
+        for (; i < n; i++) c += !(k < a[i]);
+        return c;
+    }
+};
+
+#endif
+
+/** float */
+template <>
+struct SimdCount<float> {
+    static const bool enabled = true;
+
+    BTREE_NOINLINE static int less(const float* a, int n, float k) {
+        int c = 0, i = 0;
+#ifdef BTREE_AVX2
+        __m256 kv8 = _mm256_set1_ps(k);
+        for (; i + 8 <= n; i += 8) c += maskCount((unsigned)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(a + i), kv8, _CMP_LT_OQ)));
+#endif
+        __m128 kv = _mm_set1_ps(k);
+        for (; i + 4 <= n; i += 4) c += maskCount((unsigned)_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(a + i), kv)));
+        for (; i < n; i++) c += a[i] < k;
+        return c;
+    }
+
+    BTREE_NOINLINE static int lessEqual(const float* a, int n, float k) {
+        int c = 0, i = 0;
+#ifdef BTREE_AVX2
+        __m256 kv8 = _mm256_set1_ps(k);
+        for (; i + 8 <= n; i += 8) c += maskCount((unsigned)_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(a + i), kv8, _CMP_LE_OQ)));
+#endif
+        __m128 kv = _mm_set1_ps(k);
+        for (; i + 4 <= n; i += 4) c += maskCount((unsigned)_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(a + i), kv)));
+        for (; i < n; i++) c += !(k < a[i]);
+        return c;
+    }
+};
+
+/** double */
+template <>
+struct SimdCount<double> {
+    static const bool enabled = true;
+
+    BTREE_NOINLINE static int less(const double* a, int n, double k) {
+        int c = 0, i = 0;
+#ifdef BTREE_AVX2
+        __m256d kv4 = _mm256_set1_pd(k);
+        for (; i + 4 <= n; i += 4) c += maskCount((unsigned)_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(a + i), kv4, _CMP_LT_OQ)));
+#endif
+        __m128d kv = _mm_set1_pd(k);
+        for (; i + 2 <= n; i += 2) c += maskCount((unsigned)_mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(a + i), kv)));
+        for (; i < n; i++) c += a[i] < k;
+        return c;
+    }
+
+    BTREE_NOINLINE static int lessEqual(const double* a, int n, double k) {
+        int c = 0, i = 0;
+#ifdef BTREE_AVX2
+        __m256d kv4 = _mm256_set1_pd(k);
+        for (; i + 4 <= n; i += 4) c += maskCount((unsigned)_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(a + i), kv4, _CMP_LE_OQ)));
+#endif
+        __m128d kv = _mm_set1_pd(k);
+        for (; i + 2 <= n; i += 2) c += maskCount((unsigned)_mm_movemask_pd(_mm_cmple_pd(_mm_loadu_pd(a + i), kv)));
+        for (; i < n; i++) c += !(k < a[i]);
+        return c;
+    }
+};
+
+#endif
+
+/**
+Funcin que devuelve la posicin de la primera key mayor o igual que k en un array ordenado
+(es decir, cuntas keys son estrictamente menores que k).
+
+En nodos de hasta SCALAR_SEARCH_MAX keys se recorre linealmente. Si no, para tipos con ncleo SIMD se acota
+primero con bsqueda binaria hasta SIMD_WINDOW keys y se cuentan las restantes con SIMD, y para el resto de
+tipos se hace una bsqueda binaria sin saltos.
+
+@param elems array ordenado de keys
+@param n nmero de keys del array
+@param k key buscada
+
+@return posicin de la primera key >= k (n si no hay ninguna)
+*/
+template <class T>
+inline int keyLowerBound(const T* elems, int n, const T& k) {
+    if (n <= SCALAR_SEARCH_MAX) {
+        int i = 0;
+        while (i < n && elems[i] < k) i++;
+        return i;
+    }
+    const T* base = elems;
+    if (SimdCount<T>::enabled) {
+        while (n > SIMD_WINDOW) { // Bsqueda binaria hasta que queda una ventana pequea
+            int half = n / 2;
+            base = (base[half - 1] < k) ? base + half : base;
+            n -= half;
+        }
+        return (int)(base - elems) + SimdCount<T>::less(base, n, k);
+    }
+    while (n > 1) { // Bsqueda binaria sin saltos: solo cambia base, el bucle siempre da las mismas vueltas
+        int half = n / 2;
+        base = (base[half] < k) ? base + half : base;
+        n -= half;
+    }
+    return (int)(base - elems) + (*base < k);
+}
+
+/**
+Funcin que devuelve la posicin de la primera key estrictamente mayor que k en un array ordenado
+(es decir, cuntas keys son menores o iguales que k).
+
+@param elems array ordenado de keys
+@param n nmero de keys del array
+@param k key buscada
+
+@return posicin de la primera key > k (n si no hay ninguna)
+*/
+template <class T>
+inline int keyUpperBound(const T* elems, int n, const T& k) {
+    if (n <= SCALAR_SEARCH_MAX) {
+        int i = 0;
+        while (i < n && !(k < elems[i])) i++;
+        return i;
+    }
+    const T* base = elems;
+    if (SimdCount<T>::enabled) {
+        while (n > SIMD_WINDOW) {
+            int half = n / 2;
+            base = (k < base[half - 1]) ? base : base + half;
+            n -= half;
+        }
+        return (int)(base - elems) + SimdCount<T>::lessEqual(base, n, k);
+    }
+    while (n > 1) {
+        int half = n / 2;
+        base = (k < base[half]) ? base : base + half;
+        n -= half;
+    }
+    return (int)(base - elems) + !(k < *base);
+}
+
+#endif
@@ -0,0 +1,57 @@
+/*
+- Ordenacin en paralelo de un vector de keys
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __PARALLELSORT_H
+#define __PARALLELSORT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/** Por debajo de este nmero de elementos se ordena con un solo hilo */
+const size_t PARALLEL_SORT_MIN = 1 << 16;
+
+/**
+Funcin que ordena un vector repartindolo en tantos trozos como hilos: cada hilo ordena su trozo
+y despus se mezclan los trozos de dos en dos (tambin en paralelo) hasta que queda uno solo.
+
+@param v vector a ordenar
+@param threads nmero de hilos a usar (0 para usar tantos como ncleos)
+*/
+template <class T>
+void parallelSort(std::vector<T>& v, unsigned threads = 0) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    size_t n = v.size();
+    if (threads == 1 || n < PARALLEL_SORT_MIN) {
+        std::sort(v.begin(), v.end());
+        return;
+    }
+
+    std::vector<size_t> bounds(threads + 1); // Lmites de los trozos
+    for (unsigned i = 0; i <= threads; i++) bounds[i] = n * i / threads;
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; i++) { // Cada hilo ordena su trozo
+        workers.push_back(std::thread([&v, &bounds, i]() {
+            std::sort(v.begin() + bounds[i], v.begin() + bounds[i + 1]);
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+
+    for (unsigned width = 1; width < threads; width *= 2) { // Mezclamos los trozos de dos en dos
+        workers.clear();
+        for (unsigned i = 0; i + width < threads; i += 2 * width) {
+            size_t lo = bounds[i], mid = bounds[i + width], hi = bounds[std::min(i + 2 * width, threads)];
+            workers.push_back(std::thread([&v, lo, mid, hi]() {
+                std::inplace_merge(v.begin() + lo, v.begin() + mid, v.begin() + hi);
+            }));
+        }
+        for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    }
+}
+
+#endif
@@ -0,0 +1,171 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba diferencial del rbol-B+ (BPlusTree.h) contra std::set con varios tamaos de nodo:
+- Inserciones, eliminaciones y bsquedas aleatorias; cada resultado tiene que coincidir con el de std::set.
+- lower_bound, upper_bound, find y range tienen que dar lo mismo que en std::set, y recorrer desde lower_bound
+  hasta el final tiene que dar las mismas keys (as se recorre la lista de hojas desde cualquier punto).
+- Cada cierto nmero de operaciones se comprueba la estructura con check (que tambin recorre la lista de hojas).
+- Inserciones y eliminaciones en orden creciente y decreciente hasta vaciar el rbol, y con strings (tambin traverse).
+
+*/
+
+#include "BPlusTree.h"
+
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Tamaos de nodo con los que se prueba */
+const int ORDERS[] = { 3, 4, 5, 6, 7, 8, 16, 33, 64, 255 };
+
+/** Operaciones aleatorias de cada prueba diferencial */
+const int DIFF_OPS = 60000;
+
+/** Cada cuntas operaciones se comprueba la estructura entera */
+const int CHECK_EVERY = 2000;
+
+/** Keys de las pruebas ordenadas */
+const int SEQ_KEYS = 5000;
+
+
+/** Compara un iterador del rbol con uno de std::set (los dos en el final o apuntando a la misma key) */
+template <class Tree>
+bool same(const Tree& tree, typename Tree::const_iterator it, const set<int>& ref, set<int>::const_iterator r) {
+	if (r == ref.end()) return it == tree.end();
+	return it != tree.end() && *it == *r;
+}
+
+/** Comprueba la estructura y que el recorrido de la lista de hojas (con iteradores y con for_each) da las keys de ref */
+template <class Tree>
+bool sameKeys(const Tree& tree, const set<int>& ref) {
+	vector<int> keys;
+	tree.for_each([&keys](const int& k) { keys.push_back(k); });
+	return tree.check() && tree.size() == ref.size() && tree.isEmpty() == ref.empty()
+		&& vector<int>(tree.begin(), tree.end()) == vector<int>(ref.begin(), ref.end()) && keys == vector<int>(ref.begin(), ref.end());
+}
+
+/**
+Prueba diferencial con un tamao de nodo: operaciones aleatorias sobre un rango pequeo de keys (para que haya
+muchas repetidas y muchas eliminaciones que encuentran la key) comparando cada resultado con std::set. En la
+segunda mitad hay ms eliminaciones que inserciones, as que el rbol encoge y se unen nodos.
+
+@param order nmero mximo de keys por nodo
+
+@return true si todo ha ido bien
+*/
+template <class Tree>
+bool differential(int order) {
+	Tree tree(order);
+	set<int> ref;
+	mt19937 rng(order);
+	bool ok = true;
+
+	for (int op = 0; ok && op < DIFF_OPS; op++) {
+		int k = (int)(rng() % 3000);
+		int what = (int)(rng() % 10);
+		int inserts = op < DIFF_OPS / 2 ? 5 : 2; // La segunda mitad elimina ms de lo que inserta y el rbol encoge
+		if (what < inserts) ok = tree.insert(k) == ref.insert(k).second;
+		else if (what < 8) ok = tree.remove(k) == (ref.erase(k) > 0);
+		else {
+			int hi = k + (int)(rng() % 60);
+			ok = same(tree, tree.lower_bound(k), ref, ref.lower_bound(k))
+				&& same(tree, tree.upper_bound(k), ref, ref.upper_bound(k))
+				&& same(tree, tree.find(k), ref, ref.find(k));
+			vector<int> got;
+			for (const int& x : tree.range(k, hi)) got.push_back(x);
+			ok = ok && got == vector<int>(ref.lower_bound(k), ref.lower_bound(hi));
+			got.clear();
+			for (const int& x : tree.range(hi, k)) got.push_back(x); // Intervalo vaco (hi >= k)
+			ok = ok && got.size() == 0;
+			if (what == 9) ok = ok && vector<int>(tree.lower_bound(k), tree.end()) == vector<int>(ref.lower_bound(k), ref.end());
+		}
+		if (op % CHECK_EVERY == 0) ok = ok && sameKeys(tree, ref);
+	}
+	ok = ok && sameKeys(tree, ref);
+	cout << "Diferencial con orden " << order << ": " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+Inserta keys en orden creciente o decreciente y las elimina en el mismo orden o en el contrario hasta vaciar el
+rbol, comprobando la estructura por el camino (los splits y merges siempre del mismo lado del rbol).
+
+@param order nmero mximo de keys por nodo
+
+@return true si todo ha ido bien
+*/
+bool sequential(int order) {
+	bool ok = true;
+	for (int mode = 0; ok && mode < 4; mode++) {
+		BPlusTree<int> tree(order);
+		set<int> ref;
+		for (int i = 0; ok && i < SEQ_KEYS; i++) {
+			int k = mode < 2 ? i : SEQ_KEYS - 1 - i;
+			ok = tree.insert(k) && ref.insert(k).second;
+			if (i % 500 == 0) ok = ok && sameKeys(tree, ref);
+		}
+		ok = ok && sameKeys(tree, ref) && !tree.insert(0);
+		for (int i = 0; ok && i < SEQ_KEYS; i++) {
+			int k = mode % 2 == 0 ? i : SEQ_KEYS - 1 - i;
+			ok = tree.remove(k) && ref.erase(k) == 1;
+			if (i % 500 == 0) ok = ok && sameKeys(tree, ref);
+		}
+		ok = ok && sameKeys(tree, ref) && tree.begin() == tree.end() && !tree.remove(0);
+		ok = ok && tree.insert(7) && tree.find(7) != tree.end(); // El rbol vaciado se puede seguir usando
+	}
+	cout << "Keys en orden con orden " << order << ": " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+rbol de strings: comprueba el recorrido, range y las bsquedas con keys que no son enteros.
+
+@return true si todo ha ido bien
+*/
+bool strings() {
+	BPlusTree<string> tree(4);
+	set<string> ref;
+	for (int i = 0; i < 2000; i++) {
+		string k = "key" + to_string(i * 7919 % 2000);
+		tree.insert(k);
+		ref.insert(k);
+	}
+	for (int i = 0; i < 2000; i += 3) {
+		string k = "key" + to_string(i);
+		tree.remove(k);
+		ref.erase(k);
+	}
+	vector<string> got;
+	for (const string& k : tree.range("key1", "key2")) got.push_back(k);
+	ostringstream out, expected;
+	tree.traverse(out);
+	for (set<string>::const_iterator it = ref.begin(); it != ref.end(); ++it) expected << " " << *it;
+	bool ok = tree.check() && vector<string>(tree.begin(), tree.end()) == vector<string>(ref.begin(), ref.end())
+		&& out.str() == expected.str()
+		&& got == vector<string>(ref.lower_bound("key1"), ref.lower_bound("key2"))
+		&& *tree.upper_bound("key1") == *ref.upper_bound("key1") && tree.find("key3") == tree.end();
+	cout << "Keys string: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool all_ok = true;
+	for (int order : ORDERS) {
+		all_ok = differential<BPlusTree<int> >(order) && all_ok;
+		all_ok = sequential(order) && all_ok;
+	}
+	all_ok = differential<BPlusTree<int, HeapNodeAllocator<BPlusNode<int> > > >(5) && all_ok;
+	all_ok = strings() && all_ok;
+
+	if (all_ok) cout << "Todas las pruebas del Arbol-B+ son correctas\n";
+	else cout << "Alguna prueba del Arbol-B+ ha fallado\n";
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,223 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba diferencial del mapa sobre un rbol-B (BTreeMap.h) contra std::map con varios tamaos de nodo:
+- try_emplace, insert_or_assign, operator[], erase y find aleatorios; cada resultado tiene que coincidir con el de
+  std::map y, cada cierto nmero de operaciones, todas las keys de std::map tienen que estar con su valor (y
+  for_each tiene que recorrerlas en orden). Al final traverse tiene que sacar las parejas de std::map.
+- Valores unique_ptr<string> (que solo se pueden mover): try_emplace con una key que ya est no puede perder el
+  valor pasado con std::move, y los valores tienen que seguir a sus keys en los splits, merges y prstamos.
+- Con un valor que cuenta cuntos hay vivos se comprueba que eliminar, vaciar y destruir el mapa los libera todos.
+
+*/
+
+#include "BTreeMap.h"
+
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Tamaos de nodo con los que se prueba */
+const int ORDERS[] = { 2, 3, 4, 5, 8, 16, 64 };
+
+/** Operaciones aleatorias de cada prueba diferencial */
+const int DIFF_OPS = 60000;
+
+/** Cada cuntas operaciones se comprueban todas las keys */
+const int CHECK_EVERY = 3000;
+
+/** Keys distintas que se usan */
+const int KEY_RANGE = 2000;
+
+
+/** Comprueba que el mapa tiene exactamente las keys de ref (tambin al recorrerlo con for_each) con los mismos valores */
+template <class Map>
+bool sameEntries(const Map& m, const map<int, int>& ref) {
+	if (m.size() != ref.size() || m.isEmpty() != ref.empty()) return false;
+	vector<int> keys;
+	m.for_each([&keys](const int& k) { keys.push_back(k); });
+	if (keys.size() != ref.size()) return false;
+	size_t i = 0;
+	for (map<int, int>::const_iterator it = ref.begin(); it != ref.end(); ++it) {
+		if (keys[i++] != it->first) return false;
+	}
+	for (map<int, int>::const_iterator it = ref.begin(); it != ref.end(); ++it) {
+		const int* v = m.find(it->first);
+		if (v == NULL || *v != it->second) return false;
+	}
+	return true;
+}
+
+/** Comprueba que el mapa de unique_ptr tiene exactamente las keys de ref con valores iguales a sus strings */
+bool sameEntries(const BTreeMap<int, unique_ptr<string> >& m, const map<int, string>& ref) {
+	if (m.size() != ref.size()) return false;
+	for (map<int, string>::const_iterator it = ref.begin(); it != ref.end(); ++it) {
+		unique_ptr<string>* v = m.find(it->first);
+		if (v == NULL || *v == nullptr || **v != it->second) return false;
+	}
+	return true;
+}
+
+/**
+Prueba diferencial con un tamao de nodo y valores int. En la segunda mitad hay ms eliminaciones que inserciones,
+as que el rbol encoge y se unen nodos.
+
+@param order nmero mximo de keys por nodo
+
+@return true si todo ha ido bien
+*/
+bool differential(int order) {
+	BTreeMap<int, int> m(order);
+	map<int, int> ref;
+	mt19937 rng(order);
+	bool ok = true;
+
+	for (int op = 0; ok && op < DIFF_OPS; op++) {
+		int k = (int)(rng() % KEY_RANGE);
+		int v = (int)rng();
+		int what = (int)(rng() % 10);
+		if (op >= DIFF_OPS / 2 && what < 3) what += 5; // Ms eliminaciones en la segunda mitad
+		if (what < 2) {
+			pair<int*, bool> r = m.try_emplace(k, v);
+			pair<map<int, int>::iterator, bool> e = ref.try_emplace(k, v);
+			ok = r.second == e.second && *r.first == e.first->second;
+		}
+		else if (what < 4) {
+			pair<int*, bool> r = m.insert_or_assign(k, v);
+			ok = r.second == ref.insert_or_assign(k, v).second && *r.first == v;
+		}
+		else if (what < 5) {
+			ok = m[k] == ref[k];
+			m[k] += 1;
+			ref[k] += 1;
+		}
+		else if (what < 8) ok = m.erase(k) == (ref.erase(k) > 0);
+		else {
+			const int* p = m.find(k);
+			map<int, int>::iterator it = ref.find(k);
+			ok = (p == NULL) == (it == ref.end()) && (p == NULL || *p == it->second);
+		}
+		if (op % CHECK_EVERY == 0) ok = ok && sameEntries(m, ref);
+	}
+	ok = ok && sameEntries(m, ref);
+
+	BTreeMap<int, int> moved(std::move(m)); // El mapa movido tiene que seguir igual
+	ok = ok && sameEntries(moved, ref);
+	ostringstream out, expected;
+	moved.traverse(out);
+	for (map<int, int>::const_iterator it = ref.begin(); it != ref.end(); ++it) expected << " " << it->first << ":" << it->second;
+	ok = ok && out.str() == expected.str();
+	moved.clear();
+	ok = ok && moved.isEmpty() && moved.find(0) == NULL && *moved.try_emplace(1, 5).first == 5;
+	cout << "Diferencial con orden " << order << ": " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+Prueba con valores unique_ptr<string>: los valores solo se pueden mover, as que si algn split, merge o prstamo
+los copiase no compilara, y si alguno los perdiese la key se quedara con un puntero nulo.
+
+@param order nmero mximo de keys por nodo
+
+@return true si todo ha ido bien
+*/
+bool uniquePtrValues(int order) {
+	BTreeMap<int, unique_ptr<string> > m(order);
+	map<int, string> ref;
+	mt19937 rng(order + 100);
+	bool ok = true;
+
+	for (int op = 0; ok && op < DIFF_OPS / 2; op++) {
+		int k = (int)(rng() % KEY_RANGE);
+		int what = (int)(rng() % 8);
+		string s = "valor " + to_string(op);
+		if (op >= DIFF_OPS / 4 && what < 2) what += 4;
+		if (what < 2) {
+			unique_ptr<string> p(new string(s));
+			bool inserted = m.try_emplace(k, std::move(p)).second;
+			ok = inserted == ref.try_emplace(k, s).second;
+			ok = ok && (inserted ? p == nullptr : p != nullptr && *p == s); // Si ya estaba, el valor no se ha movido
+		}
+		else if (what < 4) {
+			m.insert_or_assign(k, unique_ptr<string>(new string(s)));
+			ref[k] = s;
+		}
+		else if (what < 7) ok = m.erase(k) == (ref.erase(k) > 0);
+		else {
+			unique_ptr<string>* p = m.find(k);
+			ok = (p == NULL) == (ref.count(k) == 0);
+		}
+		if (op % CHECK_EVERY == 0) ok = ok && sameEntries(m, ref);
+	}
+	ok = ok && sameEntries(m, ref);
+	cout << "Valores unique_ptr<string> con orden " << order << ": " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/** Valor que cuenta cuntos hay vivos */
+struct Probe {
+	static int live;
+	int _id;
+	explicit Probe(int id) : _id(id) {
+		live++;
+	}
+	~Probe() {
+		live--;
+	}
+};
+
+int Probe::live = 0;
+
+/**
+Comprueba que los valores se liberan: con unique_ptr<Probe> hay tantos Probe vivos como keys en el mapa despus
+de cualquier mezcla de inserciones, sustituciones y eliminaciones, y ninguno despus de vaciar o destruir el mapa.
+
+@return true si todo ha ido bien
+*/
+bool valuesReleased() {
+	bool ok = true;
+	for (int order : ORDERS) {
+		{
+			BTreeMap<int, unique_ptr<Probe> > m(order);
+			mt19937 rng(order + 200);
+			for (int op = 0; ok && op < 20000; op++) {
+				int k = (int)(rng() % 500);
+				int what = (int)(rng() % 3);
+				if (what == 0) m.try_emplace(k, unique_ptr<Probe>(new Probe(k))); // Si ya est, el temporal se libera aqu
+				else if (what == 1) m.insert_or_assign(k, unique_ptr<Probe>(new Probe(k)));
+				else m.erase(k);
+				ok = Probe::live == (int)m.size();
+			}
+			for (int k = 0; ok && k < 500; k++) {
+				unique_ptr<Probe>* p = m.find(k);
+				ok = p == NULL || (*p)->_id == k;
+			}
+			m.clear();
+			ok = ok && Probe::live == 0;
+			for (int k = 0; k < 300; k++) m.try_emplace(k, new Probe(k));
+		}
+		ok = ok && Probe::live == 0; // El destructor libera los que quedaban
+	}
+	cout << "Valores liberados al eliminar, vaciar y destruir: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool all_ok = true;
+	for (int order : ORDERS) {
+		all_ok = differential(order) && all_ok;
+		all_ok = uniquePtrValues(order) && all_ok;
+	}
+	all_ok = valuesReleased() && all_ok;
+
+	if (all_ok) cout << "Todas las pruebas del mapa son correctas\n";
+	else cout << "Alguna prueba del mapa ha fallado\n";
+	return all_ok ? 0 : 1;
+}
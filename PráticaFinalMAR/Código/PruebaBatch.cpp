@@ -0,0 +1,244 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba diferencial de las operaciones por tandas del rbol-B (insert_batch, remove_batch y search_batch de BTree.h)
+contra std::multiset con tamaos de nodo 3, 4 y 5, que son los que ms parten, unen y prestan keys mientras se
+reutiliza el camino de la key anterior.
+- Cada tanda tiene keys seguidas (que comparten camino), keys lejos de las dems (que se salen del rango del camino
+  guardado y tienen que volver a subir), keys repetidas dentro de la tanda y keys que no estn o tienen lpida.
+- Despus de cada tanda se comprueban size, isEmpty, el recorrido con for_each y que shape cuenta las mismas keys y
+  lpidas que el rbol. remove_batch tiene que decir que no estn exactamente las keys que no puede quitar, y
+  search_batch tiene que encontrar las mismas keys que search y devolver un nodo que las tiene.
+- Las keys de [0, KEY_RANGE) no se repiten en el rbol (para poder ponerles lpida con remove_lazy); las de
+  [DUP_BASE, DUP_BASE + DUP_RANGE) se repiten.
+
+*/
+
+#include "BTree.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Tamaos de nodo con los que se prueba */
+const int ORDERS[] = { 3, 4, 5 };
+
+/** Tandas de cada prueba */
+const int ROUNDS = 2000;
+
+/** Mximo de keys de cada tanda */
+const int MAX_BATCH = 60;
+
+/** Keys distintas sin repetir que se usan */
+const int KEY_RANGE = 5000;
+
+/** Primera key de las que se repiten y cuntas distintas hay */
+const int DUP_BASE = 100000;
+const int DUP_RANGE = 30;
+
+/** Mensaje de remove_batch cuando la key no est */
+const string MISSING = "is not in the tree";
+
+
+/** Ejecuta f y devuelve lo que ha escrito en cout */
+template <class F>
+string captured(F f) {
+	ostringstream out;
+	streambuf* old = cout.rdbuf(out.rdbuf());
+	f();
+	cout.rdbuf(old);
+	return out.str();
+}
+
+/** Nmero de veces que aparece el mensaje de key que no est */
+size_t missing(const string& out) {
+	size_t n = 0;
+	for (size_t p = out.find(MISSING); p != string::npos; p = out.find(MISSING, p + 1)) n++;
+	return n;
+}
+
+/**
+Comprueba size, isEmpty, el recorrido con for_each y que shape cuenta las keys con lpida y sin ella.
+
+@return true si todo coincide con ref
+*/
+bool sameKeys(BTree<int>& tree, const multiset<int>& ref) {
+	vector<int> keys;
+	tree.for_each([&keys](const int& x) { keys.push_back(x); });
+	TreeShape s = tree.shape();
+	return tree.size() == ref.size() && tree.isEmpty() == ref.empty() && keys == vector<int>(ref.begin(), ref.end())
+		&& s._keys == tree.size() + tree.n_dead() && s._dead == tree.n_dead();
+}
+
+/**
+Tanda de keys: unas cuantas seguidas a partir de una key aleatoria, algunas lejos de las dems, de las que se
+repiten y alguna repetida dentro de la tanda.
+
+@param rng generador de nmeros aleatorios
+@return la tanda (sin ordenar)
+*/
+vector<int> randomBatch(mt19937& rng) {
+	vector<int> batch;
+	int n = 1 + (int)(rng() % MAX_BATCH);
+	int base = (int)(rng() % KEY_RANGE);
+	for (int j = 0; j < n; j++) {
+		int what = (int)(rng() % 10);
+		if (what < 6) batch.push_back((base + (int)(rng() % (2 * n + 1))) % KEY_RANGE); // Cerca de las dems
+		else if (what < 8) batch.push_back((int)(rng() % KEY_RANGE));                   // Lejos
+		else if (what < 9) batch.push_back(DUP_BASE + (int)(rng() % DUP_RANGE));
+		else batch.push_back(batch.empty() ? base : batch[rng() % batch.size()]);        // Repetida en la tanda
+	}
+	shuffle(batch.begin(), batch.end(), rng);
+	return batch;
+}
+
+/**
+insert_batch de una tanda. De las keys que no se repiten solo se insertan las que no estn (una vez); las que
+tienen lpida se reviven y dejan de contar en n_dead.
+
+@param buried keys con lpida
+@return true si todo ha ido bien
+*/
+bool insertBatch(BTree<int>& tree, multiset<int>& ref, set<int>& buried, mt19937& rng) {
+	vector<int> batch;
+	set<int> taken;
+	size_t revived = 0;
+	for (int k : randomBatch(rng)) {
+		if (k >= DUP_BASE) batch.push_back(k);
+		else if (ref.count(k) == 0 && taken.insert(k).second) {
+			batch.push_back(k);
+			revived += buried.erase(k);
+		}
+	}
+	size_t dead = tree.n_dead();
+	tree.insert_batch(batch.begin(), batch.end());
+	for (int k : batch) ref.insert(k);
+	return tree.n_dead() == dead - revived;
+}
+
+/**
+remove_batch de una tanda: tiene que decir que no estn exactamente las que no puede quitar (las que no estn, las
+que tienen lpida y las repetidas en la tanda ms veces de las que estn). Con el rbol vaco lanza E_BTree_Empty.
+
+@return true si todo ha ido bien
+*/
+bool removeBatch(BTree<int>& tree, multiset<int>& ref, mt19937& rng) {
+	vector<int> batch = randomBatch(rng);
+	if (ref.empty()) {
+		try {
+			tree.remove_batch(batch.begin(), batch.end());
+			return false;
+		}
+		catch (E_BTree_Empty&) {
+			return true;
+		}
+	}
+	size_t expected = 0;
+	for (int k : batch) {
+		multiset<int>::iterator it = ref.find(k);
+		if (it == ref.end()) expected++;
+		else ref.erase(it);
+	}
+	size_t dead = tree.n_dead();
+	string out = captured([&tree, &batch]() { tree.remove_batch(batch.begin(), batch.end()); });
+	return missing(out) == expected && tree.n_dead() == dead;
+}
+
+/**
+search_batch de una tanda: cada key se encuentra si y solo si est en ref, igual que con search, y el nodo devuelto
+la tiene. Con el rbol vaco lanza E_BTree_Empty.
+
+@return true si todo ha ido bien
+*/
+bool searchBatch(BTree<int>& tree, const multiset<int>& ref, mt19937& rng) {
+	vector<int> batch = randomBatch(rng);
+	if (ref.empty()) {
+		try {
+			tree.search_batch(batch.begin(), batch.end());
+			return false;
+		}
+		catch (E_BTree_Empty&) {
+			return true;
+		}
+	}
+	vector<BTree<int>::node_type*> found = tree.search_batch(batch.begin(), batch.end());
+	bool ok = found.size() == batch.size();
+	for (size_t j = 0; ok && j < batch.size(); j++) {
+		BTree<int>::node_type* x = found[j];
+		ok = (x != NULL) == (ref.count(batch[j]) > 0) && (x != NULL) == (tree.search(batch[j]) != NULL);
+		if (ok && x != NULL) ok = find(x->_elems, x->_elems + x->_n_elems, batch[j]) != x->_elems + x->_n_elems;
+	}
+	return ok;
+}
+
+/**
+Prueba diferencial con un tamao de nodo. En la primera mitad se inserta ms de lo que se elimina y en la segunda al
+revs, as que el rbol crece y despus encoge. Al final se vaca con tandas de las keys que quedan (con alguna que
+no est) y las tandas con el rbol vaco tienen que lanzar E_BTree_Empty.
+
+@param order nmero mximo de keys por nodo
+@return true si todo ha ido bien
+*/
+bool differential(int order) {
+	BTree<int> tree(order);
+	multiset<int> ref;
+	set<int> buried; // Keys con lpida
+	mt19937 rng(order * 17);
+	bool ok = true;
+	size_t peak = 0;
+
+	for (int round = 0; ok && round < ROUNDS; round++) {
+		bool growing = round < ROUNDS / 2;
+		int what = (int)(rng() % 10);
+		if (what < (growing ? 5 : 2)) ok = insertBatch(tree, ref, buried, rng);
+		else if (what < 7) ok = removeBatch(tree, ref, rng);
+		else if (what < 9) ok = searchBatch(tree, ref, rng);
+		else if (!ref.empty()) { // Unas cuantas lpidas, que las tandas tienen que tratar como keys que no estn
+			for (int j = 0; ok && j < 5; j++) {
+				int k = (int)(rng() % KEY_RANGE);
+				bool present = ref.count(k) > 0;
+				ok = tree.remove_lazy(k) == present;
+				if (present) {
+					ref.erase(k);
+					buried.insert(k);
+				}
+				if (ref.empty()) break;
+			}
+		}
+		ok = ok && sameKeys(tree, ref) && tree.n_dead() == buried.size();
+		peak = max(peak, ref.size());
+	}
+
+	vector<int> rest(ref.begin(), ref.end());
+	shuffle(rest.begin(), rest.end(), rng);
+	for (size_t j = 0; ok && j < rest.size(); j += MAX_BATCH) { // Se vaca el rbol
+		vector<int> batch(rest.begin() + j, rest.begin() + min(rest.size(), j + MAX_BATCH));
+		batch.push_back(KEY_RANGE + (int)j); // Una que no est
+		for (int k : batch) {
+			multiset<int>::iterator it = ref.find(k);
+			if (it != ref.end()) ref.erase(it);
+		}
+		string out = captured([&tree, &batch]() { tree.remove_batch(batch.begin(), batch.end()); });
+		ok = missing(out) == 1 && sameKeys(tree, ref);
+	}
+	ok = ok && peak > 1000 && tree.isEmpty() && tree.shape()._keys == buried.size() && removeBatch(tree, ref, rng)
+		&& searchBatch(tree, ref, rng);
+	cout << "Tandas con orden " << order << " (hasta " << peak << " keys): " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool all_ok = true;
+	for (int order : ORDERS) all_ok = differential(order) && all_ok;
+
+	if (all_ok) cout << "Todas las pruebas de las tandas son correctas\n";
+	else cout << "Alguna prueba de las tandas ha fallado\n";
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,319 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba de los casos de prueba en binario (CommandStream.h): se escribe un caso en texto, se convierte a binario con
+convertCommands y los lotes que devuelve CommandReader tienen que ser los mismos (tipo y keys) que los de
+TextCommandReader con el fichero de texto, y los dos los que salen de las operaciones escritas.
+- Keys int y long long con negativas, 0, los lmites de cada nmero de bytes del varint y los extremos del tipo
+  (INT_MIN, INT_MAX, y con long long tambin los de 64 bits), que son los casos difciles del zigzag.
+- Texto con una operacin y su key por lnea (como prueba.txt), con saltos de lnea de Windows, todo en una lnea y
+  con y sin salto de lnea al final.
+- Tramos del mismo tipo ms largos que el mximo del lote, que se tienen que partir exactamente en max.
+- Un caso grande, que pasa de los COMMAND_BLOCK bytes del buffer del escritor.
+- Ficheros en binario mal hechos: cortados dentro de una key o de la cabecera, con otra cabecera u otra versin y
+  con una operacin que no existe tienen que lanzar E_BTree_Format; uno que no existe, E_BTree_File.
+
+*/
+
+#include "CommandStream.h"
+
+#include <climits>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/** Ficheros de las pruebas */
+const string TEXT_PATH = "prueba_comandos.txt";
+const string BINARY_PATH = "prueba_comandos.bin";
+
+/** Mximos de operaciones por lote con los que se leen los casos */
+const size_t MAX_BATCHES[] = { 1, 2, 3, 7, 64, COMMAND_BLOCK };
+
+/** Formas de escribir el caso en texto */
+enum TextLayout { LINES, LINES_NO_END, CRLF, ONE_LINE };
+
+
+/** Operacin de un caso de prueba */
+template <class T>
+struct Command {
+	char _op;
+	T _key;
+};
+
+/** Lote: tipo de las operaciones y sus keys */
+template <class T>
+using Batch = pair<char, vector<T> >;
+
+/**
+Keys que se prueban adems de las aleatorias: los cambios de nmero de bytes del varint tras el zigzag, los
+extremos de int y los del tipo (y con long long, las que pasan a ocupar el ltimo byte del varint).
+
+@return las keys
+*/
+template <class T>
+vector<T> specialKeys() {
+	T max = numeric_limits<T>::max(), min = numeric_limits<T>::min();
+	return { 0, -1, 1, 63, -64, 64, -65, 8191, -8192, 8192, -8193, (T)INT_MAX, (T)INT_MIN, (T)(INT_MAX - 1),
+		(T)(INT_MIN + 1), max, min, (T)(max / 2 + 1), (T)(min / 2 - 1) };
+}
+
+/**
+Operaciones aleatorias en tramos del mismo tipo (algunos ms largos que los mximos de lote), con keys especiales,
+pequeas y de todo el rango del tipo.
+
+@param n nmero de operaciones
+@param rng generador de nmeros aleatorios
+@return las operaciones
+*/
+template <class T>
+vector<Command<T> > randomCommands(size_t n, mt19937_64& rng) {
+	const char ops[] = { 'i', 'd', 's' };
+	vector<T> special = specialKeys<T>();
+	vector<Command<T> > cmds;
+	while (cmds.size() < n) {
+		char op = ops[rng() % 3];
+		size_t run = rng() % 8 == 0 ? 1 + rng() % 100 : 1 + rng() % 6;
+		for (size_t j = 0; j < run && cmds.size() < n; j++) {
+			int what = (int)(rng() % 4);
+			T k;
+			if (what == 0) k = special[rng() % special.size()];
+			else if (what == 1) k = (T)((int)(rng() % 2001) - 1000);
+			else k = (T)rng(); // De todo el rango
+			cmds.push_back({ op, k });
+		}
+	}
+	return cmds;
+}
+
+/**
+Escribe las operaciones en un fichero de texto.
+
+@param path ruta del fichero
+@param cmds operaciones
+@param layout forma de escribirlas
+*/
+template <class T>
+void writeText(const string& path, const vector<Command<T> >& cmds, TextLayout layout) {
+	ofstream out(path.c_str(), ios::binary);
+	string sep = layout == CRLF ? "\r\n" : layout == ONE_LINE ? " " : "\n";
+	for (size_t j = 0; j < cmds.size(); j++) {
+		out << cmds[j]._op << sep << cmds[j]._key;
+		if (j + 1 < cmds.size() || layout != LINES_NO_END) out << sep;
+	}
+}
+
+/**
+Lotes que tienen que salir de las operaciones: los tramos del mismo tipo, partidos cada max operaciones.
+
+@param cmds operaciones
+@param max mximo de operaciones por lote
+@return los lotes
+*/
+template <class T>
+vector<Batch<T> > expectedBatches(const vector<Command<T> >& cmds, size_t max) {
+	vector<Batch<T> > batches;
+	for (size_t j = 0; j < cmds.size(); j++) {
+		if (batches.empty() || batches.back().first != cmds[j]._op || batches.back().second.size() == max) {
+			batches.push_back(Batch<T>(cmds[j]._op, vector<T>()));
+		}
+		batches.back().second.push_back(cmds[j]._key);
+	}
+	return batches;
+}
+
+/**
+Lee todos los lotes de un fichero.
+
+@param path ruta del fichero
+@param max mximo de operaciones por lote
+@return los lotes
+*/
+template <class Reader, class T>
+vector<Batch<T> > readBatches(const string& path, size_t max) {
+	Reader in(path);
+	vector<Batch<T> > batches;
+	char op = 0;
+	vector<T> batch;
+	while (in.next(op, batch, max)) batches.push_back(Batch<T>(op, batch));
+	return batches;
+}
+
+/**
+Ida y vuelta: texto -> convertCommands -> CommandReader tiene que dar los mismos lotes que TextCommandReader, y
+los dos los de las operaciones.
+
+@param cmds operaciones
+@param layout forma de escribir el texto
+@return true si todo coincide
+*/
+template <class T>
+bool roundTrip(const vector<Command<T> >& cmds, TextLayout layout) {
+	writeText(TEXT_PATH, cmds, layout);
+	bool ok = convertCommands<T>(TEXT_PATH, BINARY_PATH) == cmds.size();
+	for (size_t max : MAX_BATCHES) {
+		vector<Batch<T> > expected = expectedBatches(cmds, max);
+		ok = ok && readBatches<TextCommandReader<T>, T>(TEXT_PATH, max) == expected
+			&& readBatches<CommandReader<T>, T>(BINARY_PATH, max) == expected;
+	}
+	return ok;
+}
+
+/**
+Ida y vuelta con casos de varios tamaos (tambin vaco y con una sola operacin) y todas las formas del texto.
+
+@param name nombre del tipo de las keys para el mensaje
+@return true si todo ha ido bien
+*/
+template <class T>
+bool roundTrips(const string& name) {
+	bool ok = true;
+	mt19937_64 rng(sizeof(T));
+	const size_t sizes[] = { 0, 1, 2, 50, 3000 };
+	for (size_t n : sizes) {
+		vector<Command<T> > cmds = randomCommands<T>(n, rng);
+		for (TextLayout layout : { LINES, LINES_NO_END, CRLF, ONE_LINE }) ok = ok && roundTrip(cmds, layout);
+	}
+	vector<Command<T> > special; // Todas las keys especiales, cada una sola y en un tramo
+	for (T k : specialKeys<T>()) {
+		special.push_back({ 'i', k });
+		special.push_back({ 's', k });
+		special.push_back({ 's', k });
+		special.push_back({ 'd', k });
+	}
+	ok = ok && roundTrip(special, LINES) && roundTrip(special, LINES_NO_END);
+	cout << "Ida y vuelta texto -> binario con keys " << name << ": " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+Caso grande: ms bytes que COMMAND_BLOCK, as que el escritor vaca su buffer varias veces.
+
+@return true si todo ha ido bien
+*/
+bool bigCase() {
+	mt19937_64 rng(7);
+	vector<Command<long long> > cmds = randomCommands<long long>(400000, rng);
+	bool ok = roundTrip(cmds, LINES);
+	ifstream in(BINARY_PATH.c_str(), ios::binary | ios::ate);
+	ok = ok && (size_t)in.tellg() > 2 * COMMAND_BLOCK;
+	cout << "Caso de mas de " << COMMAND_BLOCK << " bytes: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/** Contenido entero de un fichero */
+string fileBytes(const string& path) {
+	ifstream in(path.c_str(), ios::binary);
+	return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+/** Sustituye el contenido de un fichero */
+void writeBytes(const string& path, const string& bytes) {
+	ofstream out(path.c_str(), ios::binary | ios::trunc);
+	out << bytes;
+}
+
+/**
+Indica si abrir y leer entero el fichero en binario lanza E_BTree_Format.
+
+@param path ruta del fichero
+@return true si la lanza
+*/
+bool badFormat(const string& path) {
+	try {
+		readBatches<CommandReader<int>, int>(path, 5);
+		return false;
+	}
+	catch (E_BTree_Format&) {
+		return true;
+	}
+}
+
+/**
+Ficheros en binario mal hechos: cortados, con otra cabecera o versin y con operaciones que no existen, y ficheros
+que no existen.
+
+@return true si todo ha ido bien
+*/
+bool badFiles() {
+	bool ok = true;
+	{
+		CommandWriter<int> out(BINARY_PATH); // La ltima key es INT_MIN, que ocupa 5 bytes
+		out.write('i', 3);
+		out.write('s', -70);
+		out.write('d', INT_MIN);
+		out.close();
+	}
+	string good = fileBytes(BINARY_PATH);
+	ok = good.size() == 8 + 2 + 3 + 6 && !badFormat(BINARY_PATH);
+
+	for (size_t cut = 1; ok && cut <= 5; cut++) { // Cortado dentro de la ltima key (o justo despus de su tipo)
+		writeBytes(BINARY_PATH, good.substr(0, good.size() - cut));
+		ok = badFormat(BINARY_PATH);
+	}
+	writeBytes(BINARY_PATH, good.substr(0, good.size() - 6)); // Sin la ltima operacin entera est bien
+	ok = ok && readBatches<CommandReader<int>, int>(BINARY_PATH, 5).size() == 2;
+
+	for (size_t n = 0; ok && n < 8; n++) { // Cortado dentro de la cabecera
+		writeBytes(BINARY_PATH, good.substr(0, n));
+		ok = badFormat(BINARY_PATH);
+	}
+	writeBytes(BINARY_PATH, good.substr(0, 8)); // Solo la cabecera: no hay operaciones
+	ok = ok && readBatches<CommandReader<int>, int>(BINARY_PATH, 5).empty();
+
+	for (size_t pos : { 0, 3, 4, 7 }) { // Otro identificador u otra versin
+		string bad = good;
+		bad[pos] ^= 0x20;
+		writeBytes(BINARY_PATH, bad);
+		ok = ok && badFormat(BINARY_PATH);
+	}
+	string bad = good; // Una operacin que no existe
+	bad[8 + 2] = 'x';
+	writeBytes(BINARY_PATH, bad);
+	ok = ok && badFormat(BINARY_PATH);
+	writeBytes(BINARY_PATH, good + "i" + string(10, '\xff') + '\x01'); // Una key de ms de 10 bytes
+	ok = ok && badFormat(BINARY_PATH);
+
+	remove(BINARY_PATH.c_str());
+	remove(TEXT_PATH.c_str());
+	try {
+		CommandReader<int> in(BINARY_PATH);
+		ok = false;
+	}
+	catch (E_BTree_File&) {}
+	try {
+		TextCommandReader<int> in(TEXT_PATH);
+		ok = false;
+	}
+	catch (E_BTree_File&) {}
+	try {
+		convertCommands<int>(TEXT_PATH, BINARY_PATH);
+		ok = false;
+	}
+	catch (E_BTree_File&) {}
+
+	cout << "Ficheros en binario mal hechos: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool all_ok = true;
+	all_ok = roundTrips<int>("int") && all_ok;
+	all_ok = roundTrips<long long>("long long") && all_ok;
+	all_ok = bigCase() && all_ok;
+	all_ok = badFiles() && all_ok;
+	remove(TEXT_PATH.c_str());
+	remove(BINARY_PATH.c_str());
+
+	if (all_ok) cout << "Todas las pruebas de los casos en binario son correctas\n";
+	else cout << "Alguna prueba de los casos en binario ha fallado\n";
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,268 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba diferencial del rbol-B+ con hojas comprimidas (CompressedBTree.h) contra std::set, con keys int64_t y string:
+- Inserciones, eliminaciones y bsquedas aleatorias con hojas pequeas, para que haya muchas hojas y el ndice se
+  parta (splitIndex) y, cuando el rbol encoge, sus nodos cojan hijos de un hermano o se unan (fixIndex).
+- Enteros cuyas diferencias con la base de la hoja cruzan los lmites de 1, 2, 4 y 8 bytes (tambin negativos,
+  INT64_MIN e INT64_MAX), y strings cuyo prefijo comn se acorta (y se vuelve a alargar) al insertar y eliminar.
+- bulk_load con varios tamaos y grados de llenado, seguido de operaciones aleatorias; y bulk_load de keys
+  desordenadas o repetidas, que tiene que lanzar E_BTree_Unsorted sin cambiar el rbol.
+- Cada cierto nmero de operaciones se comprueba la estructura con check y el recorrido con for_each.
+
+*/
+
+#include "CompressedBTree.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Keys por hoja con las que se prueba (pocas, para que haya muchas hojas) */
+const int LEAF_KEYS[] = { 2, 3, 4, 8, 16 };
+
+/** Operaciones aleatorias de cada prueba diferencial */
+const int DIFF_OPS = 60000;
+
+/** Cada cuntas operaciones se comprueba la estructura entera */
+const int CHECK_EVERY = 1000;
+
+
+/** Grupos de keys enteras: cada key es base + i * paso con i en [0, 1000), as que dentro de un grupo las diferencias
+caben en 1, 2, 4 u 8 bytes segn el paso y las hojas que juntan dos grupos necesitan diferencias ms anchas */
+const int64_t GROUP_BASE[] = { INT64_MIN, -200000, 0, 60000, 4294960000LL, 1LL << 40, INT64_MAX - 999 * 65537LL };
+const int64_t GROUP_STEP[] = { 1, 300, 1, 7, 13, 1LL << 20, 65537 };
+const int GROUPS = sizeof(GROUP_BASE) / sizeof(GROUP_BASE[0]);
+
+/** Key entera aleatoria de uno de los grupos */
+int64_t groupKey(mt19937& rng) {
+	int g = (int)(rng() % GROUPS);
+	return GROUP_BASE[g] + (int64_t)(rng() % 1000) * GROUP_STEP[g];
+}
+
+/** Keys enteras justo a los lados de los lmites de 1, 2, 4 y 8 bytes de diferencia, desde varias bases */
+vector<int64_t> boundaryKeys() {
+	const int64_t bases[] = { 0, -5, 1000, INT64_MIN, INT64_MIN + 3 };
+	const uint64_t deltas[] = { 0, 1, 0xfe, 0xff, 0x100, 0x101, 0xfffe, 0xffff, 0x10000, 0x10001,
+		0xfffffffeULL, 0xffffffffULL, 0x100000000ULL, 0x100000001ULL, 1ULL << 62 };
+	set<int64_t> keys;
+	for (int64_t b : bases) for (uint64_t d : deltas) keys.insert((int64_t)((uint64_t)b + d));
+	keys.insert(INT64_MAX);
+	keys.insert(INT64_MAX - 1);
+	keys.insert(-1);
+	return vector<int64_t>(keys.begin(), keys.end());
+}
+
+/** String aleatoria: casi siempre con un prefijo largo comn, a veces corta o vaca (que acorta el prefijo comn de
+la hoja en la que cae) y muy de vez en cuando muy larga (para que las posiciones de los sufijos necesiten 4 bytes) */
+string stringKey(mt19937& rng) {
+	string k;
+	int r = (int)(rng() % 1000);
+	if (r < 850) k = "usuarios/2024/";
+	else if (r < 998) k = "";
+	else k = string(9000, 'm');
+	int len = (int)(rng() % (r < 850 ? 8 : 4)); // Unas 3300 keys distintas
+	for (int i = 0; i < len; i++) k += (char)('a' + rng() % 3);
+	return k;
+}
+
+/** Comprueba la estructura y que el recorrido (for_each), size e isEmpty coinciden con ref */
+template <class T>
+bool sameKeys(const CompressedBTree<T>& tree, const set<T>& ref) {
+	vector<T> keys;
+	tree.for_each([&keys](const T& k) { keys.push_back(k); });
+	return tree.check() && tree.size() == ref.size() && tree.isEmpty() == ref.empty()
+		&& keys == vector<T>(ref.begin(), ref.end());
+}
+
+/**
+Operaciones aleatorias sobre el rbol y ref: en la primera mitad hay ms inserciones que eliminaciones y el rbol
+crece, en la segunda al revs y encoge; al final se eliminan todas las keys que quedan. Cada resultado tiene que
+coincidir con el de std::set.
+
+@param tree rbol (puede tener ya keys, las mismas que ref)
+@param ref las mismas keys en un std::set
+@param gen generador de keys
+@param rng generador de nmeros aleatorios
+@param ops nmero de operaciones
+@param peak (salida) mayor nmero de hojas que ha llegado a tener el rbol
+
+@return true si todo ha ido bien
+*/
+template <class T, class Gen>
+bool mutate(CompressedBTree<T>& tree, set<T>& ref, Gen gen, mt19937& rng, int ops, size_t& peak) {
+	bool ok = sameKeys(tree, ref);
+	for (int op = 0; ok && op < ops; op++) {
+		T k = gen(rng);
+		int what = (int)(rng() % 10);
+		int inserts = op < ops / 2 ? 6 : 2;
+		if (what < inserts) ok = tree.insert(k) == ref.insert(k).second;
+		else if (what < 9) ok = tree.remove(k) == (ref.erase(k) > 0);
+		else ok = tree.search(k) == (ref.count(k) > 0);
+		if (tree.n_leaves() > peak) peak = tree.n_leaves();
+		if (op % CHECK_EVERY == 0) ok = ok && sameKeys(tree, ref);
+	}
+	ok = ok && sameKeys(tree, ref);
+
+	vector<T> rest(ref.begin(), ref.end());
+	shuffle(rest.begin(), rest.end(), rng);
+	for (size_t j = 0; ok && j < rest.size(); j++) {
+		ok = tree.remove(rest[j]) && !tree.search(rest[j]) && ref.erase(rest[j]) == 1;
+		if (j % CHECK_EVERY == 0) ok = ok && sameKeys(tree, ref);
+	}
+	return ok && sameKeys(tree, ref) && tree.n_leaves() == 0 && !tree.remove(gen(rng));
+}
+
+/**
+Prueba diferencial con un nmero de keys por hoja.
+
+@param name nombre de la prueba
+@param leaf_keys nmero mximo de keys por hoja
+@param gen generador de keys
+@param ops nmero de operaciones
+@param min_peak nmero de hojas al que tiene que llegar el rbol (para asegurar que el ndice se parte)
+
+@return true si todo ha ido bien
+*/
+template <class T, class Gen>
+bool differential(const string& name, int leaf_keys, Gen gen, int ops, size_t min_peak) {
+	CompressedBTree<T> tree(leaf_keys);
+	set<T> ref;
+	mt19937 rng(leaf_keys * 7919);
+	size_t peak = 0;
+	bool ok = mutate(tree, ref, gen, rng, ops, peak) && peak >= min_peak;
+	ok = ok && tree.insert(gen(rng)) && tree.size() == 1 && tree.check(); // El rbol vaciado se puede seguir usando
+	cout << "Diferencial " << name << " con " << leaf_keys << " keys por hoja (hasta " << peak << " hojas): "
+		<< (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+Prefijo comn de las strings de una hoja: se insertan keys con un prefijo largo y despus otras que lo acortan
+(hasta la string vaca), y se eliminan para que vuelva a alargarse, comprobando cada paso.
+
+@return true si todo ha ido bien
+*/
+bool prefixes() {
+	const char* keys[] = { "abcdef1", "abcdef2", "abcdef3", "abcdefg\xff", "abcd", "abc", "ab\x01", "", "b", "abcdef0" };
+	bool ok = true;
+	for (int leaf_keys : { 4, 16 }) {
+		CompressedBTree<string> tree(leaf_keys);
+		set<string> ref;
+		for (const char* k : keys) {
+			ok = ok && tree.insert(k) && ref.insert(k).second && sameKeys(tree, ref);
+			for (const char* q : keys) ok = ok && tree.search(q) == (ref.count(q) > 0);
+			ok = ok && !tree.search("abcde") && !tree.search("abcdef") && !tree.search("c") && !tree.insert(k);
+		}
+		for (int i = 9; ok && i >= 0; i -= 2) ok = tree.remove(keys[i]) && ref.erase(keys[i]) == 1 && sameKeys(tree, ref);
+		for (int i = 8; ok && i >= 0; i -= 2) ok = tree.remove(keys[i]) && ref.erase(keys[i]) == 1 && sameKeys(tree, ref);
+	}
+	cout << "Prefijo comun que se acorta y se alarga: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+bulk_load con n keys y un grado de llenado, seguido de operaciones aleatorias.
+
+@param leaf_keys nmero mximo de keys por hoja
+@param n nmero de keys (como mucho las 7000 distintas que da groupKey)
+@param fill fraccin de cada hoja que se llena
+
+@return true si todo ha ido bien
+*/
+bool bulkThenMutate(int leaf_keys, size_t n, double fill) {
+	mt19937 rng((unsigned)(n * 31 + leaf_keys));
+	set<int64_t> ref;
+	while (ref.size() < n) ref.insert(groupKey(rng));
+	CompressedBTree<int64_t> tree(leaf_keys);
+	tree.insert(12345); // bulk_load sustituye lo que hubiera
+	tree.bulk_load(ref.begin(), ref.end(), fill);
+	bool ok = sameKeys(tree, ref);
+	for (set<int64_t>::const_iterator it = ref.begin(); ok && it != ref.end(); ++it) ok = tree.search(*it) && !tree.insert(*it);
+
+	size_t peak = 0;
+	ok = ok && mutate(tree, ref, groupKey, rng, 6000, peak);
+	if (!ok) cout << "bulk_load de " << n << " keys con " << leaf_keys << " keys por hoja y llenado " << fill << ": INCORRECTO\n";
+	return ok;
+}
+
+/**
+bulk_load de varios tamaos (vaco, una key, una hoja, justo los que caben en un nodo del ndice y uno ms, y muchos)
+con varios grados de llenado, y de keys desordenadas o repetidas.
+
+@return true si todo ha ido bien
+*/
+bool bulk() {
+	bool ok = true;
+	for (int leaf_keys : { 2, 5, 16 }) {
+		for (double fill : { 1.0, 0.5, 0.01 }) {
+			size_t per = (size_t)(fill * leaf_keys + 0.5);
+			if (per < 1) per = 1;
+			size_t sizes[] = { 0, 1, (size_t)leaf_keys, per * INDEX_FANOUT, per * INDEX_FANOUT + 1, 5000 };
+			for (size_t n : sizes) ok = bulkThenMutate(leaf_keys, n, fill) && ok;
+		}
+	}
+
+	CompressedBTree<int64_t> tree(4);
+	set<int64_t> ref;
+	for (int64_t k = 0; k < 100; k++) {
+		tree.insert(k * 3);
+		ref.insert(k * 3);
+	}
+	int threw = 0;
+	vector<int64_t> unsorted = { 1, 5, 3 };
+	vector<int64_t> repeated = { 1, 2, 2, 3 };
+	try {
+		tree.bulk_load(unsorted.begin(), unsorted.end());
+	}
+	catch (E_BTree_Unsorted&) {
+		threw++;
+	}
+	try {
+		tree.bulk_load(repeated.begin(), repeated.end());
+	}
+	catch (E_BTree_Unsorted&) {
+		threw++;
+	}
+	ok = ok && threw == 2 && sameKeys(tree, ref);
+
+	set<string> sref;
+	mt19937 rng(5);
+	while (sref.size() < 2000) sref.insert(stringKey(rng));
+	CompressedBTree<string> stree(3);
+	stree.bulk_load(sref.begin(), sref.end(), 0.7);
+	ostringstream out, expected;
+	stree.traverse(out);
+	for (set<string>::const_iterator it = sref.begin(); it != sref.end(); ++it) expected << " " << *it;
+	size_t peak = 0;
+	ok = ok && out.str() == expected.str() && mutate(stree, sref, stringKey, rng, 6000, peak);
+
+	cout << "bulk_load seguido de operaciones: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool all_ok = true;
+	vector<int64_t> bounds = boundaryKeys();
+	for (int leaf_keys : LEAF_KEYS) {
+		all_ok = differential<int64_t>("int64", leaf_keys, groupKey, DIFF_OPS, leaf_keys <= 4 ? INDEX_FANOUT : 1) && all_ok;
+		all_ok = differential<int64_t>("int64 en los limites", leaf_keys,
+			[&bounds](mt19937& rng) { return bounds[rng() % bounds.size()]; }, DIFF_OPS / 4, 1) && all_ok;
+		all_ok = differential<string>("string", leaf_keys, stringKey, DIFF_OPS / 2, leaf_keys <= 3 ? INDEX_FANOUT : 1) && all_ok;
+	}
+	all_ok = prefixes() && all_ok;
+	all_ok = bulk() && all_ok;
+
+	if (all_ok) cout << "Todas las pruebas del Arbol-B+ comprimido son correctas\n";
+	else cout << "Alguna prueba del Arbol-B+ comprimido ha fallado\n";
+	return all_ok ? 0 : 1;
+}
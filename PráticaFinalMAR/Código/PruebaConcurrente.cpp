@@ -0,0 +1,430 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba de estrs del rbol-B concurrente: varios hilos insertan, eliminan y buscan a la vez y al final
+se comprueba que el rbol sigue siendo un rbol-B vlido y que tiene exactamente las keys que debe.
+Despus se mide cuntas operaciones por segundo se hacen con una carga de casi solo lecturas.
+Despus se prueba el rbol-B con copia en escritura (CowBTree): mientras un hilo escribe, otros recorren versiones
+enteras del rbol y comprueban que cada una es una foto coherente; y se mide si esos recorridos frenan al escritor.
+Por ltimo se prueba el rbol-B repartido en particiones (ShardedBTree) con todas las keys empezando en una sola
+particin, para que el reequilibrador tenga que mover las fronteras mientras se usa, y se mide cmo crecen las
+inserciones por segundo con el nmero de particiones.
+Se puede compilar con -fsanitize=thread: los lectores sin cerrojo leen con operaciones atmicas, as que no tiene
+que salir ningn aviso.
+
+*/
+
+#include "ConcurrentBTree.h"
+#include "CowBTree.h"
+#include "ShardedBTree.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/** Keys que se insertan al principio y nunca se eliminan (siempre tienen que encontrarse) */
+const int STABLE_KEYS = 20000;
+
+/** Operaciones de cada hilo en la prueba de estrs */
+const int STRESS_OPS = 200000;
+
+/** Keys con las que se llena el rbol antes de medir el rendimiento */
+const int BENCH_KEYS = 1000000;
+
+/** Duracin de cada medida de rendimiento en milisegundos */
+const int BENCH_MS = 500;
+
+
+/**
+Prueba de estrs con un tamao de nodo. Cada hilo inserta y elimina solo keys suyas (las que dan resto id al dividir
+entre el nmero de hilos), as sabe qu keys suyas tienen que estar, y mientras tanto busca las keys estables
+(que tienen que estar siempre) y keys que nunca se insertan (que no pueden estar nunca).
+
+@param order nmero mximo de keys por nodo
+@param threads nmero de hilos
+
+@return true si todo ha ido bien
+*/
+bool stress(int order, int threads) {
+	ConcurrentBTree<int> tree(order);
+	for (int i = 0; i < STABLE_KEYS; i++) tree.insert(-1 - i); // Las keys estables son negativas
+
+	atomic<bool> ok(true);
+	vector<vector<int> > counts(threads); // Cuntas veces est cada key de cada hilo
+	vector<thread> workers;
+
+	for (int id = 0; id < threads; id++) {
+		workers.push_back(thread([&, id]() {
+			mt19937 rng(id + 1);
+			int range = 4096; // Keys propias: id, id + threads, id + 2 * threads, ...
+			vector<int>& count = counts[id];
+			count.assign(range, 0);
+
+			for (int op = 0; op < STRESS_OPS; op++) {
+				int r = rng() % 100;
+				int j = rng() % range;
+				int k = id + j * threads;
+
+				if (r < 40) {
+					tree.insert(k);
+					count[j]++;
+				}
+				else if (r < 70) {
+					bool removed = tree.remove(k);
+					if (removed != (count[j] > 0)) ok = false;
+					if (removed) count[j]--;
+				}
+				else if (r < 85) {
+					if (tree.search(k) != (count[j] > 0)) ok = false;
+				}
+				else if (r < 95) {
+					if (!tree.search(-1 - (int)(rng() % STABLE_KEYS))) ok = false;
+				}
+				else {
+					if (tree.search(1000000000 + (int)(rng() % 1000))) ok = false; // Nunca se insertan
+				}
+			}
+		}));
+	}
+	for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+
+	size_t expected = STABLE_KEYS;
+	for (int id = 0; id < threads; id++) {
+		for (size_t j = 0; j < counts[id].size(); j++) {
+			expected += counts[id][j];
+			if (tree.search(id + (int)j * threads) != (counts[id][j] > 0)) ok = false;
+		}
+	}
+
+	if (!tree.check()) {
+		cout << "El arbol de orden " << order << " no cumple las propiedades de un Arbol-B\n";
+		return false;
+	}
+	if (tree.size() != expected) {
+		cout << "El arbol de orden " << order << " tiene " << tree.size() << " keys y deberia tener " << expected << '\n';
+		return false;
+	}
+	if (!ok) {
+		cout << "El arbol de orden " << order << " ha dado un resultado incorrecto\n";
+		return false;
+	}
+	cout << "Orden " << order << " con " << threads << " hilos: correcto (" << expected << " keys)\n";
+	return true;
+}
+
+/**
+Mide las operaciones por segundo con un 95% de bsquedas y un 5% de inserciones y eliminaciones.
+
+@param tree rbol ya lleno con las keys 0, 2, 4, ...
+@param threads nmero de hilos
+
+@return operaciones por segundo
+*/
+double readMostly(ConcurrentBTree<int>& tree, int threads) {
+	atomic<bool> stop(false);
+	vector<long long> done(threads, 0);
+	vector<thread> workers;
+
+	for (int id = 0; id < threads; id++) {
+		workers.push_back(thread([&, id]() {
+			mt19937 rng(id + 7);
+			long long ops = 0;
+			while (!stop.load(memory_order_relaxed)) {
+				for (int i = 0; i < 256; i++) {
+					int k = rng() % (2 * BENCH_KEYS);
+					int r = rng() % 100;
+					if (r < 95) tree.search(k);
+					else if (r < 98) tree.insert(2 * k + 1); // Las impares no estaban, as no se desequilibra el rbol
+					else tree.remove(2 * k + 1);
+				}
+				ops += 256;
+			}
+			done[id] = ops;
+		}));
+	}
+	this_thread::sleep_for(chrono::milliseconds(BENCH_MS));
+	stop = true;
+	for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+
+	long long total = 0;
+	for (int id = 0; id < threads; id++) total += done[id];
+	return total * 1000.0 / BENCH_MS;
+}
+
+/**
+Prueba de CowBTree: un hilo inserta las keys 0..n-1 en orden y luego las elimina en orden (en lotes), mientras otros
+recorren versiones del rbol. Cada versin tiene que ser un tramo seguido de keys (las insertadas y an no
+eliminadas en ese momento) con tantas keys como dice su size.
+
+@param order nmero mximo de keys por nodo
+@param readers nmero de hilos lectores
+
+@return true si todas las versiones ledas eran coherentes
+*/
+bool cowSnapshots(int order, int readers) {
+	CowBTree<int> tree(order);
+	atomic<bool> stop(false), ok(true);
+	atomic<long long> views(0);
+	vector<thread> workers;
+
+	for (int id = 0; id < readers; id++) {
+		workers.push_back(thread([&]() {
+			while (!stop.load()) {
+				CowBTree<int>::View v = tree.view();
+				long long next = -1, count = 0;
+				v.for_each([&](const int& k) {
+					if (count > 0 && k != next) ok = false;
+					next = k + 1;
+					count++;
+				});
+				if ((size_t)count != v.size()) ok = false;
+				views++;
+			}
+		}));
+	}
+
+	for (int i = 0; i < STABLE_KEYS; i++) tree.insert(i);
+	vector<int> batch;
+	for (int i = 0; i < STABLE_KEYS; i += 64) {
+		batch.clear();
+		for (int j = i; j < i + 64 && j < STABLE_KEYS; j++) batch.push_back(j);
+		if (tree.remove_batch(batch.begin(), batch.end()) != batch.size()) ok = false;
+	}
+	stop = true;
+	for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+
+	if (tree.size() != 0) ok = false;
+	cout << "CowBTree de orden " << order << " con " << readers << " lectores: " << (ok ? "correcto" : "INCORRECTO")
+		<< " (" << views << " versiones leidas)\n";
+	return ok;
+}
+
+/**
+Mide las inserciones por segundo de un escritor en un CowBTree mientras otros hilos recorren el rbol entero una y otra vez.
+
+@param tree rbol ya lleno
+@param readers nmero de hilos que recorren el rbol
+
+@return inserciones por segundo
+*/
+double cowWrites(CowBTree<int>& tree, int readers) {
+	atomic<bool> stop(false);
+	vector<thread> workers;
+	for (int id = 0; id < readers; id++) {
+		workers.push_back(thread([&]() {
+			long long sum = 0;
+			while (!stop.load(memory_order_relaxed)) tree.for_each([&sum](const int& k) { sum += k; });
+		}));
+	}
+
+	mt19937 rng(3);
+	long long ops = 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	while (chrono::steady_clock::now() - start < chrono::milliseconds(BENCH_MS)) {
+		for (int i = 0; i < 256; i++) tree.insert(2 * (int)(rng() % BENCH_KEYS) + 1);
+		ops += 256;
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	stop = true;
+	for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+	return ops / seconds;
+}
+
+/**
+Prueba de estrs de ShardedBTree, como stress: cada hilo inserta, elimina y busca solo keys suyas y adems pide
+rangos, que tienen que salir ordenados. Las fronteras empiezan por debajo de todas las keys (todas van a la ltima
+particin), as que mientras tanto el reequilibrador (y un hilo que lo llama sin parar) mueven las fronteras.
+
+@param order nmero mximo de keys por nodo
+@param threads nmero de hilos (y de particiones)
+
+@return true si todo ha ido bien
+*/
+bool shardedStress(int order, int threads) {
+	vector<int> bounds;
+	for (int i = 1; i < threads; i++) bounds.push_back(-threads + i);
+	ShardedBTree<int> tree(bounds, order);
+
+	atomic<bool> ok(true), stop(false);
+	vector<vector<int> > counts(threads);
+	vector<thread> workers;
+	for (int id = 0; id < threads; id++) {
+		workers.push_back(thread([&, id]() {
+			mt19937 rng(id + 1);
+			int range = 4096;
+			vector<int>& count = counts[id];
+			count.assign(range, 0);
+
+			for (int op = 0; op < STRESS_OPS / 4; op++) {
+				int r = rng() % 100;
+				int j = rng() % range;
+				int k = id + j * threads;
+
+				if (r < 50) {
+					tree.insert(k);
+					count[j]++;
+				}
+				else if (r < 75) {
+					bool removed = tree.remove(k);
+					if (removed != (count[j] > 0)) ok = false;
+					if (removed) count[j]--;
+				}
+				else if (r < 97) {
+					if (tree.search(k) != (count[j] > 0)) ok = false;
+				}
+				else {
+					vector<int> keys = tree.range(k, k + 64);
+					if (!is_sorted(keys.begin(), keys.end())) ok = false;
+				}
+			}
+		}));
+	}
+	thread rebalancer([&]() {
+		while (!stop.load()) {
+			tree.rebalance();
+			this_thread::yield();
+		}
+	});
+	for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+	stop = true;
+	rebalancer.join();
+	tree.flush();
+
+	vector<int> expected;
+	for (int j = 0; j < 4096; j++) {
+		for (int id = 0; id < threads; id++) expected.insert(expected.end(), counts[id][j], id + j * threads);
+	}
+	vector<int> keys;
+	tree.for_each([&keys](const int& k) { keys.push_back(k); });
+	if (keys != expected || tree.size() != expected.size()) ok = false;
+
+	vector<size_t> sizes = tree.shard_sizes();
+	cout << "ShardedBTree de orden " << order << " con " << threads << " particiones: " << (ok ? "correcto" : "INCORRECTO")
+		<< " (" << expected.size() << " keys, por particion:";
+	for (size_t i = 0; i < sizes.size(); i++) cout << " " << sizes[i];
+	cout << ")\n";
+	return ok;
+}
+
+/** En ShardedBTree espera a que se apliquen las inserciones pendientes */
+void flushAll(ShardedBTree<int>& tree) {
+	tree.flush();
+}
+
+/** En ConcurrentBTree no hay nada pendiente */
+void flushAll(ConcurrentBTree<int>&) {}
+
+/**
+Mide las inserciones por segundo de varios hilos con keys aleatorias, en un ShardedBTree o en un ConcurrentBTree.
+Como en ShardedBTree insert no espera, se cuenta tambin lo que se tarda en aplicar las pendientes (flush).
+
+@param tree rbol vaco
+@param threads nmero de hilos que insertan
+
+@return inserciones por segundo
+*/
+template <class Tree>
+double insertRate(Tree& tree, int threads) {
+	atomic<bool> stop(false);
+	vector<long long> done(threads, 0);
+	vector<thread> workers;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int id = 0; id < threads; id++) {
+		workers.push_back(thread([&, id]() {
+			mt19937 rng(id + 11);
+			long long ops = 0;
+			while (!stop.load(memory_order_relaxed)) {
+				for (int i = 0; i < 256; i++) tree.insert((int)(rng() % (1u << 30)));
+				ops += 256;
+			}
+			done[id] = ops;
+		}));
+	}
+	this_thread::sleep_for(chrono::milliseconds(BENCH_MS));
+	stop = true;
+	for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+	flushAll(tree);
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	long long total = 0;
+	for (int id = 0; id < threads; id++) total += done[id];
+	return total / seconds;
+}
+
+/**
+Fronteras para repartir keys uniformes en [0, 2^30) entre varias particiones.
+
+@param shards nmero de particiones
+
+@return fronteras
+*/
+vector<int> evenBounds(int shards) {
+	vector<int> bounds;
+	for (int i = 1; i < shards; i++) bounds.push_back((int)((1LL << 30) * i / shards));
+	return bounds;
+}
+
+
+int main() {
+	int cores = thread::hardware_concurrency();
+	if (cores < 2) cores = 2;
+
+	bool all_ok = true;
+	int orders[] = { 3, 4, 5, 8, 31, 101 };
+	for (int i = 0; i < 6; i++) all_ok = stress(orders[i], cores) && all_ok;
+
+	if (all_ok) cout << "Todas las pruebas de estres son correctas\n";
+	else cout << "Alguna prueba de estres ha fallado\n";
+
+	ConcurrentBTree<int> tree(64);
+	for (int i = 0; i < BENCH_KEYS; i++) tree.insert(2 * i);
+
+	cout << "Rendimiento con 95% de busquedas (orden 64, " << BENCH_KEYS << " keys):\n";
+	double base = 0;
+	for (int threads = 1; threads <= cores; threads *= 2) {
+		double ops = readMostly(tree, threads);
+		if (threads == 1) base = ops;
+		cout << threads << " hilos: " << (long long)ops << " op/s (x" << ops / base << ")\n";
+		if (threads < cores && threads * 2 > cores) threads = cores / 2; // Para medir tambin con todos los ncleos
+	}
+
+	if (!tree.check()) {
+		cout << "El arbol no cumple las propiedades de un Arbol-B\n";
+		all_ok = false;
+	}
+
+	for (int i = 0; i < 3; i++) all_ok = cowSnapshots(orders[i * 2 + 1], cores - 1) && all_ok;
+
+	CowBTree<int> cow(64);
+	vector<int> keys;
+	for (int i = 0; i < BENCH_KEYS; i++) keys.push_back(2 * i);
+	cow.insert_batch(keys.begin(), keys.end());
+	cout << "Inserciones en CowBTree (orden 64, " << BENCH_KEYS << " keys) mientras otros hilos lo recorren:\n";
+	for (int readers = 0; readers < cores; readers = readers == 0 ? 1 : readers * 2) {
+		cout << readers << " lectores: " << (long long)cowWrites(cow, readers) << " op/s\n";
+	}
+
+	for (int i = 0; i < 3; i++) all_ok = shardedStress(orders[i * 2], cores) && all_ok;
+
+	cout << "Inserciones con " << cores << " hilos (orden 64, keys aleatorias):\n";
+	{
+		ConcurrentBTree<int> single(64);
+		cout << "ConcurrentBTree: " << (long long)insertRate(single, cores) << " op/s\n";
+	}
+	double first = 0;
+	for (int shards = 1; shards <= cores; shards *= 2) {
+		ShardedBTree<int> sharded(evenBounds(shards), 64);
+		double ops = insertRate(sharded, cores);
+		if (shards == 1) first = ops;
+		cout << "ShardedBTree con " << shards << " particiones: " << (long long)ops << " op/s (x" << ops / first << ")\n";
+		if (shards < cores && shards * 2 > cores) shards = cores / 2;
+	}
+
+	return all_ok ? 0 : 1;
+}
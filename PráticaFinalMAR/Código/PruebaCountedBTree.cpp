@@ -0,0 +1,197 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba diferencial de rank, select y count del rbol-B con la cuenta de cada subrbol (CountedBTree, BTree.h)
+contra std::multiset con varios tamaos de nodo. Despus de cada tanda de operaciones se comprueban todas las
+posiciones: rank de cada key (y de las que no estn), select de cada posicin y count de intervalos aleatorios.
+- Keys sin repetir con inserciones y eliminaciones (que parten, unen y se prestan keys entre nodos), lpidas con
+  remove_lazy, keys borradas que se vuelven a insertar, y compact y compact_step quitando las lpidas.
+- Inserciones y eliminaciones por tandas (insert_batch, remove_batch) y bulk_load.
+- Keys repetidas (sin lpidas, que suponen keys sin repetir).
+
+*/
+
+#include "BTree.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace std;
+
+/** Tamaos de nodo con los que se prueba */
+const int ORDERS[] = { 3, 4, 5, 8, 16, 63 };
+
+/** Tandas de operaciones de cada prueba */
+const int ROUNDS = 60;
+
+/** Operaciones de cada tanda */
+const int ROUND_OPS = 400;
+
+/** Keys distintas que se usan */
+const int KEY_RANGE = 4000;
+
+
+/**
+Comprueba rank, select, count y size del rbol contra ref.
+
+@return true si todo coincide
+*/
+bool sameCounts(const CountedBTree<int>& tree, const multiset<int>& ref, mt19937& rng) {
+	vector<int> v(ref.begin(), ref.end());
+	bool ok = tree.size() == v.size() && tree.isEmpty() == v.empty();
+	for (int k = -1; ok && k <= KEY_RANGE; k++) {
+		ok = tree.rank(k) == (size_t)(lower_bound(v.begin(), v.end(), k) - v.begin());
+	}
+	for (size_t i = 0; ok && i < v.size(); i++) ok = tree.select(i) == v[i];
+	for (int q = 0; ok && q < 200; q++) {
+		int lo = (int)(rng() % (KEY_RANGE + 100)) - 50;
+		int hi = lo + (int)(rng() % 400) - 50; // A veces hi <= lo (intervalo vaco)
+		size_t expected = hi <= lo ? 0 : (size_t)(lower_bound(v.begin(), v.end(), hi) - lower_bound(v.begin(), v.end(), lo));
+		ok = tree.count(lo, hi) == expected;
+	}
+	try {
+		tree.select(v.size());
+		ok = false;
+	}
+	catch (E_BTree_Range&) {}
+	return ok;
+}
+
+/** Key aleatoria que est en ref (ref no puede estar vaco) */
+int randomKey(const multiset<int>& ref, mt19937& rng) {
+	multiset<int>::const_iterator it = ref.lower_bound((int)(rng() % KEY_RANGE));
+	return it == ref.end() ? *ref.begin() : *it;
+}
+
+/**
+Keys sin repetir: inserciones, eliminaciones, lpidas, keys borradas vueltas a insertar, compactaciones, tandas y
+bulk_load. Las primeras tandas insertan ms de lo que eliminan y las ltimas al revs, as que el rbol crece
+(partiendo nodos) y luego encoge (uniendo nodos y prestando keys).
+
+@param order nmero mximo de keys por nodo
+
+@return true si todo ha ido bien
+*/
+bool uniqueKeys(int order) {
+	CountedBTree<int> tree(order);
+	multiset<int> ref;
+	vector<int> dead; // Keys borradas con remove_lazy (puede que ya no lo estn)
+	mt19937 rng(order);
+	bool ok = true;
+
+	for (int round = 0; ok && round < ROUNDS; round++) {
+		bool growing = round < ROUNDS / 2;
+		for (int op = 0; op < ROUND_OPS; op++) {
+			int k = (int)(rng() % KEY_RANGE);
+			int what = (int)(rng() % 12);
+			if (what < 4 || (growing && what < 7)) { // Al crecer, 7 de cada 12 son inserciones; al encoger, 4
+				if (ref.count(k) == 0) {
+					tree.insert(k); // Si estaba borrada con remove_lazy, le quita la lpida
+					ref.insert(k);
+				}
+			}
+			else if (ref.empty()) continue;
+			else if (what < 8) {
+				k = randomKey(ref, rng);
+				tree.remove(k);
+				ref.erase(k);
+			}
+			else if (what < 10) {
+				k = randomKey(ref, rng);
+				bool removed = tree.remove_lazy(k);
+				ref.erase(k);
+				ok = ok && removed && (ref.empty() || !tree.remove_lazy(k)); // La segunda vez ya est borrada
+				dead.push_back(k);
+			}
+			else if (what < 11 && !dead.empty()) { // Se vuelve a insertar una key borrada
+				k = dead[rng() % dead.size()];
+				if (ref.count(k) == 0) {
+					tree.insert(k);
+					ref.insert(k);
+				}
+			}
+			else tree.compact_step(rng() % 3 + 1); // Quita las lpidas de los nodos que tienen demasiadas
+		}
+		if (round % 10 == 9) tree.compact();
+		if (round % 15 == 7) { // Tandas: se insertan keys nuevas y se eliminan otras
+			vector<int> add, del;
+			for (int j = 0; j < 100; j++) {
+				int k = (int)(rng() % KEY_RANGE);
+				if (ref.count(k) == 0 && find(add.begin(), add.end(), k) == add.end()) add.push_back(k);
+			}
+			tree.insert_batch(add.begin(), add.end());
+			ref.insert(add.begin(), add.end());
+			for (int j = 0; j < 60 && !ref.empty(); j++) {
+				int k = randomKey(ref, rng);
+				del.push_back(k);
+				ref.erase(k);
+			}
+			sort(del.begin(), del.end());
+			if (!del.empty()) tree.remove_batch(del.begin(), del.end());
+		}
+		if (round % 20 == 19) {
+			vector<int> all(ref.begin(), ref.end());
+			tree.bulk_load(all.begin(), all.end(), 0.7);
+			dead.clear();
+		}
+		ok = ok && sameCounts(tree, ref, rng);
+	}
+	while (ok && !ref.empty()) { // Se vaca con lpidas y se compacta
+		ok = tree.remove_lazy(*ref.begin());
+		ref.erase(ref.begin());
+	}
+	ok = ok && sameCounts(tree, ref, rng);
+	tree.compact();
+	ok = ok && sameCounts(tree, ref, rng);
+	cout << "Keys sin repetir con orden " << order << ": " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+Keys repetidas: rank cuenta las keys estrictamente menores y count todas las copias del intervalo.
+
+@param order nmero mximo de keys por nodo
+
+@return true si todo ha ido bien
+*/
+bool repeatedKeys(int order) {
+	CountedBTree<int> tree(order);
+	multiset<int> ref;
+	mt19937 rng(order + 1000);
+	bool ok = true;
+
+	for (int round = 0; ok && round < ROUNDS / 2; round++) {
+		int inserts = round < ROUNDS / 4 ? 6 : 3;
+		for (int op = 0; op < ROUND_OPS; op++) {
+			int k = (int)(rng() % (KEY_RANGE / 10)) * 10; // Pocas keys distintas, muchas copias de cada una
+			if ((int)(rng() % 10) < inserts || ref.empty()) {
+				tree.insert(k);
+				ref.insert(k);
+			}
+			else {
+				k = randomKey(ref, rng);
+				tree.remove(k);
+				ref.erase(ref.find(k));
+			}
+		}
+		ok = sameCounts(tree, ref, rng);
+	}
+	cout << "Keys repetidas con orden " << order << ": " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool all_ok = true;
+	for (int order : ORDERS) {
+		all_ok = uniqueKeys(order) && all_ok;
+		all_ok = repeatedKeys(order) && all_ok;
+	}
+
+	if (all_ok) cout << "Todas las pruebas de rank, select y count son correctas\n";
+	else cout << "Alguna prueba de rank, select y count ha fallado\n";
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba diferencial del rbol-B en disco (DiskBTree.h) contra std::multiset (el rbol admite keys repetidas) con el
+buffer pool ms pequeo posible (MIN_POOL_PAGES), para que casi cada operacin tenga que echar pginas del pool:
+- Inserciones, eliminaciones y bsquedas aleatorias en varias rondas; entre ronda y ronda se cierra y se vuelve a
+  abrir el fichero, y tiene que tener las mismas keys.
+- Cada ronda abre tambin el fichero en solo lectura: las bsquedas y el recorrido tienen que dar lo mismo que
+  std::multiset, en POSIX sin leer ninguna pgina a travs del pool (se leen de la proyeccin con mmap), y cualquier
+  modificacin tiene que lanzar E_BTree_ReadOnly.
+- Llenar y vaciar el rbol varias veces no hace crecer el fichero: las pginas que quedan libres se reutilizan.
+
+*/
+
+#include "DiskBTree.h"
+
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Fichero de las pruebas */
+const string PATH = "prueba_disk.db";
+
+/** Tamaos de nodo con los que se prueba (0: los que quepan en una pgina) */
+const int ORDERS[] = { 3, 4, 5, 8, 0 };
+
+/** Rondas (cerrando y volviendo a abrir el fichero) de cada prueba diferencial */
+const int ROUNDS = 5;
+
+/** Operaciones aleatorias de cada ronda */
+const int ROUND_OPS = 15000;
+
+/** Keys distintas que se usan */
+const int KEY_RANGE = 3000;
+
+/** Keys con las que se llena el rbol en la prueba de pginas libres */
+const int FILL_KEYS = 20000;
+
+
+/** Tamao del fichero en bytes (0 si no existe) */
+long fileSize(const string& path) {
+	FILE* f = fopen(path.c_str(), "rb");
+	if (f == NULL) return 0;
+	fseek(f, 0, SEEK_END);
+	long n = ftell(f);
+	fclose(f);
+	return n;
+}
+
+/** Comprueba que el rbol tiene exactamente las keys de ref (contando las repetidas) en orden */
+bool sameKeys(DiskBTree<int>& tree, const multiset<int>& ref) {
+	vector<int> keys;
+	tree.for_each([&keys](const int& k) { keys.push_back(k); });
+	return tree.size() == ref.size() && tree.isEmpty() == ref.empty() && keys == vector<int>(ref.begin(), ref.end());
+}
+
+/**
+Abre el fichero en solo lectura y compara bsquedas, recorrido y traverse con ref; intentar modificarlo tiene que
+lanzar E_BTree_ReadOnly.
+
+@return true si todo ha ido bien
+*/
+bool readOnly(const multiset<int>& ref) {
+	DiskBTree<int> tree(PATH, DISK_READ_ONLY);
+	bool ok = sameKeys(tree, ref);
+	for (int k = -1; ok && k <= KEY_RANGE; k++) ok = tree.search(k) == (ref.count(k) > 0);
+
+	ostringstream got, expected;
+	tree.traverse(got);
+	for (multiset<int>::const_iterator it = ref.begin(); it != ref.end(); ++it) expected << " " << *it;
+	ok = ok && got.str() == expected.str();
+#ifdef BTREE_MMAP
+	ok = ok && tree.reads() == 0; // Todo se ha ledo de la proyeccin
+#endif
+
+	int threw = 0;
+	try {
+		tree.insert(1);
+	}
+	catch (E_BTree_ReadOnly&) {
+		threw++;
+	}
+	try {
+		tree.remove(1);
+	}
+	catch (E_BTree_ReadOnly&) {
+		threw++;
+	}
+	return ok && threw == 2;
+}
+
+/**
+Prueba diferencial con un tamao de nodo. La ltima ronda vaca el rbol eliminando todas las keys.
+
+@param order nmero mximo de keys por nodo al crear el rbol
+
+@return true si todo ha ido bien
+*/
+bool differential(int order) {
+	remove(PATH.c_str());
+	multiset<int> ref;
+	mt19937 rng(order + 1);
+	bool ok = true;
+
+	for (int round = 0; ok && round < ROUNDS; round++) {
+		{
+			DiskBTree<int> tree(PATH, DISK_READ_WRITE, order, MIN_POOL_PAGES);
+			ok = sameKeys(tree, ref); // Lo mismo que haba al cerrarlo
+			for (int op = 0; ok && op < ROUND_OPS; op++) {
+				int k = (int)(rng() % KEY_RANGE);
+				int what = (int)(rng() % 10);
+				if (what < 5) {
+					tree.insert(k);
+					ref.insert(k);
+				}
+				else if (what < 8) {
+					multiset<int>::iterator it = ref.find(k);
+					ok = tree.remove(k) == (it != ref.end());
+					if (it != ref.end()) ref.erase(it); // Solo se elimina una de las repetidas
+				}
+				else ok = tree.search(k) == (ref.count(k) > 0);
+			}
+			ok = ok && sameKeys(tree, ref);
+			while (ok && round == ROUNDS - 1 && !ref.empty()) {
+				ok = tree.remove(*ref.begin());
+				ref.erase(ref.begin());
+			}
+			ok = ok && sameKeys(tree, ref);
+		}
+		ok = ok && readOnly(ref);
+	}
+	{
+		DiskBTree<int> tree(PATH, DISK_READ_WRITE, order, MIN_POOL_PAGES);
+		ok = ok && tree.isEmpty() && !tree.search(0) && !tree.remove(0);
+	}
+	remove(PATH.c_str());
+	cout << "Diferencial con orden " << order << ": " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+Llena y vaca el rbol varias veces con las mismas keys en el mismo orden, cerrando el fichero entre una vez y
+otra: las pginas que quedan libres al vaciarlo se reutilizan al volver a llenarlo, as que el fichero no crece
+despus de la primera vez (sin reutilizarlas crecera lo mismo cada vez).
+
+@return true si todo ha ido bien
+*/
+bool freePages() {
+	remove(PATH.c_str());
+	bool ok = true;
+	long first = 0;
+	for (int round = 0; ok && round < 4; round++) {
+		{
+			DiskBTree<int> tree(PATH, DISK_READ_WRITE, 5, MIN_POOL_PAGES);
+			for (int i = 0; i < FILL_KEYS; i++) tree.insert((int)(i * 7919LL % FILL_KEYS));
+			for (int i = 0; ok && i < FILL_KEYS; i++) ok = tree.remove(i);
+			ok = ok && tree.isEmpty();
+		}
+		long size = fileSize(PATH);
+		if (round == 0) first = size;
+		ok = ok && size > 0 && size == first;
+	}
+	remove(PATH.c_str());
+	cout << "Reutilizacion de paginas libres: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool all_ok = true;
+	for (int order : ORDERS) all_ok = differential(order) && all_ok;
+	all_ok = freePages() && all_ok;
+
+	if (all_ok) cout << "Todas las pruebas del Arbol-B en disco son correctas\n";
+	else cout << "Alguna prueba del Arbol-B en disco ha fallado\n";
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,213 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba del rbol-B con el orden fijado al compilar (FixedBTree, BTree.h) contra BTree con el mismo orden elegido
+al crearlo: con la misma secuencia de operaciones los dos rboles tienen que quedar exactamente iguales.
+- Se mezclan insert, remove, remove_lazy, insert_batch, remove_batch, compact_step y bulk_load, con keys repetidas
+  y que no estn, y despus de cada paso se comprueban el recorrido con for_each, size, n_dead, shape y los nodos
+  (para cada key, el nodo en el que la encuentra search empieza por la misma key, tiene las mismas keys y es hoja o
+  no igual en los dos). Los mensajes de remove y remove_batch de keys que no estn tambin tienen que ser iguales.
+- FixedBTree<int, N>(size) solo acepta size == N: con otro tamao lanza E_BTree_Format (o E_BTree_Lower y
+  E_BTree_Bigger si adems est fuera de los lmites de BTree), y el constructor sin parmetros usa N.
+
+*/
+
+#include "BTree.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Tandas de operaciones de cada prueba */
+const int ROUNDS = 40;
+
+/** Operaciones de cada tanda */
+const int ROUND_OPS = 150;
+
+/** Keys distintas que se usan */
+const int KEY_RANGE = 2000;
+
+
+/** Ejecuta f y devuelve lo que ha escrito en cout */
+template <class F>
+string captured(F f) {
+	ostringstream out;
+	streambuf* old = cout.rdbuf(out.rdbuf());
+	f();
+	cout.rdbuf(old);
+	return out.str();
+}
+
+/**
+Recorrido y reparto de las keys en los nodos: las keys en orden y, para cada una, la primera key, el nmero de keys y
+si es hoja del nodo en el que la encuentra search.
+
+@param tree rbol
+@return el recorrido seguido del reparto
+*/
+template <class Tree>
+vector<int> layout(Tree& tree) {
+	vector<int> keys, out;
+	tree.for_each([&keys](const int& k) { keys.push_back(k); });
+	out = keys;
+	for (int k : keys) {
+		typename Tree::node_type* x = tree.search(k);
+		out.push_back(x->_elems[0]);
+		out.push_back(x->_n_elems);
+		out.push_back(x->_is_leaf);
+	}
+	return out;
+}
+
+/** Indica si los dos rboles tienen las mismas keys, lpidas, forma y nodos */
+template <class Fixed>
+bool same(Fixed& fixed, BTree<int>& tree) {
+	TreeShape a = fixed.shape(), b = tree.shape();
+	return fixed.size() == tree.size() && fixed.n_dead() == tree.n_dead() && fixed.isEmpty() == tree.isEmpty()
+		&& a._height == b._height && a._nodes == b._nodes && a._leaves == b._leaves && a._keys == b._keys
+		&& a._dead == b._dead && a._capacity == b._capacity && layout(fixed) == layout(tree);
+}
+
+/**
+Aplica la misma operacin a los dos rboles.
+
+@param f operacin: recibe un rbol (auto&)
+@return true si las dos han escrito lo mismo en cout y han lanzado (o no) E_BTree_Empty igual
+*/
+template <class Fixed, class F>
+bool both(Fixed& fixed, BTree<int>& tree, F f) {
+	bool empty_fixed = false, empty_tree = false;
+	string out_fixed = captured([&]() {
+		try { f(fixed); }
+		catch (E_BTree_Empty&) { empty_fixed = true; }
+	});
+	string out_tree = captured([&]() {
+		try { f(tree); }
+		catch (E_BTree_Empty&) { empty_tree = true; }
+	});
+	return out_fixed == out_tree && empty_fixed == empty_tree;
+}
+
+/** Tanda de keys aleatorias (con repetidas) */
+vector<int> randomBatch(mt19937& rng) {
+	vector<int> batch(1 + rng() % 40);
+	for (int& k : batch) k = (int)(rng() % KEY_RANGE);
+	return batch;
+}
+
+/**
+Prueba diferencial con un orden: FixedBTree<int, N> contra BTree<int>(N).
+
+@return true si todo ha ido bien
+*/
+template <int N>
+bool differential() {
+	FixedBTree<int, N> fixed;
+	BTree<int> tree(N);
+	mt19937 rng(N);
+	bool ok = fixed.shape()._capacity == (size_t)N && same(fixed, tree);
+
+	for (int round = 0; ok && round < ROUNDS; round++) {
+		bool growing = round % 10 < 6;
+		for (int op = 0; ok && op < ROUND_OPS; op++) {
+			int what = (int)(rng() % 20);
+			int k = (int)(rng() % KEY_RANGE);
+			if (what < (growing ? 8 : 4)) ok = both(fixed, tree, [k](auto& t) { t.insert(k); });
+			else if (what < 12) ok = both(fixed, tree, [k](auto& t) { t.remove(k); });
+			else if (what < 14) { // remove_lazy supone keys sin repetir: solo si hay una
+				vector<int> seen;
+				tree.for_each([&seen, k](const int& x) { if (x == k) seen.push_back(x); });
+				if (seen.size() == 1) ok = both(fixed, tree, [k](auto& t) { t.remove_lazy(k); });
+			}
+			else if (what < (growing ? 16 : 15)) {
+				vector<int> batch = randomBatch(rng);
+				ok = both(fixed, tree, [&batch](auto& t) { t.insert_batch(batch.begin(), batch.end()); });
+			}
+			else if (what < 18) {
+				vector<int> batch = randomBatch(rng);
+				ok = both(fixed, tree, [&batch](auto& t) { t.remove_batch(batch.begin(), batch.end()); });
+			}
+			else if (what < 19) {
+				size_t steps = 1 + rng() % 4;
+				ok = both(fixed, tree, [steps](auto& t) { t.compact_step(steps); });
+			}
+			else if (rng() % 20 == 0) { // De vez en cuando se reconstruye con bulk_load
+				vector<int> keys;
+				tree.for_each([&keys](const int& x) { keys.push_back(x); });
+				double fill = (rng() % 3 + 1) / 3.0;
+				ok = both(fixed, tree, [&keys, fill](auto& t) { t.bulk_load(keys.begin(), keys.end(), fill); });
+			}
+			ok = ok && same(fixed, tree);
+		}
+	}
+	ok = ok && fixed.compact() == tree.compact() && same(fixed, tree);
+
+	try { // Otro tamao
+		FixedBTree<int, N> other(N + 1);
+		ok = false;
+	}
+	catch (E_BTree_Format&) {}
+	catch (E_BTree_Bigger&) {
+		ok = ok && N + 1 > MAX_SIZE;
+	}
+	try {
+		FixedBTree<int, N> other(N - 1);
+		ok = false;
+	}
+	catch (E_BTree_Format&) {}
+	catch (E_BTree_Lower&) {
+		ok = ok && N - 1 < MIN_SIZE;
+	}
+	FixedBTree<int, N> exact(N); // Con su tamao s
+	ok = ok && exact.isEmpty() && exact.shape()._capacity == (size_t)N;
+
+	cout << "FixedBTree<int, " << N << "> igual que BTree<int>(" << N << "): " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+Tamaos fuera de los lmites de BTree: se comprueban antes que el orden fijado.
+
+@return true si todo ha ido bien
+*/
+bool limits() {
+	bool ok = true;
+	try {
+		FixedBTree<int, 5> t(1);
+		ok = false;
+	}
+	catch (E_BTree_Lower&) {}
+	try {
+		FixedBTree<int, 5> t(MAX_SIZE + 1);
+		ok = false;
+	}
+	catch (E_BTree_Bigger&) {}
+	try {
+		FixedBTree<int, 5> t(0);
+		ok = false;
+	}
+	catch (E_BTree_Lower&) {}
+	cout << "FixedBTree con tamanos fuera de los limites: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool all_ok = true;
+	all_ok = differential<3>() && all_ok;
+	all_ok = differential<4>() && all_ok;
+	all_ok = differential<5>() && all_ok;
+	all_ok = differential<8>() && all_ok;
+	all_ok = differential<15>() && all_ok;
+	all_ok = differential<63>() && all_ok;
+	all_ok = limits() && all_ok;
+
+	if (all_ok) cout << "Todas las pruebas de FixedBTree son correctas\n";
+	else cout << "Alguna prueba de FixedBTree ha fallado\n";
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba del ndice de solo lectura (FrozenBTree.h) con tamaos justo alrededor de los lmites de los bloques:
+- Con n keys, para n = m - 1, m y m + 1 con m cada nmero de keys que llena exactamente 1, 2, B + 1... bloques de
+  hojas y exactamente 1, 2 y 3 niveles, lower_bound y search tienen que coincidir con std::lower_bound y
+  std::binary_search para todas las keys que estn, las que caen entre dos y las de fuera por los dos lados.
+- La altura tiene que ser la mnima con la que caben las n keys, y operator[] y for_each tienen que dar las keys.
+- Lo mismo con keys repetidas, con varios tipos de keys (y por tanto varios B por defecto) y con B pequeos.
+- freeze de un rbol con keys borradas con remove_lazy da las keys que recorre el rbol.
+
+*/
+
+#include "FrozenBTree.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/** Key de tipo T que corresponde al entero x, conservando el orden */
+template <class T>
+T makeKey(int x) {
+	return (T)x;
+}
+
+template <>
+string makeKey<string>(int x) {
+	char buf[16];
+	snprintf(buf, sizeof(buf), "%08d", x + 1000); // Con ceros delante el orden de los strings es el de los nmeros
+	return buf;
+}
+
+/** Niveles que tiene que tener un ndice de n keys con bloques de B keys */
+int expectedHeight(size_t n, int B) {
+	if (n == 0) return 0;
+	int h = 1;
+	for (size_t cap = B; cap < n; cap *= B + 1) h++;
+	return h;
+}
+
+/**
+Construye el ndice con las keys v (ordenadas) y lo compara con v buscando cada key de probes.
+
+@return true si todo coincide
+*/
+template <class T, int B>
+bool sameSearch(const vector<T>& v, const vector<T>& probes) {
+	FrozenBTree<T, B> f(v.begin(), v.end());
+	bool ok = f.size() == v.size() && f.isEmpty() == v.empty() && f.height() == expectedHeight(v.size(), B);
+	for (size_t i = 0; ok && i < probes.size(); i++) {
+		const T& k = probes[i];
+		ok = f.lower_bound(k) == (size_t)(lower_bound(v.begin(), v.end(), k) - v.begin())
+			&& f.search(k) == binary_search(v.begin(), v.end(), k);
+	}
+	for (size_t i = 0; ok && i < v.size(); i++) ok = f[i] == v[i];
+	vector<T> keys;
+	f.for_each([&keys](const T& k) { keys.push_back(k); });
+	return ok && keys == v;
+}
+
+/**
+Prueba un tipo de keys y un B con los tamaos de alrededor de los lmites de los bloques y de los niveles.
+
+@param name nombre de la prueba
+@param max_key mayor entero que se puede convertir en key (los tamaos que necesitan ms keys se saltan)
+
+@return true si todo ha ido bien
+*/
+template <class T, int B>
+bool boundaries(const string& name, size_t max_key = 1000000) {
+	vector<size_t> full; // Nmeros de keys que llenan exactamente los bloques
+	full.push_back(1);
+	full.push_back(B);
+	full.push_back(2 * B);
+	full.push_back((size_t)B * B);
+	for (size_t m = B; m <= (size_t)B * (B + 1) * (B + 1); m *= B + 1) { // Exactamente 1, 2, 3... niveles llenos
+		full.push_back(m);
+		full.push_back(m + B); // Un bloque de hojas ms: el nivel de arriba empieza otro bloque
+	}
+
+	bool ok = true;
+	for (size_t j = 0; ok && j < full.size(); j++) {
+		for (size_t n = full[j] - 1; ok && n <= full[j] + 1; n++) {
+			if (2 * n + 1 > max_key) continue; // Las keys no caben en T
+			vector<T> v, repeated, probes;
+			for (size_t i = 0; i < n; i++) {
+				v.push_back(makeKey<T>(2 * (int)i)); // Keys pares: entre cada dos hay una impar que no est
+				repeated.push_back(makeKey<T>((int)(i / 3)));
+			}
+			for (int x = -2; x <= 2 * (int)n + 1; x++) probes.push_back(makeKey<T>(x));
+			ok = sameSearch<T, B>(v, probes) && sameSearch<T, B>(repeated, probes);
+			if (!ok) cout << "  fallo con " << n << " keys\n";
+		}
+	}
+	cout << "Limites de los bloques (" << name << ", B = " << B << "): " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+ndice construido con freeze a partir de un rbol con lpidas; las keys sin ordenar no se aceptan.
+
+@return true si todo ha ido bien
+*/
+bool frozenTree() {
+	BTree<int> tree(5);
+	for (int i = 0; i < 10000; i++) tree.insert(i * 2);
+	for (int i = 0; i < 1000; i++) tree.remove_lazy(i * 6);
+	FrozenBTree<int> f = freeze(tree);
+
+	vector<int> v;
+	tree.for_each([&v](const int& k) { v.push_back(k); });
+	bool ok = f.size() == v.size() && f.size() == tree.size();
+	for (int k = -2; ok && k <= 20001; k++) {
+		ok = f.lower_bound(k) == (size_t)(lower_bound(v.begin(), v.end(), k) - v.begin()) && f.search(k) == (tree.search(k) != NULL);
+	}
+
+	bool threw = false;
+	try {
+		vector<int> unsorted = { 1, 3, 2 };
+		FrozenBTree<int> g(unsorted.begin(), unsorted.end());
+	}
+	catch (E_BTree_Unsorted&) {
+		threw = true;
+	}
+	ok = ok && threw;
+	cout << "freeze de un arbol con lapidas: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool all_ok = boundaries<int, frozenBlock<int>()>("int");
+	all_ok = boundaries<long long, frozenBlock<long long>()>("long long") && all_ok;
+	all_ok = boundaries<short, frozenBlock<short>()>("short", 32767) && all_ok;
+	all_ok = boundaries<double, frozenBlock<double>()>("double") && all_ok;
+	all_ok = boundaries<int, 2>("int") && all_ok;
+	all_ok = boundaries<int, 3>("int") && all_ok;
+	all_ok = boundaries<string, 4>("string") && all_ok;
+	all_ok = frozenTree() && all_ok;
+
+	if (all_ok) cout << "Todas las pruebas del indice congelado son correctas\n";
+	else cout << "Alguna prueba del indice congelado ha fallado\n";
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,248 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba de la exportacin de keys (KeyExport.h): lo que escriben KeyWriter y exportKeys tiene que ser exactamente lo
+mismo que escribir cada key con operator<< seguida del separador (que es lo que hace traverse), y en binario los
+bytes de las keys una detrs de otra.
+- Enteros con y sin signo de varios tamaos: 0, negativos, los extremos de cada tipo (INT64_MIN incluido) y los
+  cambios de nmero de dgitos (9, 10, 99, 100...), adems de aleatorios. Tambin char (sale el carcter, como con
+  operator<<), double y string.
+- Suficientes keys para llenar varias veces el bloque de EXPORT_BLOCK bytes, con keys que acaban justo al final del
+  bloque y strings ms grandes que el bloque, escribiendo en un ostream, en un FILE* y en un descriptor.
+- exportKeys a un fichero de un BTree con lpidas (que no salen), en texto con varios separadores y en binario.
+- Pedir binario con keys que no se copian byte a byte lanza E_BTree_Format; un fichero que no se puede crear,
+  E_BTree_File.
+
+*/
+
+#include "KeyExport.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Fichero de las pruebas */
+const string PATH = "prueba_export.txt";
+
+/** Destinos de un KeyWriter */
+enum Target { TO_OSTREAM, TO_FILE, TO_FD };
+
+
+/** Contenido entero de un fichero */
+string fileBytes(const string& path) {
+	ifstream in(path.c_str(), ios::binary);
+	return string(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+}
+
+/**
+Texto que tiene que salir: cada key con operator<< seguida del separador.
+
+@param keys keys
+@param sep separador
+@return el texto
+*/
+template <class T>
+string expectedText(const vector<T>& keys, char sep) {
+	ostringstream out;
+	for (const T& k : keys) out << k << sep;
+	return out.str();
+}
+
+/**
+Escribe las keys con un KeyWriter en texto en un destino y devuelve lo que ha escrito.
+
+@param keys keys
+@param target destino
+@param sep separador
+@return lo escrito
+*/
+template <class T>
+string written(const vector<T>& keys, Target target, char sep) {
+	if (target == TO_OSTREAM) {
+		ostringstream out;
+		KeyWriter<T> w(out, KEYS_TEXT, sep);
+		for (const T& k : keys) w.put(k);
+		w.flush();
+		return out.str();
+	}
+	FILE* f = fopen(PATH.c_str(), "wb");
+	{
+		if (target == TO_FILE) {
+			KeyWriter<T> w(f, KEYS_TEXT, sep);
+			for (const T& k : keys) w.put(k);
+		} // El destructor escribe lo que queda
+		else {
+			KeyWriter<T> w(fileno(f), KEYS_TEXT, sep);
+			for (const T& k : keys) w.put(k);
+			w.flush();
+		}
+	}
+	fclose(f);
+	return fileBytes(PATH);
+}
+
+/**
+Enteros de tipo T para probar: 0, 1, -1, los extremos del tipo, las potencias de 10 y sus vecinos, y aleatorios
+hasta tener al menos n (repetidos para pasar varias veces por el bloque).
+
+@param n nmero mnimo de keys
+@return las keys
+*/
+template <class T>
+vector<T> integerKeys(size_t n) {
+	vector<T> keys = { 0, 1, (T)-1, numeric_limits<T>::min(), numeric_limits<T>::max(), (T)(numeric_limits<T>::min() + 1),
+		(T)(numeric_limits<T>::max() - 1) };
+	for (T p = 1; p <= numeric_limits<T>::max() / 10; p *= 10) { // 9, 10, 11, 99, 100, 101... y negativos
+		keys.push_back((T)(p * 10 - 1));
+		keys.push_back((T)(p * 10));
+		keys.push_back((T)(p * 10 + 1));
+		keys.push_back((T)-(p * 10));
+	}
+	mt19937_64 rng(sizeof(T) * 2 + is_signed<T>::value);
+	while (keys.size() < n) {
+		int what = (int)(rng() % 3);
+		if (what == 0) keys.push_back((T)rng());                            // De todo el rango
+		else if (what == 1) keys.push_back((T)(rng() % 2000) - (T)1000);    // Pequeas
+		else keys.push_back(keys[rng() % 20]);                              // De las de antes
+	}
+	return keys;
+}
+
+/**
+KeyWriter en texto con un tipo de entero contra operator<<, en los tres destinos y con dos separadores.
+
+@param name nombre del tipo para el mensaje
+@param n nmero de keys
+@return true si todo ha ido bien
+*/
+template <class T>
+bool integers(const string& name, size_t n) {
+	vector<T> keys = integerKeys<T>(n);
+	bool ok = true;
+	for (char sep : { '\n', ' ' }) {
+		string expected = expectedText(keys, sep);
+		for (Target target : { TO_OSTREAM, TO_FILE, TO_FD }) ok = ok && written(keys, target, sep) == expected;
+		ok = ok && (n < EXPORT_BLOCK / 4 || expected.size() > 2 * EXPORT_BLOCK);
+	}
+	cout << "KeyWriter igual que operator<< con " << name << ": " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+Keys que no son enteros: char (el carcter), double (con operator<<) y strings, con strings que acaban justo al final
+del bloque, vacas y ms grandes que el bloque.
+
+@return true si todo ha ido bien
+*/
+bool others() {
+	bool ok = true;
+	vector<char> chars;
+	for (int c = 'a'; c <= 'z'; c++) chars.push_back((char)c);
+	vector<signed char> schars = { 'x', '0', 'Z' };
+	vector<unsigned char> uchars = { 'x', '0', 'Z' };
+	vector<double> doubles = { 0.0, -1.5, 3.25, 1e300, -1e-300, 12345.678 };
+	for (Target target : { TO_OSTREAM, TO_FILE, TO_FD }) {
+		ok = ok && written(chars, target, '\n') == expectedText(chars, '\n')
+			&& written(schars, target, ',') == expectedText(schars, ',')
+			&& written(uchars, target, ',') == expectedText(uchars, ',')
+			&& written(doubles, target, '\n') == expectedText(doubles, '\n');
+	}
+
+	vector<string> strings;
+	strings.push_back(string(EXPORT_BLOCK - 1, 'a')); // Con el separador llena el bloque justo
+	strings.push_back("");                             // Su separador ya no cabe
+	strings.push_back("b");
+	strings.push_back(string(EXPORT_BLOCK, 'c'));      // Tan grande como el bloque
+	strings.push_back(string(EXPORT_BLOCK + 5, 'd'));  // Ms grande que el bloque
+	strings.push_back("e");
+	for (int j = 0; j < 3000; j++) strings.push_back(string(j % 700, (char)('f' + j % 20)));
+	for (Target target : { TO_OSTREAM, TO_FILE, TO_FD }) ok = ok && written(strings, target, '\n') == expectedText(strings, '\n');
+
+	cout << "KeyWriter igual que operator<< con char, double y string: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+exportKeys de un BTree a un fichero: en texto tiene que ser el recorrido con operator<< (sin las keys con lpida) y
+en binario los bytes de las keys en orden.
+
+@return true si todo ha ido bien
+*/
+bool trees() {
+	bool ok = true;
+	vector<int64_t> keys = integerKeys<int64_t>(300000);
+	sort(keys.begin(), keys.end());
+	keys.erase(unique(keys.begin(), keys.end()), keys.end()); // remove_lazy supone keys sin repetir
+	shuffle(keys.begin(), keys.end(), mt19937(1));
+	BTree<int64_t> tree(33);
+	for (int64_t k : keys) tree.insert(k);
+	for (size_t j = 0; j < keys.size(); j += 7) tree.remove_lazy(keys[j]);
+	vector<int64_t> alive;
+	tree.for_each([&alive](const int64_t& k) { alive.push_back(k); });
+
+	for (char sep : { '\n', ' ', ',' }) {
+		ok = ok && exportKeys<int64_t>(tree, PATH, KEYS_TEXT, sep) == alive.size() && fileBytes(PATH) == expectedText(alive, sep);
+	}
+	ok = ok && exportKeys<int64_t>(tree, PATH, KEYS_BINARY) == alive.size()
+		&& fileBytes(PATH) == string(reinterpret_cast<const char*>(alive.data()), alive.size() * sizeof(int64_t));
+
+	ostringstream out; // exportKeys con un KeyWriter hecho fuera
+	KeyWriter<int64_t> w(out);
+	ok = ok && exportKeys(tree, w) == alive.size() && out.str() == expectedText(alive, '\n');
+
+	BTree<int64_t> empty(5);
+	ok = ok && exportKeys<int64_t>(empty, PATH) == 0 && fileBytes(PATH).empty();
+
+	BTree<string> words(4);
+	for (const char* s : { "pera", "", "manzana", "kiwi" }) words.insert(s);
+	ok = ok && exportKeys<string>(words, PATH) == 4 && fileBytes(PATH) == "\nkiwi\nmanzana\npera\n";
+
+	try { // Binario con keys que no se copian byte a byte
+		exportKeys<string>(words, PATH, KEYS_BINARY);
+		ok = false;
+	}
+	catch (E_BTree_Format&) {}
+	try {
+		ostringstream o;
+		KeyWriter<string> bad(o, KEYS_BINARY);
+		ok = false;
+	}
+	catch (E_BTree_Format&) {}
+	try { // Fichero que no se puede crear
+		exportKeys<int64_t>(tree, "no_existe/claves.txt");
+		ok = false;
+	}
+	catch (E_BTree_File&) {}
+	remove(PATH.c_str());
+
+	cout << "exportKeys de un BTree a fichero: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool all_ok = true;
+	all_ok = integers<int64_t>("int64_t", 400000) && all_ok;
+	all_ok = integers<uint64_t>("uint64_t", 400000) && all_ok;
+	all_ok = integers<int>("int", 50000) && all_ok;
+	all_ok = integers<unsigned>("unsigned", 50000) && all_ok;
+	all_ok = integers<short>("short", 5000) && all_ok;
+	all_ok = integers<long>("long", 5000) && all_ok;
+	all_ok = others() && all_ok;
+	all_ok = trees() && all_ok;
+	remove(PATH.c_str());
+
+	if (all_ok) cout << "Todas las pruebas de la exportacion de keys son correctas\n";
+	else cout << "Alguna prueba de la exportacion de keys ha fallado\n";
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,296 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba de las partes en paralelo del rbol-B (BTree.h y WorkPool.h):
+- bulk_load(par(hilos), ...) con varios tamaos de nodo, fracciones de llenado y nmeros de hilos tiene que construir
+  exactamente el mismo rbol que bulk_load en un solo hilo: misma shape, mismo recorrido con for_each y los mismos
+  nodos (para cada key, el nodo en el que la encuentra search tiene que empezar por la misma key, tener las mismas
+  keys y ser hoja o no igual en los dos rboles). Los tamaos se eligen para que el nmero de hojas
+  (y, con nodos pequeos, el de nodos del nivel de encima) quede justo alrededor de los tramos de BUILD_CHUNK.
+- for_each(par(hilos), f) tiene que pasar por cada key viva exactamente una vez (y por ninguna con lpida), con
+  rboles construidos con bulk_load y con insert.
+- WorkPool::run: muchas veces seguidas con distinto nmero de tareas, run dentro de una tarea (del mismo conjunto y
+  de otro), varios hilos llamando a la vez a run del mismo conjunto y conjuntos que se crean y se destruyen.
+  En todos los casos cada tarea se tiene que hacer exactamente una vez.
+
+Se puede compilar tambin con -fsanitize=thread y no tiene que salir ningn aviso.
+
+*/
+
+#include "BTree.h"
+#include "WorkPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/** Tamaos de nodo con los que se prueba */
+const int ORDERS[] = { 3, 4, 5, 16, 64 };
+
+/** Fracciones de llenado con las que se prueba bulk_load */
+const double FILLS[] = { 0.5, 0.7, 1.0 };
+
+/** Nmeros de hilos con los que se prueba */
+const unsigned THREADS[] = { 2, 3, 8 };
+
+/** Mximo de keys de los rboles que se construyen (para no probar los niveles internos con nodos grandes) */
+const size_t MAX_KEYS = 300000;
+
+
+/**
+Reparto de las keys en los nodos: para cada key, la primera key, el nmero de keys y si es hoja del nodo en el que
+la encuentra search. Dos rboles con las mismas keys y el mismo reparto tienen los mismos nodos.
+
+@param tree rbol
+@param keys keys del rbol
+@return el reparto
+*/
+vector<int> layout(BTree<int>& tree, const vector<int>& keys) {
+	vector<int> out;
+	out.reserve(3 * keys.size());
+	for (int k : keys) {
+		BTree<int>::node_type* x = tree.search(k);
+		if (x == NULL) { // No est: no puede coincidir con el otro rbol, que s la tiene
+			out.push_back(k);
+			out.push_back(-1);
+			out.push_back(-1);
+			continue;
+		}
+		out.push_back(x->_elems[0]);
+		out.push_back(x->_n_elems);
+		out.push_back(x->_is_leaf);
+	}
+	return out;
+}
+
+/** Indica si dos formas son iguales */
+bool sameShape(const TreeShape& a, const TreeShape& b) {
+	return a._height == b._height && a._nodes == b._nodes && a._leaves == b._leaves && a._keys == b._keys
+		&& a._dead == b._dead && a._capacity == b._capacity;
+}
+
+/** Keys que bulk_load deja en cada nodo con ese tamao de nodo y fraccin de llenado (como en BTree::build) */
+int capacity(int order, double fill) {
+	int t = (order + 1) / 2;
+	int cap = (int)(fill * order + 0.5);
+	if (cap > order) cap = order;
+	if (cap < t - 1) cap = t - 1;
+	return cap < 1 ? 1 : cap;
+}
+
+/**
+Tamaos de rbol con los que el nmero de hojas queda alrededor de los tramos de BUILD_CHUNK (una menos, justo, una
+ms y el doble) y, si no salen demasiadas keys, tambin el de nodos del nivel de encima de las hojas.
+
+@param cap keys de cada nodo
+@return los tamaos
+*/
+vector<size_t> chunkSizes(int cap) {
+	vector<size_t> sizes = { 0, 1, 2, (size_t)cap, (size_t)cap + 1 };
+	size_t per = (size_t)cap + 1; // Keys de una hoja ms su separador
+	size_t leaves[] = { BUILD_CHUNK - 1, BUILD_CHUNK, BUILD_CHUNK + 1, 2 * BUILD_CHUNK, 2 * BUILD_CHUNK + 1,
+		(BUILD_CHUNK + 1) * per };
+	for (size_t p : leaves) {
+		size_t n = p * per - 1; // p hojas llenas
+		if (n + 1 > MAX_KEYS) continue;
+		sizes.push_back(n - 1);
+		sizes.push_back(n);
+		sizes.push_back(n + 1);
+	}
+	return sizes;
+}
+
+/**
+bulk_load en paralelo contra bulk_load en un solo hilo con un tamao de nodo: para cada fraccin de llenado, tamao
+y nmero de hilos, la misma shape, el mismo recorrido y los mismos nodos.
+
+@param order nmero mximo de keys por nodo
+@return true si todo ha ido bien
+*/
+bool sameBuild(int order) {
+	bool ok = true;
+	size_t builds = 0;
+	for (double fill : FILLS) {
+		for (size_t n : chunkSizes(capacity(order, fill))) {
+			vector<int> keys(n);
+			for (size_t i = 0; i < n; i++) keys[i] = 3 * (int)i - (int)n; // Tambin negativas
+			BTree<int> serial(order);
+			serial.bulk_load(keys.begin(), keys.end(), fill);
+			vector<int> expected = n > 0 ? layout(serial, keys) : vector<int>();
+
+			for (unsigned threads : THREADS) {
+				BTree<int> tree(order);
+				tree.insert(-1); // Lo que hubiera antes se sustituye
+				tree.bulk_load(par(threads), keys.begin(), keys.end(), fill);
+				vector<int> seen;
+				seen.reserve(n);
+				tree.for_each([&seen](const int& k) { seen.push_back(k); });
+				ok = ok && tree.size() == n && sameShape(tree.shape(), serial.shape()) && seen == keys
+					&& (n == 0 ? tree.isEmpty() : layout(tree, keys) == expected);
+				builds++;
+			}
+		}
+	}
+	cout << "bulk_load en paralelo igual que en serie con orden " << order << " (" << builds << " arboles): "
+		<< (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+Comprueba que for_each(par(hilos), f) pasa por cada key viva de tree una vez y por ninguna ms.
+
+@param tree rbol con keys de [0, range)
+@param alive alive[k] indica si la key k est viva en el rbol
+@return true si todo ha ido bien
+*/
+bool visitsOnce(const BTree<int>& tree, const vector<char>& alive) {
+	bool ok = true;
+	for (unsigned threads : THREADS) {
+		unique_ptr<atomic<int>[]> visits(new atomic<int>[alive.size()]);
+		for (size_t k = 0; k < alive.size(); k++) visits[k] = 0;
+		atomic<int> outside(0);
+		tree.for_each(par(threads), [&visits, &outside, &alive](const int& k) {
+			if (k < 0 || (size_t)k >= alive.size()) outside++;
+			else visits[k]++;
+		});
+		ok = ok && outside == 0;
+		for (size_t k = 0; ok && k < alive.size(); k++) ok = visits[k] == (alive[k] ? 1 : 0);
+	}
+	return ok;
+}
+
+/**
+for_each en paralelo con rboles construidos con bulk_load y con insert, con y sin lpidas.
+
+@param order nmero mximo de keys por nodo
+@return true si todo ha ido bien
+*/
+bool parallelForEach(int order) {
+	bool ok = true;
+	mt19937 rng(order);
+	const size_t sizes[] = { 0, 1, 100, 5000, 40000 };
+	for (size_t n : sizes) {
+		vector<int> keys(n);
+		for (size_t i = 0; i < n; i++) keys[i] = (int)i;
+		vector<char> alive(n, 1);
+
+		BTree<int> bulk(order);
+		bulk.bulk_load(par(3), keys.begin(), keys.end(), 0.7);
+		ok = ok && visitsOnce(bulk, alive);
+
+		BTree<int> inserted(order);
+		vector<int> shuffled(keys);
+		shuffle(shuffled.begin(), shuffled.end(), rng);
+		for (int k : shuffled) inserted.insert(k);
+		ok = ok && visitsOnce(inserted, alive);
+
+		for (size_t k = 0; k < n; k++) { // Lpidas en un tercio de las keys, tambin en nodos internos
+			if (rng() % 3 == 0) {
+				alive[k] = 0;
+				ok = ok && bulk.remove_lazy((int)k) && inserted.remove_lazy((int)k);
+			}
+		}
+		ok = ok && visitsOnce(bulk, alive) && visitsOnce(inserted, alive);
+	}
+	cout << "for_each en paralelo con orden " << order << ": " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/** Comprueba que cada tarea se ha hecho una vez y deja los contadores a 0 */
+bool once(unique_ptr<atomic<int>[]>& done, size_t n) {
+	bool ok = true;
+	for (size_t i = 0; i < n; i++) {
+		ok = ok && done[i] == 1;
+		done[i] = 0;
+	}
+	return ok;
+}
+
+/**
+WorkPool::run muchas veces seguidas, dentro de una tarea, desde varios hilos a la vez y con conjuntos que se crean y
+se destruyen.
+
+@return true si todo ha ido bien
+*/
+bool workPool() {
+	bool ok = true;
+	const size_t MAX_TASKS = 4096;
+	unique_ptr<atomic<int>[]> done(new atomic<int>[MAX_TASKS]);
+	for (size_t i = 0; i < MAX_TASKS; i++) done[i] = 0;
+
+	for (unsigned threads : THREADS) { // Seguidas, con ms y menos tareas que hilos
+		WorkPool& pool = WorkPool::shared(threads);
+		for (size_t r = 0; r < 300; r++) {
+			size_t n = r % 40;
+			if (r % 50 == 49) n = MAX_TASKS;
+			pool.run(n, [&done](size_t i) { done[i]++; });
+			ok = ok && once(done, n);
+		}
+	}
+
+	for (unsigned threads : THREADS) { // Dentro de una tarea, con el mismo conjunto y con otro
+		WorkPool& pool = WorkPool::shared(threads);
+		WorkPool& other = WorkPool::shared(threads + 1);
+		for (int r = 0; r < 20; r++) {
+			pool.run(32, [&done, &pool, &other](size_t i) {
+				WorkPool& inner = i % 2 == 0 ? pool : other;
+				inner.run(32, [&done, i](size_t j) { done[i * 32 + j]++; });
+			});
+			ok = ok && once(done, 32 * 32);
+		}
+	}
+
+	BTree<int> tree(5); // for_each en paralelo dentro de una tarea
+	vector<int> keys(3000);
+	for (size_t i = 0; i < keys.size(); i++) keys[i] = (int)i;
+	tree.bulk_load(keys.begin(), keys.end());
+	WorkPool::shared(3).run(8, [&done, &tree](size_t i) {
+		tree.for_each(par(3), [&done, i](const int& k) { if (k == (int)i) done[i]++; });
+	});
+	ok = ok && once(done, 8);
+
+	for (unsigned threads : THREADS) { // Varios hilos llamando a la vez al mismo conjunto
+		WorkPool& pool = WorkPool::shared(threads);
+		vector<thread> callers;
+		for (size_t c = 0; c < 4; c++) {
+			callers.push_back(thread([&done, &pool, c]() {
+				for (int r = 0; r < 50; r++) pool.run(256, [&done, c](size_t i) { done[c * 256 + i]++; });
+			}));
+		}
+		for (thread& t : callers) t.join();
+		for (size_t i = 0; i < 4 * 256; i++) {
+			ok = ok && done[i] == 50;
+			done[i] = 0;
+		}
+	}
+
+	for (int r = 0; r < 50; r++) { // Conjuntos que se destruyen con los hilos dormidos (o sin haberlos creado)
+		WorkPool pool(1 + r % 5);
+		for (int j = 0; j < r % 3; j++) {
+			pool.run(100, [&done](size_t i) { done[i]++; });
+			ok = ok && once(done, 100);
+		}
+	}
+
+	cout << "WorkPool::run seguidos, anidados y a la vez: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool all_ok = true;
+	for (int order : ORDERS) all_ok = sameBuild(order) && all_ok;
+	for (int order : ORDERS) all_ok = parallelForEach(order) && all_ok;
+	all_ok = workPool() && all_ok;
+
+	if (all_ok) cout << "Todas las pruebas en paralelo son correctas\n";
+	else cout << "Alguna prueba en paralelo ha fallado\n";
+	return all_ok ? 0 : 1;
+}
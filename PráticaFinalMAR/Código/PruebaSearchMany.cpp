@@ -0,0 +1,166 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba de search_many del rbol-B (BTree.h) contra search: para cada key pedida, search_many tiene que devolver
+el mismo nodo que search (o NULL igual que search). Se prueba con BTree de varios tamaos de nodo, con FixedBTree y
+con CountedBTree.
+- Los rboles tienen keys repetidas y lpidas (remove_lazy), y se piden keys que estn, que no estn (entre dos keys,
+  por debajo de la menor y por encima de la mayor), con lpida, repetidas y la misma key varias veces en una tanda.
+- Tandas de 0, 1, 15, 16, 17 keys y ms grandes, que no son mltiplos de SEARCH_GROUP, para que el grupo de
+  bsquedas se llene, se quede a medias y se vaya vaciando al final.
+- Con el rbol vaco (tambin si todas sus keys tienen lpida) search_many lanza E_BTree_Empty.
+
+*/
+
+#include "BTree.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Tamaos de nodo con los que se prueba BTree y CountedBTree */
+const int ORDERS[] = { 3, 4, 5, 16, 64 };
+
+/** Nmero de keys de las tandas */
+const size_t LENGTHS[] = { 0, 1, 15, 16, 17, 2 * SEARCH_GROUP + 1, 1000, 4099 };
+
+/** Nmero de keys de los rboles que se prueban (todas pares, para que las impares no estn) */
+const int SIZES[] = { 1, 10, 300, 20000 };
+
+
+/**
+Llena tree con las keys pares de [0, 2 * n) en orden aleatorio, repite una de cada diez y pone lpida a una de cada
+siete de las que no se repiten.
+
+@param tree rbol vaco
+@param n nmero de keys distintas
+@param rng generador de nmeros aleatorios
+*/
+template <class Tree>
+void populate(Tree& tree, int n, mt19937& rng) {
+	vector<int> keys;
+	for (int k = 0; k < n; k++) {
+		keys.push_back(2 * k);
+		if (k % 10 == 3) keys.push_back(2 * k);
+	}
+	shuffle(keys.begin(), keys.end(), rng);
+	for (int k : keys) tree.insert(k);
+	for (int k = 0; k < n; k++) {
+		if (k % 7 == 5 && k % 10 != 3) tree.remove_lazy(2 * k);
+	}
+}
+
+/**
+Tanda de keys para buscar: pares (que estn, repetidas o con lpida), impares (que no estn), fuera del rango de
+las keys y alguna repetida en la tanda.
+
+@param length nmero de keys de la tanda
+@param n nmero de keys distintas del rbol
+@param rng generador de nmeros aleatorios
+@return la tanda
+*/
+vector<int> queries(size_t length, int n, mt19937& rng) {
+	vector<int> q;
+	for (size_t j = 0; j < length; j++) {
+		int what = (int)(rng() % 10);
+		if (what < 5) q.push_back(2 * (int)(rng() % n));          // Est (o tiene lpida)
+		else if (what < 8) q.push_back(2 * (int)(rng() % n) + 1); // Entre dos keys
+		else if (what < 9) q.push_back(rng() % 2 == 0 ? -1 - (int)(rng() % 100) : 2 * n + (int)(rng() % 100));
+		else q.push_back(q.empty() ? 0 : q[rng() % q.size()]);     // Repetida en la tanda
+	}
+	return q;
+}
+
+/**
+Comprueba que search_many devuelve, para cada key de cada tanda, lo mismo que search.
+
+@param tree rbol con keys
+@param n nmero de keys distintas del rbol
+@param rng generador de nmeros aleatorios
+@return true si todo coincide
+*/
+template <class Tree>
+bool sameAsSearch(Tree& tree, int n, mt19937& rng) {
+	bool ok = true;
+	for (size_t length : LENGTHS) {
+		vector<int> q = queries(length, n, rng);
+		vector<typename Tree::node_type*> found = tree.search_many(q.begin(), q.end());
+		ok = ok && found.size() == q.size();
+		for (size_t j = 0; ok && j < q.size(); j++) ok = found[j] == tree.search(q[j]);
+	}
+	return ok;
+}
+
+/**
+Con el rbol vaco (sin keys o con todas con lpida) search_many tiene que lanzar E_BTree_Empty.
+
+@param tree rbol vaco
+@return true si lanza la excepcin
+*/
+template <class Tree>
+bool throwsEmpty(Tree& tree) {
+	vector<int> q(1, 0);
+	try {
+		tree.search_many(q.begin(), q.end());
+		return false;
+	}
+	catch (E_BTree_Empty&) {
+		return true;
+	}
+}
+
+/**
+Prueba un tipo de rbol con todos los tamaos de rbol: creado con make, lleno con populate y, al final, con todas las
+keys con lpida.
+
+@param name nombre del rbol para el mensaje
+@param make funcin que crea un rbol vaco
+@return true si todo ha ido bien
+*/
+template <class Tree, class Make>
+bool test(const string& name, Make make) {
+	bool ok = true;
+	mt19937 rng(name.size());
+	{
+		Tree tree = make();
+		ok = throwsEmpty(tree);
+	}
+	for (int n : SIZES) {
+		Tree tree = make();
+		populate(tree, n, rng);
+		ok = ok && sameAsSearch(tree, n, rng);
+
+		Tree dead = make(); // Todas las keys con lpida
+		for (int k = 0; k < n; k++) dead.insert(2 * k);
+		for (int k = 0; k < n; k++) dead.remove_lazy(2 * k);
+		ok = ok && dead.isEmpty() && throwsEmpty(dead);
+		dead.insert(0); // Se revive una y la encuentra
+		vector<int> q = { 0, 2, 0 };
+		vector<typename Tree::node_type*> found = dead.search_many(q.begin(), q.end());
+		ok = ok && found[0] != NULL && found[0] == found[2] && found[0] == dead.search(0) && found[1] == NULL;
+	}
+	cout << "search_many igual que search con " << name << ": " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool all_ok = true;
+	for (int order : ORDERS) {
+		all_ok = test<BTree<int> >("BTree de orden " + to_string(order), [order]() { return BTree<int>(order); }) && all_ok;
+	}
+	all_ok = test<FixedBTree<int, 5> >("FixedBTree<int, 5>", []() { return FixedBTree<int, 5>(); }) && all_ok;
+	all_ok = test<FixedBTree<int, 63> >("FixedBTree<int, 63>", []() { return FixedBTree<int, 63>(); }) && all_ok;
+	for (int order : { 4, 33 }) {
+		all_ok = test<CountedBTree<int> >("CountedBTree de orden " + to_string(order),
+			[order]() { return CountedBTree<int>(order); }) && all_ok;
+	}
+
+	if (all_ok) cout << "Todas las pruebas de search_many son correctas\n";
+	else cout << "Alguna prueba de search_many ha fallado\n";
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,202 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba de las instantneas de BTree (Snapshot.h):
+- Ida y vuelta con varios tamaos de nodo y de rbol: se guarda un rbol con lpidas (remove_lazy), se abre la
+  instantnea comprobando la suma de los nodos y search, for_each y size tienen que dar lo mismo que std::set; las
+  keys se cargan en otro rbol con load, se guarda ese y la segunda instantnea tiene que tener las mismas keys.
+- Lpidas: las keys borradas no se encuentran ni se recorren (tampoco si estn en nodos internos o si estn todas
+  borradas), y las que se vuelven a insertar antes de guardar s.
+- Ficheros daados: un byte cambiado en los nodos hace que verify devuelva false y que abrir comprobando lance
+  E_BTree_Format; un byte cambiado en la cabecera, un fichero cortado o de keys de otro tipo no se pueden abrir.
+
+*/
+
+#include "Snapshot.h"
+
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Fichero de las pruebas */
+const string PATH = "prueba_snapshot.snap";
+
+/** Tamaos de nodo con los que se prueba */
+const int ORDERS[] = { 3, 4, 5, 8, 33, 64, 200 };
+
+/** Nmero de keys de los rboles que se guardan */
+const int SIZES[] = { 0, 1, 10, 1000, 50000 };
+
+
+/** Comprueba que la instantnea tiene exactamente las keys de ref: size, for_each y search de keys que estn y que no */
+bool sameKeys(const BTreeSnapshot<int>& snap, const set<int>& ref, int range) {
+	vector<int> keys;
+	snap.for_each([&keys](const int& k) { keys.push_back(k); });
+	bool ok = snap.size() == ref.size() && keys == vector<int>(ref.begin(), ref.end());
+	for (int k = -1; ok && k <= range; k++) ok = snap.search(k) == (ref.count(k) > 0);
+	return ok;
+}
+
+/** Cambia un byte del fichero */
+void corrupt(const string& path, long pos) {
+	FILE* f = fopen(path.c_str(), "r+b");
+	fseek(f, pos, SEEK_SET);
+	int c = fgetc(f);
+	fseek(f, pos, SEEK_SET);
+	fputc(c ^ 0xff, f);
+	fclose(f);
+}
+
+/** Deja en el fichero solo sus primeros n bytes */
+void cut(const string& path, long n) {
+	FILE* f = fopen(path.c_str(), "rb");
+	vector<char> data(n);
+	size_t got = fread(data.data(), 1, n, f);
+	fclose(f);
+	f = fopen(path.c_str(), "wb");
+	fwrite(data.data(), 1, got, f);
+	fclose(f);
+}
+
+/** Indica si abrir el fichero como instantnea de T lanza la excepcin E */
+template <class T, class E>
+bool openThrows(const string& path, bool check) {
+	try {
+		BTreeSnapshot<T> snap(path, check);
+	}
+	catch (E&) {
+		return true;
+	}
+	return false;
+}
+
+/**
+Ida y vuelta con un tamao de nodo y de rbol: rbol con keys sin repetir, una cuarta parte borradas con
+remove_lazy (y algunas de esas revividas), guardado, abierto, cargado en otro rbol y guardado otra vez.
+
+@param order nmero mximo de keys por nodo
+@param n nmero de keys que se intentan insertar
+
+@return true si todo ha ido bien
+*/
+bool roundTrip(int order, int n) {
+	mt19937 rng(order * 100003 + n);
+	int range = 2 * n + 1;
+	BTree<int> tree(order);
+	set<int> ref;
+	for (int i = 0; i < n; i++) {
+		int k = (int)(rng() % range);
+		if (ref.insert(k).second) tree.insert(k);
+	}
+	vector<int> dead;
+	for (int i = 0; i < n / 4; i++) {
+		int k = (int)(rng() % range);
+		if (!tree.isEmpty() && tree.remove_lazy(k)) {
+			ref.erase(k);
+			dead.push_back(k);
+		}
+	}
+	for (size_t i = 0; i < dead.size(); i += 5) { // Algunas se vuelven a insertar antes de guardar
+		tree.insert(dead[i]); // Insertar una key borrada le quita la lpida
+		ref.insert(dead[i]);
+	}
+
+	uint64_t bytes = BTreeSnapshot<int>::save(tree, PATH);
+	bool ok;
+	{
+		BTreeSnapshot<int> snap(PATH, true);
+		ok = sameKeys(snap, ref, range) && snap.bytes() == bytes && snap.n_keys() == order && snap.verify();
+#ifdef BTREE_MMAP
+		ok = ok && snap.isMapped();
+#endif
+		BTree<int> loaded(16);
+		snap.load(loaded);
+		vector<int> keys;
+		loaded.for_each([&keys](const int& k) { keys.push_back(k); });
+		ok = ok && keys == vector<int>(ref.begin(), ref.end()) && loaded.size() == ref.size();
+		BTreeSnapshot<int>::save(loaded, PATH); // Se sustituye el fichero abierto (la proyeccin sigue viendo el viejo)
+		ok = ok && sameKeys(snap, ref, range);
+	}
+	{
+		BTreeSnapshot<int> again(PATH, true);
+		ok = ok && sameKeys(again, ref, range) && again.n_keys() == 16;
+	}
+	if (!ok) cout << "Ida y vuelta con orden " << order << " y " << n << " keys: INCORRECTO\n";
+	return ok;
+}
+
+/**
+rbol con todas las keys borradas con remove_lazy: la instantnea no tiene ninguna aunque sus nodos s.
+
+@return true si todo ha ido bien
+*/
+bool allDead() {
+	BTree<int> tree(4);
+	for (int i = 0; i < 500; i++) tree.insert(i);
+	for (int i = 0; i < 500; i++) tree.remove_lazy(i);
+	BTreeSnapshot<int>::save(tree, PATH);
+	BTreeSnapshot<int> snap(PATH, true);
+	set<int> none;
+	bool ok = sameKeys(snap, none, 500) && snap.n_nodes() > 1;
+	cout << "Instantanea con todas las keys borradas: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+Ficheros daados, cortados, de otro tipo de keys o que no existen.
+
+@return true si todo ha ido bien
+*/
+bool damaged() {
+	BTree<int> tree(8);
+	for (int i = 0; i < 5000; i++) tree.insert(i * 3);
+	uint64_t bytes = BTreeSnapshot<int>::save(tree, PATH);
+
+	bool ok = openThrows<long long, E_BTree_Format>(PATH, false) && openThrows<float, E_BTree_Format>(PATH, false);
+	corrupt(PATH, (long)(bytes / 2)); // Un byte de los nodos
+	{
+		BTreeSnapshot<int> snap(PATH); // Sin comprobar los nodos se abre
+		ok = ok && !snap.verify();
+	}
+	ok = ok && openThrows<int, E_BTree_Format>(PATH, true);
+	corrupt(PATH, (long)(bytes / 2)); // Se deja como estaba
+	{
+		BTreeSnapshot<int> snap(PATH, true);
+		ok = ok && snap.verify() && snap.search(300) && !snap.search(301);
+	}
+
+	corrupt(PATH, 20); // Un byte de la cabecera (el nmero de keys)
+	ok = ok && openThrows<int, E_BTree_Format>(PATH, false);
+	corrupt(PATH, 20);
+	cut(PATH, (long)bytes - 8);
+	ok = ok && openThrows<int, E_BTree_Format>(PATH, false);
+	cut(PATH, 10); // Ni siquiera la cabecera entera
+	ok = ok && openThrows<int, E_BTree_Format>(PATH, false);
+	remove(PATH.c_str());
+	ok = ok && openThrows<int, E_BTree_File>(PATH, false);
+	cout << "Instantaneas estropeadas: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool ok = true;
+	for (int order : ORDERS) {
+		for (int n : SIZES) ok = roundTrip(order, n) && ok;
+	}
+	cout << "Ida y vuelta con lapidas: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	bool all_ok = ok;
+	all_ok = allDead() && all_ok;
+	all_ok = damaged() && all_ok;
+	remove(PATH.c_str());
+	remove((PATH + ".tmp").c_str());
+
+	if (all_ok) cout << "Todas las pruebas de las instantaneas son correctas\n";
+	else cout << "Alguna prueba de las instantaneas ha fallado\n";
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,289 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba diferencial de las lpidas del rbol-B (BTree.h) contra std::multiset con varios tamaos de nodo: se mezclan
+remove, remove_lazy, remove_batch, compact_step, compact y keys borradas que se vuelven a insertar, y despus de
+cada paso se comprueban size, isEmpty, search de la key tocada, el recorrido con for_each y que shape cuenta las
+mismas keys y lpidas que el rbol.
+- Las keys de [0, KEY_RANGE) no se repiten y les pasa de todo; las de [DUP_BASE, DUP_BASE + DUP_RANGE) se repiten y
+  solo se eliminan con remove y remove_batch (remove_lazy supone keys sin repetir).
+- Eliminar con remove o remove_batch una key con lpida tiene que decir que no est y no cambiar nada.
+- needs_compaction tiene que seguir a set_dead_ratio: en una hoja sola se comprueba exactamente con cuntas lpidas
+  empieza a pedir compactacin, y en las pruebas aleatorias que compact y compact_step la dejan sin pedir.
+
+*/
+
+#include "BTree.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Tamaos de nodo con los que se prueba */
+const int ORDERS[] = { 3, 4, 5, 8, 16 };
+
+/** Fracciones de lpidas con las que se prueba needs_compaction */
+const double RATIOS[] = { 0.25, 0.5, 1.0 };
+
+/** Tandas de operaciones de cada prueba */
+const int ROUNDS = 40;
+
+/** Operaciones de cada tanda */
+const int ROUND_OPS = 300;
+
+/** Keys distintas sin repetir que se usan */
+const int KEY_RANGE = 3000;
+
+/** Primera key de las que se repiten y cuntas distintas hay */
+const int DUP_BASE = 100000;
+const int DUP_RANGE = 40;
+
+/** Mensaje de remove y remove_batch cuando la key no est */
+const string MISSING = "is not in the tree";
+
+
+/** Ejecuta f y devuelve lo que ha escrito en cout */
+template <class F>
+string captured(F f) {
+	ostringstream out;
+	streambuf* old = cout.rdbuf(out.rdbuf());
+	f();
+	cout.rdbuf(old);
+	return out.str();
+}
+
+/** Nmero de veces que aparece el mensaje de key que no est */
+size_t missing(const string& out) {
+	size_t n = 0;
+	for (size_t p = out.find(MISSING); p != string::npos; p = out.find(MISSING, p + 1)) n++;
+	return n;
+}
+
+/** Indica si search encuentra k (search no se puede llamar con el rbol vaco) */
+bool found(BTree<int>& tree, int k) {
+	return !tree.isEmpty() && tree.search(k) != NULL;
+}
+
+/**
+Comprueba size, isEmpty, search de k, el recorrido con for_each y que shape cuenta las keys con lpida y sin ella.
+
+@return true si todo coincide con ref
+*/
+bool sameKeys(BTree<int>& tree, const multiset<int>& ref, int k) {
+	vector<int> keys;
+	tree.for_each([&keys](const int& x) { keys.push_back(x); });
+	TreeShape s = tree.shape();
+	return tree.size() == ref.size() && tree.isEmpty() == ref.empty() && found(tree, k) == (ref.count(k) > 0)
+		&& keys == vector<int>(ref.begin(), ref.end()) && s._keys == tree.size() + tree.n_dead() && s._dead == tree.n_dead();
+}
+
+/** Key aleatoria: casi siempre de las que no se repiten, a veces de las que s (si dup) */
+int randomKey(mt19937& rng, bool dup) {
+	if (dup && rng() % 4 == 0) return DUP_BASE + (int)(rng() % DUP_RANGE);
+	return (int)(rng() % KEY_RANGE);
+}
+
+/**
+Elimina k con remove y comprueba que solo dice que no est si no estaba (o tena lpida) y que lo hace igual que ref.
+Con el rbol vaco tiene que lanzar E_BTree_Empty.
+
+@return true si todo ha ido bien
+*/
+bool eagerRemove(BTree<int>& tree, multiset<int>& ref, int k) {
+	if (ref.empty()) {
+		try {
+			tree.remove(k);
+			return false;
+		}
+		catch (E_BTree_Empty&) {
+			return true;
+		}
+	}
+	bool present = ref.count(k) > 0;
+	size_t dead = tree.n_dead();
+	string out = captured([&tree, k]() { tree.remove(k); });
+	if (present) ref.erase(ref.find(k));
+	return missing(out) == (present ? 0u : 1u) && tree.n_dead() == dead;
+}
+
+/**
+Elimina con remove_batch una tanda de keys (algunas que no estn, algunas con lpida y algunas repetidas en la
+tanda) y comprueba que dice que no estn exactamente las que no puede quitar.
+
+@return true si todo ha ido bien
+*/
+bool batchRemove(BTree<int>& tree, multiset<int>& ref, mt19937& rng) {
+	vector<int> batch;
+	int n = 1 + (int)(rng() % 8);
+	for (int j = 0; j < n; j++) batch.push_back(randomKey(rng, true));
+	if (n > 1 && rng() % 2 == 0) batch.push_back(batch[0]); // La misma key dos veces en la tanda
+	if (ref.empty()) {
+		try {
+			tree.remove_batch(batch.begin(), batch.end());
+			return false;
+		}
+		catch (E_BTree_Empty&) {
+			return true;
+		}
+	}
+	vector<int> sorted(batch);
+	sort(sorted.begin(), sorted.end());
+	size_t expected = 0;
+	for (int k : sorted) {
+		multiset<int>::iterator it = ref.find(k);
+		if (it == ref.end()) expected++;
+		else ref.erase(it);
+	}
+	string out = captured([&tree, &batch]() { tree.remove_batch(batch.begin(), batch.end()); });
+	return missing(out) == expected;
+}
+
+/**
+Prueba diferencial con un tamao de nodo. Las primeras tandas insertan ms de lo que eliminan y las ltimas al revs,
+as que el rbol crece (partiendo nodos, con las lpidas movindose con sus keys) y luego encoge (uniendo nodos y
+prestando keys).
+
+@param order nmero mximo de keys por nodo
+
+@return true si todo ha ido bien
+*/
+bool differential(int order) {
+	BTree<int> tree(order);
+	multiset<int> ref;
+	mt19937 rng(order * 31);
+	bool ok = true;
+	size_t lazy = 0, revived = 0, compacted = 0;
+	vector<int> buried; // Keys a las que se les ha puesto lpida, para volver a insertarlas
+
+	for (int round = 0; ok && round < ROUNDS; round++) {
+		tree.set_dead_ratio(RATIOS[round % 3]);
+		bool growing = round < ROUNDS / 2;
+		for (int op = 0; ok && op < ROUND_OPS; op++) {
+			int what = (int)(rng() % 20);
+			int k = randomKey(rng, false);
+			if (what < (growing ? 7 : 3)) { // Insercin de una key sin repetir (si tiene lpida, se le quita)
+				if (!buried.empty() && rng() % 2 == 0) {
+					size_t j = rng() % buried.size();
+					k = buried[j];
+					buried[j] = buried.back();
+					buried.pop_back();
+				}
+				if (ref.count(k) == 0) {
+					size_t dead = tree.n_dead();
+					tree.insert(k);
+					ref.insert(k);
+					if (tree.n_dead() < dead) revived++;
+				}
+			}
+			else if (what < 8) { // Insercin de una key repetida
+				k = DUP_BASE + (int)(rng() % DUP_RANGE);
+				tree.insert(k);
+				ref.insert(k);
+			}
+			else if (what < (growing ? 11 : 13)) { // Lpida, y a veces se intenta eliminar del todo despus
+				if (ref.empty()) {
+					try {
+						tree.remove_lazy(k);
+						ok = false;
+					}
+					catch (E_BTree_Empty&) {}
+				}
+				else {
+					bool present = ref.count(k) > 0;
+					size_t dead = tree.n_dead();
+					ok = tree.remove_lazy(k) == present && tree.n_dead() == dead + (present ? 1 : 0);
+					if (present) {
+						ref.erase(k);
+						buried.push_back(k);
+						lazy++;
+						if (ok && rng() % 3 == 0 && !ref.empty()) ok = eagerRemove(tree, ref, k); // Tiene que decir que no est
+					}
+				}
+			}
+			else if (what < (growing ? 13 : 16)) { // Eliminacin normal
+				ok = eagerRemove(tree, ref, randomKey(rng, true));
+			}
+			else if (what < 17) {
+				ok = batchRemove(tree, ref, rng);
+			}
+			else if (what < 18) { // Unos pasos de compactacin
+				size_t steps[] = { 1, 2, 5, 100 };
+				size_t dead = tree.n_dead();
+				size_t removed = tree.compact_step(steps[rng() % 4]);
+				ok = tree.n_dead() == dead - removed;
+				compacted += removed;
+			}
+			else if (what < 19 && rng() % 4 == 0) { // Compactacin entera
+				size_t dead = tree.n_dead();
+				ok = tree.compact() == dead && tree.n_dead() == 0 && !tree.needs_compaction();
+				compacted += dead;
+			}
+			else if (!ref.empty()) { // Bsqueda (tambin de las que se repiten)
+				k = randomKey(rng, true);
+				ok = found(tree, k) == (ref.count(k) > 0);
+			}
+			ok = ok && sameKeys(tree, ref, k);
+		}
+
+		for (int steps = 0; ok && tree.needs_compaction(); steps++) { // Al final de cada tanda se compacta poco a poco
+			size_t dead = tree.n_dead();
+			compacted += tree.compact_step(1);
+			ok = steps < 100000 && tree.n_dead() <= dead && sameKeys(tree, ref, 0);
+		}
+	}
+	ok = ok && lazy > 0 && revived > 0 && compacted > 0;
+	cout << "Diferencial con orden " << order << " (" << lazy << " lapidas, " << revived << " revividas, " << compacted
+		<< " compactadas): " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+needs_compaction en un rbol de una sola hoja con 10 keys: con cada fraccin, tiene que empezar a pedir compactacin
+justo con la lpida que lleva el nodo a esa fraccin (y no antes); compact_step la quita de verdad. Con una fraccin
+mayor que 1 nunca la pide.
+
+@return true si todo ha ido bien
+*/
+bool ratioThreshold() {
+	bool ok = true;
+	const double ratios[] = { 0.1, 0.3, 0.5, 0.75, 1.0, 2.0 };
+	for (double ratio : ratios) {
+		BTree<int> tree(16);
+		multiset<int> ref;
+		for (int k = 0; k < 10; k++) {
+			tree.insert(k);
+			ref.insert(k);
+		}
+		tree.set_dead_ratio(ratio);
+		for (int j = 1; ok && j <= 10; j++) { // Lpida a la key j - 1: el nodo queda con j de 10
+			ok = !tree.needs_compaction() && tree.remove_lazy(j - 1);
+			ref.erase(j - 1);
+			ok = ok && tree.needs_compaction() == (j >= ratio * 10) && sameKeys(tree, ref, j - 1);
+			if (ok && tree.needs_compaction()) {
+				ok = tree.compact_step(1) == (size_t)j && tree.n_dead() == 0 && !tree.needs_compaction()
+					&& sameKeys(tree, ref, j - 1) && tree.shape()._keys == ref.size();
+				break;
+			}
+		}
+		if (ratio > 1) ok = ok && tree.n_dead() == 10 && tree.isEmpty() && tree.compact() == 10 && tree.shape()._keys == 0;
+	}
+	cout << "needs_compaction segun set_dead_ratio: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool all_ok = true;
+	for (int order : ORDERS) all_ok = differential(order) && all_ok;
+	all_ok = ratioThreshold() && all_ok;
+
+	if (all_ok) cout << "Todas las pruebas de las lapidas son correctas\n";
+	else cout << "Alguna prueba de las lapidas ha fallado\n";
+	return all_ok ? 0 : 1;
+}
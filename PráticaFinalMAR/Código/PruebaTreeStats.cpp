@@ -0,0 +1,272 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba de las estadsticas del rbol-B (TreeStats.h) con la poltica de reserva por defecto (NodePool, que libera
+todo de golpe), con HeapNodeAllocator (que libera los nodos uno a uno), con FixedBTree y con CountedBTree:
+- Despus de cada operacin, nodes_allocated - nodes_freed tiene que ser el nmero de nodos de shape().
+- Mientras no se reconstruye el rbol (bulk_load o clear), la altura tiene que ser 1 + root_splits - root_collapses;
+  con inserciones crecientes o decrecientes no hay merges ni prstamos y root_splits es la altura menos 1.
+- clear libera los nodos (con NodePool, con releaseAll) pero no borra los contadores: los splits, merges y dems
+  siguen igual, y despus de clear solo queda la raz nueva sin liberar.
+- searches cuenta una por key buscada (tambin con search_batch y search_many) y los nodos visitados por bsqueda no
+  pasan de la altura; tombstones y compactions cuentan las lpidas y las compactaciones.
+
+*/
+
+#include "BTree.h"
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/** Tandas de operaciones de la prueba aleatoria */
+const int ROUNDS = 30;
+
+/** Operaciones de cada tanda */
+const int ROUND_OPS = 200;
+
+/** Keys distintas que se usan */
+const int KEY_RANGE = 3000;
+
+/** rboles con estadsticas que se prueban */
+typedef BTree<int, NodePool<Node<int> >, TreeStats> PoolTree;
+typedef BTree<int, HeapNodeAllocator<Node<int> >, TreeStats> HeapTree;
+typedef FixedBTree<int, 5, TreeStats> FixedTree;
+typedef CountedBTree<int, TreeStats> CountedTree;
+
+
+/** Ejecuta f sin que lo que escribe en cout (keys que no estn) salga por pantalla */
+template <class F>
+void quiet(F f) {
+	ostringstream out;
+	streambuf* old = cout.rdbuf(out.rdbuf());
+	f();
+	cout.rdbuf(old);
+}
+
+/** Nodos reservados que no se han liberado */
+template <class Tree>
+uint64_t liveNodes(const Tree& tree) {
+	return tree.stats()[STAT_NODE_ALLOC] - tree.stats()[STAT_NODE_FREE];
+}
+
+/** Indica si los nodos reservados y no liberados son los del rbol */
+template <class Tree>
+bool nodesMatch(const Tree& tree) {
+	return liveNodes(tree) == tree.shape()._nodes;
+}
+
+/** Indica si la altura es la que sale de los splits y colapsos de la raz desde que el rbol tena altura base */
+template <class Tree>
+bool heightMatches(const Tree& tree, int base) {
+	const TreeStats& s = tree.stats();
+	return (uint64_t)(tree.shape()._height - base) == s[STAT_ROOT_SPLIT] - s[STAT_ROOT_COLLAPSE];
+}
+
+/**
+Inserciones crecientes y decrecientes en un rbol vaco: solo splits, y root_splits es la altura menos 1.
+
+@param make funcin que crea un rbol vaco
+@return true si todo ha ido bien
+*/
+template <class Tree, class Make>
+bool monotonic(Make make) {
+	bool ok = true;
+	for (int dir : { 1, -1 }) {
+		Tree tree = make();
+		for (int k = 0; ok && k < 20000; k++) {
+			tree.insert(dir * k);
+			if (k % 997 == 0) ok = nodesMatch(tree) && heightMatches(tree, 1);
+		}
+		const TreeStats& s = tree.stats();
+		ok = ok && nodesMatch(tree) && s[STAT_ROOT_SPLIT] == (uint64_t)tree.shape()._height - 1
+			&& tree.shape()._height > 3 && s[STAT_MERGE] == 0 && s[STAT_BORROW_PREV] == 0 && s[STAT_BORROW_NEXT] == 0
+			&& s[STAT_ROOT_COLLAPSE] == 0 && s[STAT_NODE_FREE] == 0 && s[STAT_SPLIT] + s[STAT_ROOT_SPLIT] + 1 == tree.shape()._nodes;
+	}
+	return ok;
+}
+
+/**
+Operaciones aleatorias: despus de cada una, los nodos reservados y no liberados son los del rbol y la altura sale
+de los splits y colapsos de la raz. De vez en cuando se reconstruye con bulk_load o clear (y la altura de base
+cambia). clear no borra los contadores. Al final se llena, se compacta y se vaca.
+
+@param make funcin que crea un rbol vaco
+@return true si todo ha ido bien
+*/
+template <class Tree, class Make>
+bool randomOps(Make make) {
+	Tree tree = make();
+	mt19937 rng(7);
+	vector<char> present(KEY_RANGE, 0); // Keys sin repetir, para poder usar remove_lazy
+	bool ok = true;
+	int base = 1; // Altura cuando se han empezado a contar los cambios de altura
+	uint64_t root_splits = 0, root_collapses = 0, clears = 0, rebuilds = 0;
+	auto consistent = [&tree, &base, &root_splits, &root_collapses]() {
+		const TreeStats& s = tree.stats();
+		return nodesMatch(tree)
+			&& tree.shape()._height - base == (int)(s[STAT_ROOT_SPLIT] - root_splits) - (int)(s[STAT_ROOT_COLLAPSE] - root_collapses);
+	};
+
+	for (int round = 0; ok && round < ROUNDS; round++) {
+		bool growing = round % 6 < 4;
+		for (int op = 0; ok && op < ROUND_OPS; op++) {
+			int what = (int)(rng() % 40);
+			int k = (int)(rng() % KEY_RANGE);
+			if (what < (growing ? 20 : 8)) {
+				if (!present[k]) tree.insert(k);
+				present[k] = 1;
+			}
+			else if (what < 28) {
+				if (!tree.isEmpty()) quiet([&tree, k]() { tree.remove(k); });
+				present[k] = 0;
+			}
+			else if (what < 32) {
+				if (!tree.isEmpty() && tree.remove_lazy(k)) present[k] = 0;
+			}
+			else if (what < 34) {
+				vector<int> batch;
+				for (int j = 0; j < 30; j++) {
+					int x = (int)(rng() % KEY_RANGE);
+					if (!present[x]) batch.push_back(x);
+					present[x] = 1;
+				}
+				tree.insert_batch(batch.begin(), batch.end());
+			}
+			else if (what < 36) {
+				vector<int> batch;
+				for (int j = 0; j < 30; j++) {
+					int x = (int)(rng() % KEY_RANGE);
+					batch.push_back(x);
+					present[x] = 0;
+				}
+				if (!tree.isEmpty()) quiet([&tree, &batch]() { tree.remove_batch(batch.begin(), batch.end()); });
+			}
+			else if (what < 38) tree.compact_step(1 + rng() % 3);
+			else if (what < 39 && rng() % 8 == 0) { // Se reconstruye con las keys que tiene
+				vector<int> keys;
+				tree.for_each([&keys](const int& x) { keys.push_back(x); });
+				tree.bulk_load(keys.begin(), keys.end(), 0.7);
+				base = tree.shape()._height;
+				root_splits = tree.stats()[STAT_ROOT_SPLIT];
+				root_collapses = tree.stats()[STAT_ROOT_COLLAPSE];
+				rebuilds++;
+			}
+			else if (what == 39 && rng() % 10 == 0) { // clear no borra los contadores
+				TreeStats before = tree.stats();
+				tree.clear();
+				fill(present.begin(), present.end(), 0);
+				for (int e = 0; e < STAT_EVENTS; e++) {
+					StatEvent ev = (StatEvent)e;
+					if (ev != STAT_NODE_FREE) ok = ok && tree.stats()[ev] == before[ev] + (ev == STAT_NODE_ALLOC ? 1 : 0);
+				}
+				ok = ok && liveNodes(tree) == 1 && tree.isEmpty() && tree.shape()._nodes == 1;
+				base = 1;
+				root_splits = tree.stats()[STAT_ROOT_SPLIT];
+				root_collapses = tree.stats()[STAT_ROOT_COLLAPSE];
+				clears++;
+			}
+			ok = ok && consistent();
+		}
+	}
+
+	// Al final se llena, se pone lpida a la mitad de las keys, se compacta poco a poco y se vaca, para que con
+	// cualquier orden haya compactaciones y colapsos de la raz
+	for (int k = 0; ok && k < KEY_RANGE; k++) {
+		if (!present[k]) tree.insert(k);
+		present[k] = 1;
+		ok = consistent();
+	}
+	ok = ok && tree.shape()._height > 1;
+	for (int k = 0; ok && k < KEY_RANGE; k += 2) ok = tree.remove_lazy(k) && consistent();
+	while (ok && tree.needs_compaction()) {
+		tree.compact_step(1);
+		ok = consistent();
+	}
+	tree.compact(); // Las lpidas de los nodos que no llegan a la fraccin
+	ok = ok && tree.n_dead() == 0 && consistent();
+	for (int k = 1; ok && k < KEY_RANGE; k += 2) {
+		tree.remove(k);
+		ok = consistent();
+	}
+	const TreeStats& s = tree.stats();
+	ok = ok && tree.isEmpty() && tree.shape()._height == 1
+		&& clears > 0 && rebuilds > 0 && s[STAT_MERGE] > 0 && s[STAT_BORROW_PREV] > 0 && s[STAT_BORROW_NEXT] > 0
+		&& s[STAT_ROOT_COLLAPSE] > 0 && s[STAT_TOMBSTONE] > 0 && s[STAT_COMPACTION] > 0;
+	return ok;
+}
+
+/**
+Bsquedas, lpidas y compactaciones: searches cuenta cada key buscada (con search, search_batch y search_many), los
+nodos visitados por bsqueda no pasan de la altura y cada remove_lazy que pone una lpida y cada compactacin cuentan.
+
+@param make funcin que crea un rbol vaco
+@return true si todo ha ido bien
+*/
+template <class Tree, class Make>
+bool searches(Make make) {
+	Tree tree = make();
+	for (int k = 0; k < 5000; k++) tree.insert(k * 2);
+	TreeStats before = tree.stats();
+	const TreeStats& s = tree.stats();
+	int height = tree.shape()._height;
+
+	for (int k = -10; k < 10010; k++) tree.search(k);
+	vector<int> keys;
+	for (int k = 0; k < 777; k++) keys.push_back(k * 13 % 10000);
+	tree.search_batch(keys.begin(), keys.end());
+	tree.search_many(keys.begin(), keys.end());
+	uint64_t n = 10020 + 2 * keys.size();
+	bool ok = s[STAT_SEARCH] - before[STAT_SEARCH] == n && s[STAT_SEARCH_NODES] - before[STAT_SEARCH_NODES] >= n
+		&& s[STAT_SEARCH_NODES] - before[STAT_SEARCH_NODES] <= n * height
+		&& s[STAT_SEARCH_KEYS] >= s[STAT_SEARCH_NODES] - before[STAT_SEARCH_NODES];
+
+	uint64_t tombstones = s[STAT_TOMBSTONE], compactions = s[STAT_COMPACTION];
+	for (int k = 0; k < 1000; k++) tree.remove_lazy(k * 2);
+	for (int k = 0; k < 1000; k++) tree.remove_lazy(k * 2); // Ya tienen lpida: no cuentan
+	tree.remove_lazy(1);                                     // No est: no cuenta
+	ok = ok && s[STAT_TOMBSTONE] - tombstones == 1000;
+	tree.compact_step(1);
+	tree.compact();
+	ok = ok && s[STAT_COMPACTION] - compactions >= 1 && tree.n_dead() == 0 && nodesMatch(tree);
+
+	ostringstream json;
+	tree.stats_json(json);
+	ok = ok && json.str().find("\"nodes_allocated\": " + to_string(s[STAT_NODE_ALLOC])) != string::npos
+		&& json.str().find("\"tombstones\": " + to_string(s[STAT_TOMBSTONE])) != string::npos;
+	return ok;
+}
+
+/**
+Todas las pruebas con un tipo de rbol.
+
+@param name nombre del rbol para el mensaje
+@param make funcin que crea un rbol vaco
+@return true si todo ha ido bien
+*/
+template <class Tree, class Make>
+bool test(const string& name, Make make) {
+	bool ok = monotonic<Tree>(make) && randomOps<Tree>(make) && searches<Tree>(make);
+	cout << "Estadisticas con " << name << ": " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+
+int main() {
+	bool all_ok = true;
+	for (int order : { 3, 4, 16 }) {
+		all_ok = test<PoolTree>("NodePool de orden " + to_string(order), [order]() { return PoolTree(order); }) && all_ok;
+		all_ok = test<HeapTree>("HeapNodeAllocator de orden " + to_string(order), [order]() { return HeapTree(order); }) && all_ok;
+	}
+	all_ok = test<FixedTree>("FixedBTree<int, 5>", []() { return FixedTree(); }) && all_ok;
+	all_ok = test<CountedTree>("CountedBTree de orden 4", []() { return CountedTree(4); }) && all_ok;
+
+	if (all_ok) cout << "Todas las pruebas de las estadisticas son correctas\n";
+	else cout << "Alguna prueba de las estadisticas ha fallado\n";
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,283 @@
+/*
+lvaro Corrochano Lpez
+
+Prueba de la recuperacin de DurableBTree y WriteAheadLog (WAL.h):
+- Un registro con basura al final (un registro a medio escribir) se recupera hasta la ltima operacin completa.
+- Si el programa se cae tras escribir el checkpoint y antes de vaciar el registro, al recuperar se saltan las
+  operaciones que ya estaban en el checkpoint y solo se aplican las posteriores.
+- Si falla una escritura del registro, lo que no se pudo escribir se reintenta en el siguiente commit sin dejar
+  huecos; si el fichero no se puede arreglar, el registro deja de aceptar operaciones.
+- Un proceso hijo escribe sin parar y se mata con SIGKILL: todo lo que haba confirmado con sync tiene que estar.
+Las dos ltimas solo en sistemas POSIX.
+
+*/
+
+#include "WAL.h"
+
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define PRUEBA_POSIX 1
+#endif
+
+using namespace std;
+
+/** Ruta (sin extensin) de los ficheros de las pruebas */
+const string PATH = "prueba_wal";
+
+/** Borra los ficheros de un DurableBTree */
+void removeFiles(const string& path) {
+	remove((path + ".wal").c_str());
+	remove((path + ".ckpt").c_str());
+	remove((path + ".ckpt.tmp").c_str());
+}
+
+/** Lee un fichero entero (vaco si no existe) */
+string readFile(const string& path) {
+	string s;
+	FILE* f = fopen(path.c_str(), "rb");
+	if (f == NULL) return s;
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0) s.append(buf, n);
+	fclose(f);
+	return s;
+}
+
+/** Escribe un fichero entero (append para aadir al final) */
+void writeFile(const string& path, const string& s, bool append = false) {
+	FILE* f = fopen(path.c_str(), append ? "ab" : "wb");
+	fwrite(s.data(), 1, s.size(), f);
+	fclose(f);
+}
+
+/** Keys del rbol en orden */
+vector<int> keysOf(const DurableBTree<int>& tree) {
+	vector<int> keys;
+	tree.for_each([&keys](const int& k) { keys.push_back(k); });
+	return keys;
+}
+
+/**
+Operacin j de las pruebas: si j es mltiplo de 3 se elimina la key j - 2 (que se insert antes), si no se inserta j.
+As se mezclan inserciones y eliminaciones y se sabe qu keys tiene que haber tras las l primeras operaciones.
+*/
+void operation(DurableBTree<int>& tree, uint64_t j) {
+	if (j % 3 == 0) tree.remove((int)(j - 2));
+	else tree.insert((int)j);
+}
+
+/** Keys que tiene que haber tras las operaciones 1..l */
+vector<int> expected(uint64_t l) {
+	set<int> s;
+	for (uint64_t j = 1; j <= l; j++) {
+		if (j % 3 == 0) s.erase((int)(j - 2));
+		else s.insert((int)j);
+	}
+	return vector<int>(s.begin(), s.end());
+}
+
+/**
+Registro con un registro a medio escribir al final: se recupera hasta la ltima operacin completa y se puede
+seguir escribiendo detrs.
+
+@return true si todo ha ido bien
+*/
+bool tornTail() {
+	removeFiles(PATH);
+	{
+		DurableBTree<int> tree(PATH, 3, 8);
+		for (uint64_t j = 1; j <= 100; j++) operation(tree, j);
+		tree.sync();
+	}
+	string wal = readFile(PATH + ".wal");
+	writeFile(PATH + ".wal", wal.substr(0, wal.size() - WriteAheadLog<int>::RECORD_BYTES / 2)); // La ltima a medias
+	writeFile(PATH + ".wal", "basura", true);
+
+	bool ok;
+	{
+		DurableBTree<int> tree(PATH, 3, 8);
+		ok = tree.lsn() == 99 && keysOf(tree) == expected(99);
+		for (uint64_t j = 100; j <= 120; j++) operation(tree, j);
+	}
+	{
+		DurableBTree<int> tree(PATH, 3, 8);
+		ok = ok && tree.lsn() == 120 && keysOf(tree) == expected(120);
+	}
+	cout << "Registro con el final a medio escribir: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+Cada entre el checkpoint y el vaciado del registro: el registro an tiene operaciones que ya estn en el checkpoint
+(y detrs otras que no). Al recuperar, las primeras se saltan por su LSN y las dems se aplican una sola vez.
+
+@return true si todo ha ido bien
+*/
+bool checkpointSkip() {
+	removeFiles(PATH);
+	string before;
+	{
+		DurableBTree<int> tree(PATH, 4, 16);
+		for (uint64_t j = 1; j <= 60; j++) operation(tree, j);
+		tree.sync();
+		before = readFile(PATH + ".wal"); // Operaciones 1..60
+		tree.checkpoint();                // Checkpoint con LSN 60 y registro vaco
+		for (uint64_t j = 61; j <= 80; j++) operation(tree, j);
+		tree.sync();
+	}
+	writeFile(PATH + ".wal", before + readFile(PATH + ".wal")); // Como si no se hubiera vaciado
+
+	bool ok;
+	{
+		DurableBTree<int> tree(PATH, 4, 16);
+		ok = tree.lsn() == 80 && keysOf(tree) == expected(80); // Con las inserciones repetidas habra keys de ms
+	}
+	{
+		DurableBTree<int> tree(PATH, 4, 16); // La recuperacin deja un checkpoint nuevo y el registro vaco
+		ok = ok && tree.lsn() == 80 && keysOf(tree) == expected(80) && tree.log().empty();
+	}
+	cout << "Registro con operaciones que ya estaban en el checkpoint: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+#ifdef PRUEBA_POSIX
+
+/**
+Escritura fallida: con un lmite de tamao de fichero (RLIMIT_FSIZE) el grupo se escribe a medias y commit falla.
+Al quitar el lmite, el siguiente sync escribe lo que faltaba y el registro se puede leer entero, sin huecos.
+Despus, con un registro en /dev/full (que no se puede recortar), el registro queda inutilizable.
+
+@return true si todo ha ido bien
+*/
+bool failedWrite() {
+	signal(SIGXFSZ, SIG_IGN); // Sin esto, pasar del lmite mata el proceso en vez de hacer fallar la escritura
+	string path = PATH + ".wal";
+	remove(path.c_str());
+	const size_t rec = WriteAheadLog<int>::RECORD_BYTES;
+	bool ok = true;
+
+	rlimit old;
+	getrlimit(RLIMIT_FSIZE, &old);
+	{
+		WriteAheadLog<int> log(path, 1, 1000);
+		for (int i = 0; i < 10; i++) log.append(WAL_INSERT, i);
+		log.sync();
+
+		rlimit lim = old;
+		lim.rlim_cur = 13 * rec + rec / 2; // Caben 3 operaciones y media ms
+		setrlimit(RLIMIT_FSIZE, &lim);
+		for (int i = 10; i < 20; i++) log.append(WAL_INSERT, i);
+		bool threw = false;
+		try {
+			log.sync();
+		}
+		catch (E_BTree_File&) {
+			threw = true;
+		}
+		setrlimit(RLIMIT_FSIZE, &old);
+		ok = threw && !log.failed() && log.durable() == 10 && readFile(path).size() == 10 * rec;
+
+		for (int i = 20; i < 25; i++) log.append(WAL_INSERT, i);
+		log.sync();
+		ok = ok && log.durable() == 25;
+	}
+	uint64_t lsn = 0;
+	vector<int> keys;
+	WriteAheadLog<int>::replay(path, lsn, [&keys](char, const int& k) { keys.push_back(k); });
+	ok = ok && lsn == 25 && keys.size() == 25;
+	for (size_t i = 0; ok && i < keys.size(); i++) ok = keys[i] == (int)i;
+	remove(path.c_str());
+
+	{
+		WriteAheadLog<int> log("/dev/full", 1, 4);
+		int threw = 0;
+		try {
+			for (int i = 0; i < 8; i++) log.append(WAL_INSERT, i);
+		}
+		catch (E_BTree_File&) {
+			threw++;
+		}
+		try {
+			log.append(WAL_INSERT, 8);
+		}
+		catch (E_BTree_File&) {
+			threw++;
+		}
+		ok = ok && threw == 2 && log.failed();
+	}
+	cout << "Escritura fallida del registro: " << (ok ? "correcto" : "INCORRECTO") << '\n';
+	return ok;
+}
+
+/**
+Cadas de verdad: un hijo hace operaciones sin parar (con checkpoints frecuentes) y manda por una tubera el LSN
+de cada sync; se le mata con SIGKILL en un momento distinto cada vez. Al recuperar tiene que estar al menos hasta
+el ltimo LSN confirmado, y las keys tienen que ser exactamente las de ese prefijo de operaciones.
+
+@param rounds nmero de cadas
+
+@return true si todo ha ido bien
+*/
+bool killRecovery(int rounds) {
+	removeFiles(PATH);
+	uint64_t last = 0;
+	for (int round = 0; round < rounds; round++) {
+		int fd[2];
+		if (pipe(fd) != 0) return false;
+		pid_t pid = fork();
+		if (pid == 0) {
+			close(fd[0]);
+			DurableBTree<int> tree(PATH, 3, 64, 5000);
+			for (uint64_t j = tree.lsn() + 1; ; j++) {
+				operation(tree, j);
+				if (j % 97 == 0) {
+					tree.sync();
+					if (write(fd[1], &j, sizeof(j)) != sizeof(j)) _exit(1);
+				}
+			}
+		}
+		close(fd[1]);
+		usleep(2000 + (round * 7919) % 30000);
+		kill(pid, SIGKILL);
+		int status;
+		waitpid(pid, &status, 0);
+		uint64_t acked = 0, x;
+		while (read(fd[0], &x, sizeof(x)) == sizeof(x)) acked = x;
+		close(fd[0]);
+
+		DurableBTree<int> tree(PATH, 3, 64, 5000);
+		if (tree.lsn() < acked || tree.lsn() < last || keysOf(tree) != expected(tree.lsn())) {
+			cout << "Caida " << round << ": recuperado hasta " << tree.lsn() << " con " << acked << " confirmadas: INCORRECTO\n";
+			return false;
+		}
+		last = tree.lsn();
+	}
+	cout << rounds << " caidas con SIGKILL: correcto (" << last << " operaciones)\n";
+	return true;
+}
+
+#endif
+
+
+int main() {
+	bool all_ok = tornTail();
+	all_ok = checkpointSkip() && all_ok;
+#ifdef PRUEBA_POSIX
+	all_ok = failedWrite() && all_ok;
+	all_ok = killRecovery(20) && all_ok;
+#endif
+	removeFiles(PATH);
+
+	if (all_ok) cout << "Todas las pruebas de recuperacion son correctas\n";
+	else cout << "Alguna prueba de recuperacion ha fallado\n";
+	return all_ok ? 0 : 1;
+}
@@ -0,0 +1,616 @@
+/*
+- rbol-B repartido por rangos de keys entre varios rboles-B, cada uno con su propio hilo
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __SHARDEDBTREE_H
+#define __SHARDEDBTREE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "BTree.h"
+#include "Epoch.h"
+
+/** Operaciones que caben en la cola de cada particin (potencia de 2) */
+const size_t SHARD_QUEUE = 4096;
+
+/** Vueltas (cediendo el ncleo) que da un hilo de particin sin trabajo antes de dormirse */
+const int SHARD_IDLE_SPINS = 256;
+
+/** Milisegundos entre dos pasadas del reequilibrador */
+const int REBALANCE_MS = 100;
+
+/** Se reequilibra si la particin ms grande tiene ms de SHARD_SKEW veces la media de keys */
+const double SHARD_SKEW = 1.5;
+
+/** Diferencia mnima de keys entre dos particiones vecinas para mover su frontera */
+const size_t REBALANCE_MIN = 1024;
+
+/**
+  Cola acotada de varios productores y un consumidor sin cerrojos (la de Vyukov). Cada casilla lleva un nmero de
+  secuencia que dice de quin es el turno: los productores se reservan una casilla con un compare_exchange sobre
+  _tail y la publican cambiando su secuencia; el consumidor solo lee la secuencia de la casilla de _head.
+  */
+template <class E>
+class MPSCQueue {
+
+public:
+
+    /** Constructor
+
+    @param capacity nmero de casillas (potencia de 2)
+    */
+    explicit MPSCQueue(size_t capacity) : _cells(new Cell[capacity]), _mask(capacity - 1), _head(0), _tail(0) {
+        for (size_t i = 0; i < capacity; i++) _cells[i]._seq.store(i, std::memory_order_relaxed);
+    }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    /** Aade e al final (desde cualquier hilo)
+
+    @param e elemento
+
+    @return false si la cola est llena
+    */
+    bool push(const E& e) {
+        size_t pos = _tail.load(std::memory_order_relaxed);
+        Cell* c;
+        while (true) {
+            c = &_cells[pos & _mask];
+            size_t seq = c->_seq.load(std::memory_order_acquire);
+            long diff = (long)seq - (long)pos;
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) return false; // La casilla an no la ha vaciado el consumidor
+            else pos = _tail.load(std::memory_order_relaxed);
+        }
+        c->_value = e;
+        c->_seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Saca el primer elemento (solo desde el hilo consumidor)
+
+    @param e donde se deja el elemento
+
+    @return false si la cola est vaca
+    */
+    bool pop(E& e) {
+        Cell* c = &_cells[_head & _mask];
+        if (c->_seq.load(std::memory_order_acquire) != _head + 1) return false;
+        e = c->_value;
+        c->_seq.store(_head + _mask + 1, std::memory_order_release);
+        _head++;
+        return true;
+    }
+
+    /** Indica si la cola est vaca (solo desde el hilo consumidor) */
+    bool empty() const {
+        return _cells[_head & _mask]._seq.load(std::memory_order_acquire) != _head + 1;
+    }
+
+private:
+
+    /** Casilla de la cola */
+    struct Cell {
+        std::atomic<size_t> _seq; // pos si est libre para el productor de pos, pos + 1 si tiene el elemento de pos
+        E _value;                 // elemento
+    };
+
+    std::unique_ptr<Cell[]> _cells;       // casillas
+    size_t _mask;                         // capacidad - 1
+    alignas(64) size_t _head;             // siguiente posicin que lee el consumidor
+    alignas(64) std::atomic<size_t> _tail; // siguiente posicin que se reservan los productores
+};
+
+/**
+
+Clase que representa a un rbol-B repartido por rangos de keys en N particiones. Cada particin es un BTree
+independiente del que solo se ocupa su propio hilo, as que no hay una raz (ni unos niveles de arriba) por la que
+compitan todos los hilos que escriben.
+
+- Las fronteras son N - 1 keys ordenadas: la particin i tiene las keys k con frontera[i - 1] <= k < frontera[i].
+- Cada operacin se manda a la cola (MPSCQueue) de su particin y la aplica el hilo de la particin en el orden en
+  que llega. insert no espera; remove, search y las consultas de rango esperan la respuesta, as que lo que hace un
+  hilo siempre se aplica en el orden en que lo pide. flush espera a que se apliquen todas las operaciones anteriores.
+- Un reequilibrador mira cada REBALANCE_MS el nmero de keys de cada particin y, si est descompensado, mueve la
+  frontera entre las dos particiones vecinas ms distintas para que queden con las mismas keys. Para moverla deja
+  esperando a los hilos que mandan operaciones, espera a que salgan los que ya estaban eligiendo particin (con las
+  pocas de Epoch.h), para los hilos de esas dos particiones cuando han aplicado todo lo que tenan en la cola,
+  reconstruye los dos rboles con bulk_load y cambia la frontera. As ninguna operacin va a la particin vieja
+  despus de moverse su key.
+- range y for_each piden las keys a todas las particiones a la vez y las juntan en orden: como cada particin es un
+  rango, basta con ir una detrs de otra.
+
+@author lvaro Corrochano Lpez
+
+*/
+template <class T>
+class ShardedBTree {
+
+public:
+
+    /**
+    Constructor con las fronteras entre particiones (tantas particiones como fronteras ms una), cada una con un rbol
+    vaco de nodos de size keys. Si las fronteras no reparten bien las keys, el reequilibrador las ir moviendo.
+
+    Error: Si las fronteras no estn ordenadas de forma creciente, lanza una excepcin E_BTree_Unsorted
+    Error: Si el tamao especificado es menor que 2, lanza una excepcin E_BTree_Lower
+    Error: Si el tamao especificado es mayor que 1000, lanza una excepcin E_BTree_Bigger
+
+    @param bounds fronteras entre las particiones
+    @param size nmero mximo de keys que puede almacenar el nodo
+    @param rebalance indica si se lanza el hilo reequilibrador (si no, solo se reequilibra llamando a rebalance)
+    */
+    explicit ShardedBTree(const vector<T>& bounds, int size = DEFAULT_SIZE, bool rebalance = true) : _bounds(bounds),
+        _shards(), _epoch(), _moving(false), _rebalance_m(), _stop_m(), _stop_cv(), _stop(false), _rebalancer() {
+        if (!is_sorted(bounds.begin(), bounds.end())) throw E_BTree_Unsorted();
+        for (size_t i = 0; i <= bounds.size(); i++) _shards.push_back(unique_ptr<Shard>(new Shard(size)));
+        for (size_t i = 0; i < _shards.size(); i++) {
+            Shard* s = _shards[i].get();
+            s->_worker = thread([s]() { work(*s); });
+        }
+        if (rebalance) _rebalancer = thread([this]() { rebalanceLoop(); });
+    }
+
+    ShardedBTree(const ShardedBTree&) = delete;
+    ShardedBTree& operator=(const ShardedBTree&) = delete;
+
+    /** Destructor, aplica las operaciones pendientes y para todos los hilos */
+    ~ShardedBTree() {
+        {
+            lock_guard<mutex> lock(_stop_m);
+            _stop = true;
+        }
+        _stop_cv.notify_all();
+        if (_rebalancer.joinable()) _rebalancer.join();
+        for (size_t i = 0; i < _shards.size(); i++) push(*_shards[i], Op(OP_STOP));
+        for (size_t i = 0; i < _shards.size(); i++) _shards[i]->_worker.join();
+    }
+
+    /** Devuelve el nmero de particiones
+
+    @return nmero de particiones
+    */
+    size_t shards() const {
+        return _shards.size();
+    }
+
+    /**
+    Funcin para insertar un elemento en el rbol. No espera a que se inserte: se aplica en orden con las dems
+    operaciones del mismo hilo.
+
+    @param k elemento a insertar en el rbol.
+    */
+    void insert(const T& k) {
+        route([this, &k]() { push(*_shards[shardOf(k)], Op(OP_INSERT, k)); });
+    }
+
+    /**
+    Funcin para eliminar el elemento k del rbol (si est repetido, una sola vez). Espera a que se elimine.
+
+    @param k elemento a eliminar
+
+    @return true si k estaba en el rbol
+    */
+    bool remove(const T& k) {
+        Reply r;
+        route([this, &k, &r]() { push(*_shards[shardOf(k)], Op(OP_REMOVE, k, &r)); });
+        wait(r);
+        return r._found;
+    }
+
+    /** Busca el elemento pasado por parmetro en el rbol. Espera a que lo busque el hilo de su particin.
+
+      @param k elemento a buscar en el rbol.
+
+      @return true si la clave est en el rbol
+    */
+    bool search(const T& k) {
+        Reply r;
+        route([this, &k, &r]() { push(*_shards[shardOf(k)], Op(OP_SEARCH, k, &r)); });
+        wait(r);
+        return r._found;
+    }
+
+    /**
+    Devuelve las keys del intervalo [lo, hi) en orden. Cada particin que se cruza con el intervalo saca sus keys a la
+    vez que las dems (for_each_range en su rbol) y se juntan una detrs de otra.
+
+    @param lo cota inferior (incluida)
+    @param hi cota superior (excluida)
+
+    @return keys k con lo <= k < hi, en orden creciente
+    */
+    vector<T> range(const T& lo, const T& hi) {
+        if (!(lo < hi)) return vector<T>();
+        size_t first = 0, last = 0;
+        vector<vector<T> > parts;
+        vector<Reply> replies;
+        route([&]() {
+            first = shardOf(lo);
+            last = shardOf(hi);
+            parts.assign(last - first + 1, vector<T>());
+            replies = vector<Reply>(last - first + 1);
+            for (size_t i = first; i <= last; i++) {
+                replies[i - first]._keys = &parts[i - first];
+                push(*_shards[i], Op(OP_RANGE, lo, &replies[i - first], hi));
+            }
+        });
+        return join(parts, replies);
+    }
+
+    /**
+    Funcin que aplica f a cada key del rbol, en orden creciente. Primero se copian las keys de todas las
+    particiones (a la vez) y despus se recorren desde el hilo que llama.
+
+    @param f funcin que recibe cada key (const T&)
+    */
+    template <class F>
+    void for_each(F f) {
+        vector<T> keys = all();
+        for (size_t i = 0; i < keys.size(); i++) f(keys[i]);
+    }
+
+    /**
+    Funcin para recorrer el rbol, va sacando las keys guardadas en orden (siempre creciente).
+
+    @param out flujo en el que se sacan (por defecto la salida estndar)
+    */
+    void traverse(ostream& out = cout) {
+        for_each([&out](const T& k) { out << " " << k; });
+    }
+
+    /** Espera a que se apliquen todas las operaciones mandadas antes (por cualquier hilo) */
+    void flush() {
+        vector<Reply> replies;
+        route([&]() {
+            replies = vector<Reply>(_shards.size());
+            for (size_t i = 0; i < _shards.size(); i++) push(*_shards[i], Op(OP_BARRIER, T(), &replies[i]));
+        });
+        for (size_t i = 0; i < replies.size(); i++) wait(replies[i]);
+    }
+
+    /** Devuelve el nmero de keys del rbol (exacto si no hay operaciones pendientes, ver flush)
+
+    @return nmero de keys
+    */
+    size_t size() const {
+        size_t n = 0;
+        for (size_t i = 0; i < _shards.size(); i++) n += _shards[i]->_keys.load(memory_order_relaxed);
+        return n;
+    }
+
+    /** Devuelve el nmero de keys de cada particin (exacto si no hay operaciones pendientes)
+
+    @return keys de cada particin, en orden
+    */
+    vector<size_t> shard_sizes() const {
+        vector<size_t> n;
+        for (size_t i = 0; i < _shards.size(); i++) n.push_back(_shards[i]->_keys.load(memory_order_relaxed));
+        return n;
+    }
+
+    /**
+    Hace una pasada del reequilibrador: si la particin ms grande tiene ms de SHARD_SKEW veces la media de keys,
+    busca las dos particiones vecinas con ms diferencia de keys (al menos REBALANCE_MIN) y mueve su frontera para que
+    la mitad de la diferencia pase de la grande a la pequea (sin separar keys repetidas). Como las keys solo pasan
+    a una vecina, una particin muy cargada se reparte en varias pasadas.
+    Complejidad: O(n) en las keys de las dos particiones
+
+    @return true si se ha movido alguna frontera
+    */
+    bool rebalance() {
+        lock_guard<mutex> lock(_rebalance_m);
+        vector<size_t> n = shard_sizes();
+        size_t total = 0, max = 0;
+        for (size_t i = 0; i < n.size(); i++) {
+            total += n[i];
+            if (n[i] > max) max = n[i];
+        }
+        if (n.size() < 2 || max * n.size() <= SHARD_SKEW * total) return false;
+
+        size_t b = 0, diff = 0; // Frontera entre las particiones b y b + 1
+        for (size_t i = 0; i + 1 < n.size(); i++) {
+            size_t d = n[i] > n[i + 1] ? n[i] - n[i + 1] : n[i + 1] - n[i];
+            if (d > diff) {
+                diff = d;
+                b = i;
+            }
+        }
+        if (diff < REBALANCE_MIN) return false;
+
+        _moving.store(true); // Los hilos que mandan operaciones esperan
+        _epoch.synchronize(); // y los que ya haban elegido particin han terminado de mandarlas
+        Shard& left = *_shards[b];
+        Shard& right = *_shards[b + 1];
+        hold(left);
+        hold(right);
+        waitParked(left, true);
+        waitParked(right, true);
+
+        bool moved = moveBound(b, left, right);
+
+        left._hold.store(false, memory_order_release);
+        right._hold.store(false, memory_order_release);
+        waitParked(left, false); // Si no, con la siguiente pasada podra no ver nunca que se le ha soltado
+        waitParked(right, false);
+        _moving.store(false);
+        return moved;
+    }
+
+    /** Devuelve las fronteras entre las particiones (solo cuando no hay otros hilos usando el rbol)
+
+    @return fronteras, en orden
+    */
+    const vector<T>& bounds() const {
+        return _bounds;
+    }
+
+private:
+
+    /** Tipos de operacin que aplica el hilo de una particin */
+    enum OpKind { OP_INSERT, OP_REMOVE, OP_SEARCH, OP_RANGE, OP_ALL, OP_BARRIER, OP_HOLD, OP_STOP };
+
+    /** Respuesta a una operacin: el que la manda espera a que _done sea true */
+    struct Reply {
+        Reply() : _done(false), _found(false), _keys(NULL) {}
+        Reply(const Reply&) : _done(false), _found(false), _keys(NULL) {}
+
+        atomic<bool> _done;  // el hilo de la particin ya ha aplicado la operacin
+        bool _found;         // resultado de search y remove
+        vector<T>* _keys;    // donde se dejan las keys en OP_RANGE y OP_ALL
+    };
+
+    /** Operacin en la cola de una particin */
+    struct Op {
+        Op() : _kind(OP_STOP), _key(), _hi(), _reply(NULL) {}
+        explicit Op(OpKind kind, const T& key = T(), Reply* reply = NULL, const T& hi = T()) : _kind(kind), _key(key),
+            _hi(hi), _reply(reply) {}
+
+        OpKind _kind;    // tipo de operacin
+        T _key;          // key (o cota inferior en OP_RANGE)
+        T _hi;           // cota superior en OP_RANGE
+        Reply* _reply;   // respuesta (NULL en OP_INSERT, OP_HOLD y OP_STOP)
+    };
+
+    /** Una particin: su rbol, su cola y su hilo */
+    struct Shard {
+        explicit Shard(int size) : _tree(size), _queue(SHARD_QUEUE), _keys(0), _sleeping(false), _hold(false),
+            _parked(false), _m(), _cv(), _worker() {}
+
+        BTree<T> _tree;                  // keys de la particin (solo las toca su hilo)
+        MPSCQueue<Op> _queue;            // operaciones pendientes
+        alignas(64) atomic<size_t> _keys; // nmero de keys del rbol
+        atomic<bool> _sleeping;          // el hilo est dormido esperando operaciones
+        atomic<bool> _hold;              // el hilo tiene que quedarse parado tras OP_HOLD
+        atomic<bool> _parked;            // el hilo est parado en OP_HOLD
+        mutex _m;                        // para dormir y despertar al hilo
+        condition_variable _cv;
+        thread _worker;                  // hilo de la particin
+    };
+
+    /** Particin a la que va k (solo dentro de route) */
+    size_t shardOf(const T& k) const {
+        return upper_bound(_bounds.begin(), _bounds.end(), k) - _bounds.begin();
+    }
+
+    /**
+    Funcin que ejecuta f (que elige particiones y les manda operaciones) dentro de una poca, esperando antes si se
+    est moviendo una frontera. Mientras se ejecuta f las fronteras no cambian.
+
+    @param f funcin que manda las operaciones
+    */
+    template <class F>
+    void route(F f) {
+        while (true) {
+            {
+                EpochGuard guard(_epoch);
+                if (!_moving.load()) {
+                    f();
+                    return;
+                }
+            }
+            this_thread::yield();
+        }
+    }
+
+    /** Aade op a la cola de la particin (esperando si est llena) y despierta a su hilo si est dormido */
+    static void push(Shard& s, const Op& op) {
+        while (!s._queue.push(op)) this_thread::yield();
+        atomic_thread_fence(memory_order_seq_cst); // Con la de work: o el hilo ve la operacin o aqu se ve que duerme
+        if (s._sleeping.load(memory_order_relaxed)) {
+            lock_guard<mutex> lock(s._m);
+            s._cv.notify_one();
+        }
+    }
+
+    /** Espera a que el hilo de una particin aplique una operacin */
+    static void wait(const Reply& r) {
+        while (!r._done.load(memory_order_acquire)) this_thread::yield();
+    }
+
+    /** Manda a la particin que se pare cuando llegue a esta operacin, hasta que se ponga _hold a false */
+    static void hold(Shard& s) {
+        s._hold.store(true, memory_order_relaxed);
+        push(s, Op(OP_HOLD));
+    }
+
+    /** Espera a que el hilo de la particin est parado en OP_HOLD (parked true) o haya salido (false) */
+    static void waitParked(const Shard& s, bool parked) {
+        while (s._parked.load(memory_order_acquire) != parked) this_thread::yield();
+    }
+
+    /** Bucle del hilo de una particin: aplica operaciones y, si no le llegan, cede el ncleo y al final se duerme */
+    static void work(Shard& s) {
+        Op op;
+        int idle = 0;
+        while (true) {
+            if (s._queue.pop(op)) {
+                idle = 0;
+                if (!apply(s, op)) return;
+                continue;
+            }
+            if (++idle < SHARD_IDLE_SPINS) {
+                this_thread::yield();
+                continue;
+            }
+            unique_lock<mutex> lock(s._m);
+            s._sleeping.store(true, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            if (s._queue.empty()) s._cv.wait_for(lock, chrono::milliseconds(1)); // Con tiempo mximo por si acaso
+            s._sleeping.store(false, memory_order_relaxed);
+            idle = 0;
+        }
+    }
+
+    /**
+    Aplica una operacin en el rbol de la particin y marca su respuesta.
+
+    @return false si es OP_STOP (el hilo tiene que terminar)
+    */
+    static bool apply(Shard& s, const Op& op) {
+        BTree<T>& tree = s._tree;
+        switch (op._kind) {
+        case OP_INSERT:
+            tree.insert(op._key);
+            s._keys.store(s._keys.load(memory_order_relaxed) + 1, memory_order_relaxed);
+            return true;
+        case OP_REMOVE:
+            op._reply->_found = !tree.isEmpty() && tree.search(op._key) != NULL;
+            if (op._reply->_found) {
+                tree.remove(op._key);
+                s._keys.store(s._keys.load(memory_order_relaxed) - 1, memory_order_relaxed);
+            }
+            break;
+        case OP_SEARCH:
+            op._reply->_found = !tree.isEmpty() && tree.search(op._key) != NULL;
+            break;
+        case OP_RANGE: {
+            vector<T>* keys = op._reply->_keys;
+            tree.for_each_range(op._key, op._hi, [keys](const T& k) { keys->push_back(k); });
+            break;
+        }
+        case OP_ALL: {
+            vector<T>* keys = op._reply->_keys;
+            keys->reserve(s._keys.load(memory_order_relaxed));
+            tree.for_each([keys](const T& k) { keys->push_back(k); });
+            break;
+        }
+        case OP_BARRIER:
+            break;
+        case OP_HOLD: // El reequilibrador toca el rbol mientras el hilo espera
+            s._parked.store(true, memory_order_release);
+            while (s._hold.load(memory_order_acquire)) this_thread::yield();
+            s._parked.store(false, memory_order_release);
+            return true;
+        case OP_STOP:
+            return false;
+        }
+        op._reply->_done.store(true, memory_order_release);
+        return true;
+    }
+
+    /** Espera las respuestas y junta las keys de cada particin una detrs de otra */
+    static vector<T> join(vector<vector<T> >& parts, const vector<Reply>& replies) {
+        size_t n = 0;
+        for (size_t i = 0; i < replies.size(); i++) {
+            wait(replies[i]);
+            n += parts[i].size();
+        }
+        vector<T> keys;
+        keys.reserve(n);
+        for (size_t i = 0; i < parts.size(); i++) keys.insert(keys.end(), parts[i].begin(), parts[i].end());
+        return keys;
+    }
+
+    /** Todas las keys del rbol en orden, pedidas a la vez a todas las particiones */
+    vector<T> all() {
+        vector<vector<T> > parts;
+        vector<Reply> replies;
+        route([&]() {
+            parts.assign(_shards.size(), vector<T>());
+            replies = vector<Reply>(_shards.size());
+            for (size_t i = 0; i < _shards.size(); i++) {
+                replies[i]._keys = &parts[i];
+                push(*_shards[i], Op(OP_ALL, T(), &replies[i]));
+            }
+        });
+        return join(parts, replies);
+    }
+
+    /**
+    Funcin que pasa la mitad de la diferencia de keys de la mayor de las particiones b y b + 1 a la otra y mueve la
+    frontera b. Se llama con los hilos de las dos particiones parados y sin nadie eligiendo particin, as que toca
+    los rboles directamente.
+
+    @param b frontera que se mueve
+    @param left particin b
+    @param right particin b + 1
+
+    @return true si se ha movido la frontera (no se mueve si para pasar keys habra que separar keys repetidas)
+    */
+    bool moveBound(size_t b, Shard& left, Shard& right) {
+        vector<T> l, r;
+        left._tree.for_each([&l](const T& k) { l.push_back(k); });
+        right._tree.for_each([&r](const T& k) { r.push_back(k); });
+        size_t m = (l.size() > r.size() ? l.size() - r.size() : r.size() - l.size()) / 2;
+        if (m == 0) return false;
+
+        size_t cut; // Las keys l[0..cut) + r se reparten en [0, cut) y [cut, ...)
+        if (l.size() > r.size()) {
+            cut = l.size() - m;
+            cut = lower_bound(l.begin(), l.end(), l[cut]) - l.begin(); // Las repetidas van juntas
+            if (cut == 0) return false;
+            _bounds[b] = l[cut];
+            r.insert(r.begin(), l.begin() + cut, l.end());
+            l.resize(cut);
+        }
+        else {
+            cut = lower_bound(r.begin(), r.end(), r[m]) - r.begin();
+            if (cut == 0) return false;
+            _bounds[b] = r[cut];
+            l.insert(l.end(), r.begin(), r.begin() + cut);
+            r.erase(r.begin(), r.begin() + cut);
+        }
+
+        left._tree.bulk_load(l.begin(), l.end());
+        right._tree.bulk_load(r.begin(), r.end());
+        left._keys.store(l.size(), memory_order_relaxed);
+        right._keys.store(r.size(), memory_order_relaxed);
+        return true;
+    }
+
+    /** Bucle del hilo reequilibrador: una pasada cada REBALANCE_MS hasta que se destruye el rbol */
+    void rebalanceLoop() {
+        unique_lock<mutex> lock(_stop_m);
+        while (!_stop) {
+            _stop_cv.wait_for(lock, chrono::milliseconds(REBALANCE_MS));
+            if (_stop) break;
+            lock.unlock();
+            rebalance();
+            lock.lock();
+        }
+    }
+
+    vector<T> _bounds;                   // fronteras entre particiones (solo cambian con _moving y sin nadie en route)
+    vector<unique_ptr<Shard> > _shards;  // particiones
+    EpochManager _epoch;                 // para saber cundo han terminado de elegir particin los que empezaron antes
+    atomic<bool> _moving;                // se est moviendo una frontera
+    mutex _rebalance_m;                  // solo una pasada del reequilibrador a la vez
+    mutex _stop_m;                       // para despertar al reequilibrador al destruir el rbol
+    condition_variable _stop_cv;
+    bool _stop;                          // el rbol se est destruyendo
+    thread _rebalancer;                  // hilo reequilibrador
+};
+
+#endif
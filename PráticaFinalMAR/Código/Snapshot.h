@@ -0,0 +1,405 @@
+/*
+- Instantneas de un rbol-B en un fichero que se puede proyectar en memoria y consultar sin reconstruir los nodos
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "BTree.h"
+#include "WAL.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define BTREE_MMAP 1
+#endif
+
+/** Identificador de un fichero de instantnea ("BTSN") */
+const uint32_t SNAPSHOT_MAGIC = 0x4e535442;
+
+/** Versin del formato de las instantneas */
+const uint32_t SNAPSHOT_VERSION = 1;
+
+/** Bytes que se acumulan antes de escribirlos al guardar una instantnea */
+const size_t SNAPSHOT_BLOCK = 1 << 20;
+
+/** Cabecera de una instantnea (64 bytes, al principio del fichero) */
+struct SnapshotHeader {
+    uint32_t _magic;        // SNAPSHOT_MAGIC
+    uint32_t _version;      // SNAPSHOT_VERSION
+    uint32_t _key_size;     // sizeof(T)
+    uint32_t _max_elems;    // nmero mximo de keys por nodo del rbol guardado
+    uint64_t _count;        // keys (sin contar las lpidas)
+    uint64_t _nodes;        // nmero de nodos
+    uint64_t _root;         // posicin de la raz en el fichero
+    uint64_t _bytes;        // tamao del fichero
+    uint32_t _height;       // niveles del rbol
+    uint32_t _body_check;   // suma de comprobacin de todo lo que va tras la cabecera
+    uint32_t _key_kind;     // clase de las keys (ver keyKind)
+    uint32_t _header_check; // suma de comprobacin de la cabecera hasta este campo
+};
+
+/**
+  Cabecera de cada nodo en una instantnea. Detrs van, empezando cada parte en un mltiplo de 8 bytes:
+  sus _n keys, las posiciones en el fichero de sus _n + 1 hijos (uint64_t, si no es hoja) y, si tiene lpidas,
+  un bit por key que dice cules estn borradas.
+  */
+struct SnapshotNode {
+    uint32_t _n;    // nmero de keys
+    uint16_t _leaf; // 1 si es hoja
+    uint16_t _dead; // 1 si tiene lpidas
+};
+
+/** Clase de las keys de tipo T, para no abrir como enteros una instantnea de reales del mismo tamao (o al revs)
+
+@return 1 si son enteros con signo, 2 si son enteros sin signo, 3 si son reales y 0 si son de otro tipo
+*/
+template <class T>
+inline uint32_t keyKind() {
+    if (is_integral<T>::value) return is_signed<T>::value ? 1 : 2;
+    return is_floating_point<T>::value ? 3 : 0;
+}
+
+/** Redondea n al siguiente mltiplo de 8 */
+inline uint64_t align8(uint64_t n) {
+    return (n + 7) & ~(uint64_t)7;
+}
+
+/**
+  Instantnea de un BTree: un fichero con una cabecera (versin y sumas de comprobacin) y los nodos en orden por
+  niveles (la raz, luego sus hijos...), cada uno como un registro seguido cuyos hijos se indican por su posicin
+  dentro del fichero y no con punteros. As el fichero se puede proyectar en memoria (mmap en POSIX) y buscar en
+  l directamente: abrirlo solo lee la cabecera, no reserva ni crea ningn Node, y las pginas se comparten entre
+  todos los procesos que lo tengan abierto. Donde no hay mmap, se lee entero en memoria.
+
+  Se guarda con save y se abre con el constructor. Al abrir solo se comprueba la cabecera; la suma de comprobacin
+  de los nodos se comprueba con verify (o al abrir si se pide), porque hay que leer el fichero entero. Un fichero
+  de fuera en el que no se confe se debe comprobar antes de usarlo.
+  T tiene que poder copiarse byte a byte y las keys se guardan tal cual, as que una instantnea solo se puede
+  abrir en una mquina con el mismo orden de bytes.
+  */
+template <class T>
+class BTreeSnapshot {
+
+    static_assert(is_trivially_copyable<T>::value, "Las keys se guardan byte a byte");
+    static_assert(alignof(T) <= 8, "Cada parte de un nodo empieza en un mltiplo de 8 bytes");
+
+public:
+
+    /**
+    Guarda un rbol en una instantnea. Se escribe en path.tmp y se renombra al terminar, as que un fallo a mitad
+    no deja una instantnea a medias en path.
+
+    Error: Si no se puede escribir el fichero, lanza una excepcin E_BTree_File
+
+    @param tree rbol
+    @param path ruta del fichero
+
+    @return bytes del fichero
+    */
+    template <class Alloc, class Stats>
+    static uint64_t save(const BTree<T, Alloc, Stats>& tree, const string& path) {
+        typedef typename BTree<T, Alloc, Stats>::node_type N;
+        vector<const N*> nodes(1, tree._root); // Nodos por niveles: los hijos de cada nodo quedan seguidos
+        for (size_t j = 0; j < nodes.size(); j++) {
+            const N* x = nodes[j];
+            if (!x->_is_leaf) for (int i = 0; i <= x->_n_elems; i++) nodes.push_back(x->_child[i]);
+        }
+
+        SnapshotHeader h;
+        memset(&h, 0, sizeof(h));
+        h._magic = SNAPSHOT_MAGIC;
+        h._version = SNAPSHOT_VERSION;
+        h._key_size = sizeof(T);
+        h._key_kind = keyKind<T>();
+        h._max_elems = tree._size;
+        h._nodes = nodes.size();
+        h._root = sizeof(SnapshotHeader);
+        h._height = 1;
+        for (const N* x = tree._root; !x->_is_leaf; x = x->_child[0]) h._height++;
+
+        string tmp = path + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "wb");
+        if (f == NULL) throw E_BTree_File();
+        bool ok = fwrite(&h, sizeof(h), 1, f) == 1; // Se vuelve a escribir al final, con las sumas
+
+        vector<char> buf;
+        buf.reserve(SNAPSHOT_BLOCK + 2 * recordBytes(tree._size, false, true));
+        uint64_t off = sizeof(SnapshotHeader) + recordBytes(nodes[0]); // Posicin del siguiente hijo
+        uint32_t check = fnv1a(NULL, 0);
+        for (size_t j = 0; j < nodes.size() && ok; j++) {
+            const N* x = nodes[j];
+            size_t start = buf.size();
+            buf.resize(start + recordBytes(x), 0);
+            char* p = buf.data() + start;
+
+            SnapshotNode s;
+            s._n = (uint32_t)x->_n_elems;
+            s._leaf = x->_is_leaf ? 1 : 0;
+            s._dead = x->_n_dead > 0 ? 1 : 0;
+            memcpy(p, &s, sizeof(s));
+            p += sizeof(s);
+            memcpy(p, x->_elems, x->_n_elems * sizeof(T));
+            p += align8(x->_n_elems * sizeof(T));
+            if (!x->_is_leaf) {
+                for (int i = 0; i <= x->_n_elems; i++) {
+                    memcpy(p, &off, sizeof(off));
+                    p += sizeof(off);
+                    off += recordBytes(x->_child[i]);
+                }
+            }
+            if (s._dead) {
+                for (int i = 0; i < x->_n_elems; i++) if (x->isDead(i)) p[i / 8] |= (char)(1 << (i % 8));
+            }
+            h._count += x->_n_elems - x->_n_dead;
+
+            if (buf.size() >= SNAPSHOT_BLOCK || j + 1 == nodes.size()) {
+                check = fnv1a(buf.data(), buf.size(), check);
+                ok = fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+                buf.clear();
+            }
+        }
+
+        h._bytes = off;
+        h._body_check = check;
+        h._header_check = fnv1a(&h, offsetof(SnapshotHeader, _header_check));
+        ok = ok && fseek(f, 0, SEEK_SET) == 0 && fwrite(&h, sizeof(h), 1, f) == 1;
+        if (ok) syncFile(f);
+        if (fclose(f) != 0) ok = false;
+        if (!ok) throw E_BTree_File();
+
+#ifdef _WIN32
+        ::remove(path.c_str()); // En Windows rename no sustituye un fichero que ya existe
+#endif
+        if (rename(tmp.c_str(), path.c_str()) != 0) throw E_BTree_File();
+        syncDir(path);
+        return h._bytes;
+    }
+
+    /**
+    Abre una instantnea guardada con save.
+
+    Error: Si no se puede abrir o leer el fichero, lanza una excepcin E_BTree_File
+    Error: Si no es una instantnea de keys de este tipo, o est cortada o daada, lanza una excepcin E_BTree_Format
+
+    @param path ruta del fichero
+    @param check true para comprobar tambin la suma de comprobacin de los nodos (lee el fichero entero)
+    */
+    explicit BTreeSnapshot(const string& path, bool check = false) : _base(NULL), _mapped(false), _copy(), _h() {
+        FILE* f = fopen(path.c_str(), "rb");
+        if (f == NULL) throw E_BTree_File();
+        bool ok = fread(&_h, sizeof(_h), 1, f) == 1 && _h._magic == SNAPSHOT_MAGIC && _h._version == SNAPSHOT_VERSION
+            && _h._key_size == sizeof(T) && _h._key_kind == keyKind<T>() && _h._header_check == fnv1a(&_h, offsetof(SnapshotHeader, _header_check))
+            && fseek(f, 0, SEEK_END) == 0 && (uint64_t)ftell(f) == _h._bytes && _h._root < _h._bytes;
+        if (!ok) {
+            fclose(f);
+            throw E_BTree_Format();
+        }
+
+#ifdef BTREE_MMAP
+        void* p = mmap(NULL, (size_t)_h._bytes, PROT_READ, MAP_SHARED, fileno(f), 0);
+        if (p != MAP_FAILED) {
+            madvise(p, (size_t)_h._bytes, MADV_RANDOM); // Cada bsqueda toca unas pocas pginas sueltas
+            _base = static_cast<const char*>(p);
+            _mapped = true;
+        }
+#endif
+        if (!_mapped) { // Se lee entero (en palabras de 8 bytes, para que los nodos queden alineados)
+            _copy.resize((size_t)(_h._bytes + 7) / 8);
+            ok = fseek(f, 0, SEEK_SET) == 0 && fread(_copy.data(), 1, (size_t)_h._bytes, f) == _h._bytes;
+            _base = reinterpret_cast<const char*>(_copy.data());
+        }
+        fclose(f);
+        if (!ok) throw E_BTree_File();
+        if (check && !verify()) {
+            unmap();
+            throw E_BTree_Format();
+        }
+    }
+
+    BTreeSnapshot(const BTreeSnapshot&) = delete;
+    BTreeSnapshot& operator=(const BTreeSnapshot&) = delete;
+
+    /** Destructor, deshace la proyeccin */
+    ~BTreeSnapshot() {
+        unmap();
+    }
+
+    /**
+    Comprueba la suma de comprobacin de los nodos.
+
+    @return true si coincide con la de la cabecera
+    */
+    bool verify() const {
+        return fnv1a(_base + sizeof(SnapshotHeader), (size_t)(_h._bytes - sizeof(SnapshotHeader))) == _h._body_check;
+    }
+
+    /**
+    Funcin que busca k directamente en los nodos del fichero.
+
+    @param k elemento a buscar
+
+    @return true si est (y no est borrado)
+    */
+    bool search(const T& k) const {
+        uint64_t off = _h._root;
+        while (true) {
+            const SnapshotNode& s = node(off);
+            int n = (int)s._n;
+            const T* elems = keys(off);
+            int i = keyLowerBound(elems, n, k); // Primer ndice i cuya clave cumpla k <= key
+
+            if (i < n && k == elems[i]) return !(s._dead && isDead(off, i)); // Una lpida cuenta como no encontrado
+            if (s._leaf) return false;
+            off = children(off)[i];
+        }
+    }
+
+    /**
+    Funcin que aplica f a cada key de la instantnea, en orden creciente (sin las borradas).
+
+    @param f funcin que recibe cada key (const T&)
+    */
+    template <class F>
+    void for_each(F f) const {
+        PathStack<Step> path;
+        path.push(Step(_h._root, 0));
+
+        while (!path.empty()) {
+            Step& st = path.top();
+            const SnapshotNode& s = node(st._off);
+            const T* elems = keys(st._off);
+            if (s._leaf) { // Si es hoja, saco todas sus keys (menos las borradas)
+                for (int i = 0; i < (int)s._n; i++) if (!s._dead || !isDead(st._off, i)) f(elems[i]);
+                path.pop();
+            }
+            else if (st._next <= (int)s._n) { // Si no es hoja, bajo al siguiente hijo
+                uint64_t child = children(st._off)[st._next];
+                path.push(Step(child, 0));
+                continue;
+            }
+            else path.pop(); // Ya he recorrido todos sus hijos
+
+            if (!path.empty()) { // He terminado con un hijo: paso a f la key que lo sigue en el padre
+                Step& p = path.top();
+                const SnapshotNode& ps = node(p._off);
+                if (p._next < (int)ps._n && (!ps._dead || !isDead(p._off, p._next))) f(keys(p._off)[p._next]);
+                p._next++;
+            }
+        }
+    }
+
+    /**
+    Funcin que carga las keys de la instantnea en un rbol (sustituyendo su contenido) con bulk_load.
+
+    @param tree rbol
+    @param fill fraccin de cada nodo que se llena
+    */
+    template <class Tree>
+    void load(Tree& tree, double fill = 1.0) const {
+        vector<T> all;
+        all.reserve((size_t)_h._count);
+        for_each([&all](const T& k) { all.push_back(k); });
+        tree.bulk_load(all.begin(), all.end(), fill);
+    }
+
+    /** Nmero de keys (sin contar las borradas) */
+    uint64_t size() const {
+        return _h._count;
+    }
+
+    /** Nmero de nodos */
+    uint64_t n_nodes() const {
+        return _h._nodes;
+    }
+
+    /** Niveles del rbol */
+    int height() const {
+        return (int)_h._height;
+    }
+
+    /** Nmero mximo de keys por nodo del rbol guardado */
+    int n_keys() const {
+        return (int)_h._max_elems;
+    }
+
+    /** Tamao del fichero en bytes */
+    uint64_t bytes() const {
+        return _h._bytes;
+    }
+
+    /** Indica si el fichero est proyectado en memoria (si no, se ha ledo entero) */
+    bool isMapped() const {
+        return _mapped;
+    }
+
+private:
+
+    /** Paso del recorrido: posicin de un nodo y el siguiente hijo suyo que hay que visitar */
+    struct Step {
+        Step() : _off(0), _next(0) {}
+
+        Step(uint64_t off, int next) : _off(off), _next(next) {}
+
+        uint64_t _off; // posicin del nodo
+        int _next;     // siguiente hijo a visitar
+    };
+
+    /** Bytes del registro de un nodo con n keys */
+    static uint64_t recordBytes(int n, bool leaf, bool dead) {
+        uint64_t b = sizeof(SnapshotNode) + align8((uint64_t)n * sizeof(T));
+        if (!leaf) b += (uint64_t)(n + 1) * sizeof(uint64_t);
+        if (dead) b += align8(((uint64_t)n + 7) / 8);
+        return b;
+    }
+
+    template <class N>
+    static uint64_t recordBytes(const N* x) {
+        return recordBytes(x->_n_elems, x->_is_leaf, x->_n_dead > 0);
+    }
+
+    /** Cabecera del nodo que est en la posicin off */
+    const SnapshotNode& node(uint64_t off) const {
+        return *reinterpret_cast<const SnapshotNode*>(_base + off);
+    }
+
+    /** Keys del nodo que est en la posicin off */
+    const T* keys(uint64_t off) const {
+        return reinterpret_cast<const T*>(_base + off + sizeof(SnapshotNode));
+    }
+
+    /** Posiciones de los hijos del nodo (no hoja) que est en la posicin off */
+    const uint64_t* children(uint64_t off) const {
+        return reinterpret_cast<const uint64_t*>(_base + off + sizeof(SnapshotNode) + align8((uint64_t)node(off)._n * sizeof(T)));
+    }
+
+    /** Indica si la key i del nodo (con lpidas) que est en la posicin off est borrada */
+    bool isDead(uint64_t off, int i) const {
+        const SnapshotNode& s = node(off);
+        uint64_t bits = off + recordBytes(s._n, s._leaf != 0, true) - align8(((uint64_t)s._n + 7) / 8);
+        return ((unsigned char)_base[bits + i / 8] >> (i % 8)) & 1;
+    }
+
+    /** Deshace la proyeccin (si la hay) */
+    void unmap() {
+#ifdef BTREE_MMAP
+        if (_mapped) munmap(const_cast<char*>(_base), (size_t)_h._bytes);
+#endif
+        _mapped = false;
+        _base = NULL;
+    }
+
+    const char* _base;         // principio del fichero en memoria
+    bool _mapped;              // si est proyectado (si no, est en _copy)
+    vector<uint64_t> _copy;    // el fichero ledo entero (si no se ha podido proyectar)
+    SnapshotHeader _h;         // cabecera
+};
+
+#endif
@@ -0,0 +1,214 @@
+/*
+- Estadsticas de un rbol-B: contadores de splits, merges, prstamos, nodos y bsquedas
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __TREESTATS_H
+#define __TREESTATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <utility>
+
+/** Sucesos que se cuentan en un rbol */
+enum StatEvent {
+    STAT_SPLIT,         // un nodo lleno se parte en dos (splitChild)
+    STAT_MERGE,         // dos hermanos se unen en uno (merge)
+    STAT_BORROW_PREV,   // un hijo coge una key de su hermano anterior (borrowFromPrev)
+    STAT_BORROW_NEXT,   // un hijo coge una key de su hermano siguiente (borrowFromNext)
+    STAT_ROOT_SPLIT,    // la raz se parte y el rbol crece un nivel
+    STAT_ROOT_COLLAPSE, // la raz se queda sin keys y el rbol baja un nivel
+    STAT_NODE_ALLOC,    // nodos reservados
+    STAT_NODE_FREE,     // nodos liberados
+    STAT_SEARCH,        // bsquedas
+    STAT_SEARCH_NODES,  // nodos visitados por las bsquedas
+    STAT_SEARCH_KEYS,   // keys de los nodos visitados por las bsquedas (entre las que se busca dentro de cada nodo)
+    STAT_TOMBSTONE,     // keys borradas sin reequilibrar (lpidas, BTree::remove_lazy)
+    STAT_COMPACTION,    // compactaciones que quitan las lpidas (BTree::compact y compact_step)
+    STAT_EVENTS         // nmero de sucesos
+};
+
+/** Nombre de cada suceso en el JSON */
+const char* const STAT_NAMES[STAT_EVENTS] = {
+    "splits", "merges", "borrows_prev", "borrows_next", "root_splits", "root_collapses",
+    "nodes_allocated", "nodes_freed", "searches", "search_nodes", "search_keys",
+    "tombstones", "compactions"
+};
+
+/**
+  Poltica de estadsticas por defecto: no cuenta nada. Sus funciones estn vacas y se eliminan al compilar,
+  as que un rbol sin estadsticas no paga nada por ellas.
+
+  Cualquier poltica de estadsticas debe ofrecer la misma interfaz:
+  - enabled: true si cuenta algo.
+  - count(e, n): suma n al contador del suceso e.
+  - releaseAll(): todos los nodos reservados se han liberado de golpe (NodePool::release).
+  - reset(): pone los contadores a 0.
+  - json(out): escribe los contadores como un objeto JSON.
+  */
+struct NoStats {
+
+    static const bool enabled = false;
+
+    void count(StatEvent, uint64_t = 1) {}
+
+    void releaseAll() {}
+
+    void reset() {}
+
+    void json(std::ostream& out) const {
+        out << "{}";
+    }
+};
+
+/** Poltica de estadsticas que cuenta cada suceso */
+struct TreeStats {
+
+    static const bool enabled = true;
+
+    TreeStats() {
+        reset();
+    }
+
+    /** Suma n al contador del suceso e
+
+    @param e suceso
+    @param n veces que ha ocurrido
+    */
+    void count(StatEvent e, uint64_t n = 1) {
+        _counts[e] += n;
+    }
+
+    /** Todos los nodos reservados se han liberado de golpe */
+    void releaseAll() {
+        _counts[STAT_NODE_FREE] = _counts[STAT_NODE_ALLOC];
+    }
+
+    /** Pone los contadores a 0 */
+    void reset() {
+        for (int e = 0; e < STAT_EVENTS; e++) _counts[e] = 0;
+    }
+
+    /** Devuelve el contador de un suceso
+
+    @param e suceso
+
+    @return veces que ha ocurrido
+    */
+    uint64_t operator[](StatEvent e) const {
+        return _counts[e];
+    }
+
+    /** Escribe los contadores como un objeto JSON, con la media de nodos y keys por bsqueda
+
+    @param out flujo de salida
+    */
+    void json(std::ostream& out) const {
+        out << "{";
+        for (int e = 0; e < STAT_EVENTS; e++) out << "\"" << STAT_NAMES[e] << "\": " << _counts[e] << ", ";
+        double searches = _counts[STAT_SEARCH] > 0 ? (double)_counts[STAT_SEARCH] : 1.0;
+        out << "\"nodes_per_search\": " << _counts[STAT_SEARCH_NODES] / searches
+            << ", \"keys_per_search\": " << _counts[STAT_SEARCH_KEYS] / searches << "}";
+    }
+
+private:
+
+    uint64_t _counts[STAT_EVENTS]; // veces que ha ocurrido cada suceso
+};
+
+/**
+  Poltica de reserva que envuelve a otra (Alloc) y cuenta en Stats los nodos que reserva y libera.
+  BTree guarda su poltica de reserva dentro de una de estas, as que los Node la reciben en splitChild, fill y
+  merge y avisan de esos sucesos con nodeEvent. Hereda tambin de Stats para que NoStats no ocupe nada.
+  */
+template <class Alloc, class Stats>
+class StatsAllocator : public Alloc, private Stats {
+
+public:
+
+    typedef typename Alloc::node_type node_type;
+
+    /** Constructor
+
+    @param max_elems nmero mximo de keys de los nodos que se van a reservar
+    */
+    explicit StatsAllocator(int max_elems) : Alloc(max_elems), Stats() {}
+
+    StatsAllocator(StatsAllocator&&) = default;
+    StatsAllocator& operator=(StatsAllocator&&) = default;
+
+    /** Reserva un nodo con Alloc y lo cuenta */
+    node_type* allocate(bool is_leaf) {
+        Stats::count(STAT_NODE_ALLOC);
+        return Alloc::allocate(is_leaf);
+    }
+
+    /** Libera un nodo con Alloc y lo cuenta */
+    void deallocate(node_type* n) {
+        Stats::count(STAT_NODE_FREE);
+        Alloc::deallocate(n);
+    }
+
+    /** Libera con Alloc todo lo que quede (si puede) */
+    void release() {
+        if (Alloc::releases_all) Stats::releaseAll();
+        Alloc::release();
+    }
+
+    /** Estadsticas */
+    Stats& stats() {
+        return *this;
+    }
+
+    const Stats& stats() const {
+        return *this;
+    }
+};
+
+/**
+Avisa a la poltica de reserva de un suceso de un nodo (split, merge o prstamo). Con cualquier poltica de reserva
+que no sea un StatsAllocator no hace nada.
+
+@param alloc poltica de reserva que ha recibido el nodo
+@param e suceso
+*/
+template <class A>
+inline void nodeEvent(A&, StatEvent) {}
+
+template <class Alloc, class Stats>
+inline void nodeEvent(StatsAllocator<Alloc, Stats>& alloc, StatEvent e) {
+    alloc.stats().count(e);
+}
+
+/** Forma de un rbol: altura, nodos, keys y cunto de llenos estn sus nodos */
+struct TreeShape {
+
+    TreeShape() : _height(0), _nodes(0), _leaves(0), _keys(0), _dead(0), _capacity(0) {}
+
+    /** Fraccin media de llenado de los nodos (keys / capacidad total)
+
+    @return nmero entre 0 y 1
+    */
+    double fill() const {
+        return _capacity > 0 ? (double)_keys / (double)_capacity : 0.0;
+    }
+
+    /** Escribe la forma como un objeto JSON
+
+    @param out flujo de salida
+    */
+    void json(std::ostream& out) const {
+        out << "{\"height\": " << _height << ", \"nodes\": " << _nodes << ", \"leaves\": " << _leaves
+            << ", \"keys\": " << _keys << ", \"tombstones\": " << _dead << ", \"fill\": " << fill() << "}";
+    }
+
+    int _height;       // niveles del rbol (1 si solo est la raz)
+    size_t _nodes;     // nmero de nodos
+    size_t _leaves;    // nmero de hojas
+    size_t _keys;      // nmero de keys (contando las borradas)
+    size_t _dead;      // nmero de keys borradas (lpidas)
+    size_t _capacity;  // keys que caben en todos los nodos
+};
+
+#endif
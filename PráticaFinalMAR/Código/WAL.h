@@ -0,0 +1,638 @@
+/*
+- Registro de escritura anticipada (WAL) y recuperacin tras un fallo para el rbol-B
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __WAL_H
+#define __WAL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "BTree.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define BTREE_FSYNC 1
+#elif defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+/** Operaciones que se juntan en cada fsync del registro si no se pide antes (group commit) */
+const size_t GROUP_COMMIT_OPS = 1024;
+
+/** Operaciones registradas tras las que se hace un checkpoint si no se especifica */
+const uint64_t CHECKPOINT_OPS = 1 << 20;
+
+/** Identificador de un fichero de checkpoint ("BTCK") */
+const uint32_t CHECKPOINT_MAGIC = 0x4b434254;
+
+/** Versin del formato del checkpoint */
+const uint32_t CHECKPOINT_VERSION = 1;
+
+/** Operacin de insercin en el registro */
+const char WAL_INSERT = 'i';
+
+/** Operacin de eliminacin en el registro */
+const char WAL_REMOVE = 'd';
+
+/**
+Suma de comprobacin FNV-1a de 32 bits, para detectar registros o ficheros a medio escribir.
+
+@param data bytes
+@param n nmero de bytes
+@param h valor con el que se empieza (para seguir una suma anterior)
+
+@return la suma de comprobacin
+*/
+inline uint32_t fnv1a(const void* data, size_t n, uint32_t h = 2166136261u) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/** Se asegura de que lo escrito en el fichero llega al disco
+
+@param f fichero
+
+@return false si no se ha podido
+*/
+inline bool syncFile(FILE* f) {
+    if (fflush(f) != 0) return false;
+#if defined(BTREE_FSYNC)
+    return fsync(fileno(f)) == 0;
+#elif defined(_WIN32)
+    return _commit(_fileno(f)) == 0;
+#else
+    return true;
+#endif
+}
+
+/** Recorta un fichero (que no est abierto) a sus primeros bytes
+
+@param path ruta del fichero
+@param bytes tamao con el que se queda
+
+@return false si no se ha podido
+*/
+inline bool truncateFile(const string& path, uint64_t bytes) {
+#if defined(BTREE_FSYNC)
+    return truncate(path.c_str(), (off_t)bytes) == 0;
+#elif defined(_WIN32)
+    int fd = _open(path.c_str(), _O_RDWR | _O_BINARY);
+    if (fd < 0) return false;
+    bool ok = _chsize_s(fd, (long long)bytes) == 0;
+    _close(fd);
+    return ok;
+#else
+    (void)path;
+    (void)bytes;
+    return false;
+#endif
+}
+
+/** Se asegura de que un rename dentro del directorio de path llega al disco (en POSIX hace falta un fsync del directorio)
+
+@param path ruta de un fichero del directorio
+*/
+inline void syncDir(const string& path) {
+#ifdef BTREE_FSYNC
+    size_t slash = path.find_last_of('/');
+    string dir = slash == string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int fd = open(dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+#else
+    (void)path;
+#endif
+}
+
+/**
+  Registro de escritura anticipada: fichero al que solo se aaden las operaciones (insertar o eliminar una key),
+  cada una con su nmero de secuencia (LSN, consecutivos) y una suma de comprobacin. Tras un fallo, las operaciones
+  que llegaron al disco se vuelven a aplicar con replay; un registro a medio escribir al final se descarta.
+
+  Las operaciones se aaden a un buffer en memoria y se escriben con un solo fsync para todas (group commit):
+  cuando se llenan GROUP_COMMIT_OPS, cuando se llama a sync o cuando un hilo espera a la suya con commit. Si varios
+  hilos esperan a la vez, uno hace el fsync y los dems esperan a que acabe en vez de hacer el suyo.
+
+  Una operacin es duradera cuando commit (o sync) ha vuelto despus de aadirla. Es seguro usarlo desde varios hilos.
+
+  Si falla una escritura, el fichero se recorta a lo que ya era duradero y lo que no se pudo escribir vuelve al
+  principio del buffer, as que el siguiente commit lo reintenta sin dejar huecos de LSN. Si ni siquiera se puede
+  recortar (o volver a abrir), el registro queda inutilizable y todas las operaciones siguientes lanzan E_BTree_File.
+  */
+template <class T>
+class WriteAheadLog {
+
+    static_assert(is_trivially_copyable<T>::value, "WriteAheadLog guarda las keys en el fichero byte a byte");
+
+public:
+
+    /** Bytes de cada operacin en el fichero: LSN, tipo, key y suma de comprobacin */
+    static const size_t RECORD_BYTES = sizeof(uint64_t) + 1 + sizeof(T) + sizeof(uint32_t);
+
+    /**
+    Constructor, abre el registro para aadir operaciones al final (lo crea si no existe).
+
+    Error: Si no se puede abrir, lanza una excepcin E_BTree_File
+
+    @param path ruta del fichero
+    @param next_lsn LSN de la siguiente operacin
+    @param group operaciones que se juntan en cada fsync
+    */
+    WriteAheadLog(const string& path, uint64_t next_lsn, size_t group = GROUP_COMMIT_OPS)
+        : _path(path), _f(NULL), _group(group == 0 ? 1 : group), _buf(), _last(next_lsn - 1), _durable(next_lsn - 1),
+          _bytes(0), _syncing(false), _failed(false), _syncs(0) {
+        _f = fopen(path.c_str(), "ab");
+        if (_f == NULL) throw E_BTree_File();
+        fseek(_f, 0, SEEK_END);
+        _bytes = (uint64_t)ftell(_f);
+    }
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    /** Destructor, escribe las operaciones que queden en el buffer */
+    ~WriteAheadLog() {
+        try {
+            sync();
+        }
+        catch (...) {} // Un destructor no puede lanzar; quien quiera saber si se ha escrito debe llamar a sync
+        if (_f != NULL) fclose(_f);
+    }
+
+    /**
+    Aade una operacin al registro. Si con ella se llena el grupo, escribe el grupo (con un fsync).
+
+    Error: Si el registro ha quedado inutilizable o no se puede escribir el grupo, lanza una excepcin E_BTree_File
+
+    @param op WAL_INSERT o WAL_REMOVE
+    @param k key de la operacin
+
+    @return LSN de la operacin
+    */
+    uint64_t append(char op, const T& k) {
+        uint64_t lsn;
+        bool full;
+        {
+            lock_guard<mutex> l(_m);
+            if (_failed) throw E_BTree_File();
+            lsn = ++_last;
+            size_t at = _buf.size();
+            _buf.resize(at + RECORD_BYTES);
+            encode(&_buf[at], lsn, op, k);
+            full = _buf.size() >= _group * RECORD_BYTES;
+        }
+        if (full) commit(lsn);
+        return lsn;
+    }
+
+    /**
+    Espera a que la operacin con ese LSN (y todas las anteriores) est en el disco. Si no hay ningn fsync en marcha,
+    este hilo escribe todo el buffer y hace uno; si lo hay, espera a que acabe y vuelve a mirar.
+
+    Error: Si no se puede escribir (o el registro ha quedado inutilizable), lanza una excepcin E_BTree_File
+
+    @param lsn LSN de la operacin
+    */
+    void commit(uint64_t lsn) {
+        unique_lock<mutex> l(_m);
+        while (_durable < lsn) {
+            if (_failed) throw E_BTree_File();
+            if (_syncing) { // Otro hilo est escribiendo, quiz ya con nuestra operacin
+                _cv.wait(l);
+                continue;
+            }
+            _syncing = true;
+            vector<char> out;
+            out.swap(_buf);
+            uint64_t upto = _last;
+            l.unlock();
+
+            bool ok = fwrite(out.data(), 1, out.size(), _f) == out.size();
+            if (ok) ok = syncFile(_f);
+
+            l.lock();
+            _syncing = false;
+            if (!ok) {
+                out.insert(out.end(), _buf.begin(), _buf.end()); // Lo no escrito va delante de lo aadido despus
+                _buf.swap(out);
+                restore();
+                _cv.notify_all();
+                throw E_BTree_File();
+            }
+            _bytes += out.size();
+            _durable = upto;
+            _syncs++;
+            _cv.notify_all();
+        }
+    }
+
+    /** Espera a que todas las operaciones aadidas estn en el disco */
+    void sync() {
+        uint64_t lsn;
+        {
+            lock_guard<mutex> l(_m);
+            lsn = _last;
+        }
+        commit(lsn);
+    }
+
+    /**
+    Vaca el registro (tras un checkpoint que ya tiene todas sus operaciones). Los LSN siguen donde estaban.
+
+    Error: Si no se puede volver a abrir, lanza una excepcin E_BTree_File (y el registro queda inutilizable)
+    */
+    void reset() {
+        sync();
+        lock_guard<mutex> l(_m);
+        fclose(_f);
+        _f = fopen(_path.c_str(), "wb");
+        if (_f == NULL) {
+            _failed = true;
+            throw E_BTree_File();
+        }
+        syncFile(_f);
+        _bytes = 0;
+    }
+
+    /** LSN de la ltima operacin aadida */
+    uint64_t last() {
+        lock_guard<mutex> l(_m);
+        return _last;
+    }
+
+    /** LSN de la ltima operacin que est en el disco */
+    uint64_t durable() {
+        lock_guard<mutex> l(_m);
+        return _durable;
+    }
+
+    /** Nmero de fsync hechos */
+    uint64_t syncs() {
+        lock_guard<mutex> l(_m);
+        return _syncs;
+    }
+
+    /** Indica si el registro ha quedado inutilizable tras un fallo que no se ha podido deshacer */
+    bool failed() {
+        lock_guard<mutex> l(_m);
+        return _failed;
+    }
+
+    /** Indica si el registro est vaco (en el fichero y en el buffer) */
+    bool empty() {
+        lock_guard<mutex> l(_m);
+        return _bytes == 0 && _buf.empty();
+    }
+
+    /**
+    Lee el registro y aplica, en orden, las operaciones con LSN mayor que lsn. Para en la primera operacin a medio
+    escribir o con la suma de comprobacin mal (lo que haya detrs no lleg a ser duradero).
+
+    @param path ruta del fichero (si no existe no se aplica nada)
+    @param lsn LSN hasta el que ya estn aplicadas las operaciones; a la salida, el de la ltima aplicada
+    @param f funcin que recibe cada operacin (char op, const T& k)
+
+    @return nmero de operaciones aplicadas
+    */
+    template <class F>
+    static uint64_t replay(const string& path, uint64_t& lsn, F f) {
+        FILE* in = fopen(path.c_str(), "rb");
+        if (in == NULL) return 0;
+
+        uint64_t applied = 0;
+        char rec[RECORD_BYTES];
+        while (fread(rec, 1, RECORD_BYTES, in) == RECORD_BYTES) {
+            uint64_t r_lsn;
+            char op;
+            T k;
+            if (!decode(rec, r_lsn, op, k)) break; // Operacin a medio escribir
+            if (r_lsn <= lsn) continue;            // Ya estaba en el checkpoint
+            if (r_lsn != lsn + 1) break;           // Falta alguna operacin
+            f(op, k);
+            lsn = r_lsn;
+            applied++;
+        }
+        fclose(in);
+        return applied;
+    }
+
+private:
+
+    /**
+    Tras una escritura fallida, deja el fichero con solo lo duradero (_bytes) y lo vuelve a abrir. El fichero se
+    cierra antes de recortarlo porque al cerrarlo se puede escribir lo que quedase en el buffer del FILE*.
+    Si no se puede, marca el registro como inutilizable. Se llama con _m cogido.
+    */
+    void restore() {
+        fclose(_f);
+        _f = NULL;
+        if (truncateFile(_path, _bytes)) _f = fopen(_path.c_str(), "ab");
+        if (_f == NULL) _failed = true;
+    }
+
+    /** Escribe una operacin en rec (RECORD_BYTES bytes) */
+    static void encode(char* rec, uint64_t lsn, char op, const T& k) {
+        memcpy(rec, &lsn, sizeof(lsn));
+        rec[sizeof(lsn)] = op;
+        memcpy(rec + sizeof(lsn) + 1, &k, sizeof(T));
+        uint32_t check = fnv1a(rec, RECORD_BYTES - sizeof(uint32_t));
+        memcpy(rec + RECORD_BYTES - sizeof(uint32_t), &check, sizeof(check));
+    }
+
+    /** Lee una operacin de rec
+
+    @return false si la suma de comprobacin no coincide o el tipo no existe
+    */
+    static bool decode(const char* rec, uint64_t& lsn, char& op, T& k) {
+        uint32_t check;
+        memcpy(&check, rec + RECORD_BYTES - sizeof(uint32_t), sizeof(check));
+        if (check != fnv1a(rec, RECORD_BYTES - sizeof(uint32_t))) return false;
+        memcpy(&lsn, rec, sizeof(lsn));
+        op = rec[sizeof(lsn)];
+        memcpy(&k, rec + sizeof(lsn) + 1, sizeof(T));
+        return op == WAL_INSERT || op == WAL_REMOVE;
+    }
+
+    string _path;           // ruta del fichero
+    FILE* _f;               // fichero, abierto para aadir al final
+    size_t _group;          // operaciones por fsync
+    vector<char> _buf;      // operaciones que an no se han escrito
+    uint64_t _last;         // LSN de la ltima operacin aadida
+    uint64_t _durable;      // LSN de la ltima operacin en el disco
+    uint64_t _bytes;        // bytes del fichero
+    bool _syncing;          // si algn hilo est haciendo fsync
+    bool _failed;           // si ha fallado una escritura y no se ha podido deshacer
+    uint64_t _syncs;        // nmero de fsync hechos
+    mutex _m;               // protege todo lo anterior
+    condition_variable _cv; // avisa a los que esperan cuando acaba un fsync
+};
+
+/**
+
+Clase que representa a un rbol-B en memoria que no pierde las operaciones si el programa se cae.
+
+Cada insert o remove se apunta en un WriteAheadLog (path.wal) antes de aplicarse al rbol. Cada cierto nmero de
+operaciones (o al llamar a checkpoint) se guardan todas las keys del rbol en path.ckpt, junto con el LSN de la
+ltima operacin que incluyen, y se vaca el registro. El checkpoint se escribe en un fichero temporal y se
+renombra, as que siempre hay uno completo.
+
+Al construirlo se recupera el estado: se carga el checkpoint con bulk_load y se vuelven a aplicar las operaciones
+del registro posteriores a l. Las operaciones son duraderas (sobreviven a un fallo) tras sync, o cuando se llena
+su grupo de GROUP_COMMIT_OPS; las que no, pueden perderse, pero siempre se recupera un prefijo de las operaciones.
+
+No es seguro usarlo desde varios hilos (el rbol no lo es).
+
+@author lvaro Corrochano Lpez
+
+*/
+template <class T>
+class DurableBTree {
+
+public:
+
+    /**
+    Constructor, recupera el rbol de path.ckpt y path.wal (o empieza uno vaco si no existen).
+
+    Error: Si no se pueden abrir o escribir los ficheros, lanza una excepcin E_BTree_File
+    Error: Si el checkpoint est daado o es de otro tipo de key, lanza una excepcin E_BTree_Format
+
+    @param path ruta de los ficheros, sin extensin
+    @param size nmero mximo de keys por nodo
+    @param group operaciones que se juntan en cada fsync del registro
+    @param checkpoint_ops operaciones tras las que se hace un checkpoint
+    */
+    DurableBTree(const string& path, int size = DEFAULT_SIZE, size_t group = GROUP_COMMIT_OPS, uint64_t checkpoint_ops = CHECKPOINT_OPS)
+        : _tree(size), _path(path), _log(), _group(group), _checkpoint_ops(checkpoint_ops), _since_checkpoint(0) {
+        recover();
+    }
+
+    DurableBTree(const DurableBTree&) = delete;
+    DurableBTree& operator=(const DurableBTree&) = delete;
+
+    /** Busca una key
+
+    @param k key buscada
+
+    @return true si la key est en el rbol
+    */
+    bool search(T k) {
+        return !_tree.isEmpty() && _tree.search(k) != NULL;
+    }
+
+    /** Inserta una key (primero en el registro y luego en el rbol)
+
+    @param k key a insertar
+    */
+    void insert(T k) {
+        _log->append(WAL_INSERT, k);
+        _tree.insert(k);
+        logged();
+    }
+
+    /** Elimina una key (primero en el registro y luego en el rbol). Si no est no se registra nada.
+
+    @param k key a eliminar
+
+    @return true si la key estaba en el rbol
+    */
+    bool remove(T k) {
+        if (!search(k)) return false;
+        _log->append(WAL_REMOVE, k);
+        _tree.remove(k);
+        logged();
+        return true;
+    }
+
+    /** Espera a que todas las operaciones hechas estn en el disco */
+    void sync() {
+        _log->sync();
+    }
+
+    /**
+    Guarda todas las keys del rbol en path.ckpt con el LSN de la ltima operacin y vaca el registro.
+
+    Error: Si no se puede escribir, lanza una excepcin E_BTree_File
+    */
+    void checkpoint() {
+        _log->sync();
+        writeCheckpoint(_log->last());
+        _log->reset();
+        _since_checkpoint = 0;
+    }
+
+    /** Recorre el rbol sacando sus keys en orden creciente
+
+    @param out flujo en el que se sacan (por defecto la salida estndar)
+    */
+    void traverse(ostream& out = cout) {
+        _tree.traverse(out);
+    }
+
+    /** Aplica f a cada key del rbol, en orden creciente
+
+    @param f funcin que recibe cada key (const T&)
+    */
+    template <class F>
+    void for_each(F f) const {
+        _tree.for_each(f);
+    }
+
+    /** rbol en memoria (para consultarlo) */
+    const BTree<T>& tree() const {
+        return _tree;
+    }
+
+    /** LSN de la ltima operacin hecha */
+    uint64_t lsn() {
+        return _log->last();
+    }
+
+    /** Registro de operaciones */
+    WriteAheadLog<T>& log() {
+        return *_log;
+    }
+
+private:
+
+    /** Cabecera de un checkpoint (detrs van las keys y despus el nmero de keys y la suma de comprobacin) */
+    struct CheckpointHeader {
+        uint32_t _magic;    // CHECKPOINT_MAGIC
+        uint32_t _version;  // CHECKPOINT_VERSION
+        uint32_t _key_size; // sizeof(T)
+        uint32_t _pad;      // (sin usar)
+        uint64_t _lsn;      // LSN de la ltima operacin incluida
+    };
+
+    /** Final de un checkpoint */
+    struct CheckpointTrailer {
+        uint64_t _count; // nmero de keys
+        uint32_t _check; // suma de comprobacin de la cabecera y las keys
+        uint32_t _pad;   // (sin usar)
+    };
+
+    /** Ruta del registro */
+    string walPath() const {
+        return _path + ".wal";
+    }
+
+    /** Ruta del checkpoint */
+    string checkpointPath() const {
+        return _path + ".ckpt";
+    }
+
+    /** Cuenta una operacin registrada y hace un checkpoint si toca */
+    void logged() {
+        if (++_since_checkpoint >= _checkpoint_ops) checkpoint();
+    }
+
+    /** Aplica al rbol una operacin del registro */
+    void apply(char op, const T& k) {
+        if (op == WAL_INSERT) _tree.insert(k);
+        else if (search(k)) _tree.remove(k);
+    }
+
+    /**
+    Carga el checkpoint (si hay), aplica las operaciones posteriores del registro y, si el registro no estaba
+    vaco, hace un checkpoint nuevo (as lo que hubiera a medio escribir al final del registro desaparece).
+    */
+    void recover() {
+        uint64_t lsn = readCheckpoint();
+        WriteAheadLog<T>::replay(walPath(), lsn, [this](char op, const T& k) { apply(op, k); });
+        _log.reset(new WriteAheadLog<T>(walPath(), lsn + 1, _group));
+        if (!_log->empty()) checkpoint();
+    }
+
+    /**
+    Carga en el rbol las keys del checkpoint.
+
+    @return LSN del checkpoint (0 si no hay)
+    */
+    uint64_t readCheckpoint() {
+        FILE* f = fopen(checkpointPath().c_str(), "rb");
+        if (f == NULL) return 0;
+
+        CheckpointHeader h;
+        CheckpointTrailer tr;
+        fseek(f, 0, SEEK_END);
+        long bytes = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        long body = bytes - (long)sizeof(h) - (long)sizeof(tr);
+        bool ok = body >= 0 && body % sizeof(T) == 0 && fread(&h, sizeof(h), 1, f) == 1;
+        ok = ok && h._magic == CHECKPOINT_MAGIC && h._version == CHECKPOINT_VERSION && h._key_size == sizeof(T);
+
+        vector<T> keys(ok ? body / sizeof(T) : 0);
+        ok = ok && (keys.empty() || fread(keys.data(), sizeof(T), keys.size(), f) == keys.size());
+        ok = ok && fread(&tr, sizeof(tr), 1, f) == 1;
+        fclose(f);
+
+        ok = ok && tr._count == keys.size() && tr._check == fnv1a(keys.data(), keys.size() * sizeof(T), fnv1a(&h, sizeof(h)));
+        if (!ok) throw E_BTree_Format();
+
+        _tree.bulk_load(keys.begin(), keys.end());
+        return h._lsn;
+    }
+
+    /**
+    Escribe todas las keys del rbol en un checkpoint temporal y lo renombra sobre el anterior.
+
+    @param lsn LSN de la ltima operacin que incluye el rbol
+    */
+    void writeCheckpoint(uint64_t lsn) {
+        string tmp = checkpointPath() + ".tmp";
+        FILE* f = fopen(tmp.c_str(), "wb");
+        if (f == NULL) throw E_BTree_File();
+
+        CheckpointHeader h;
+        memset(&h, 0, sizeof(h));
+        h._magic = CHECKPOINT_MAGIC;
+        h._version = CHECKPOINT_VERSION;
+        h._key_size = sizeof(T);
+        h._lsn = lsn;
+        bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+
+        CheckpointTrailer tr;
+        memset(&tr, 0, sizeof(tr));
+        tr._check = fnv1a(&h, sizeof(h));
+        _tree.for_each([&](const T& k) {
+            ok = ok && fwrite(&k, sizeof(T), 1, f) == 1;
+            tr._check = fnv1a(&k, sizeof(T), tr._check);
+            tr._count++;
+        });
+        ok = ok && fwrite(&tr, sizeof(tr), 1, f) == 1;
+        if (ok) ok = syncFile(f);
+        fclose(f);
+        if (!ok) throw E_BTree_File();
+
+#ifdef _WIN32
+        ::remove(checkpointPath().c_str()); // En Windows rename no sustituye un fichero que ya existe
+#endif
+        if (rename(tmp.c_str(), checkpointPath().c_str()) != 0) throw E_BTree_File();
+        syncDir(checkpointPath());
+    }
+
+    BTree<T> _tree;                     // rbol en memoria
+    string _path;                       // ruta de los ficheros, sin extensin
+    unique_ptr<WriteAheadLog<T> > _log; // registro de operaciones
+    size_t _group;                      // operaciones por fsync
+    uint64_t _checkpoint_ops;           // operaciones entre checkpoints
+    uint64_t _since_checkpoint;         // operaciones desde el ltimo checkpoint
+};
+
+#endif
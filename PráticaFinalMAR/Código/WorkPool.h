@@ -0,0 +1,246 @@
+/*
+- Reparto de tareas entre hilos con robo de trabajo
+- lvaro Corrochano Lpez
+*/
+
+#ifndef __WORKPOOL_H
+#define __WORKPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Tareas por hilo en las que se reparte un trabajo: con varias por hilo, los que acaban antes roban a los dems */
+const size_t TASKS_PER_THREAD = 8;
+
+/**
+  Poltica de ejecucin en paralelo para las funciones que la aceptan (for_each(par, f), bulk_load(par, ...)).
+  par usa tantos hilos como ncleos; par(8) usa 8.
+  */
+struct ParallelPolicy {
+
+    explicit ParallelPolicy(unsigned threads = 0) : _threads(threads) {}
+
+    /** Misma poltica con un nmero de hilos concreto */
+    ParallelPolicy operator()(unsigned threads) const {
+        return ParallelPolicy(threads);
+    }
+
+    /** Nmero de hilos que se van a usar (al menos 1) */
+    unsigned threads() const {
+        unsigned t = _threads != 0 ? _threads : std::thread::hardware_concurrency();
+        return t != 0 ? t : 1;
+    }
+
+    unsigned _threads; // nmero de hilos pedido (0 para tantos como ncleos)
+};
+
+/** Poltica de ejecucin en paralelo con tantos hilos como ncleos */
+const ParallelPolicy par;
+
+/**
+  Conjunto de hilos que ejecuta las tareas 0..n-1 robndose trabajo. Cada hilo empieza con un trozo seguido de
+  tareas y las va cogiendo por el principio; cuando se queda sin ninguna, roba la mitad final del trozo que le queda
+  a otro hilo. As, si unas tareas tardan ms que otras (subrboles ms grandes), los hilos no se quedan parados.
+
+  Los hilos se crean en el primer run y se quedan dormidos en una variable de condicin hasta el siguiente, as que
+  cada run solo cuesta despertarlos (no crearlos y unirlos); el que llama a run trabaja como uno ms. Con shared se
+  usa un conjunto por nmero de hilos para todo el programa, que es lo que hacen for_each(par) y bulk_load(par).
+  Los run de un mismo conjunto se hacen de uno en uno; un run llamado desde dentro de una tarea hace sus tareas en
+  el hilo que lo llama, sin repartirlas.
+  */
+class WorkPool {
+
+public:
+
+    /** Constructor
+
+    @param threads nmero de hilos (al menos 1)
+    */
+    explicit WorkPool(unsigned threads) : _threads(threads > 0 ? threads : 1), _workers(), _run(), _m(), _wake(), _done(),
+        _job(NULL), _round(0), _active(0), _stop(false) {}
+
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    /** Destructor, despierta a los hilos para que terminen y los espera */
+    ~WorkPool() {
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (size_t j = 0; j < _workers.size(); j++) _workers[j].join();
+    }
+
+    /**
+    Devuelve el conjunto de hilos compartido por todo el programa con ese nmero de hilos (se crea la primera vez).
+
+    @param threads nmero de hilos (al menos 1)
+
+    @return el conjunto
+    */
+    static WorkPool& shared(unsigned threads) {
+        static std::mutex m;
+        static std::map<unsigned, std::unique_ptr<WorkPool> > pools;
+        std::lock_guard<std::mutex> lock(m);
+        std::unique_ptr<WorkPool>& pool = pools[threads > 0 ? threads : 1];
+        if (!pool) pool.reset(new WorkPool(threads));
+        return *pool;
+    }
+
+    /**
+    Ejecuta f(i) para cada tarea i de 0 a n - 1, repartidas entre los hilos. Vuelve cuando han terminado todas.
+    f se llama desde varios hilos a la vez y no debe lanzar excepciones.
+
+    @param n nmero de tareas
+    @param f funcin que hace una tarea
+    */
+    template <class F>
+    void run(size_t n, F f) {
+        unsigned threads = (size_t)_threads < n ? _threads : (unsigned)(n > 0 ? n : 1);
+        if (threads == 1 || inside()) { // Sin reparto (tambin dentro de una tarea, para no esperar a este mismo run)
+            for (size_t i = 0; i < n; i++) f(i);
+            return;
+        }
+
+        std::lock_guard<std::mutex> one(_run);
+        std::vector<Range> ranges(threads);
+        for (unsigned w = 0; w < threads; w++) {
+            ranges[w]._lo = n * w / threads;
+            ranges[w]._hi = n * (w + 1) / threads;
+        }
+
+        Job job;
+        job._ranges = &ranges;
+        job._f = &f;
+        job._work = &workErased<F>;
+        job._threads = threads;
+        {
+            std::lock_guard<std::mutex> lock(_m);
+            while (_workers.size() + 1 < _threads) { // La primera vez se crean los hilos
+                unsigned w = (unsigned)_workers.size() + 1;
+                _workers.push_back(std::thread([this, w]() { loop(w); }));
+            }
+            _job = &job;
+            _active = threads - 1;
+            _round++;
+        }
+        _wake.notify_all();
+
+        inside() = true;
+        work(ranges, 0, f);
+        inside() = false;
+
+        std::unique_lock<std::mutex> lock(_m);
+        _done.wait(lock, [this]() { return _active == 0; });
+        _job = NULL;
+    }
+
+private:
+
+    /** Tareas que le quedan a un hilo: [_lo, _hi) */
+    struct Range {
+        Range() : _m(), _lo(0), _hi(0) {}
+
+        std::mutex _m;
+        size_t _lo;
+        size_t _hi;
+    };
+
+    /** Trabajo de un run: las tareas de cada hilo y la funcin (sin su tipo, para que los hilos no dependan de F) */
+    struct Job {
+        std::vector<Range>* _ranges;                          // tareas que le quedan a cada hilo
+        void* _f;                                             // funcin de las tareas
+        void (*_work)(std::vector<Range>&, unsigned, void*);  // work con el tipo de _f
+        unsigned _threads;                                    // hilos que trabajan en este run (contando al que llama)
+    };
+
+    /** Indica si el hilo est haciendo tareas de algn run */
+    static bool& inside() {
+        static thread_local bool in = false;
+        return in;
+    }
+
+    /** Bucle de cada hilo del conjunto: espera a que empiece un run, hace su parte y avisa al terminar
+
+    @param w nmero del hilo (de 1 a _threads - 1; el 0 es el que llama a run)
+    */
+    void loop(unsigned w) {
+        inside() = true;
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(_m);
+        while (true) {
+            _wake.wait(lock, [this, seen]() { return _stop || _round != seen; });
+            if (_stop) return;
+            seen = _round;
+            Job* job = _job;
+            if (job == NULL || w >= job->_threads) continue; // En este run trabajan menos hilos
+            lock.unlock();
+            job->_work(*job->_ranges, w, job->_f);
+            lock.lock();
+            if (--_active == 0) _done.notify_one();
+        }
+    }
+
+    template <class F>
+    static void workErased(std::vector<Range>& ranges, unsigned w, void* f) {
+        work(ranges, w, *static_cast<F*>(f));
+    }
+
+    /** Bucle de un hilo: hace sus tareas y, cuando se le acaban, roba hasta que no quedan en ningn hilo */
+    template <class F>
+    static void work(std::vector<Range>& ranges, unsigned w, F& f) {
+        size_t i;
+        while (true) {
+            if (take(ranges[w], i)) f(i);
+            else if (!steal(ranges, w)) return;
+        }
+    }
+
+    /** Coge la primera tarea de un trozo */
+    static bool take(Range& r, size_t& i) {
+        std::lock_guard<std::mutex> lock(r._m);
+        if (r._lo == r._hi) return false;
+        i = r._lo++;
+        return true;
+    }
+
+    /** Pasa al hilo w la mitad final de las tareas de otro (nunca se bloquean dos trozos a la vez) */
+    static bool steal(std::vector<Range>& ranges, unsigned w) {
+        for (size_t d = 1; d < ranges.size(); d++) {
+            Range& v = ranges[(w + d) % ranges.size()];
+            size_t lo, hi;
+            {
+                std::lock_guard<std::mutex> lock(v._m);
+                size_t half = (v._hi - v._lo + 1) / 2;
+                if (half == 0) continue;
+                hi = v._hi;
+                lo = v._hi = v._hi - half;
+            }
+            std::lock_guard<std::mutex> lock(ranges[w]._m);
+            ranges[w]._lo = lo;
+            ranges[w]._hi = hi;
+            return true;
+        }
+        return false;
+    }
+
+    unsigned _threads;                 // nmero de hilos (contando al que llama a run)
+    std::vector<std::thread> _workers; // hilos del conjunto (se crean en el primer run)
+    std::mutex _run;                   // hace los run de uno en uno
+    std::mutex _m;                     // protege lo que sigue
+    std::condition_variable _wake;     // despierta a los hilos al empezar un run (o al destruir el conjunto)
+    std::condition_variable _done;     // avisa al que llama a run de que han terminado los hilos
+    Job* _job;                         // trabajo del run en curso
+    uint64_t _round;                   // nmero de run, para que cada hilo sepa si ya ha hecho el actual
+    unsigned _active;                  // hilos que an no han terminado su parte del run en curso
+    bool _stop;                        // los hilos tienen que terminar
+};
+
+#endif
@@ -3,51 +3,178 @@
 
 Main del programa.
 
-Lee un caso de prueba de un .txt y lo ejecuta.
+Lee un caso de prueba (por defecto prueba.txt) y lo ejecuta, aplicando juntas (en lote) las operaciones seguidas del mismo tipo.
+
+Uso: caseReader [-t caso.txt | -b caso.bin] [-x claves.txt] [arbol.db | -w registro | -e estadisticas.json]
+     caseReader -c caso.txt caso.bin
+  Con -t se lee un caso en texto y con -b uno en binario (ver CommandStream.h), mucho ms rpido de leer para casos
+  grandes. Con -c se convierte un caso de texto a binario y no se ejecuta nada.
+  Sin argumentos el rbol est en memoria y se pierde al acabar. Con un fichero, el rbol es un DiskBTree guardado
+  en l: si ya existe se abre con las keys que tuviera (sin volver a insertarlas) y al acabar se queda guardado.
+  Con -w, el rbol es un DurableBTree: las operaciones se apuntan en registro.wal y, si el programa se cae, al volver
+  a ejecutarlo se recuperan desde el ltimo checkpoint (registro.ckpt).
+  Con -e, el rbol en memoria cuenta splits, merges, prstamos, nodos y bsquedas (TreeStats) y al acabar se
+  escriben en estadisticas.json junto con su forma (altura, nodos y llenado medio).
+  Con -x, las keys del rbol al acabar se escriben en claves.txt, una por lnea (con exportKeys, ver KeyExport.h), en
+  vez de sacarlas por la salida estndar.
 
 */
 
 #include "BTree.h"
+#include "DiskBTree.h"
+#include "WAL.h"
+#include "CommandStream.h"
+#include "KeyExport.h"
 
 #include<iostream>
 #include<fstream>
+#include<vector>
+#include<string>
 
 using namespace std;
 
+/** Mximo de operaciones seguidas del mismo tipo que se agrupan en un lote */
+const size_t MAX_BATCH = 100000;
 
-int main() {
+/**
+Aplica al rbol un lote de operaciones del mismo tipo y lo vaca.
 
-	BTree<int> tree = BTree<int>(3);
+@param tree rbol sobre el que se aplican las operaciones
+@param action tipo de operacin del lote ('i', 'd' o 's')
+@param batch keys del lote
+*/
+template <class Alloc, class Stats>
+void flush(BTree<int, Alloc, Stats>& tree, char action, vector<int>& batch) {
+	switch (action) {
 
-	ifstream fe("prueba.txt");
-	char action;
-	int n;
+	case 'i': // Insert case
+		tree.insert_batch(batch.begin(), batch.end());
+		break;
+
+	case 'd': // delete case
+		tree.remove_batch(batch.begin(), batch.end());
+		break;
+
+	case 's': // search case
+		tree.search_batch(batch.begin(), batch.end());
+		break;
+	}
+	batch.clear();
+}
+
+/**
+Aplica un lote de operaciones del mismo tipo, una a una, a un rbol sin operaciones en lote (DiskBTree o
+DurableBTree) y lo vaca.
 
-	while (!fe.eof()) {
-		fe >> action;
-		fe >> n;
+@param tree rbol sobre el que se aplican las operaciones
+@param action tipo de operacin del lote ('i', 'd' o 's')
+@param batch keys del lote
+*/
+template <class Tree>
+void flush(Tree& tree, char action, vector<int>& batch) {
+	for (size_t j = 0; j < batch.size(); j++) {
 		switch (action) {
 
 		case 'i': // Insert case
-			// cout << "Insertamos " << n << '\n';
-			tree.insert(n);
+			tree.insert(batch[j]);
 			break;
 
 		case 'd': // delete case
-			// cout << "Eliminamos " << n << '\n';
-			tree.remove(n);
+			tree.remove(batch[j]);
 			break;
 
 		case 's': // search case
-			// cout << "Buscamos " << n << '\n';
-			tree.search(n);
+			tree.search(batch[j]);
 			break;
 		}
+	}
+	batch.clear();
+}
+
+/**
+Ejecuta un caso de prueba sobre un rbol y saca sus keys.
+
+@param tree rbol sobre el que se ejecuta (BTree, DiskBTree o DurableBTree)
+@param in lector del caso de prueba (TextCommandReader o CommandReader)
+@param keys fichero en el que se escriben las keys (vaco para sacarlas por la salida estndar)
+*/
+template <class Tree, class Reader>
+void run(Tree& tree, Reader& in, const string& keys) {
+	char action;
+	vector<int> batch; // Las operaciones seguidas del mismo tipo se aplican juntas
+
+	while (in.next(action, batch, MAX_BATCH)) {
+		flush(tree, action, batch);
+	}
+
+	if (keys.empty()) tree.traverse();
+	else exportKeys<int>(tree, keys);
+}
+
+/**
+Ejecuta un caso de prueba sobre el rbol que se haya pedido.
 
+@param in lector del caso de prueba
+@param db fichero del rbol en disco (vaco si no se usa)
+@param wal ruta del registro de operaciones (vaca si no se usa)
+@param stats ruta del fichero de estadsticas (vaca si no se usa)
+@param keys fichero en el que se escriben las keys (vaco para sacarlas por la salida estndar)
+*/
+template <class Reader>
+void run(Reader& in, const string& db, const string& wal, const string& stats, const string& keys) {
+
+	if (!wal.empty()) { // rbol con registro de operaciones
+		DurableBTree<int> tree(wal, 3);
+		run(tree, in, keys);
+	}
+
+	else if (!db.empty()) { // rbol en disco
+		DiskBTree<int> tree(db);
+		run(tree, in, keys);
+	}
+
+	else if (!stats.empty()) { // rbol en memoria que cuenta lo que hace
+		BTree<int, NodePool<Node<int> >, TreeStats> tree(3);
+		run(tree, in, keys);
+		ofstream fs(stats.c_str());
+		if (!fs.is_open()) throw E_BTree_File();
+		tree.stats_json(fs);
+	}
+
+	else {
+		BTree<int> tree = BTree<int>(3);
+		run(tree, in, keys);
 	}
+}
 
-	tree.traverse();
 
-	fe.close();
+int main(int argc, char** argv) {
+
+	string text = "prueba.txt", binary, db, wal, stats, keys;
+
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		if (arg == "-c" && i + 2 < argc) { // Conversin de texto a binario
+			size_t n = convertCommands<int>(argv[i + 1], argv[i + 2]);
+			cout << n << " operaciones convertidas\n";
+			return 0;
+		}
+		else if (arg == "-t" && i + 1 < argc) text = argv[++i];
+		else if (arg == "-b" && i + 1 < argc) binary = argv[++i];
+		else if (arg == "-w" && i + 1 < argc) wal = argv[++i];
+		else if (arg == "-e" && i + 1 < argc) stats = argv[++i];
+		else if (arg == "-x" && i + 1 < argc) keys = argv[++i];
+		else db = arg;
+	}
+
+	if (!binary.empty()) {
+		CommandReader<int> in(binary);
+		run(in, db, wal, stats, keys);
+	}
+	else {
+		TextCommandReader<int> in(text);
+		run(in, db, wal, stats, keys);
+	}
+
 	return 0;
 }
\ No newline at end of file